@@ -11,6 +11,11 @@
 #ifndef _BIOMDI_H
 #define _BIOMDI_H
 
+#include <stdio.h>
+#include <stdint.h>
+
+#include <biomdimacro.h>
+
 /*
  * Declare a type, and a function, that will enable the creation of sets of
  * data items as simple arrays, and check for membership. These sets can be
@@ -27,6 +32,311 @@ typedef struct intSet biomdiIntSet;
 
 int inIntSet(biomdiIntSet S, uint32_t val);
 
+/*
+ * Read the first 'hdrlen' octets of a length-prefixed record from a file.
+ *
+ * Returns READ_OK on success, READ_EOF, without reporting it, when the file
+ * ends before the first octet, and READ_ERROR when the file ends within the
+ * octets, or on failure.
+ */
+int read_bdb_header(FILE *fp, uint8_t *hdr, uint32_t hdrlen);
+
+/*
+ * Read the remainder of a length-prefixed record from a file into a newly
+ * allocated buffer. The buffer grows as the octets are read, so a record
+ * length beyond the end of the file does not allocate memory for the
+ * whole record. The caller has already read the first 'hdrlen' octets of
+ * the record, containing the record length, into 'hdr'; those octets are
+ * copied to the front of the buffer. If the file ends
+ * before the entire record is read, the buffer will contain only the
+ * octets that were read, and scanning the buffer will encounter EOF.
+ * The caller must free bdb->bdb_start.
+ *
+ * Returns READ_OK on success, READ_ERROR on failure.
+ */
+int read_bdb_record(FILE *fp, BDB *bdb, uint8_t *hdr, uint32_t hdrlen,
+    uint64_t reclen);
+
+/*
+ * Finish reading a record from a buffer filled by read_bdb_record(), given
+ * the result 'ret' of scanning the buffer, and free the buffer. When the
+ * scan ran off the end of a buffer that was cut short by the end of the
+ * file, the truncation is reported and READ_EOF is returned. When it ran
+ * off the end of a complete buffer, the record content runs past the
+ * record length; that is reported, and READ_ERROR is returned.
+ *
+ * Returns 'ret' otherwise.
+ */
+int end_bdb_record(BDB *bdb, uint64_t reclen, int ret);
+
+/*
+ * Allocate a buffer of exactly 'reclen' octets to push an encoded record
+ * into. The caller must free bdb->bdb_start.
+ *
+ * Returns WRITE_OK on success, WRITE_ERROR on failure.
+ */
+int new_bdb_record(BDB *bdb, uint64_t reclen);
+
+/*
+ * Initialize a growable buffer to push encoded records into without first
+ * computing their length. The buffer doubles in size whenever an object
+ * does not fit. If 'buf' is not NULL, it is used as the initial buffer of
+ * 'size' octets, and must have been allocated with malloc(), because it
+ * may be reallocated; this allows a buffer to be reused across records.
+ * If 'buf' is NULL, a buffer of 'size' octets, or BDB_DEFAULT_SIZE octets
+ * if 'size' is 0, is allocated. Use REWIND_BDB() to start the next record
+ * in the same buffer, and BDB_LENGTH() to get the length pushed so far.
+ * The caller must free bdb->bdb_start.
+ *
+ * Returns WRITE_OK on success, WRITE_ERROR on failure.
+ */
+#define BDB_DEFAULT_SIZE	4096
+int new_growable_bdb(BDB *bdb, uint8_t *buf, uint32_t size);
+
+/*
+ * Write a record that was pushed into a buffer from new_bdb_record() or
+ * new_growable_bdb() to a file with one write. A record pushed into a
+ * buffer from new_bdb_record() must have filled the buffer.
+ *
+ * Returns WRITE_OK on success, WRITE_ERROR on failure.
+ */
+int write_bdb_record(FILE *fp, BDB *bdb);
+
+/*
+ * A corpus is a file of concatenated records, mapped into memory, along
+ * with a table of the offset of each record within the file. The table is
+ * built by walking only the record length fields, so any record can then
+ * be accessed directly. The table can be saved to an index file, named by
+ * appending ".idx" to the corpus file name, and is reloaded from that
+ * file when it matches the size, the modification time, to the nanosecond
+ * where the system keeps it, and a checksum of both ends of the corpus.
+ *
+ * The length type gives the location of the record length field:
+ *   CORPUS_LENGTH_FMR_ANSI  ANSI/INCITS 378-2004 minutiae records; two
+ *                           octets, or four more octets when those are 0.
+ *   CORPUS_LENGTH_32        Four octets: ISO and ANSI 2007 minutiae
+ *                           records, iris image and face records.
+ *   CORPUS_LENGTH_48        Six octets: finger image records.
+ * In all cases the length field begins at octet 8 of the record.
+ */
+#define CORPUS_LENGTH_FMR_ANSI	1
+#define CORPUS_LENGTH_32	2
+#define CORPUS_LENGTH_48	3
+
+/* Flags for open_corpus() */
+#define CORPUS_USE_INDEX	0x01	/* Load the index file if valid */
+#define CORPUS_SAVE_INDEX	0x02	/* Save the index file if rebuilt */
+
+struct biomdi_corpus {
+	int		fd;
+	uint8_t		*base;		// Mapped file contents
+	uint64_t	size;		// Size of the file
+	uint64_t	mtime;		// Modification time of the file
+	uint64_t	mtime_nsec;	// and its nanoseconds, or 0
+	int		length_type;
+	char		*index_path;
+	uint64_t	count;		// Number of complete records
+	uint64_t	*offsets;	// count + 1 entries; the last entry
+					// is the end of the last record
+};
+typedef struct biomdi_corpus CORPUS;
+
+/*
+ * Map a corpus file and build, or load, its record offset table.
+ * Returns 0 on success, -1 on failure.
+ */
+int open_corpus(const char *path, int length_type, int flags,
+    CORPUS **corpus);
+
+/*
+ * Save the record offset table of a corpus to its index file.
+ * Returns 0 on success, -1 on failure.
+ */
+int save_corpus_index(CORPUS *corpus);
+
+/*
+ * Unmap a corpus and free its storage.
+ */
+void close_corpus(CORPUS *corpus);
+
+/*
+ * Return the number of complete records in the corpus, and the number of
+ * octets following the last complete record. Trailing octets indicate a
+ * truncated record, or a record length that does not fit the file.
+ */
+uint64_t get_corpus_count(CORPUS *corpus);
+uint64_t get_corpus_trailing(CORPUS *corpus);
+
+/*
+ * Initialize a BDB to cover record 'n', starting at 0, of the corpus.
+ * The BDB refers to the mapped file and must not be written to.
+ * Returns READ_OK on success, READ_EOF if there is no such record, and
+ * READ_ERROR if the record is too large to be covered by a BDB.
+ */
+int get_corpus_record(CORPUS *corpus, uint64_t n, BDB *bdb);
+
+/*
+ * The format of a record can be found from its first octets: the format
+ * identifier gives the modality, and the spec version and the layout of
+ * the header give the standard and the location of the record length.
+ * The standard is BIOMDI_STD_UNKNOWN when the header does not tell the
+ * standards apart; the ANSI and ISO face records, and the iris records
+ * before ISO/IEC 19794-6:2011, share one layout. The ISO card formats
+ * for finger minutiae have no header, and are not recognized.
+ */
+#define BIOMDI_MODALITY_UNKNOWN		0
+#define BIOMDI_MODALITY_FINGER_MINUTIAE	1
+#define BIOMDI_MODALITY_FINGER_IMAGE	2
+#define BIOMDI_MODALITY_FACE		3
+#define BIOMDI_MODALITY_IRIS		4
+
+/* The standards have the values of the FMR_STD_ and FIR_STD_ constants */
+#define BIOMDI_STD_UNKNOWN		0
+#define BIOMDI_STD_ANSI			1
+#define BIOMDI_STD_ISO			2
+#define BIOMDI_STD_ANSI07		5
+
+/* Octets of a record that are enough to find its format */
+#define BIOMDI_SNIFF_LENGTH		40
+
+struct biomdi_record_format {
+	int		modality;	// BIOMDI_MODALITY_*
+	int		format_std;	// BIOMDI_STD_*
+	unsigned int	version;	// Spec version; 20 for " 20"
+	int		length_type;	// CORPUS_LENGTH_*
+	uint64_t	record_length;	// From the header
+};
+typedef struct biomdi_record_format BIOMDI_FORMAT;
+
+/*
+ * Find the format of the record at the current position of a buffer,
+ * which is not changed, from at most BIOMDI_SNIFF_LENGTH octets. When
+ * fewer octets are in the buffer, the format is found from those.
+ * Returns 0 if the record is recognized, -1 if not.
+ */
+int sniff_biomdi_record(const BDB *bdb, BIOMDI_FORMAT *fmt);
+
+/*
+ * An arena is a growing region of memory from which record trees are
+ * allocated. Nothing allocated from an arena is freed individually;
+ * instead, all of it is released at once by resetting the arena, which
+ * keeps the memory for reuse. When a record did not fit in the arena's
+ * first block, the reset replaces all blocks with one large enough to
+ * hold that record, so the allocations for later records of a similar
+ * size are satisfied without calling malloc().
+ */
+#define ARENA_DEFAULT_SIZE	16384
+
+struct arena_block {
+	struct arena_block	*next;
+	size_t			size;		// Usable octets in the block
+	size_t			used;
+};
+
+struct biomdi_arena {
+	struct arena_block	*blocks;	// Current block first
+	size_t			total;		// Usable octets in all blocks
+};
+typedef struct biomdi_arena ARENA;
+
+/*
+ * Allocate a new arena with an initial block of 'size' octets; a size
+ * of 0 selects ARENA_DEFAULT_SIZE.
+ * Returns 0 on success, -1 on failure.
+ */
+int new_arena(size_t size, ARENA **arena);
+
+/*
+ * Free an arena and all memory allocated from it.
+ */
+void free_arena(ARENA *arena);
+
+/*
+ * Allocate 'size' octets, suitably aligned for any type, from an arena,
+ * growing the arena when needed. When 'arena' is NULL, the memory is
+ * obtained from malloc() instead, and must be freed by the caller.
+ * Returns NULL on failure.
+ */
+void *arena_alloc(ARENA *arena, size_t size);
+
+/*
+ * Release all memory allocated from an arena for reuse.
+ * Returns 0 on success, -1 when the blocks could not be combined; the
+ * arena remains usable in either case.
+ */
+int reset_arena(ARENA *arena);
+
+/*
+ * An error context collects the errors reported by the library macros
+ * (ERR_OUT, ERRP, READ_ERR_OUT, etc.) for one thread, instead of having
+ * them printed to stderr. Each error is recorded as its code, the format
+ * string of the message, which identifies the check or field that failed,
+ * the source location, and the offset within the record being read, or
+ * -1 if unknown. The message text is formatted only if the context was
+ * initialized with BIOMDI_ERRCTX_TEXT. Only the first
+ * BIOMDI_ERRCTX_MAX_ERRORS errors are kept, but all are counted.
+ */
+#define BIOMDI_ERRCTX_MAX_ERRORS	16
+#define BIOMDI_ERRCTX_TEXT_LEN		256
+
+#define BIOMDI_ERRCTX_TEXT		0x00000001
+
+struct biomdi_error {
+	int			code;		// BIOMDI_ERR_*
+	const char		*field;		// Message format string
+	const char		*file;
+	int			line;
+	int64_t			offset;
+};
+
+struct biomdi_error_context {
+	unsigned int		flags;
+	unsigned int		count;		// Errors reported
+	FILE			*source_fp;	// Record being read, if any
+	const BDB		*source_bdb;
+	struct biomdi_error	errors[BIOMDI_ERRCTX_MAX_ERRORS];
+	char			text[BIOMDI_ERRCTX_MAX_ERRORS]
+				    [BIOMDI_ERRCTX_TEXT_LEN];
+};
+typedef struct biomdi_error_context BIOMDI_ERRCTX;
+
+/*
+ * Initialize an error context with the given flags, and no errors.
+ */
+void init_biomdi_errctx(BIOMDI_ERRCTX *ctx, unsigned int flags);
+
+/*
+ * Remove all errors from an error context, so it can be used for the
+ * next record.
+ */
+void clear_biomdi_errctx(BIOMDI_ERRCTX *ctx);
+
+/*
+ * Install an error context for the calling thread; a NULL context
+ * restores printing to stderr. Returns the previously installed context.
+ */
+BIOMDI_ERRCTX *set_biomdi_errctx(BIOMDI_ERRCTX *ctx);
+
+/*
+ * Return the error context of the calling thread, or NULL.
+ */
+BIOMDI_ERRCTX *get_biomdi_errctx(void);
+
+/*
+ * Set the file or buffer of the record being read by the calling thread,
+ * so that errors are recorded with their offset. Both may be NULL. This
+ * has no effect when the thread has no error context.
+ */
+void set_biomdi_error_source(FILE *fp, const BDB *bdb);
+
+/*
+ * Print the errors in an error context to a file, one per line. Errors
+ * that were not formatted are printed as their kind, format string and
+ * source location.
+ * Returns PRINT_OK on success, PRINT_ERROR on failure.
+ */
+int print_biomdi_errors(FILE *fp, const BIOMDI_ERRCTX *ctx);
+
 // Header CBEFF ID fields
 #define HDR_PROD_ID_OWNER_MASK	0xFFFF0000
 #define HDR_PROD_ID_OWNER_SHIFT	16
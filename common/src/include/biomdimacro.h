@@ -15,6 +15,8 @@
 #define _BIOMDIMACRO_H 
 
 #include <arpa/inet.h>
+#include <stdint.h>
+#include <stdio.h>
 
 /******************************************************************************/
 /* Common definitions used throughout                                         */
@@ -36,6 +38,36 @@
 #define VALIDATE_OK	0
 #define VALIDATE_ERROR	1
 
+/* Storage class of variables that each thread has its own copy of */
+#if defined(_MSC_VER)
+#define BIOMDI_THREAD_LOCAL	__declspec(thread)
+#else
+#define BIOMDI_THREAD_LOCAL	__thread
+#endif
+
+/*
+ * Error codes, identifying the macro that reported an error. Errors are
+ * printed to stderr unless the calling thread has installed an error
+ * context; see set_biomdi_errctx() in biomdi.h.
+ */
+#define BIOMDI_ERR_NONE		0
+#define BIOMDI_ERR_GENERAL	1	// ERR_OUT
+#define BIOMDI_ERR_INVALID	2	// ERRP, and the validation checks
+#define BIOMDI_ERR_READ		3	// READ_ERR_OUT, READ_ERR_RETURN
+#define BIOMDI_ERR_WRITE	4	// WRITE_ERR_OUT
+#define BIOMDI_ERR_ALLOC	5	// ALLOC_ERR_OUT, ALLOC_ERR_RETURN
+#define BIOMDI_ERR_IO		6	// OREAD, OWRITE, FPRINTF
+
+void biomdi_error(int code, const char *file, int line, const char *fmt, ...);
+void biomdi_io_error(const char *op, FILE *stream, const char *file,
+    int line);
+
+/*
+ * Returns non-zero if errors are being printed rather than recorded, so
+ * that additional diagnostic output can be skipped when recording.
+ */
+int biomdi_error_printing(void);
+
 #define NULL_VERBOSITY_LEVEL	0
 #define ERR_VERBOSITY_LEVEL	1
 #define INFO_VERBOSITY_LEVEL	2
@@ -49,11 +81,25 @@ struct biometric_data_buffer {
 	uint8_t			*bdb_start;	// Beginning read/write location
 	uint8_t			*bdb_end;	// Last read/write location
 	uint8_t			*bdb_current;	// Current read/write location
+	uint32_t		bdb_flags;	// Buffer behavior, see below
 };
 typedef struct biometric_data_buffer BDB;
 
+/*
+ * Flags for the buffer. A growable buffer was obtained from malloc(), and
+ * is enlarged with realloc() when an object is pushed past its end.
+ */
+#define BDB_GROWABLE		0x00000001
+
+/*
+ * Enlarge a growable buffer so that at least 'size' more octets can be
+ * pushed into it. Returns 0 on success, -1 on failure.
+ */
+int grow_bdb(struct biometric_data_buffer *bdb, uint32_t size);
+
 #define INIT_BDB(bdb, ptr, size) do {					\
 	(bdb)->bdb_size = size;						\
+	(bdb)->bdb_flags = 0;						\
 	(bdb)->bdb_start = (bdb)->bdb_current = ptr;			\
 	(bdb)->bdb_end = ptr + size;					\
 } while (0)
@@ -62,6 +108,11 @@ typedef struct biometric_data_buffer BDB;
 	(bdb)->bdb_current = (bdb)->bdb_start;				\
 } while (0)
 
+/*
+ * The number of octets pushed into, or scanned from, the buffer.
+ */
+#define BDB_LENGTH(bdb)	((uint32_t)((bdb)->bdb_current - (bdb)->bdb_start))
+
 /*
  * Dump the contents of a BDB to stdout, 16 octets per row, in Hex.
  */
@@ -93,9 +144,7 @@ typedef struct biometric_data_buffer BDB;
 		  if (feof(stream)) {					\
 			goto eof_out;					\
 		  } else {						\
-		    fprintf(stderr, 					\
-			    "Error reading at position %ld from %s:%d\n",\
-			    ftell(stream), __FILE__, __LINE__);		\
+		    biomdi_io_error("reading", stream, __FILE__, __LINE__);\
 			goto err_out;					\
 		  }							\
 		}							\
@@ -104,9 +153,7 @@ typedef struct biometric_data_buffer BDB;
 #define FPRINTF(stream, ...)						\
 	do {								\
 		if (fprintf(stream, __VA_ARGS__) < 0) {			\
-		  fprintf(stderr, 					\
-			    "Error printing at position %ld from %s:%d\n",\
-			    ftell(stream), __FILE__, __LINE__);		\
+		  biomdi_io_error("printing", stream, __FILE__, __LINE__);\
 			goto err_out;					\
 		}							\
 	} while (0)
@@ -211,9 +258,7 @@ typedef struct biometric_data_buffer BDB;
 #define OWRITE(ptr, size, nmemb, stream)				\
 	do {								\
 		if (fwrite(ptr, size, nmemb, stream) < nmemb) {		\
-		  fprintf(stderr, 					\
-			    "Error writing at position %ld from %s:%d\n",\
-			    ftell(stream), __FILE__, __LINE__);		\
+		  biomdi_io_error("writing", stream, __FILE__, __LINE__);\
 			goto err_out;					\
 		}							\
 	} while (0)
@@ -241,11 +286,14 @@ typedef struct biometric_data_buffer BDB;
 	} while (0)
 
 /* 
- * Copy an opaque object to a buffer.
+ * Copy an opaque object to a buffer, enlarging the buffer if it is
+ * growable and the object does not fit.
  */
 #define OPUSH(ptr, size, bdb)						\
 	do {								\
-		if (((bdb)->bdb_current + size) > (bdb)->bdb_end)	\
+		if ((((bdb)->bdb_current + size) > (bdb)->bdb_end) &&	\
+		    (!((bdb)->bdb_flags & BDB_GROWABLE) ||		\
+		    (grow_bdb(bdb, size) != 0)))			\
 			goto err_out;					\
 		(void)memcpy((bdb)->bdb_current, ptr, size);		\
 		(bdb)->bdb_current += size;				\
@@ -322,9 +370,8 @@ typedef struct biometric_data_buffer BDB;
 
 #define ERRP(...)							\
 	do {								\
-		fprintf(stderr, "ERROR: ");				\
-		fprintf(stderr, __VA_ARGS__);				\
-		fprintf(stderr, ".\n");					\
+		biomdi_error(BIOMDI_ERR_INVALID, __FILE__, __LINE__,	\
+		    __VA_ARGS__);					\
 	} while (0)
 
 /*
@@ -337,19 +384,17 @@ typedef struct biometric_data_buffer BDB;
 		exit(EXIT_FAILURE);					\
 	} while (0)
 
-#define READ_ERR_RETURN(...)						\
+#define READ_ERR_RETURN(...)					\
 	do {								\
-		fprintf(stderr, "Error reading ");			\
-		fprintf(stderr, __VA_ARGS__);				\
-		fprintf(stderr, " (line %d in %s).\n", __LINE__, __FILE__);\
+		biomdi_error(BIOMDI_ERR_READ, __FILE__, __LINE__,	\
+		    __VA_ARGS__);					\
 		return (READ_ERROR);					\
 	} while (0)
 
-#define READ_ERR_OUT(...)						\
+#define READ_ERR_OUT(...)					\
 	do {								\
-		fprintf(stderr, "Error reading ");			\
-		fprintf(stderr, __VA_ARGS__);				\
-		fprintf(stderr, " (line %d in %s).\n", __LINE__, __FILE__);\
+		biomdi_error(BIOMDI_ERR_READ, __FILE__, __LINE__,	\
+		    __VA_ARGS__);					\
 		goto err_out;						\
 	} while (0)
 
@@ -362,31 +407,27 @@ typedef struct biometric_data_buffer BDB;
 
 #define ALLOC_ERR_RETURN(msg)						\
 	do {								\
-		fprintf(stderr, "Error allocating %s.", msg);		\
-		fprintf(stderr, " (line %d in %s).\n", __LINE__, __FILE__);\
+		biomdi_error(BIOMDI_ERR_ALLOC, __FILE__, __LINE__, msg);\
 		return (-1);						\
 	} while (0)
 
 #define ALLOC_ERR_OUT(msg)						\
 	do {								\
-		fprintf(stderr, "Error allocating %s.", msg);		\
-		fprintf(stderr, " (line %d in %s).\n", __LINE__, __FILE__);\
+		biomdi_error(BIOMDI_ERR_ALLOC, __FILE__, __LINE__, msg);\
 		goto err_out;						\
 	} while (0)
 
-#define WRITE_ERR_OUT(...)						\
+#define WRITE_ERR_OUT(...)					\
 	do {								\
-		fprintf(stderr, "Error writing ");			\
-		fprintf(stderr, __VA_ARGS__);				\
-		fprintf(stderr, " (line %d in %s).\n", __LINE__, __FILE__);\
+		biomdi_error(BIOMDI_ERR_WRITE, __FILE__, __LINE__,	\
+		    __VA_ARGS__);					\
 		goto err_out;						\
 	} while (0)
 
-#define ERR_OUT(...)							\
+#define ERR_OUT(...)						\
 	do {								\
-		fprintf(stderr, "ERROR: ");				\
-		fprintf(stderr, __VA_ARGS__);				\
-		fprintf(stderr, " (line %d in %s).\n", __LINE__, __FILE__);\
+		biomdi_error(BIOMDI_ERR_GENERAL, __FILE__, __LINE__,	\
+		    __VA_ARGS__);					\
 		goto err_out;						\
 	} while (0)
 
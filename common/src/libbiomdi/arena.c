@@ -0,0 +1,151 @@
+/*
+ * This software was developed at the National Institute of Standards and
+ * Technology (NIST) by employees of the Federal Government in the course
+ * of their official duties. Pursuant to title 17 Section 105 of the
+ * United States Code, this software is not subject to copyright protection
+ * and is in the public domain. NIST assumes no responsibility whatsoever for
+ * its use by other parties, and makes no guarantees, expressed or implied,
+ * about its quality, reliability, or any other characteristic.
+ */
+/******************************************************************************/
+/* Implementation of the arena memory allocator. Each block is obtained with  */
+/* a single malloc() and holds the block header followed by the allocations,  */
+/* which are handed out in increasing address order.                          */
+/*                                                                            */
+/******************************************************************************/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <biomdi.h>
+#include <biomdimacro.h>
+
+/* The strictest alignment required by any of the basic types */
+union arena_align {
+	long double	ld;
+	uint64_t	u64;
+	void		*ptr;
+	void		(*func)(void);
+};
+#define ARENA_ALIGN		(sizeof(union arena_align))
+#define ARENA_ROUND(n)		(((n) + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1))
+#define ARENA_BLOCK_HDR_LEN	ARENA_ROUND(sizeof(struct arena_block))
+#define ARENA_BLOCK_DATA(blk)	((uint8_t *)(blk) + ARENA_BLOCK_HDR_LEN)
+
+static struct arena_block *
+new_arena_block(size_t size)
+{
+	struct arena_block *blk;
+
+	blk = (struct arena_block *)malloc(ARENA_BLOCK_HDR_LEN + size);
+	if (blk == NULL)
+		return (NULL);
+	blk->next = NULL;
+	blk->size = size;
+	blk->used = 0;
+	return (blk);
+}
+
+int
+new_arena(size_t size, ARENA **arena)
+{
+	ARENA *larena;
+
+	if (size == 0)
+		size = ARENA_DEFAULT_SIZE;
+	size = ARENA_ROUND(size);
+	larena = (ARENA *)malloc(sizeof(ARENA));
+	if (larena == NULL)
+		ALLOC_ERR_RETURN("arena");
+	larena->blocks = new_arena_block(size);
+	if (larena->blocks == NULL) {
+		free(larena);
+		ALLOC_ERR_RETURN("arena block");
+	}
+	larena->total = size;
+	*arena = larena;
+	return (0);
+}
+
+static void
+free_arena_blocks(ARENA *arena)
+{
+	struct arena_block *blk;
+
+	while (arena->blocks != NULL) {
+		blk = arena->blocks;
+		arena->blocks = blk->next;
+		free(blk);
+	}
+	arena->total = 0;
+}
+
+void
+free_arena(ARENA *arena)
+{
+	free_arena_blocks(arena);
+	free(arena);
+}
+
+void *
+arena_alloc(ARENA *arena, size_t size)
+{
+	struct arena_block *blk;
+	size_t bsize;
+	void *ptr;
+
+	if (arena == NULL)
+		return (malloc(size));
+
+	size = ARENA_ROUND(size);
+	blk = arena->blocks;
+	if ((blk == NULL) || (blk->size - blk->used < size)) {
+		/* Double the arena, but always fit the request */
+		bsize = arena->total;
+		if (bsize < size)
+			bsize = size;
+		if (bsize < ARENA_DEFAULT_SIZE)
+			bsize = ARENA_DEFAULT_SIZE;
+		blk = new_arena_block(bsize);
+		if (blk == NULL)
+			return (NULL);
+		blk->next = arena->blocks;
+		arena->blocks = blk;
+		arena->total += bsize;
+	}
+	ptr = ARENA_BLOCK_DATA(blk) + blk->used;
+	blk->used += size;
+	return (ptr);
+}
+
+int
+reset_arena(ARENA *arena)
+{
+	struct arena_block *blk;
+	size_t total;
+
+	blk = arena->blocks;
+	if ((blk != NULL) && (blk->next == NULL)) {
+		blk->used = 0;
+		return (0);
+	}
+
+	/*
+	 * Combine all the blocks into one, so the next tree of this size
+	 * fits without growing the arena. If that fails, fall back to a
+	 * block of the default size.
+	 */
+	total = arena->total;
+	free_arena_blocks(arena);
+	arena->blocks = new_arena_block(total);
+	if (arena->blocks == NULL) {
+		arena->blocks = new_arena_block(ARENA_DEFAULT_SIZE);
+		if (arena->blocks != NULL)
+			arena->total = ARENA_DEFAULT_SIZE;
+		ALLOC_ERR_RETURN("arena block");
+	}
+	arena->total = total;
+	return (0);
+}
@@ -11,6 +11,7 @@
 #include <stdio.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 #include <biomdi.h>
 #include <biomdimacro.h>
 
@@ -26,3 +27,171 @@ inIntSet(biomdiIntSet S, uint32_t val)
 			return (1);
 	return (0);
 }
+
+int
+read_bdb_header(FILE *fp, uint8_t *hdr, uint32_t hdrlen)
+{
+	size_t len;
+
+	len = fread(hdr, 1, hdrlen, fp);
+	if (len == hdrlen)
+		return (READ_OK);
+	if (ferror(fp)) {
+		biomdi_io_error("reading", fp, __FILE__, __LINE__);
+		return (READ_ERROR);
+	}
+	if (len == 0)
+		return (READ_EOF);
+	ERRP("EOF encountered in record header");
+	return (READ_ERROR);
+}
+
+int
+read_bdb_record(FILE *fp, BDB *bdb, uint8_t *hdr, uint32_t hdrlen,
+    uint64_t reclen)
+{
+	uint8_t *buf, *nbuf;
+	size_t len, size;
+
+	if (reclen < hdrlen)
+		ERR_OUT("Record length %llu is less than header length %u",
+		    (unsigned long long)reclen, hdrlen);
+	if (reclen > SIZE_MAX)
+		ERR_OUT("Record length %llu is too large",
+		    (unsigned long long)reclen);
+
+	/*
+	 * The record length is not trusted to size the buffer, as a
+	 * truncated file may claim a very long record; the buffer starts
+	 * small and doubles while the file keeps supplying octets.
+	 */
+	size = (reclen < BDB_DEFAULT_SIZE + hdrlen) ?
+	    (size_t)reclen : BDB_DEFAULT_SIZE + hdrlen;
+	buf = (uint8_t *)malloc(size);
+	if (buf == NULL)
+		ALLOC_ERR_OUT("record buffer");
+	memcpy(buf, hdr, hdrlen);
+	len = hdrlen;
+	for (;;) {
+		len += fread(buf + len, 1, size - len, fp);
+		if ((len < size) || (size == reclen))
+			break;
+		size = (reclen - size < size) ? (size_t)reclen : size * 2;
+		nbuf = (uint8_t *)realloc(buf, size);
+		if (nbuf == NULL) {
+			free(buf);
+			ALLOC_ERR_OUT("record buffer");
+		}
+		buf = nbuf;
+	}
+	if ((len < reclen) && ferror(fp)) {
+		free(buf);
+		ERR_OUT("Could not read record from file");
+	}
+	INIT_BDB(bdb, buf, len);
+	return (READ_OK);
+
+err_out:
+	return (READ_ERROR);
+}
+
+int
+end_bdb_record(BDB *bdb, uint64_t reclen, int ret)
+{
+	if (ret == READ_EOF) {
+		if ((uint64_t)(bdb->bdb_end - bdb->bdb_start) < reclen) {
+			ERRP("EOF encountered in record of length %llu",
+			    (unsigned long long)reclen);
+		} else {
+			ERRP("Record content runs past record length %llu",
+			    (unsigned long long)reclen);
+			ret = READ_ERROR;
+		}
+	}
+	free(bdb->bdb_start);
+	return (ret);
+}
+
+int
+new_bdb_record(BDB *bdb, uint64_t reclen)
+{
+	uint8_t *buf;
+
+	if ((reclen > UINT32_MAX) || (reclen > SIZE_MAX))
+		ERR_OUT("Record length %llu is too large",
+		    (unsigned long long)reclen);
+	/* Always allocate something, so the buffer can be freed */
+	buf = (uint8_t *)malloc(reclen == 0 ? 1 : reclen);
+	if (buf == NULL)
+		ALLOC_ERR_OUT("record buffer");
+	INIT_BDB(bdb, buf, (uint32_t)reclen);
+	return (WRITE_OK);
+
+err_out:
+	return (WRITE_ERROR);
+}
+
+int
+new_growable_bdb(BDB *bdb, uint8_t *buf, uint32_t size)
+{
+	if (buf == NULL) {
+		if (size == 0)
+			size = BDB_DEFAULT_SIZE;
+		buf = (uint8_t *)malloc(size);
+		if (buf == NULL)
+			ALLOC_ERR_OUT("record buffer");
+	}
+	INIT_BDB(bdb, buf, size);
+	bdb->bdb_flags |= BDB_GROWABLE;
+	return (WRITE_OK);
+
+err_out:
+	return (WRITE_ERROR);
+}
+
+int
+grow_bdb(BDB *bdb, uint32_t size)
+{
+	uint64_t used, needed, newsize;
+	uint8_t *buf;
+
+	used = bdb->bdb_current - bdb->bdb_start;
+	needed = used + size;
+	if (needed > UINT32_MAX)
+		ERR_OUT("Record length %llu is too large",
+		    (unsigned long long)needed);
+	newsize = (bdb->bdb_size == 0) ? BDB_DEFAULT_SIZE : bdb->bdb_size;
+	while (newsize < needed)
+		newsize *= 2;
+	if (newsize > UINT32_MAX)
+		newsize = UINT32_MAX;
+	buf = (uint8_t *)realloc(bdb->bdb_start, newsize);
+	if (buf == NULL)
+		ALLOC_ERR_OUT("record buffer");
+	bdb->bdb_size = (uint32_t)newsize;
+	bdb->bdb_start = buf;
+	bdb->bdb_current = buf + used;
+	bdb->bdb_end = buf + newsize;
+	return (0);
+
+err_out:
+	return (-1);
+}
+
+int
+write_bdb_record(FILE *fp, BDB *bdb)
+{
+	if (bdb->bdb_flags & BDB_GROWABLE) {
+		OWRITE(bdb->bdb_start, 1, BDB_LENGTH(bdb), fp);
+		return (WRITE_OK);
+	}
+	if (bdb->bdb_current != bdb->bdb_end)
+		ERR_OUT("Record length %u does not match the encoded length %u",
+		    bdb->bdb_size, (uint32_t)(bdb->bdb_current -
+		    bdb->bdb_start));
+	OWRITE(bdb->bdb_start, 1, bdb->bdb_size, fp);
+	return (WRITE_OK);
+
+err_out:
+	return (WRITE_ERROR);
+}
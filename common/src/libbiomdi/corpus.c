@@ -0,0 +1,426 @@
+/*
+ * This software was developed at the National Institute of Standards and
+ * Technology (NIST) by employees of the Federal Government in the course
+ * of their official duties. Pursuant to title 17 Section 105 of the
+ * United States Code, this software is not subject to copyright protection
+ * and is in the public domain. NIST assumes no responsibility whatsoever for
+ * its use by other parties, and makes no guarantees, expressed or implied,
+ * about its quality, reliability, or any other characteristic.
+ */
+/******************************************************************************/
+/* Implementation of the record corpus interface. A corpus is a file of       */
+/* concatenated length-prefixed records that is mapped into memory, with mmap */
+/* on Posix systems and a file mapping object on Windows. Only the            */
+/* record length fields are examined in order to build a table of record      */
+/* offsets, which can be saved to, and later loaded from, an index file       */
+/* stored next to the corpus file.                                            */
+/*                                                                            */
+/******************************************************************************/
+
+/* Needed by the GNU C libraries for Posix and other extensions */
+#define _XOPEN_SOURCE	700
+
+#if defined(_WIN32)
+#include <windows.h>
+#include <io.h>
+#else
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <biomdi.h>
+#include <biomdimacro.h>
+
+/*
+ * The file status calls, and the nanoseconds of the modification time,
+ * where the system keeps them.
+ */
+#if defined(_WIN32)
+typedef struct _stat64 corpus_stat_t;
+#define corpus_fstat(fd, sb)	_fstat64(fd, sb)
+#define corpus_open(path)	_open(path, _O_RDONLY | _O_BINARY)
+#define corpus_close(fd)	_close(fd)
+#define CORPUS_MTIME_NSEC(sb)	0
+#else
+typedef struct stat corpus_stat_t;
+#define corpus_fstat(fd, sb)	fstat(fd, sb)
+#define corpus_open(path)	open(path, O_RDONLY)
+#define corpus_close(fd)	close(fd)
+#if defined(__APPLE__)
+#define CORPUS_MTIME_NSEC(sb)	((sb)->st_mtimespec.tv_nsec)
+#else
+#define CORPUS_MTIME_NSEC(sb)	((sb)->st_mtim.tv_nsec)
+#endif
+#endif
+
+/*
+ * Layout of the index file; all values are big-endian:
+ *   magic (4), version (4), length type (4), reserved (4),
+ *   corpus file size (8), corpus modification time (8), nanoseconds of
+ *   the modification time (8), checksum (8), record count (8),
+ *   record offsets (8 each, count + 1 entries)
+ * The checksum covers the first and last CORPUS_CHECKSUM_LENGTH octets of
+ * the corpus, so that a file rewritten with the same size within the
+ * resolution of the modification time is still detected where its
+ * content differs at either end.
+ */
+#define CORPUS_INDEX_MAGIC		"BIDX"
+#define CORPUS_INDEX_VERSION		2
+#define CORPUS_INDEX_HEADER_LENGTH	56
+#define CORPUS_INDEX_SUFFIX		".idx"
+#define CORPUS_CHECKSUM_LENGTH		4096
+
+/* Offset of the record length field, common to all record types */
+#define CORPUS_LENGTH_OFFSET		8
+
+static uint64_t
+get_be(const uint8_t *ptr, int size)
+{
+	uint64_t val;
+	int i;
+
+	val = 0;
+	for (i = 0; i < size; i++)
+		val = (val << 8) | ptr[i];
+	return (val);
+}
+
+static void
+put_be(uint8_t *ptr, uint64_t val, int size)
+{
+	int i;
+
+	for (i = size - 1; i >= 0; i--) {
+		ptr[i] = val & 0xFF;
+		val >>= 8;
+	}
+}
+
+/*
+ * FNV-1a hash of the first and last octets of the corpus.
+ */
+static uint64_t
+corpus_checksum(const CORPUS *corpus)
+{
+	uint64_t hash, i, len, start;
+
+	hash = 0xcbf29ce484222325ULL;
+	len = corpus->size;
+	if (len > CORPUS_CHECKSUM_LENGTH)
+		len = CORPUS_CHECKSUM_LENGTH;
+	for (i = 0; i < len; i++)
+		hash = (hash ^ corpus->base[i]) * 0x100000001b3ULL;
+	start = corpus->size - len;
+	if (start < len)
+		start = len;
+	for (i = start; i < corpus->size; i++)
+		hash = (hash ^ corpus->base[i]) * 0x100000001b3ULL;
+	return (hash);
+}
+
+/*
+ * Decode the length of the record starting at 'ptr', with 'avail' octets
+ * remaining in the file. Returns 0 if the record length cannot be
+ * determined, or if the record would extend past the end of the file.
+ */
+static uint64_t
+corpus_record_length(int length_type, const uint8_t *ptr, uint64_t avail)
+{
+	uint64_t reclen;
+	uint64_t hdrlen;
+
+	switch (length_type) {
+	case CORPUS_LENGTH_FMR_ANSI:
+		hdrlen = CORPUS_LENGTH_OFFSET + 2;
+		if (avail < hdrlen)
+			return (0);
+		reclen = get_be(ptr + CORPUS_LENGTH_OFFSET, 2);
+		if (reclen == 0) {
+			hdrlen += 4;
+			if (avail < hdrlen)
+				return (0);
+			reclen = get_be(ptr + CORPUS_LENGTH_OFFSET + 2, 4);
+		}
+		break;
+	case CORPUS_LENGTH_32:
+		hdrlen = CORPUS_LENGTH_OFFSET + 4;
+		if (avail < hdrlen)
+			return (0);
+		reclen = get_be(ptr + CORPUS_LENGTH_OFFSET, 4);
+		break;
+	case CORPUS_LENGTH_48:
+		hdrlen = CORPUS_LENGTH_OFFSET + 6;
+		if (avail < hdrlen)
+			return (0);
+		reclen = get_be(ptr + CORPUS_LENGTH_OFFSET, 6);
+		break;
+	default:
+		return (0);
+	}
+	if ((reclen < hdrlen) || (reclen > avail))
+		return (0);
+	return (reclen);
+}
+
+/*
+ * Build the offset table by walking the record length fields.
+ */
+static int
+corpus_build_offsets(CORPUS *corpus)
+{
+	uint64_t offset, reclen, alloc;
+	uint64_t *offsets;
+
+	alloc = 1024;
+	corpus->offsets = (uint64_t *)malloc(alloc * sizeof(uint64_t));
+	if (corpus->offsets == NULL)
+		ALLOC_ERR_RETURN("corpus offset table");
+	corpus->count = 0;
+	offset = 0;
+	while (offset < corpus->size) {
+		reclen = corpus_record_length(corpus->length_type,
+		    corpus->base + offset, corpus->size - offset);
+		if (reclen == 0)
+			break;
+		if (corpus->count + 1 >= alloc) {
+			alloc *= 2;
+			offsets = (uint64_t *)realloc(corpus->offsets,
+			    alloc * sizeof(uint64_t));
+			if (offsets == NULL)
+				ALLOC_ERR_RETURN("corpus offset table");
+			corpus->offsets = offsets;
+		}
+		corpus->offsets[corpus->count++] = offset;
+		offset += reclen;
+	}
+	corpus->offsets[corpus->count] = offset;
+	return (0);
+}
+
+/*
+ * Load the offset table from the index file, if the index file exists
+ * and describes the current contents of the corpus file. Returns 0 if
+ * the table was loaded, -1 otherwise.
+ */
+static int
+corpus_load_index(CORPUS *corpus)
+{
+	FILE *fp;
+	uint8_t hdr[CORPUS_INDEX_HEADER_LENGTH];
+	uint8_t val[8];
+	uint64_t count, i;
+
+	fp = fopen(corpus->index_path, "rb");
+	if (fp == NULL)
+		return (-1);
+	if (fread(hdr, 1, sizeof(hdr), fp) != sizeof(hdr))
+		goto err_out;
+	if ((memcmp(hdr, CORPUS_INDEX_MAGIC, 4) != 0) ||
+	    (get_be(hdr + 4, 4) != CORPUS_INDEX_VERSION) ||
+	    (get_be(hdr + 8, 4) != corpus->length_type) ||
+	    (get_be(hdr + 16, 8) != corpus->size) ||
+	    (get_be(hdr + 24, 8) != corpus->mtime) ||
+	    (get_be(hdr + 32, 8) != corpus->mtime_nsec) ||
+	    (get_be(hdr + 40, 8) != corpus_checksum(corpus)))
+		goto err_out;
+	count = get_be(hdr + 48, 8);
+	if (count > corpus->size)
+		goto err_out;
+	corpus->offsets = (uint64_t *)malloc((count + 1) * sizeof(uint64_t));
+	if (corpus->offsets == NULL)
+		goto err_out;
+	for (i = 0; i <= count; i++) {
+		if (fread(val, 1, sizeof(val), fp) != sizeof(val))
+			goto err_out;
+		corpus->offsets[i] = get_be(val, sizeof(val));
+		if ((corpus->offsets[i] > corpus->size) ||
+		    ((i > 0) &&
+		    (corpus->offsets[i] <= corpus->offsets[i - 1])))
+			goto err_out;
+	}
+	corpus->count = count;
+	fclose(fp);
+	return (0);
+
+err_out:
+	if (corpus->offsets != NULL) {
+		free(corpus->offsets);
+		corpus->offsets = NULL;
+	}
+	fclose(fp);
+	return (-1);
+}
+
+int
+open_corpus(const char *path, int length_type, int flags, CORPUS **corpus)
+{
+	CORPUS *lcorpus;
+	corpus_stat_t sb;
+#if defined(_WIN32)
+	HANDLE mapping;
+#endif
+
+	lcorpus = (CORPUS *)malloc(sizeof(CORPUS));
+	if (lcorpus == NULL)
+		ALLOC_ERR_RETURN("corpus");
+	memset((void *)lcorpus, 0, sizeof(CORPUS));
+	lcorpus->fd = -1;
+	lcorpus->length_type = length_type;
+
+	lcorpus->index_path = (char *)malloc(strlen(path) +
+	    strlen(CORPUS_INDEX_SUFFIX) + 1);
+	if (lcorpus->index_path == NULL)
+		ALLOC_ERR_OUT("corpus index path");
+	strcpy(lcorpus->index_path, path);
+	strcat(lcorpus->index_path, CORPUS_INDEX_SUFFIX);
+
+	lcorpus->fd = corpus_open(path);
+	if (lcorpus->fd < 0)
+		ERR_OUT("Could not open %s: %s", path, strerror(errno));
+	if (corpus_fstat(lcorpus->fd, &sb) < 0)
+		ERR_OUT("Could not get stats on %s: %s", path,
+		    strerror(errno));
+	lcorpus->size = sb.st_size;
+	lcorpus->mtime = sb.st_mtime;
+	lcorpus->mtime_nsec = CORPUS_MTIME_NSEC(&sb);
+	if ((uint64_t)(size_t)lcorpus->size != lcorpus->size)
+		ERR_OUT("%s is too large to map", path);
+	if (lcorpus->size != 0) {
+#if defined(_WIN32)
+		/* The view keeps the mapping object open once it is mapped */
+		mapping = CreateFileMapping(
+		    (HANDLE)_get_osfhandle(lcorpus->fd), NULL, PAGE_READONLY,
+		    0, 0, NULL);
+		if (mapping == NULL)
+			ERR_OUT("Could not map %s: error %lu", path,
+			    (unsigned long)GetLastError());
+		lcorpus->base = (uint8_t *)MapViewOfFile(mapping,
+		    FILE_MAP_READ, 0, 0, (SIZE_T)lcorpus->size);
+		CloseHandle(mapping);
+		if (lcorpus->base == NULL)
+			ERR_OUT("Could not map %s: error %lu", path,
+			    (unsigned long)GetLastError());
+#else
+		lcorpus->base = (uint8_t *)mmap(NULL, lcorpus->size,
+		    PROT_READ, MAP_SHARED, lcorpus->fd, 0);
+		if (lcorpus->base == MAP_FAILED) {
+			lcorpus->base = NULL;
+			ERR_OUT("Could not map %s: %s", path, strerror(errno));
+		}
+#endif
+	}
+
+	if (!(flags & CORPUS_USE_INDEX) ||
+	    (corpus_load_index(lcorpus) != 0)) {
+		if (corpus_build_offsets(lcorpus) != 0)
+			goto err_out;
+		if (flags & CORPUS_SAVE_INDEX)
+			if (save_corpus_index(lcorpus) != 0)
+				goto err_out;
+	}
+	*corpus = lcorpus;
+	return (0);
+
+err_out:
+	close_corpus(lcorpus);
+	return (-1);
+}
+
+int
+save_corpus_index(CORPUS *corpus)
+{
+	FILE *fp;
+	uint8_t hdr[CORPUS_INDEX_HEADER_LENGTH];
+	uint8_t val[8];
+	uint64_t i;
+
+	fp = fopen(corpus->index_path, "wb");
+	if (fp == NULL)
+		ERR_OUT("Could not open %s: %s", corpus->index_path,
+		    strerror(errno));
+	memset(hdr, 0, sizeof(hdr));
+	memcpy(hdr, CORPUS_INDEX_MAGIC, 4);
+	put_be(hdr + 4, CORPUS_INDEX_VERSION, 4);
+	put_be(hdr + 8, corpus->length_type, 4);
+	put_be(hdr + 16, corpus->size, 8);
+	put_be(hdr + 24, corpus->mtime, 8);
+	put_be(hdr + 32, corpus->mtime_nsec, 8);
+	put_be(hdr + 40, corpus_checksum(corpus), 8);
+	put_be(hdr + 48, corpus->count, 8);
+	if (fwrite(hdr, 1, sizeof(hdr), fp) != sizeof(hdr))
+		goto write_err;
+	for (i = 0; i <= corpus->count; i++) {
+		put_be(val, corpus->offsets[i], sizeof(val));
+		if (fwrite(val, 1, sizeof(val), fp) != sizeof(val))
+			goto write_err;
+	}
+	if (fclose(fp) != 0)
+		ERR_OUT("Could not write %s", corpus->index_path);
+	return (0);
+
+write_err:
+	fclose(fp);
+	ERR_OUT("Could not write %s", corpus->index_path);
+err_out:
+	return (-1);
+}
+
+void
+close_corpus(CORPUS *corpus)
+{
+	if (corpus->base != NULL) {
+#if defined(_WIN32)
+		UnmapViewOfFile(corpus->base);
+#else
+		munmap(corpus->base, corpus->size);
+#endif
+	}
+	if (corpus->fd >= 0)
+		corpus_close(corpus->fd);
+	if (corpus->offsets != NULL)
+		free(corpus->offsets);
+	if (corpus->index_path != NULL)
+		free(corpus->index_path);
+	free(corpus);
+}
+
+uint64_t
+get_corpus_count(CORPUS *corpus)
+{
+	return (corpus->count);
+}
+
+uint64_t
+get_corpus_trailing(CORPUS *corpus)
+{
+	return (corpus->size - corpus->offsets[corpus->count]);
+}
+
+int
+get_corpus_record(CORPUS *corpus, uint64_t n, BDB *bdb)
+{
+	uint8_t *ptr;
+	uint64_t len;
+
+	if (n >= corpus->count)
+		return (READ_EOF);
+	ptr = corpus->base + corpus->offsets[n];
+	len = corpus->offsets[n + 1] - corpus->offsets[n];
+	if (len > UINT32_MAX)
+		ERR_OUT("Record %llu of length %llu is too large for a buffer",
+		    (unsigned long long)n + 1, (unsigned long long)len);
+	INIT_BDB(bdb, ptr, (uint32_t)len);
+	return (READ_OK);
+
+err_out:
+	return (READ_ERROR);
+}
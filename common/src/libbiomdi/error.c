@@ -0,0 +1,247 @@
+/*
+ * This software was developed at the National Institute of Standards and
+ * Technology (NIST) by employees of the Federal Government in the course
+ * of their official duties. Pursuant to title 17 Section 105 of the
+ * United States Code, this software is not subject to copyright protection
+ * and is in the public domain. NIST assumes no responsibility whatsoever for
+ * its use by other parties, and makes no guarantees, expressed or implied,
+ * about its quality, reliability, or any other characteristic.
+ */
+/******************************************************************************/
+/* Implementation of the error reporting used by the error macros. Without   */
+/* an error context, each error is printed to stderr. When the calling        */
+/* thread has installed an error context, the error is recorded there         */
+/* instead, and is only formatted as text if the context asks for it.         */
+/*                                                                            */
+/******************************************************************************/
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <biomdi.h>
+#include <biomdimacro.h>
+
+static BIOMDI_THREAD_LOCAL BIOMDI_ERRCTX *errctx = NULL;
+
+/*
+ * The text placed before and after each message, whether the source
+ * location follows the message, and the name used for errors recorded
+ * without text, indexed by error code.
+ */
+static const struct {
+	const char	*prefix;
+	const char	*suffix;
+	int		location;
+	const char	*name;
+} error_formats[] = {
+	{ "", "", 0, "No" },			/* BIOMDI_ERR_NONE */
+	{ "ERROR: ", "", 1, "General" },	/* BIOMDI_ERR_GENERAL */
+	{ "ERROR: ", ".", 0, "Record" },	/* BIOMDI_ERR_INVALID */
+	{ "Error reading ", "", 1, "Read" },	/* BIOMDI_ERR_READ */
+	{ "Error writing ", "", 1, "Write" },	/* BIOMDI_ERR_WRITE */
+	{ "Error allocating ", ".", 1, "Allocation" },	/* BIOMDI_ERR_ALLOC */
+	{ "Error ", "", 0, "I/O" }		/* BIOMDI_ERR_IO */
+};
+#define ERROR_FORMAT_COUNT \
+    (sizeof(error_formats) / sizeof(error_formats[0]))
+
+static void
+render_error(char *buf, size_t len, int code, const char *msg,
+    const char *file, int line, int64_t offset)
+{
+	if ((code < 0) || (code >= ERROR_FORMAT_COUNT))
+		code = BIOMDI_ERR_GENERAL;
+	if (code == BIOMDI_ERR_IO)
+		snprintf(buf, len, "Error %s at position %lld from %s:%d",
+		    msg, (long long)offset, file, line);
+	else if (error_formats[code].location)
+		snprintf(buf, len, "%s%s%s (line %d in %s).",
+		    error_formats[code].prefix, msg,
+		    error_formats[code].suffix, line, file);
+	else
+		snprintf(buf, len, "%s%s%s", error_formats[code].prefix,
+		    msg, error_formats[code].suffix);
+}
+
+/*
+ * Record an error in the context of the calling thread. Returns the buffer
+ * for the text of the error if the context formats errors, NULL otherwise.
+ */
+static char *
+record_error(int code, const char *field, const char *file, int line,
+    int64_t offset)
+{
+	struct biomdi_error *err;
+	char *text;
+
+	text = NULL;
+	if (errctx->count < BIOMDI_ERRCTX_MAX_ERRORS) {
+		err = &errctx->errors[errctx->count];
+		err->code = code;
+		err->field = field;
+		err->file = file;
+		err->line = line;
+		err->offset = offset;
+		text = errctx->text[errctx->count];
+		text[0] = '\0';
+		if (!(errctx->flags & BIOMDI_ERRCTX_TEXT))
+			text = NULL;
+	}
+	errctx->count++;
+	return (text);
+}
+
+/*
+ * The offset, within the record being read, of the current read position,
+ * or -1 if there is no record being read.
+ */
+static int64_t
+source_offset(void)
+{
+	if (errctx->source_bdb != NULL)
+		return (errctx->source_bdb->bdb_current -
+		    errctx->source_bdb->bdb_start);
+	if (errctx->source_fp != NULL)
+		return (ftell(errctx->source_fp));
+	return (-1);
+}
+
+void
+biomdi_error(int code, const char *file, int line, const char *fmt, ...)
+{
+	char msg[BIOMDI_ERRCTX_TEXT_LEN];
+	char buf[BIOMDI_ERRCTX_TEXT_LEN + 64];
+	char *text;
+	int64_t offset;
+	va_list ap;
+
+	if (errctx != NULL) {
+		offset = source_offset();
+		text = record_error(code, fmt, file, line, offset);
+		if (text == NULL)
+			return;
+	} else {
+		offset = -1;
+		text = buf;
+	}
+	va_start(ap, fmt);
+	vsnprintf(msg, sizeof(msg), fmt, ap);
+	va_end(ap);
+	if (text == buf) {
+		render_error(buf, sizeof(buf), code, msg, file, line, offset);
+		fprintf(stderr, "%s\n", buf);
+	} else {
+		render_error(text, BIOMDI_ERRCTX_TEXT_LEN, code, msg, file,
+		    line, offset);
+	}
+}
+
+void
+biomdi_io_error(const char *op, FILE *stream, const char *file, int line)
+{
+	char buf[BIOMDI_ERRCTX_TEXT_LEN];
+	char *text;
+	int64_t offset;
+
+	offset = ftell(stream);
+	if (errctx == NULL) {
+		render_error(buf, sizeof(buf), BIOMDI_ERR_IO, op, file, line,
+		    offset);
+		fprintf(stderr, "%s\n", buf);
+		return;
+	}
+	text = record_error(BIOMDI_ERR_IO, op, file, line, offset);
+	if (text != NULL)
+		render_error(text, BIOMDI_ERRCTX_TEXT_LEN, BIOMDI_ERR_IO, op,
+		    file, line, offset);
+}
+
+int
+biomdi_error_printing(void)
+{
+	return (errctx == NULL);
+}
+
+void
+init_biomdi_errctx(BIOMDI_ERRCTX *ctx, unsigned int flags)
+{
+	memset(ctx, 0, sizeof(BIOMDI_ERRCTX));
+	ctx->flags = flags;
+}
+
+void
+clear_biomdi_errctx(BIOMDI_ERRCTX *ctx)
+{
+	ctx->count = 0;
+}
+
+BIOMDI_ERRCTX *
+set_biomdi_errctx(BIOMDI_ERRCTX *ctx)
+{
+	BIOMDI_ERRCTX *prev;
+
+	prev = errctx;
+	errctx = ctx;
+	return (prev);
+}
+
+BIOMDI_ERRCTX *
+get_biomdi_errctx(void)
+{
+	return (errctx);
+}
+
+void
+set_biomdi_error_source(FILE *fp, const BDB *bdb)
+{
+	if (errctx == NULL)
+		return;
+	errctx->source_fp = fp;
+	errctx->source_bdb = bdb;
+}
+
+int
+print_biomdi_errors(FILE *fp, const BIOMDI_ERRCTX *ctx)
+{
+	const struct biomdi_error *err;
+	char buf[BIOMDI_ERRCTX_TEXT_LEN];
+	unsigned int i, count;
+	int code;
+
+	count = ctx->count;
+	if (count > BIOMDI_ERRCTX_MAX_ERRORS)
+		count = BIOMDI_ERRCTX_MAX_ERRORS;
+	for (i = 0; i < count; i++) {
+		err = &ctx->errors[i];
+		if (ctx->text[i][0] == '\0') {
+			/* The message was not formatted, so print the format
+			 * string itself, which names the check that failed,
+			 * with its conversions left as they are.
+			 */
+			code = err->code;
+			if ((code < 0) || (code >= ERROR_FORMAT_COUNT))
+				code = BIOMDI_ERR_GENERAL;
+			snprintf(buf, sizeof(buf),
+			    "%s error: %s (line %d in %s).",
+			    error_formats[code].name,
+			    (err->field != NULL) ? err->field : "",
+			    err->line, err->file);
+		} else
+			strcpy(buf, ctx->text[i]);
+		if ((err->offset >= 0) && ((err->code != BIOMDI_ERR_IO) ||
+		    (ctx->text[i][0] == '\0')))
+			FPRINTF(fp, "%s [offset %lld]\n", buf,
+			    (long long)err->offset);
+		else
+			FPRINTF(fp, "%s\n", buf);
+	}
+	if (ctx->count > count)
+		FPRINTF(fp, "%u more errors not recorded.\n",
+		    ctx->count - count);
+	return (PRINT_OK);
+
+err_out:
+	return (PRINT_ERROR);
+}
@@ -0,0 +1,237 @@
+/*
+ * This software was developed at the National Institute of Standards and
+ * Technology (NIST) by employees of the Federal Government in the course
+ * of their official duties. Pursuant to title 17 Section 105 of the
+ * United States Code, this software is not subject to copyright protection
+ * and is in the public domain. NIST assumes no responsibility whatsoever for
+ * its use by other parties, and makes no guarantees, expressed or implied,
+ * about its quality, reliability, or any other characteristic.
+ */
+/******************************************************************************/
+/* Implementation of the record format sniffer. The format of a record is     */
+/* found from the format identifier, the spec version, and the layout of the  */
+/* header fields that follow the record length, using only the first          */
+/* BIOMDI_SNIFF_LENGTH octets of the record.                                  */
+/*                                                                            */
+/******************************************************************************/
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <biomdi.h>
+#include <biomdimacro.h>
+
+#define SNIFF_ID_LEN		4	// Format identifier, with NUL
+#define SNIFF_VERSION_LEN	4	// Spec version, with NUL
+#define SNIFF_LENGTH_OFFSET	8
+
+/*
+ * Finger minutiae record headers. The ANSI 2004 record length is two
+ * octets, or, when those are 0, the four octets that follow them; the
+ * ISO record length is four octets. The reserved octet follows the
+ * number of finger views, and must be 0.
+ */
+#define FMR_ANSI_SMALL_HEADER	26
+#define FMR_ANSI_LARGE_HEADER	30
+#define FMR_ISO_HEADER		24
+
+/*
+ * Finger image record headers. Both standards have the same identifier
+ * and spec version; the ANSI header has the four octet product
+ * identifier that the ISO header lacks. The header ends with the number
+ * of images, scale units, four resolutions, pixel depth, compression
+ * algorithm, and two reserved octets, and is followed by the four octet
+ * length of the first image view.
+ */
+#define FIR_ANSI_HEADER		36
+#define FIR_ISO_HEADER		32
+#define FIR_VIEW_HEADER		14
+#define FIR_MAX_PIXEL_DEPTH	16
+#define FIR_MAX_COMPRESSION	5
+
+#define IID_2011_VERSION	"020"
+
+static uint64_t
+get_be(const uint8_t *ptr, int size)
+{
+	uint64_t val;
+	int i;
+
+	val = 0;
+	for (i = 0; i < size; i++)
+		val = (val << 8) | ptr[i];
+	return (val);
+}
+
+/*
+ * Convert a spec version of three digits or spaces to a number.
+ * Returns 0 if the version is not of that form.
+ */
+static unsigned int
+version_number(const uint8_t *ptr)
+{
+	unsigned int val;
+	int i;
+
+	if (ptr[SNIFF_VERSION_LEN - 1] != 0)
+		return (0);
+	val = 0;
+	for (i = 0; i < SNIFF_VERSION_LEN - 1; i++) {
+		if ((ptr[i] >= '0') && (ptr[i] <= '9'))
+			val = val * 10 + (ptr[i] - '0');
+		else if (ptr[i] != ' ')
+			return (0);
+	}
+	return (val);
+}
+
+/*
+ * Check whether the octets that are present agree with a finger minutiae
+ * record header of 'hdrlen' octets and record length 'reclen': the
+ * record must hold the header, and the reserved octet must be 0.
+ */
+static int
+fmr_layout_fits(const uint8_t *ptr, uint64_t avail, unsigned int hdrlen,
+    uint64_t reclen)
+{
+	if (reclen < hdrlen)
+		return (0);
+	if ((avail >= hdrlen) && (ptr[hdrlen - 1] != 0))
+		return (0);
+	return (1);
+}
+
+static int
+sniff_fmr(const uint8_t *ptr, uint64_t avail, BIOMDI_FORMAT *fmt)
+{
+	uint64_t ansilen, isolen;
+	int ansi;
+
+	fmt->modality = BIOMDI_MODALITY_FINGER_MINUTIAE;
+	if (fmt->version == 30) {
+		fmt->format_std = BIOMDI_STD_ANSI07;
+		fmt->length_type = CORPUS_LENGTH_32;
+		fmt->record_length = get_be(ptr + SNIFF_LENGTH_OFFSET, 4);
+		return (0);
+	}
+	if (fmt->version != 20)
+		return (-1);
+
+	/* The ANSI and ISO records share the spec version, so the layout
+	 * decides. When the two octet ANSI length is not 0, the record is
+	 * ANSI, unless it is an ISO record of more than 65535 octets;
+	 * otherwise, it is ISO, unless it is a large ANSI record. Each
+	 * pair is told apart by the reserved octet of the header, and the
+	 * smaller record is assumed when both layouts fit.
+	 */
+	isolen = get_be(ptr + SNIFF_LENGTH_OFFSET, 4);
+	ansilen = get_be(ptr + SNIFF_LENGTH_OFFSET, 2);
+	if (ansilen != 0) {
+		ansi = fmr_layout_fits(ptr, avail, FMR_ANSI_SMALL_HEADER,
+		    ansilen) || !fmr_layout_fits(ptr, avail, FMR_ISO_HEADER,
+		    isolen);
+	} else {
+		if (avail < SNIFF_LENGTH_OFFSET + 6)
+			return (-1);
+		ansilen = get_be(ptr + SNIFF_LENGTH_OFFSET + 2, 4);
+		ansi = !fmr_layout_fits(ptr, avail, FMR_ISO_HEADER, isolen) &&
+		    fmr_layout_fits(ptr, avail, FMR_ANSI_LARGE_HEADER,
+		    ansilen);
+	}
+	if (ansi) {
+		fmt->format_std = BIOMDI_STD_ANSI;
+		fmt->length_type = CORPUS_LENGTH_FMR_ANSI;
+		fmt->record_length = ansilen;
+	} else {
+		fmt->format_std = BIOMDI_STD_ISO;
+		fmt->length_type = CORPUS_LENGTH_32;
+		fmt->record_length = isolen;
+	}
+	return (0);
+}
+
+/*
+ * Check whether the octets that are present agree with a finger image
+ * record header of 'hdrlen' octets and record length 'reclen'. The number
+ * of images and the scale units are 14 and 13 octets from the end of the
+ * header, and the pixel depth and compression algorithm 4 and 3.
+ */
+static int
+fir_layout_fits(const uint8_t *ptr, uint64_t avail, unsigned int hdrlen,
+    uint64_t reclen)
+{
+	uint64_t viewlen;
+
+	if (reclen < hdrlen + FIR_VIEW_HEADER)
+		return (0);
+	if (avail >= hdrlen) {
+		if ((ptr[hdrlen - 14] == 0) ||
+		    ((ptr[hdrlen - 13] != 1) && (ptr[hdrlen - 13] != 2)) ||
+		    (ptr[hdrlen - 4] == 0) ||
+		    (ptr[hdrlen - 4] > FIR_MAX_PIXEL_DEPTH) ||
+		    (ptr[hdrlen - 3] > FIR_MAX_COMPRESSION))
+			return (0);
+	}
+	if (avail >= hdrlen + 4) {
+		viewlen = get_be(ptr + hdrlen, 4);
+		if ((viewlen < FIR_VIEW_HEADER) || (viewlen > reclen - hdrlen))
+			return (0);
+	}
+	return (1);
+}
+
+static int
+sniff_fir(const uint8_t *ptr, uint64_t avail, BIOMDI_FORMAT *fmt)
+{
+	fmt->modality = BIOMDI_MODALITY_FINGER_IMAGE;
+	if (avail < SNIFF_LENGTH_OFFSET + 6)
+		return (-1);
+	fmt->length_type = CORPUS_LENGTH_48;
+	fmt->record_length = get_be(ptr + SNIFF_LENGTH_OFFSET, 6);
+
+	/* The ANSI record is assumed when both layouts fit */
+	if (fir_layout_fits(ptr, avail, FIR_ANSI_HEADER, fmt->record_length))
+		fmt->format_std = BIOMDI_STD_ANSI;
+	else if (fir_layout_fits(ptr, avail, FIR_ISO_HEADER,
+	    fmt->record_length))
+		fmt->format_std = BIOMDI_STD_ISO;
+	else
+		fmt->format_std = BIOMDI_STD_UNKNOWN;
+	return (0);
+}
+
+int
+sniff_biomdi_record(const BDB *bdb, BIOMDI_FORMAT *fmt)
+{
+	const uint8_t *ptr;
+	uint64_t avail;
+
+	memset(fmt, 0, sizeof(BIOMDI_FORMAT));
+	ptr = bdb->bdb_current;
+	avail = bdb->bdb_end - ptr;
+	if (avail < SNIFF_LENGTH_OFFSET + 4)
+		return (-1);
+	fmt->version = version_number(ptr + SNIFF_ID_LEN);
+
+	if (memcmp(ptr, "FMR", SNIFF_ID_LEN) == 0)
+		return (sniff_fmr(ptr, avail, fmt));
+	if (memcmp(ptr, "FIR", SNIFF_ID_LEN) == 0)
+		return (sniff_fir(ptr, avail, fmt));
+
+	/* The face records of both standards share one layout, as do
+	 * the iris records other than those of ISO/IEC 19794-6:2011.
+	 */
+	if (memcmp(ptr, "FAC", SNIFF_ID_LEN) == 0) {
+		fmt->modality = BIOMDI_MODALITY_FACE;
+	} else if (memcmp(ptr, "IIR", SNIFF_ID_LEN) == 0) {
+		fmt->modality = BIOMDI_MODALITY_IRIS;
+		if (memcmp(ptr + SNIFF_ID_LEN, IID_2011_VERSION,
+		    SNIFF_VERSION_LEN) == 0)
+			fmt->format_std = BIOMDI_STD_ISO;
+	} else {
+		return (-1);
+	}
+	fmt->length_type = CORPUS_LENGTH_32;
+	fmt->record_length = get_be(ptr + SNIFF_LENGTH_OFFSET, 4);
+	return (0);
+}
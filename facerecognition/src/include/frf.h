@@ -188,6 +188,7 @@ scan_fb(BDB *fbdb, FB *fb);
 /******************************************************************************/
 /* Write a Facial Block to a file or memory buffer, including the Facial      */
 /* Header and all of the Facial Data blocks.                                  */
+/* A buffer from new_growable_bdb() is enlarged as needed when pushing.       */
 /*                                                                            */
 /* Parameters:                                                                */
 /*   fp     The open file pointer.                                            */
@@ -204,6 +205,49 @@ write_fb(FILE *fp, FB *fb);
 int
 push_fb(BDB *fbdb, FB *fb);
 
+/******************************************************************************/
+/* Compute the length of a Facial Block as it would be written by push_fb(), */
+/* from the Facial Data blocks in the record. The length fields of the record */
+/* are not used or changed.                                                   */
+/*                                                                            */
+/* Parameters:                                                                */
+/*   fb     Pointer to the Facial Block.                                      */
+/*                                                                            */
+/* Returns:                                                                   */
+/*   The encoded length, in octets.                                           */
+/*                                                                            */
+/******************************************************************************/
+uint32_t
+get_fb_encoded_length(FB *fb);
+
+/******************************************************************************/
+/* Set the record length of a Facial Block, and the block length of each      */
+/* Facial Data block, to match its contents.                                  */
+/*                                                                            */
+/* Parameters:                                                                */
+/*   fb     Pointer to the Facial Block.                                      */
+/*                                                                            */
+/******************************************************************************/
+void
+update_fb_length(FB *fb);
+
+/******************************************************************************/
+/* Update the lengths of a Facial Block with update_fb_length(), then encode  */
+/* the record into a newly allocated buffer of exactly the record length.     */
+/*                                                                            */
+/* Parameters:                                                                */
+/*   fb     Pointer to the Facial Block.                                      */
+/*   buf    Set to the address of the buffer, which the caller must free.     */
+/*   length Set to the length of the buffer.                                  */
+/*                                                                            */
+/* Returns:                                                                   */
+/*      WRITE_OK      Success                                                 */
+/*      WRITE_ERROR   Failure                                                 */
+/*                                                                            */
+/******************************************************************************/
+int
+serialize_fb(FB *fb, uint8_t **buf, uint32_t *length);
+
 /******************************************************************************/
 /* Print a Facial Block to a file in human-readable form. The Facial Header   */
 /* and all of the Facial Data blocks are printed.                             */
@@ -407,6 +451,20 @@ write_fdb(FILE *fp, FDB *fdb);
 int
 push_fdb(BDB *fdbdb, FDB *fdb);
 
+/******************************************************************************/
+/* Compute the length of a Facial Data Block as it would be written by        */
+/* push_fdb(), including the feature points and the image data.              */
+/*                                                                            */
+/* Parameters:                                                                */
+/*   fdb    Pointer to the Facial Data Block.                                 */
+/*                                                                            */
+/* Returns:                                                                   */
+/*   The encoded length, in octets.                                           */
+/*                                                                            */
+/******************************************************************************/
+uint32_t
+get_fdb_encoded_length(FDB *fdb);
+
 
 /******************************************************************************/
 /* Print a Facial Data Block to a file in human-readable form.                */
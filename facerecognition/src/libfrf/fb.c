@@ -25,6 +25,7 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include <biomdi.h>
 #include <biomdimacro.h>
 #include <frf.h>
 
@@ -104,16 +105,43 @@ err_out:
 	return READ_ERROR;
 }
 
+/*
+ * Read the Facial Header far enough to find the record length, then
+ * read the entire record into memory and scan it from there. End of file
+ * before the first octet of the record is not reported; a record cut
+ * short by the end of the file is returned as read so far, with READ_EOF.
+ */
 int
 read_fb(FILE *fp, FB *fb)
 {
-	return (internal_read_fb(fp, NULL, fb));
+	uint8_t hdr[FRF_FORMAT_ID_LENGTH + FRF_VERSION_NUM_LENGTH + 4];
+	uint64_t reclen;
+	BDB fbdb;
+	int ret;
+
+	ret = read_bdb_header(fp, hdr, sizeof(hdr));
+	if (ret != READ_OK)
+		return (ret);
+	reclen = ((uint32_t)hdr[8] << 24) | (hdr[9] << 16) | (hdr[10] << 8) |
+	    hdr[11];
+
+	if (read_bdb_record(fp, &fbdb, hdr, sizeof(hdr), reclen) != READ_OK)
+		return (READ_ERROR);
+	set_biomdi_error_source(NULL, &fbdb);
+	ret = internal_read_fb(NULL, &fbdb, fb);
+	set_biomdi_error_source(NULL, NULL);
+	return (end_bdb_record(&fbdb, reclen, ret));
 }
 
 int
 scan_fb(BDB *fbdb, FB *fb)
 {
-	return (internal_read_fb(NULL, fbdb, fb));
+	int ret;
+
+	set_biomdi_error_source(NULL, fbdb);
+	ret = internal_read_fb(NULL, fbdb, fb);
+	set_biomdi_error_source(NULL, NULL);
+	return (ret);
 }
 
 static int
@@ -145,10 +173,23 @@ err_out:
 	return WRITE_ERROR;
 }
 
+/*
+ * Write the record by pushing it into a buffer of the encoded length, then
+ * writing the buffer with one write.
+ */
 int
 write_fb(FILE *fp, FB *fb)
 {
-	return (internal_write_fb(fp, NULL, fb));
+	BDB fbdb;
+	int ret;
+
+	if (new_bdb_record(&fbdb, get_fb_encoded_length(fb)) != WRITE_OK)
+		return (WRITE_ERROR);
+	ret = internal_write_fb(NULL, &fbdb, fb);
+	if (ret == WRITE_OK)
+		ret = write_bdb_record(fp, &fbdb);
+	free(fbdb.bdb_start);
+	return (ret);
 }
 
 int
@@ -157,6 +198,49 @@ push_fb(BDB *fbdb, FB *fb)
 	return (internal_write_fb(NULL, fbdb, fb));
 }
 
+uint32_t
+get_fb_encoded_length(FB *fb)
+{
+	FDB *fdb;
+	uint32_t length;
+
+	length = FRF_FHB_LENGTH;
+	TAILQ_FOREACH(fdb, &fb->facial_data, list)
+		length += get_fdb_encoded_length(fdb);
+	return (length);
+}
+
+void
+update_fb_length(FB *fb)
+{
+	FDB *fdb;
+
+	TAILQ_FOREACH(fdb, &fb->facial_data, list)
+		fdb->block_length = get_fdb_encoded_length(fdb);
+	fb->record_length = get_fb_encoded_length(fb);
+}
+
+int
+serialize_fb(FB *fb, uint8_t **buf, uint32_t *length)
+{
+	BDB fbdb;
+
+	update_fb_length(fb);
+	if (new_bdb_record(&fbdb, fb->record_length) != WRITE_OK)
+		return (WRITE_ERROR);
+	if ((internal_write_fb(NULL, &fbdb, fb) != WRITE_OK) ||
+	    (fbdb.bdb_current != fbdb.bdb_end)) {
+		free(fbdb.bdb_start);
+		ERR_OUT("Could not serialize Facial Block");
+	}
+	*buf = fbdb.bdb_start;
+	*length = fbdb.bdb_size;
+	return (WRITE_OK);
+
+err_out:
+	return (WRITE_ERROR);
+}
+
 int
 print_fb(FILE *fp, FB *fb)
 {
@@ -255,6 +255,20 @@ push_fdb(BDB *fdbdb, FDB *fdb)
 	return (internal_write_fdb(NULL, fdbdb, fdb));
 }
 
+uint32_t
+get_fdb_encoded_length(FDB *fdb)
+{
+	FPB *fpb;
+	uint32_t length;
+
+	length = FRF_FIB_LENGTH + FRF_IIB_LENGTH;
+	TAILQ_FOREACH(fpb, &fdb->feature_points, list)
+		length += FRF_FPB_LENGTH;
+	if (fdb->image_data != NULL)
+		length += fdb->image_len;
+	return (length);
+}
+
 int
 print_fdb(FILE *fp, FDB *fdb)
 {
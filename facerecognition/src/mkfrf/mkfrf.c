@@ -41,7 +41,6 @@
 #include <frf.h>
 
 #define MAXFDBS		4
-int total_length = 0;
 
 /******************************************************************************/
 /* Load the FRF header info from a text file and set the fields in the face   */
@@ -65,7 +64,6 @@ load_hdr(FILE *fp, struct facial_block *fb)
 	// NULL-terminate the version number
 	fb->version_num[3] = 0x00;
 
-	total_length += FRF_FHB_LENGTH;
 	return (READ_OK);
 }
 
@@ -157,9 +155,6 @@ load_fdb(FILE *fp, struct facial_block *fb)
 			return (READ_ERROR);
 		}
 
-	fdb->block_length = FRF_FIB_LENGTH + FRF_IIB_LENGTH + 
-	    fdb->num_feature_points * FRF_FPB_LENGTH;
-
 	if (fscanf(fp, "%s", buf) < 0) {
 		ERRP("Could not read image name");
 		return (READ_ERROR);
@@ -169,8 +164,6 @@ load_fdb(FILE *fp, struct facial_block *fb)
 
 	add_fdb_to_fb(fdb, fb);
 
-	total_length += fdb->block_length;
-
 	return (READ_OK);
 }
 
@@ -254,7 +247,8 @@ main(int argc, char *argv[])
 		}
 	} while (ret == READ_OK);
 
-	fb->record_length = total_length;
+	// The block and record lengths are calculated from the images
+	update_fb_length(fb);
 
 	// Validate the Facial Block
 	if (validate_fb(fb) != VALIDATE_OK) {
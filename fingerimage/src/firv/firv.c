@@ -30,8 +30,8 @@
 #include <string.h>
 #include <unistd.h>
 
-#include <fir.h>
 #include <biomdimacro.h>
+#include <fir.h>
 
 static void
 usage(char *name)
@@ -211,12 +211,14 @@ add_image_to_fivr(char *image, unsigned int length,
     struct finger_image_view_record *fivr);
 
 /******************************************************************************/
-/* Read a complete Finger Image Record from a file, filling in the fields     */
-/* of the header record, including all of the Finger Views.                   */
+/* Read a complete Finger Image Record from a file, or buffer, filling in the */
+/* fields of the header record, including all of the Finger Views.            */
 /* This function does not do any validation of the data being read.           */
+/* Fields within the FILE and BDB structs are modified by these functions.    */
 /*                                                                            */
 /* Parameters:                                                                */
 /*   fp     The open file pointer.                                            */
+/*   fdb    Pointer to the biometric data block containing image data.        */
 /*   fir    Pointer to the FIR.                                               */
 /*                                                                            */
 /* Returns:                                                                   */
@@ -227,11 +229,16 @@ add_image_to_fivr(char *image, unsigned int length,
 int
 read_fir(FILE *fp, struct finger_image_record *fir);
 
+int
+scan_fir(BDB *fdb, struct finger_image_record *fir);
+
 /******************************************************************************/
-/* Write a Finger Image Record to a file.                                     */
+/* Write a Finger Image Record to a file or memory buffer.                    */
+/* A buffer from new_growable_bdb() is enlarged as needed when pushing.       */
 /*                                                                            */
 /* Parameters:                                                                */
 /*   fp     The open file pointer.                                            */
+/*   fdb    Pointer to the biometric data block.                              */
 /*   fir    Pointer to the Finger Image Record.                               */
 /*                                                                            */
 /* Returns:                                                                   */
@@ -241,6 +248,51 @@ read_fir(FILE *fp, struct finger_image_record *fir);
 int
 write_fir(FILE *fp, struct finger_image_record *fir);
 
+int
+push_fir(BDB *fdb, struct finger_image_record *fir);
+
+/******************************************************************************/
+/* Compute the length of a Finger Image Record as it would be written by      */
+/* push_fir(), from the views and images in the record. The length fields of  */
+/* the record are not used or changed.                                        */
+/*                                                                            */
+/* Parameters:                                                                */
+/*   fir    Pointer to the Finger Image Record.                               */
+/*                                                                            */
+/* Returns:                                                                   */
+/*   The encoded length, in octets.                                           */
+/******************************************************************************/
+unsigned long long
+get_fir_encoded_length(struct finger_image_record *fir);
+
+/******************************************************************************/
+/* Set the record length of a Finger Image Record, and the length of each     */
+/* view, to match its contents.                                               */
+/*                                                                            */
+/* Parameters:                                                                */
+/*   fir    Pointer to the Finger Image Record.                               */
+/******************************************************************************/
+void
+update_fir_length(struct finger_image_record *fir);
+
+/******************************************************************************/
+/* Update the lengths of a Finger Image Record with update_fir_length(),      */
+/* then encode the record into a newly allocated buffer of exactly the        */
+/* record length.                                                             */
+/*                                                                            */
+/* Parameters:                                                                */
+/*   fir    Pointer to the Finger Image Record.                               */
+/*   buf    Set to the address of the buffer, which the caller must free.     */
+/*   length Set to the length of the buffer.                                  */
+/*                                                                            */
+/* Returns:                                                                   */
+/*        WRITE_OK     Success                                                */
+/*        WRITE_ERROR  Failure                                                */
+/******************************************************************************/
+int
+serialize_fir(struct finger_image_record *fir, uint8_t **buf,
+    uint32_t *length);
+
 /******************************************************************************/
 /* Print an entire finger Image Record to a file in human-readable form.      */
 /* This function does not validate the record.                                */
@@ -276,10 +328,11 @@ validate_fir(struct finger_image_record *fir);
 /******************************************************************************/
 
 /******************************************************************************/
-/* Read a single Finger Image View Record from a file.                        */
+/* Read a single Finger Image View Record from a file or buffer.              */
 /*                                                                            */
 /* Parameters:                                                                */
 /*   fp     The open file pointer.                                            */
+/*   fdb    Pointer to the biometric data block containing image data.        */
 /*   fivr   Pointer to the Finger Image View Record.                          */
 /*                                                                            */
 /* Returns:                                                                   */
@@ -290,11 +343,15 @@ validate_fir(struct finger_image_record *fir);
 int
 read_fivr(FILE *fp, struct finger_image_view_record *fivr);
 
+int
+scan_fivr(BDB *fdb, struct finger_image_view_record *fivr);
+
 /******************************************************************************/
-/* Write a single Finger Image View Record to a file.                         */
+/* Write a single Finger Image View Record to a file or memory buffer.        */
 /*                                                                            */
 /* Parameters:                                                                */
 /*   fp     The open file pointer.                                            */
+/*   fdb    Pointer to the biometric data block.                              */
 /*   fivr   Pointer to the Finger Image View Record.                          */
 /*                                                                            */
 /* Returns:                                                                   */
@@ -304,6 +361,22 @@ read_fivr(FILE *fp, struct finger_image_view_record *fivr);
 int
 write_fivr(FILE *fp, struct finger_image_view_record *fivr);
 
+int
+push_fivr(BDB *fdb, struct finger_image_view_record *fivr);
+
+/******************************************************************************/
+/* Compute the length of a Finger Image View Record as it would be written by */
+/* push_fivr(), including the image data.                                     */
+/*                                                                            */
+/* Parameters:                                                                */
+/*   fivr   Pointer to the Finger Image View Record.                          */
+/*                                                                            */
+/* Returns:                                                                   */
+/*   The encoded length, in octets.                                           */
+/******************************************************************************/
+unsigned int
+get_fivr_encoded_length(struct finger_image_view_record *fivr);
+
 /******************************************************************************/
 /* Print a FIVR to a file in human-readable form.                             */
 /*                                                                            */
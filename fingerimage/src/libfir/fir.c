@@ -95,8 +95,8 @@ add_fivr_to_fir(struct finger_image_view_record *fivr,
 /******************************************************************************/
 /* Implement the interface for reading/writing/printing finger image records  */
 /******************************************************************************/
-int
-read_fir(FILE *fp, struct finger_image_record *fir)
+static int
+internal_read_fir(FILE *fp, BDB *fdb, struct finger_image_record *fir)
 {
 	struct finger_image_view_record *fivr;
 	unsigned short sval;
@@ -104,22 +104,22 @@ read_fir(FILE *fp, struct finger_image_record *fir)
 	int i;
 	int ret;
 
-	OREAD(fir->format_id, 1, FIR_FORMAT_ID_LEN, fp);
-	OREAD(fir->spec_version, 1, FIR_SPEC_VERSION_LEN, fp);
+	OGET(fir->format_id, 1, FIR_FORMAT_ID_LEN, fp, fdb);
+	OGET(fir->spec_version, 1, FIR_SPEC_VERSION_LEN, fp, fdb);
 
-	SREAD(&sval, fp);
-	LREAD(&fir->record_length, fp);
+	SGET(&sval, fp, fdb);
+	LGET(&fir->record_length, fp, fdb);
 	llval = sval;
 	llval = llval << 32;
 	fir->record_length += llval;
 
 	if (fir->format_std == FIR_STD_ANSI) {
-		SREAD(&fir->product_identifier_owner, fp);
-		SREAD(&fir->product_identifier_type, fp);
+		SGET(&fir->product_identifier_owner, fp, fdb);
+		SGET(&fir->product_identifier_type, fp, fdb);
 	}
 
 	// Capture Eqpt Compliance/Scanner ID
-	SREAD(&sval, fp);
+	SGET(&sval, fp, fdb);
 	if (fir->format_std == FIR_STD_ANSI) {
 		fir->scanner_id = sval & HDR_SCANNER_ID_MASK;
 		fir->compliance = (sval & HDR_COMPLIANCE_MASK) >>
@@ -128,30 +128,34 @@ read_fir(FILE *fp, struct finger_image_record *fir)
 		fir->scanner_id = sval & HDR_SCANNER_ID_MASK;
 	}
 
-	SREAD(&fir->image_acquisition_level, fp);
-	CREAD(&fir->num_fingers_or_palm_images, fp);
-	CREAD(&fir->scale_units, fp);
+	SGET(&fir->image_acquisition_level, fp, fdb);
+	CGET(&fir->num_fingers_or_palm_images, fp, fdb);
+	CGET(&fir->scale_units, fp, fdb);
 	
-        SREAD(&fir->x_scan_resolution, fp);
-        SREAD(&fir->y_scan_resolution, fp);
-        SREAD(&fir->x_image_resolution, fp);
-        SREAD(&fir->y_image_resolution, fp);
-        CREAD(&fir->pixel_depth, fp);
-        CREAD(&fir->image_compression_algorithm, fp);
-        SREAD(&fir->reserved, fp);
+        SGET(&fir->x_scan_resolution, fp, fdb);
+        SGET(&fir->y_scan_resolution, fp, fdb);
+        SGET(&fir->x_image_resolution, fp, fdb);
+        SGET(&fir->y_image_resolution, fp, fdb);
+        CGET(&fir->pixel_depth, fp, fdb);
+        CGET(&fir->image_compression_algorithm, fp, fdb);
+        SGET(&fir->reserved, fp, fdb);
 
 	// Read the image views
 	for (i = 1; i <= fir->num_fingers_or_palm_images; i++) {
 		if (new_fivr(&fivr) < 0) 
 			ERR_OUT("Could not allocate FIVR %d", i);
 
-		ret = read_fivr(fp, fivr);
+		if (fp != NULL)
+			ret = read_fivr(fp, fivr);
+		else
+			ret = scan_fivr(fdb, fivr);
 		if (ret == READ_OK)
 			add_fivr_to_fir(fivr, fir);
-		else if (ret == READ_EOF)
+		else if (ret == READ_EOF) {
 			// XXX Handle a partial read?
+			free_fivr(fivr);
 			return (READ_EOF);
-		else
+		} else
 			ERR_OUT("Could not read entire FIVR %d", i);
 	}
 
@@ -164,8 +168,49 @@ err_out:
 	return (READ_ERROR);
 }
 
+/*
+ * Read the record header far enough to find the record length, then
+ * read the entire record into memory and scan it from there. End of file
+ * before the first octet of the record is not reported; a record cut
+ * short by the end of the file is returned as read so far, with READ_EOF.
+ */
 int
-write_fir(FILE *fp, struct finger_image_record *fir)
+read_fir(FILE *fp, struct finger_image_record *fir)
+{
+	uint8_t hdr[FIR_FORMAT_ID_LEN + FIR_SPEC_VERSION_LEN + 6];
+	uint64_t reclen;
+	BDB fdb;
+	int i, ret;
+
+	ret = read_bdb_header(fp, hdr, sizeof(hdr));
+	if (ret != READ_OK)
+		return (ret);
+	reclen = 0;
+	for (i = FIR_FORMAT_ID_LEN + FIR_SPEC_VERSION_LEN; i < sizeof(hdr);
+	    i++)
+		reclen = (reclen << 8) | hdr[i];
+
+	if (read_bdb_record(fp, &fdb, hdr, sizeof(hdr), reclen) != READ_OK)
+		return (READ_ERROR);
+	set_biomdi_error_source(NULL, &fdb);
+	ret = internal_read_fir(NULL, &fdb, fir);
+	set_biomdi_error_source(NULL, NULL);
+	return (end_bdb_record(&fdb, reclen, ret));
+}
+
+int
+scan_fir(BDB *fdb, struct finger_image_record *fir)
+{
+	int ret;
+
+	set_biomdi_error_source(NULL, fdb);
+	ret = internal_read_fir(NULL, fdb, fir);
+	set_biomdi_error_source(NULL, NULL);
+	return (ret);
+}
+
+static int
+internal_write_fir(FILE *fp, BDB *fdb, struct finger_image_record *fir)
 {
 	struct finger_image_view_record *fivr;
 	unsigned short sval;
@@ -173,43 +218,46 @@ write_fir(FILE *fp, struct finger_image_record *fir)
 	unsigned long long llval;
 	int ret;
 
-	OWRITE(fir->format_id, sizeof(char), FIR_FORMAT_ID_LEN, fp);
-	OWRITE(fir->spec_version, sizeof(char), FIR_SPEC_VERSION_LEN, fp);
+	OPUT(fir->format_id, sizeof(char), FIR_FORMAT_ID_LEN, fp, fdb);
+	OPUT(fir->spec_version, sizeof(char), FIR_SPEC_VERSION_LEN, fp, fdb);
 
         // The six byte length...
 	llval = fir->record_length >> 32;
 	sval = (unsigned short)llval;
 	lval = (unsigned long)fir->record_length;
-	SWRITE(sval, fp);
-	LWRITE(lval, fp);
+	SPUT(sval, fp, fdb);
+	LPUT(lval, fp, fdb);
 
 	if (fir->format_std == FIR_STD_ANSI) {
-		SWRITE(fir->product_identifier_owner, fp);
-		SWRITE(fir->product_identifier_type, fp);
+		SPUT(fir->product_identifier_owner, fp, fdb);
+		SPUT(fir->product_identifier_type, fp, fdb);
 	}
 
 	if (fir->format_std == FIR_STD_ANSI) {
 		sval = (fir->compliance << HDR_COMPLIANCE_SHIFT) |
 		    fir->scanner_id;
-		SWRITE(sval, fp);
+		SPUT(sval, fp, fdb);
 	} else {
-		SWRITE(fir->scanner_id, fp);
+		SPUT(fir->scanner_id, fp, fdb);
 	}
 
-	SWRITE(fir->image_acquisition_level, fp);
-        CWRITE(fir->num_fingers_or_palm_images, fp);
-        CWRITE(fir->scale_units, fp);
-        SWRITE(fir->x_scan_resolution, fp);
-        SWRITE(fir->y_scan_resolution, fp);
-        SWRITE(fir->x_image_resolution, fp);
-        SWRITE(fir->y_image_resolution, fp);
-        CWRITE(fir->pixel_depth, fp);
-        CWRITE(fir->image_compression_algorithm, fp);
-        SWRITE(fir->reserved, fp);
+	SPUT(fir->image_acquisition_level, fp, fdb);
+        CPUT(fir->num_fingers_or_palm_images, fp, fdb);
+        CPUT(fir->scale_units, fp, fdb);
+        SPUT(fir->x_scan_resolution, fp, fdb);
+        SPUT(fir->y_scan_resolution, fp, fdb);
+        SPUT(fir->x_image_resolution, fp, fdb);
+        SPUT(fir->y_image_resolution, fp, fdb);
+        CPUT(fir->pixel_depth, fp, fdb);
+        CPUT(fir->image_compression_algorithm, fp, fdb);
+        SPUT(fir->reserved, fp, fdb);
 
 	// Write the image views
 	TAILQ_FOREACH(fivr, &fir->finger_views, list) {
-		ret = write_fivr(fp, fivr);
+		if (fp != NULL)
+			ret = write_fivr(fp, fivr);
+		else
+			ret = push_fivr(fdb, fivr);
 		if (ret != WRITE_OK)
 			ERR_OUT("Could not write FIVR");
 	}
@@ -219,6 +267,83 @@ err_out:
 	return (WRITE_ERROR);
 }
 
+/*
+ * Write the record by pushing it into a buffer of the encoded length, then
+ * writing the buffer with one write. Records too large for a buffer are
+ * written field by field.
+ */
+int
+write_fir(FILE *fp, struct finger_image_record *fir)
+{
+	unsigned long long length;
+	BDB fdb;
+	int ret;
+
+	length = get_fir_encoded_length(fir);
+	if (length > UINT32_MAX)
+		return (internal_write_fir(fp, NULL, fir));
+	if (new_bdb_record(&fdb, length) != WRITE_OK)
+		return (WRITE_ERROR);
+	ret = internal_write_fir(NULL, &fdb, fir);
+	if (ret == WRITE_OK)
+		ret = write_bdb_record(fp, &fdb);
+	free(fdb.bdb_start);
+	return (ret);
+}
+
+int
+push_fir(BDB *fdb, struct finger_image_record *fir)
+{
+	return (internal_write_fir(NULL, fdb, fir));
+}
+
+unsigned long long
+get_fir_encoded_length(struct finger_image_record *fir)
+{
+	struct finger_image_view_record *fivr;
+	unsigned long long length;
+
+	if (fir->format_std == FIR_STD_ANSI)
+		length = FIR_ANSI_HEADER_LENGTH;
+	else
+		length = FIR_ISO_HEADER_LENGTH;
+	TAILQ_FOREACH(fivr, &fir->finger_views, list)
+		length += get_fivr_encoded_length(fivr);
+	return (length);
+}
+
+void
+update_fir_length(struct finger_image_record *fir)
+{
+	struct finger_image_view_record *fivr;
+
+	TAILQ_FOREACH(fivr, &fir->finger_views, list)
+		fivr->length = get_fivr_encoded_length(fivr);
+	fir->record_length = get_fir_encoded_length(fir);
+}
+
+int
+serialize_fir(struct finger_image_record *fir, uint8_t **buf,
+    uint32_t *length)
+{
+	BDB fdb;
+
+	update_fir_length(fir);
+	if (new_bdb_record(&fdb, fir->record_length) != WRITE_OK)
+		return (WRITE_ERROR);
+	if ((internal_write_fir(NULL, &fdb, fir) != WRITE_OK) ||
+	    (fdb.bdb_current != fdb.bdb_end)) {
+		free(fdb.bdb_start);
+		ERR_OUT("Could not serialize FIR");
+	}
+	*buf = fdb.bdb_start;
+	*length = fdb.bdb_size;
+	return (WRITE_OK);
+
+err_out:
+	return (WRITE_ERROR);
+}
+
 int
 print_fir(FILE *fp, struct finger_image_record *fir)
 {
@@ -57,18 +57,18 @@ add_image_to_fivr(char *image, unsigned int length,
 /* Implement the interface for reading and writing Finger Image View records  */
 /******************************************************************************/
 
-int
-read_fivr(FILE *fp, struct finger_image_view_record *fivr)
+static int
+internal_read_fivr(FILE *fp, BDB *fdb, struct finger_image_view_record *fivr)
 {
-	LREAD(&fivr->length, fp);
-	CREAD(&fivr->finger_palm_position, fp);
-	CREAD(&fivr->count_of_views, fp);
-	CREAD(&fivr->view_number, fp);
-	CREAD(&fivr->quality, fp);
-	CREAD(&fivr->impression_type, fp);
-	SREAD(&fivr->horizontal_line_length, fp);
-	SREAD(&fivr->vertical_line_length, fp);
-	CREAD(&fivr->reserved, fp);
+	LGET(&fivr->length, fp, fdb);
+	CGET(&fivr->finger_palm_position, fp, fdb);
+	CGET(&fivr->count_of_views, fp, fdb);
+	CGET(&fivr->view_number, fp, fdb);
+	CGET(&fivr->quality, fp, fdb);
+	CGET(&fivr->impression_type, fp, fdb);
+	SGET(&fivr->horizontal_line_length, fp, fdb);
+	SGET(&fivr->vertical_line_length, fp, fdb);
+	CGET(&fivr->reserved, fp, fdb);
 	// XXX Need stronger constraints here on length
 	if (fivr->length > FIVR_HEADER_LENGTH) {
 		fivr->image_length = fivr->length - FIVR_HEADER_LENGTH;
@@ -76,7 +76,7 @@ read_fivr(FILE *fp, struct finger_image_view_record *fivr)
 		if (fivr->image_data == NULL)
 			ERR_OUT("Could not allocate memory for image data");
 		else
-			OREAD(fivr->image_data, 1, fivr->image_length, fp);
+			OGET(fivr->image_data, 1, fivr->image_length, fp, fdb);
 	}
 	return (READ_OK);
 eof_out:
@@ -87,25 +87,59 @@ err_out:
 }
 
 int
-write_fivr(FILE *fp, struct finger_image_view_record *fivr)
+read_fivr(FILE *fp, struct finger_image_view_record *fivr)
+{
+	return (internal_read_fivr(fp, NULL, fivr));
+}
+
+int
+scan_fivr(BDB *fdb, struct finger_image_view_record *fivr)
+{
+	return (internal_read_fivr(NULL, fdb, fivr));
+}
+
+static int
+internal_write_fivr(FILE *fp, BDB *fdb, struct finger_image_view_record *fivr)
 {
-	LWRITE(fivr->length, fp);
-	CWRITE(fivr->finger_palm_position, fp);
-	CWRITE(fivr->count_of_views, fp);
-	CWRITE(fivr->view_number, fp);
-	CWRITE(fivr->quality, fp);
-	CWRITE(fivr->impression_type, fp);
-	SWRITE(fivr->horizontal_line_length, fp);
-	SWRITE(fivr->vertical_line_length, fp);
-	CWRITE(fivr->reserved, fp);
+	LPUT(fivr->length, fp, fdb);
+	CPUT(fivr->finger_palm_position, fp, fdb);
+	CPUT(fivr->count_of_views, fp, fdb);
+	CPUT(fivr->view_number, fp, fdb);
+	CPUT(fivr->quality, fp, fdb);
+	CPUT(fivr->impression_type, fp, fdb);
+	SPUT(fivr->horizontal_line_length, fp, fdb);
+	SPUT(fivr->vertical_line_length, fp, fdb);
+	CPUT(fivr->reserved, fp, fdb);
 	if (fivr->image_data != NULL) {
-		OWRITE(fivr->image_data, sizeof(char), fivr->image_length, fp);
+		OPUT(fivr->image_data, sizeof(char), fivr->image_length, fp,
+		    fdb);
 	}
 	return (WRITE_OK);
 err_out:
 	return (WRITE_ERROR);
 }
 
+int
+write_fivr(FILE *fp, struct finger_image_view_record *fivr)
+{
+	return (internal_write_fivr(fp, NULL, fivr));
+}
+
+int
+push_fivr(BDB *fdb, struct finger_image_view_record *fivr)
+{
+	return (internal_write_fivr(NULL, fdb, fivr));
+}
+
+unsigned int
+get_fivr_encoded_length(struct finger_image_view_record *fivr)
+{
+	if (fivr->image_data != NULL)
+		return (FIVR_HEADER_LENGTH + fivr->image_length);
+	else
+		return (FIVR_HEADER_LENGTH);
+}
+
 int
 print_fivr(FILE *fp, struct finger_image_view_record *fivr)
 {
@@ -40,8 +40,6 @@
 #include <biomdimacro.h>
 #include <fir.h>
 
-int total_length = 0;
-
 static void
 usage()
 {
@@ -95,10 +93,6 @@ load_hdr(FILE *fp, struct finger_image_record *fir)
 	// NULL-terminate the version number
 	fir->spec_version[3] = 0x00;
 
-	if (fir->format_std == FIR_STD_ANSI)
-		total_length += FIR_ANSI_HEADER_LENGTH;
-	else
-		total_length += FIR_ISO_HEADER_LENGTH;
 	return (READ_OK);
 }
 
@@ -139,10 +133,6 @@ load_fivr(FILE *fp, struct finger_image_record *fir)
 	if (fscanf(fp, "%s", filename) != 1)
 		return (READ_ERROR);
 
-	// Even though we read the length from the header, we set it to
-	// the correct size here.
-	fivr->length = FIVR_HEADER_LENGTH;
-
 	if (stat(filename, &sb) == 0) {
 		if ((image_fp = fopen(filename, "rb")) == NULL) {
 			ERRP ("Could not read image file %s", filename);
@@ -157,7 +147,6 @@ load_fivr(FILE *fp, struct finger_image_record *fir)
 					ERRP("Could not read image file %s",
 					    filename);
 				} else {
-					fivr->length += sb.st_size;
 					add_image_to_fivr(buf, sb.st_size, fivr);
 				}
 			}
@@ -168,8 +157,6 @@ load_fivr(FILE *fp, struct finger_image_record *fir)
 
 	add_fivr_to_fir(fivr, fir);
 
-	total_length += fivr->length;
-
 	return (READ_OK);
 }
 
@@ -256,7 +243,8 @@ main(int argc, char *argv[])
 		}
 	} while (ret == READ_OK);
 
-	fir->record_length = total_length;
+	// The view and record lengths are calculated from the images
+	update_fir_length(fir);
 
 	// Validate the Finger Image Record
 	if (validate_fir(fir) != VALIDATE_OK) {
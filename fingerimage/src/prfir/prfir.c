@@ -29,9 +29,9 @@
 #include <string.h>
 #include <unistd.h>
 
-#include <fir.h>
 #include <biomdi.h>
 #include <biomdimacro.h>
+#include <fir.h>
 
 static void
 usage()
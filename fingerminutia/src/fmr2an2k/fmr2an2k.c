@@ -9,7 +9,9 @@
  */
 /******************************************************************************/
 /* This program will convert a ANSI/INCITS 378-2004 Finger Minutiae Record    */
-/* into a ANSI/NIST Type 9 record embedded in the ANSI/NIST data record.      */
+/* into a ANSI/NIST Type 9 record embedded in the ANSI/NIST data record. The  */
+/* input may hold the records of many subjects, which are packed into as few  */
+/* transactions as the IDC range allows.                                      */
 /*                                                                            */
 /* For more information, see:                                                 */
 /*  'Finger Minutiae Format for Data Interchange', ANSI INCITS 378-2004.      */
@@ -18,11 +20,11 @@
 /*  NIST Spectial Publication 500-245.                                        */
 /*                                                                            */
 /* Parameters to this program:                                                */
-/*    -i <m1file>   The input file containing the raw Finger Minutiae Record. */
+/*    -i <m1file>   The input file containing the raw Finger Minutiae         */
+/*                  Records, one after another.                               */
 /*    -o <an2kfile> The output file to contain the raw ANSI/NIST record.      */
 /*    -v            Optionally verify the Finger Minutiae Record. The program */
-/*                  will exit with an error code if the FMR is invalid, and   */
-/*                  won't create the ANSI/NIST file.                          */
+/*                  will exit with an error code at the first invalid FMR.    */
 /*    -f            Optionally specifies a file that contains a list of       */
 /*                  file names for the 8-bit grayscale image files.  The      */
 /*                  files are read in order and placed within a the Type-13   */
@@ -30,6 +32,8 @@
 /*                  that precedes the Type-13 record.                         */
 /*    -t            Optionally specifies a file that contains the Type-2      */
 /*                  record information. See fmr2an2k(1) for information.      */
+/*    -n            Optionally specifies the largest number of subjects       */
+/*                  placed into one transaction.                              */
 /*                                                                            */
 /******************************************************************************/
 #define _XOPEN_SOURCE   1
@@ -59,12 +63,13 @@ usage()
 {
 	fprintf(stderr, 
 		"usage:\n\tfmr2an2k -i <m1file> -o <an2kfile>"
-		" [-f <imglist>] [-t <type2file] [-v]\n"
+		" [-f <imglist>] [-t <type2file] [-n <count>] [-v]\n"
 		"\t\t -i:  Specifies the M1 input file\n"
 		"\t\t -o:  Specifies the AN2K output file\n"
 		"\t\t -f:  Specifies a file containing the list of"
 		" fingerprint images\n"
 		"\t\t -t: Specifies the file containing Type-2 record info\n"
+		"\t\t -n: Specifies the most subjects in a transaction\n"
 		"\t\t -v: Verify the FMR file\n");
 }
 
@@ -111,15 +116,42 @@ convert_xy(unsigned short x_size, unsigned short y_size,
 }
 
 /******************************************************************************/
-/* Convert an angle (theta) value from FMR format to ANSI/NIST format.        */
+/* Convert the X-Y coordinates of all minutiae of a block in the same manner  */
+/* as convert_xy(), and their angles (theta) from FMR format to ANSI/NIST     */
+/* format. The scale factors are found once per block, and each field is      */
+/* converted in a separate loop over the block's arrays, which the compiler   */
+/* can vectorize.                                                             */
 /******************************************************************************/
 static void
-convert_theta(unsigned char fmr_theta, unsigned int *ansi_theta)
+convert_fmb(const FMB *fmb, unsigned short y_size, unsigned short x_res,
+	    unsigned short y_res, unsigned int *ansi_x, unsigned int *ansi_y,
+	    unsigned int *ansi_theta)
 {
+	float xfactor, yfactor, tsize;
+	unsigned int i;
+
+	if (x_res != 0) {
+		xfactor = (float)x_res / 1000;
+		for (i = 0; i < fmb->count; i++)
+			ansi_x[i] = (unsigned short)
+			    (((float)fmb->x_coord[i] / xfactor) + 0.5);
+	} else
+		memset(ansi_x, 0, fmb->count * sizeof(unsigned int));
+
+	if (y_res != 0) {
+		yfactor = (float)y_res / 1000;
+		tsize = (float)(y_size - 1) / yfactor;
+		for (i = 0; i < fmb->count; i++)
+			ansi_y[i] = (unsigned short)
+			    (tsize - ((float)fmb->y_coord[i] / yfactor));
+	} else
+		memset(ansi_y, 0, fmb->count * sizeof(unsigned int));
+
 	// FMR angles are in increments of 2, so 45 = 90 degrees.
 	// Also, FMR angles are formed in the opposite manner as AN2K, so
 	// flip the angle by 180 degrees.
-	*ansi_theta = (((unsigned int)fmr_theta * 2) + 180) % 360;
+	for (i = 0; i < fmb->count; i++)
+		ansi_theta[i] = (((unsigned int)fmb->angle[i] * 2) + 180) % 360;
 }
 
 /******************************************************************************/
@@ -156,13 +188,15 @@ convert_type(unsigned char fmr_type, char *ansi_type)
 /******************************************************************************/
 /* Create an ANSI/NIST Type-1 record with predefined values. The record will  */
 /* be allocated in this function, and must be freed by the caller.            */
-/* Only the mandatory fields are placed in the Type-1 record.                 */
+/* Only the mandatory fields are placed in the Type-1 record. The sequence    */
+/* number of the transaction in the output file is appended to the TCN of     */
+/* all transactions but the first.                                            */
 /* Returns:                                                                   */
 /*	 0 Success                                                            */
 /*	-1 Failure                                                            */
 /******************************************************************************/
 static int
-create_type1(RECORD **anrecord) 
+create_type1(RECORD **anrecord, unsigned int seq)
 {
 	ITEM *item = NULL;
 	SUBFIELD *subfield = NULL;
@@ -229,7 +263,10 @@ create_type1(RECORD **anrecord)
 	snprintf(buf, sizeof(buf), "%04d%02d%02d%02d%02d%02d",
 	    tm->tm_year+1900, tm->tm_mon+1, tm->tm_mday, tm->tm_hour, 
 	    tm->tm_min, tm->tm_sec);
-	
+	if (seq > 0)
+		snprintf(buf + strlen(buf), sizeof(buf) - strlen(buf),
+		    "%u", seq);
+
 	APPEND_TYPE1_FIELD(lrecord, 9, buf);
 
 	/*** 1.011 - Native scanning resolution ***/
@@ -331,9 +368,11 @@ err_out2:	// This exit point doesn't free any memory because the
 
 /******************************************************************************/
 /* Create an ANSI/NIST Type-2 record with text values taken from the input    */
-/* file given on the command line.                                            */
-/* Returns:                        
-                                           */
+/* file given on the command line. Each call takes the next block of lines    */
+/* from the file, blocks being separated by blank lines; when the blocks run  */
+/* out, the file is read again from the start, so a file with one block gives */
+/* every subject the same fields.                                             */
+/* Returns:                                                                   */
 /*	 0 Success                                                            */
 /*	-1 Failure                                                            */
 /******************************************************************************/
@@ -343,9 +382,11 @@ create_type2(RECORD **anrecord, FILE *fp, unsigned int idc)
 	FIELD *field = NULL;
 	SUBFIELD *subfield = NULL;
 	RECORD *lrecord;	// For local convenience
-	int field_num;
-	char buf[MAX_TYPE2_FIELD_SIZE + 1];
+	int field_num, fields, rewound;
+	char buf[16];
+	char line[MAX_TYPE2_LINE_SIZE];
 	char *s;
+	size_t len;
 
 	if (new_ANSI_NIST_record(anrecord, TYPE_2_ID) != 0) 
 		ALLOC_ERR_EXIT("Type-2 Record");
@@ -360,28 +401,40 @@ create_type2(RECORD **anrecord, FILE *fp, unsigned int idc)
 	snprintf(buf, sizeof(buf), IDC_FMT, idc);
 	APPEND_TYPE2_FIELD(lrecord, IDC_ID, buf);
 
+	fields = 0;
+	rewound = 0;
 	while (1) {
-		// Read the field number, followed by single whitespace char,
-		// followed by the string to place in the field.
-		if (fscanf(fp, "%d", &field_num) < 0) {
-			if (feof(fp)) {
+		if (fgets(line, sizeof(line), fp) == NULL) {
+			if (ferror(fp))
+				ERR_OUT("reading Type-2 info file");
+			if ((fields > 0) || rewound)
 				break;
-			} else {
-				ERR_OUT("reading Type-2 buf file.\n");
-			}
+			rewind(fp);
+			rewound = 1;
+			continue;
 		}
-		fgetc(fp);	// skip the single whitespace char
-		s = fgets(buf, MAX_TYPE2_FIELD_SIZE, fp);
-		buf[strlen(buf) - 1] = '\0';
-		if (s == NULL) {
-			if (feof(fp)) {
+		len = strlen(line);
+		if ((len > 0) && (line[len - 1] == '\n'))
+			line[--len] = '\0';
+		else if (!feof(fp))
+			ERR_OUT("Type-2 info line is too long");
+		if (strspn(line, " \t\r") == len) {
+			if (fields > 0)
 				break;
-			} else {
-				ERR_OUT("reading Type-2 buf file.\n");
-			}
+			continue;
 		}
+
+		// Read the field number, followed by single whitespace char,
+		// followed by the string to place in the field.
+		field_num = strtol(line, &s, 10);
+		if ((s == line) || (*s == '\0'))
+			ERR_OUT("Type-2 info line has no field data");
+		s++;		// skip the single whitespace char
+		if (strlen(s) > MAX_TYPE2_FIELD_SIZE)
+			ERR_OUT("Type-2 field %d is too long", field_num);
+
 		/*** 2.xxx - User-defined field   ***/
-		if (value2subfield(&subfield, buf) != 0)
+		if (value2subfield(&subfield, s) != 0)
 			ERR_OUT("creating new Type-2 subfield");
 		if (new_ANSI_NIST_field(&field, TYPE_2_ID, field_num) != 0)
 			ERR_OUT("creating new Type-2 field");
@@ -389,7 +442,7 @@ create_type2(RECORD **anrecord, FILE *fp, unsigned int idc)
 			ERR_OUT("appending Type-2 subfield");
 		if (append_ANSI_NIST_record(lrecord, field) != 0)
 			ERR_OUT("appending Type-2 field");
-
+		fields++;
 	}
 
 	// Calculate and update the record length field
@@ -417,14 +470,17 @@ create_type9(RECORD **anrecord, struct finger_view_minutiae_record *fvmr,
 	SUBFIELD *subfield = NULL;
 	ITEM *item = NULL;
 	RECORD *lrecord;	// For local convenience
-	struct finger_minutiae_data **fmds = NULL;
 	struct ridge_count_data **rcds = NULL;
-	struct core_data **cds;
-	struct delta_data **dds;
+	struct core_data **cds = NULL;
+	struct delta_data **dds = NULL;
+	FMB *fmb;
 	char buf[16];
 	int mincnt, minidx, rdgcnt;
 	int cnt, i;
 	unsigned int x, y; 
+	unsigned int xs[FMR_MAX_NUM_MINUTIAE];
+	unsigned int ys[FMR_MAX_NUM_MINUTIAE];
+	unsigned int thetas[FMR_MAX_NUM_MINUTIAE];
 
 	if (new_ANSI_NIST_record(anrecord, TYPE_9_ID) != 0) 
 		ALLOC_ERR_EXIT("Type-9 Record");
@@ -553,6 +609,9 @@ create_type9(RECORD **anrecord, struct finger_view_minutiae_record *fvmr,
 	if (mincnt < 0)
 		ERR_OUT("getting minutiae count");
 
+	if (mincnt > FMR_MAX_NUM_MINUTIAE)
+		ERR_OUT("Finger view has %d minutiae", mincnt);
+
 	snprintf(buf, sizeof(buf), "%d", mincnt);
 	APPEND_TYPE9_FIELD(lrecord, MIN_ID, buf);
 
@@ -574,19 +633,19 @@ create_type9(RECORD **anrecord, struct finger_view_minutiae_record *fvmr,
 		APPEND_TYPE9_FIELD(lrecord, RDG_ID, "0");
 
 	/*** 9.012 - Minutiae and ridge count data             ***/ 
-	fmds = (struct finger_minutiae_data **) malloc(
-		mincnt * sizeof(struct finger_minutiae_data **));
-	if (fmds == NULL)
-		ALLOC_ERR_EXIT("Finger Minutiae data");
-
-	if (get_fmds(fvmr, fmds) != mincnt)
-		ERR_OUT("retrieving minutiae data");
+	// The coordinates and angles of all minutiae are converted at once
+	// from the minutiae block, which holds the same values as the list.
+	fmb = get_fmb(fvmr);
+	if ((fmb == NULL) || (fmb->count != (unsigned int)mincnt))
+		ERR_OUT("retrieving minutiae block");
+	convert_fmb(fmb, fvmr->fmr->y_image_size, fvmr->fmr->x_resolution,
+	    fvmr->fmr->y_resolution, xs, ys, thetas);
 
 	if (new_ANSI_NIST_field(&field, TYPE_9_ID, MRC_ID) != 0)
 		ERR_OUT("creating Type-9 field");
 
 	for (minidx = 0; minidx < mincnt; minidx++) {
-		unsigned int theta, rdgidx, minqual;
+		unsigned int rdgidx, minqual;
 		char mintype;
 		int idxnum = minidx + 1;
 
@@ -596,19 +655,15 @@ create_type9(RECORD **anrecord, struct finger_view_minutiae_record *fvmr,
 			ERR_OUT("creating Type-9 subfield");
 
 		// X, Y, and theta values
-		convert_xy(fvmr->fmr->x_image_size, fvmr->fmr->y_image_size,
-			   fvmr->fmr->x_resolution, fvmr->fmr->y_resolution,
-			   fmds[minidx]->x_coord, fmds[minidx]->y_coord, 
-			   &x, &y);
-		convert_theta(fmds[minidx]->angle, &theta);
-		snprintf(buf, sizeof(buf), "%04u%04u%03u", x, y, theta);
+		snprintf(buf, sizeof(buf), "%04u%04u%03u", xs[minidx],
+		    ys[minidx], thetas[minidx]);
 		if (value2item(&item, buf) != 0)
 			ERR_OUT("creating Type-9 item");
 		if (append_ANSI_NIST_subfield(subfield, item) != 0)
 			ERR_OUT("appending Type-9 item");
 
 		// Quality measure
-		convert_quality(fmds[minidx]->quality, &minqual);
+		convert_quality(fmb->quality[minidx], &minqual);
 		snprintf(buf, sizeof(buf), "%u", minqual);
 		if (value2item(&item, buf) != 0)
 			ERR_OUT("creating Type-9 item");
@@ -616,7 +671,7 @@ create_type9(RECORD **anrecord, struct finger_view_minutiae_record *fvmr,
 			ERR_OUT("appending Type-9 item");
 
 		// Minutia type designation
-		convert_type(fmds[minidx]->type, &mintype);
+		convert_type(fmb->type[minidx], &mintype);
 		snprintf(buf, sizeof(buf), "%c", mintype);
 		if (value2item(&item, buf) != 0)
 			ERR_OUT("creating Type-9 item");
@@ -646,7 +701,6 @@ create_type9(RECORD **anrecord, struct finger_view_minutiae_record *fvmr,
 		if (append_ANSI_NIST_field(field, subfield) != 0)
 			ERR_OUT("appending Type-9 subfield");
 	}
-	free(fmds);
 	if (append_ANSI_NIST_record(lrecord, field) != 0)
 		ERR_OUT("appending Type-9 field");
 	/*** End of minutiae and ridge count                 */
@@ -655,6 +709,12 @@ create_type9(RECORD **anrecord, struct finger_view_minutiae_record *fvmr,
 	if (update_ANSI_NIST_tagged_record_LEN(lrecord) != 0)
 		ERR_OUT("updating Type-9 record length");
 
+	// Records are created for each finger view of a batch, so the
+	// arrays of pointers are not left behind
+	free(cds);
+	free(dds);
+	free(rcds);
+
 	return 0;
 
 err_out:
@@ -667,8 +727,12 @@ err_out:
 		free_ANSI_NIST_field(field);
 	if (lrecord != NULL)
 		free_ANSI_NIST_record(lrecord);
-	if (fmds != NULL)
-		free(fmds);
+	if (cds != NULL)
+		free(cds);
+	if (dds != NULL)
+		free(dds);
+	if (rcds != NULL)
+		free(rcds);
 
 	return -1;
 }
@@ -717,7 +781,10 @@ err_out:
 }
 
 /* Global option indicators */
-int i_opt, o_opt, f_opt, v_opt, t_opt;
+int i_opt, o_opt, f_opt, v_opt, t_opt, n_opt;
+
+/* The most subjects in a transaction, when n_opt is set */
+int max_subjects;
 
 /* Global file pointers */
 FILE *fmr_fp = NULL;	// the FMR (378-2004) input file
@@ -752,8 +819,8 @@ get_options(int argc, char *argv[])
 	char ch;
 	struct stat sb;
 
-	i_opt = o_opt = f_opt = v_opt = t_opt = 0;
-	while ((ch = getopt(argc, argv, "i:o:f:t:v")) != -1) {
+	i_opt = o_opt = f_opt = v_opt = t_opt = n_opt = 0;
+	while ((ch = getopt(argc, argv, "i:o:f:t:n:v")) != -1) {
 		switch (ch) {
 		    case 'v':
 			v_opt = 1;
@@ -788,6 +855,15 @@ get_options(int argc, char *argv[])
 			t_opt = 1;
 			break;
 
+		    case 'n':
+			max_subjects = (int)strtol(optarg, NULL, 10);
+			if (max_subjects < 1) {
+				usage();
+				goto err_out;
+			}
+			n_opt = 1;
+			break;
+
 		    case '?':
 		    default:
 			usage();
@@ -806,109 +882,206 @@ err_out:
 	exit(EXIT_FAILURE);
 }
 
-int
-main(int argc, char *argv[])
+/******************************************************************************/
+/* Write one ANSI/NIST record to the output file, and free it.                */
+/******************************************************************************/
+static int
+write_record(RECORD *anrecord)
 {
-	struct finger_minutiae_record *fmr = NULL;
-	struct finger_view_minutiae_record **fvmrs = NULL;
+	int ret;
+
+	ret = write_ANSI_NIST_record(an2k_fp, anrecord);
+	free_ANSI_NIST_record(anrecord);
+	if (ret != 0)
+		WRITE_ERR_OUT("ANSI/NIST record");
+	return 0;
+
+err_out:
+	return -1;
+}
 
-	ANSI_NIST *ansi_nist;
+/******************************************************************************/
+/* Write the transaction for a batch of subjects, one FMR each. The Type-1    */
+/* record must list every record of the transaction, so it is built first    */
+/* from the finger view counts and written on its own. The Type-2 record of   */
+/* each subject takes the IDC of its first finger view, and the Type-9 and    */
+/* Type-13 records of the views follow, one IDC per view. Each record is      */
+/* written and freed as soon as it is created, so at most one of them is in   */
+/* memory at a time.                                                          */
+/* Returns:                                                                   */
+/*	 0 Success                                                            */
+/*	-1 Failure                                                            */
+/******************************************************************************/
+static int
+write_transaction(struct finger_minutiae_record **fmrs, int nfmrs,
+    unsigned int seq)
+{
+	struct finger_view_minutiae_record *fvmrs[MAX_TRANSACTION_VIEWS];
+	ANSI_NIST *ansi_nist = NULL;
 	RECORD *anrecord;
 	RECORD *type1;
-
-	int rcount, i;
 	unsigned int idc;
+	int rcount, s, i;
 
-	get_options(argc, argv);
-
-	// Allocate the FMR record in memory
-	if (new_fmr(FMR_STD_ANSI, &fmr) < 0)
-		ALLOC_ERR_EXIT("FMR");
-
-	// Read the FMR
-	if (read_fmr(fmr_fp, fmr) != READ_OK) {
-		fprintf(stderr, "Could not read FMR from file.\n");
-		exit(EXIT_FAILURE);
-	}
-
-	if (v_opt) {
-		if (validate_fmr(fmr) != VALIDATE_OK) {
-		    fprintf(stdout, "Finger Minutiae Record is NOT valid.\n");
-		    exit(EXIT_FAILURE);
-		} else {
-		    fprintf(stdout, "Finger Minutiae Record is valid.\n");
-		}
-	}
-
-	// Create the ANSI/NIST block
+	// Create the ANSI/NIST block, holding the Type-1 record only
 	if (alloc_ANSI_NIST(&ansi_nist) != 0) 
 		ALLOC_ERR_EXIT("ANSI/NIST Block");
 
-	// Create and add the Type-1 record
-	create_type1(&type1);
+	if (create_type1(&type1, seq) != 0)
+		ERR_OUT("creating Type-1 record");
 	if (update_ANSI_NIST(ansi_nist, type1) != 0) 
 		ERR_OUT("inserting Type-1 Record");
 
-	// Create and add the Type-2 record, with IDC 0, if asked for
-	if (t_opt) {
-		create_type2(&anrecord, text_fp, 0);
-		if (update_type1(ansi_nist, type1, TYPE_2_ID, 0) != 0)
-			ERR_OUT("updating Type-1 record");
-		if (update_ANSI_NIST(ansi_nist, anrecord) != 0) 
-			ERR_OUT("inserting Type-9 record");
+	idc = 0;
+	for (s = 0; s < nfmrs; s++) {
+		rcount = get_fvmr_count(fmrs[s]);
+		if (t_opt)
+			if (update_type1(ansi_nist, type1, TYPE_2_ID, idc) != 0)
+				ERR_OUT("updating Type-1 record");
+		for (i = 0; i < rcount; i++, idc++) {
+			if (update_type1(ansi_nist, type1, TYPE_9_ID, idc) != 0)
+				ERR_OUT("updating Type-1 record");
+			if (f_opt)
+			    if (update_type1(ansi_nist, type1, TYPE_13_ID,
+				idc) != 0)
+				ERR_OUT("updating Type-1 record");
+		}
 	}
 
-	// Create the Type-9 records
-	rcount = get_fvmr_count(fmr);
+	if (write_ANSI_NIST(an2k_fp, ansi_nist) != 0) 
+		WRITE_ERR_OUT("ANSI/NIST Type-1 record");
+	free_ANSI_NIST(ansi_nist);
+	ansi_nist = NULL;
+
 	idc = 0;
-	if (rcount > 0) {
-		fvmrs = (struct finger_view_minutiae_record **) malloc(
-		    rcount * sizeof(struct finger_view_minutiae_record **));
-		if (fvmrs == NULL)
-			ALLOC_ERR_EXIT("FVMR Array");
-		if (get_fvmrs(fmr, fvmrs) != rcount)
+	for (s = 0; s < nfmrs; s++) {
+		rcount = get_fvmr_count(fmrs[s]);
+		if (get_fvmrs(fmrs[s], fvmrs) != rcount)
 			ERR_OUT("getting FVMRs from FMR");
 
-		// Create and add the Type-9 record
-		for (i = 0; i < rcount; i++) {
+		// Create and write the Type-2 record, if asked for
+		if (t_opt) {
+			if (create_type2(&anrecord, text_fp, idc) != 0)
+				ERR_OUT("creating Type-2 record");
+			if (write_record(anrecord) != 0)
+				goto err_out;
+		}
+
+		// Create and write the Type-9 and Type-13 records
+		for (i = 0; i < rcount; i++, idc++) {
 			if (create_type9(&anrecord, fvmrs[i], idc) != 0)
 				ERR_OUT("creating Type-9 record");
-			if (update_type1(ansi_nist, type1, TYPE_9_ID, idc) != 0)
-				ERR_OUT("updating Type-1 record");
-			if (update_ANSI_NIST(ansi_nist, anrecord) != 0) 
-				ERR_OUT("inserting Type-9 record");
+			if (write_record(anrecord) != 0)
+				goto err_out;
 			if (f_opt) {	// images
 			    if (create_type13(&anrecord, fvmrs[i], 
 						img_fp, idc) != 0)
-				ERR_OUT("creating Type-3 record");
-			    if (update_type1(ansi_nist, type1, TYPE_13_ID, 
-				    idc) != 0)
-				ERR_OUT("updating Type-1 record");
-			    if (update_ANSI_NIST(ansi_nist, anrecord) != 0) 
-				ERR_OUT("inserting Type-9 record");
+				ERR_OUT("creating Type-13 record");
+			    if (write_record(anrecord) != 0)
+				goto err_out;
 			}
-			idc++;
 		}
-		free(fvmrs);
-	} else {
-		if (rcount == 0)
-			fprintf(stderr, "Warning: 0 FVMRs in the FMR\n");
-		else {
+	}
+	return 0;
+
+err_out:
+	if (ansi_nist != NULL)
+		free_ANSI_NIST(ansi_nist);
+	return -1;
+}
+
+int
+main(int argc, char *argv[])
+{
+	struct finger_minutiae_record *fmrs[MAX_TRANSACTION_VIEWS];
+	struct finger_minutiae_record *fmr = NULL;
+	int nfmrs, nviews, nread, rcount, ret, i;
+	unsigned int seq;
+	long start;
+
+	get_options(argc, argv);
+
+	// Subjects are gathered until the next one would not fit into the
+	// transaction; only their FMRs are kept, the ANSI/NIST records
+	// being created as the transaction is written.
+	nfmrs = nviews = nread = 0;
+	seq = 0;
+	while (1) {
+		// Allocate the FMR record in memory
+		if (new_fmr(FMR_STD_ANSI, &fmr) < 0)
+			ALLOC_ERR_EXIT("FMR");
+
+		// Read the FMR; only the end of the input before the first
+		// octet of a record ends the input, any other EOF leaves a
+		// partial record behind
+		start = ftell(fmr_fp);
+		ret = read_fmr(fmr_fp, fmr);
+		if ((ret == READ_EOF) && (ftell(fmr_fp) == start))
+			break;
+		if (ret == READ_EOF) {
+			fprintf(stderr, "Input ends with a partial FMR after "
+			    "%d records.\n", nread);
+			goto err_out;
+		}
+		if (ret != READ_OK) {
+			fprintf(stderr, "Could not read FMR from file.\n");
+			goto err_out;
+		}
+		nread++;
+
+		if (v_opt) {
+			if (validate_fmr(fmr) != VALIDATE_OK) {
+			    fprintf(stdout,
+				"Finger Minutiae Record is NOT valid.\n");
+			    goto err_out;
+			} else {
+			    fprintf(stdout,
+				"Finger Minutiae Record is valid.\n");
+			}
+		}
+
+		rcount = get_fvmr_count(fmr);
+		if (rcount < 0) {
 			fprintf(stderr, "Error retrieving FVMRs from FMR.\n");
-			exit (EXIT_FAILURE);
+			goto err_out;
+		}
+		if (rcount == 0) {
+			fprintf(stderr, "Warning: 0 FVMRs in the FMR\n");
+			free_fmr(fmr);
+			continue;
+		}
+		if (rcount > MAX_TRANSACTION_VIEWS) {
+			fprintf(stderr, "FMR has %d FVMRs; at most %d fit "
+			    "into a transaction.\n", rcount,
+			    MAX_TRANSACTION_VIEWS);
+			goto err_out;
 		}
-	}
 
-	// Free the entire FMR
+		if ((nviews + rcount > MAX_TRANSACTION_VIEWS) ||
+		    (n_opt && (nfmrs == max_subjects))) {
+			if (write_transaction(fmrs, nfmrs, seq++) != 0)
+				goto err_out;
+			for (i = 0; i < nfmrs; i++)
+				free_fmr(fmrs[i]);
+			nfmrs = nviews = 0;
+		}
+		fmrs[nfmrs++] = fmr;
+		nviews += rcount;
+	}
 	free_fmr(fmr);
+	fmr = NULL;
+	if (nread == 0) {
+		fprintf(stderr, "Could not read FMR from file.\n");
+		goto err_out;
+	}
 
-	// Write out the new ANSI/NIST record
-	if (write_ANSI_NIST(an2k_fp, ansi_nist) != 0) 
-		WRITE_ERR_OUT("ANSI/NIST File");
-
-	// Convert the FMR to a Type 9 record`
-	// Free the entire ANSI/NIST block
-	free_ANSI_NIST(ansi_nist);
+	// The last transaction; an input without finger views still
+	// gives a transaction holding the Type-1 record
+	if ((nfmrs > 0) || (seq == 0))
+		if (write_transaction(fmrs, nfmrs, seq) != 0)
+			goto err_out;
+	for (i = 0; i < nfmrs; i++)
+		free_fmr(fmrs[i]);
 
 	close_files();
 
@@ -917,9 +1090,8 @@ main(int argc, char *argv[])
 err_out:
 	if (fmr != NULL)
 		free_fmr(fmr);
-
-	if (fvmrs != NULL)
-		free(fvmrs);
+	for (i = 0; i < nfmrs; i++)
+		free_fmr(fmrs[i]);
 
 	close_files();
 
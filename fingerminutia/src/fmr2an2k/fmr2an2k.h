@@ -45,3 +45,11 @@
 // ELECTRONIC FINGERPRINT TRANSMISSION SPECIFICATION (CJIS-RS-0010),
 // January 1999.
 #define MAX_TYPE2_FIELD_SIZE	120
+
+// Longest line of the Type-2 info file: the field number, the separator,
+// the field data, and the newline.
+#define MAX_TYPE2_LINE_SIZE	(MAX_TYPE2_FIELD_SIZE + 16)
+
+// The IDC of a record is two digits, so a transaction holds the Type-9
+// records of at most this many finger views.
+#define MAX_TRANSACTION_VIEWS	100
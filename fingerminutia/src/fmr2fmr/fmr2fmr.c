@@ -8,17 +8,18 @@
  * about its quality, reliability, or any other characteristic.
  */
 /******************************************************************************/
-/* This program will transform a finger minutia record in one format to       */
+/* This program will transform finger minutia records in one format to       */
 /* another, ANSI to ISO compact for for example. The type of input and        */
 /* output files are given on the command line.                                */
 /******************************************************************************/
 
 /* Needed by the GNU C libraries for Posix and other extensions */
-#define _XOPEN_SOURCE	1
+#define _XOPEN_SOURCE	500
 
 #include <errno.h>
 #include <fcntl.h>
 #include <math.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdint.h>
 #include <stdlib.h>
@@ -27,8 +28,10 @@
 #include <unistd.h>
 #include <sys/queue.h>
 #include <sys/stat.h>
+#include <sys/time.h>
 #include <sys/types.h>
 
+#include <biomdi.h>
 #include <biomdimacro.h>
 #include <fmr.h>
 #include <fmr2fmr.h>
@@ -42,14 +45,16 @@ usage()
 	fprintf(stderr, 
 	    "usage:\n"
 	    "\tfmr2fmr -i <infile> -ti <type> -o <outfile> -to <type>\n"
-	    "\t\t[-rx <res> -ry <res>]\n"
+	    "\t\t[-rx <res> -ry <res>] [-n <threads>] [-v]\n"
 	    "\twhere:\n"
-	    "\t   -i:  Specifies the input FMR file\n"
-	    "\t   -ti: Specifies the input file type\n"
-	    "\t   -o:  Specifies the output FMR file\n"
+	    "\t   -i:  Specifies the input FMR file, or - for stdin\n"
+	    "\t   -ti: Specifies the input file type, or auto\n"
+	    "\t   -o:  Specifies the output FMR file, or - for stdout\n"
 	    "\t   -to: Specifies the output file type\n"
 	    "\t   -rx: Specifies the X resolution for ISO card formats\n"
 	    "\t   -ry: Specifies the Y resolution for ISO card formats\n"
+	    "\t   -n:  Specifies the number of conversion threads\n"
+	    "\t   -v:  Print the conversion rate\n"
 	    "\t   <type> is one of ISO | ISONC | ISOCC | ANSI | ANSI07\n");
 }
 
@@ -58,9 +63,14 @@ static FILE *in_fp;	// the FMR input file
 static FILE *out_fp;	// for the output file
 static char *out_file;
 
+#define STD_AUTO	0	// Input type found from the record header
+
 static int in_type;	// Standard type of the input file
 static int out_type;	// Standard type of the output file
 static unsigned short iso_xres, iso_yres;	// X/Y resolution for ISO NC/CC
+#define MAX_THREADS	256
+static int threads = 1;	// Number of conversion threads
+static int v_opt;	// Print the conversion rate
 
 /******************************************************************************/
 /* Close all open files.                                                      */
@@ -93,6 +103,8 @@ stdstr_to_type(char *stdstr)
 		return (FMR_STD_ISO_NORMAL_CARD);
 	if (strcmp(stdstr, "ISOCC") == 0)
 		return (FMR_STD_ISO_COMPACT_CARD);
+	if (strcmp(stdstr, "auto") == 0)
+		return (STD_AUTO);
 	return (-1);
 }
 
@@ -109,20 +121,39 @@ get_options(int argc, char *argv[])
 	struct stat sb;
 
 	i_opt = o_opt = ti_opt = to_opt = rx_opt = ry_opt = 0;
-	while ((ch = getopt(argc, argv, "i:o:t:r:")) != -1) {
+	while ((ch = getopt(argc, argv, "i:n:o:t:r:v")) != -1) {
 		/* Make sure we don't fall off the end of argv */
 		if (optind > argc)
 			goto err_usage_out;
 		switch (ch) {
 		    case 'i':
-			if ((in_fp = fopen(optarg, "rb")) == NULL)
+			if (i_opt == 1)
+				goto err_usage_out;
+			if (strcmp(optarg, "-") == 0)
+				in_fp = stdin;
+			else if ((in_fp = fopen(optarg, "rb")) == NULL)
 				OPEN_ERR_EXIT(optarg);
 			i_opt++;
 			break;
 
+		    case 'n':
+			threads = (int)strtol(optarg, NULL, 10);
+			if ((threads < 1) || (threads > MAX_THREADS))
+				goto err_usage_out;
+			break;
+
+		    case 'v':
+			v_opt = 1;
+			break;
+
 		    case 'o':
 			if (o_opt == 1)
 				goto err_usage_out;
+			o_opt++;
+			if (strcmp(optarg, "-") == 0) {
+				out_fp = stdout;
+				break;
+			}
 			if (stat(optarg, &sb) == 0) {
 		    	    ERR_OUT(
 				"File '%s' exists, remove it first.", optarg);
@@ -130,7 +161,6 @@ get_options(int argc, char *argv[])
 			if ((out_fp = fopen(optarg, "wb")) == NULL)
 				OPEN_ERR_EXIT(optarg);
 			out_file = optarg;
-			o_opt++;
 			break;
 				
 		    case 't':
@@ -147,7 +177,7 @@ get_options(int argc, char *argv[])
 				break;
 			    case 'o':
 				out_type = stdstr_to_type(argv[optind]);
-				if (out_type < 0)
+				if ((out_type < 0) || (out_type == STD_AUTO))
 					goto err_usage_out;
 				optind++;
 				to_opt++;
@@ -200,279 +230,390 @@ err_out:
 	close_files();
 
 	/* If we created the output file, remove it. */
-	if (o_opt == 1)
+	if (out_file != NULL)
 		(void)unlink(out_file);
 	exit(EXIT_FAILURE);
 }
 
-/*
- * Copy an FMR without any conversion. This procedure goes through the process
- * of reading the FMR and copying it using the FMR library. The reason for
- * this is to verify that the FMR is valid.
- */
-static int
-copy_without_conversion(FMR *ifmr, FMR *ofmr, int fmr_type)
-{
-	FVMR *ofvmr;
-	FVMR **ifvmrs = NULL;
-	FMD **ifmds = NULL;
-	FMD *ofmd;
-	int r, rcount, m, mcount;
-	int retval;
-
-	retval = -1;			/* Assume failure, for now */
-
-	COPY_FMR(ifmr, ofmr);
-
-	/* Get all of the finger view records */
-	rcount = get_fvmr_count(ifmr);
-	if (rcount > 0) {
-		ifvmrs = (FVMR **) malloc(rcount * sizeof(FVMR *));
-		if (ifvmrs == NULL)
-			ALLOC_ERR_OUT("FVMR Array");
-		if (get_fvmrs(ifmr, ifvmrs) != rcount)
-			ERR_OUT("getting FVMRs from FMR");
-
-		for (r = 0; r < rcount; r++) {
-			if (new_fvmr(fmr_type, &ofvmr) < 0)
-	                        ALLOC_ERR_RETURN("Output FVMR");
-
-			COPY_FVMR(ifvmrs[r], ofvmr);
-			mcount = get_fmd_count(ifvmrs[r]);
-			if (mcount != 0) {
-				ifmds = (FMD **)malloc(mcount * sizeof(FMD *));
-				if (ifmds == NULL)
-					ALLOC_ERR_RETURN("FMD array");
-				if (get_fmds(ifvmrs[r], ifmds) != mcount)
-					ERR_OUT("getting FMDs from FVMR");
-
-				for (m = 0; m < mcount; m++) {
-					if (new_fmd(FMR_STD_ISO, &ofmd, m) != 0)
-						ALLOC_ERR_RETURN("Output FMD");
-					COPY_FMD(ifmds[m], ofmd);
-					add_fmd_to_fvmr(ofmd, ofvmr);
-				}
-			}
-
-			/* Subtract off the length of the extended data block,
-			 * if present, because we don't copy extended data yet.
-			 */
-			if (ifvmrs[r]->extended != NULL) {
-				ofmr->record_length -=
-				    ifvmrs[r]->extended->block_length;
-				
-			}
-			add_fvmr_to_fmr(ofvmr, ofmr);
-			// XXX Copy the FEDB to the output fmr
-		}
-
-	} else {
-		if (rcount == 0)
-			ERR_OUT("there are no FVMRs in the input FMR");
-		else
-			ERR_OUT("retrieving FVMRs from input FMR");
-	}
-	retval = 0;
-
-err_out:
-	if (ifvmrs != NULL)
-		free (ifvmrs);
-	if (ifmds != NULL)
-		free (ifmds);
-	return (retval);
-}
+/******************************************************************************/
+/* The input is read in blocks of whole records by a reader thread, into a    */
+/* ring of blocks. Each block is converted into its own output buffer by one  */
+/* of the conversion threads, and the main thread writes the blocks in the    */
+/* order they were read. Memory use depends only on the number of blocks,     */
+/* their size, and the largest record. A record that is cut off by the end of */
+/* a block is carried over to the start of the next block.                    */
+/******************************************************************************/
+#define INPUT_BLOCK_SIZE	(1024 * 1024)
+#define BLOCKS_PER_THREAD	2
+
+#define BLOCK_EMPTY		0
+#define BLOCK_FILLED		1
+#define BLOCK_CONVERTING	2
+#define BLOCK_CONVERTED		3
+
+struct input_block {
+	uint8_t		*buf;
+	size_t		size;		// Allocated size
+	size_t		length;		// Octets of complete records
+	size_t		trailing;	// Octets following the records
+	uint64_t	first;		// Records before this block
+	uint64_t	records;
+	int		eof;		// Last block of the input
+	int		error;
+	int		state;		// BLOCK_*
+	BDB		odb;		// The converted records
+};
+
+struct pipeline {
+	FILE			*fp;
+	int			std;		// Input type
+	FMR_TRANSCODER		fmrt;
+	struct input_block	*blocks;
+	int			count;		// Blocks in the ring
+	uint64_t		next;		// Next block to convert
+	uint64_t		last;		// Last block, once read
+	int			last_known;
+	int			stop;		// Conversion failed
+	pthread_mutex_t		lock;
+	pthread_cond_t		cond;
+};
 
-/*
- * Copy an FMR with conversion.
- */
+/******************************************************************************/
+/* Get the length of the record at 'ptr' from its header. Return -1 if the    */
+/* header is not complete within 'avail' octets, or the input type has no     */
+/* header; the record in an ISO card format is the entire input.              */
+/******************************************************************************/
 static int
-copy_with_conversion(FMR *ifmr, FMR *ofmr, int in_type, int out_type)
+input_record_length(int std, const uint8_t *ptr, size_t avail, uint64_t *len)
 {
-	FVMR *ofvmr;
-	FVMR **ifvmrs = NULL;
-	int r, rcount;
-	unsigned int fmr_len, fvmr_len;
-	int rc, retval;
-	char *ver;
-
-	retval = -1;			/* Assume failure, for now */
-
-	if (in_type == out_type)
+	/* The record length follows the format identifier and version */
+	if (avail < FMR_FORMAT_ID_LEN + FMR_SPEC_VERSION_LEN)
 		return (-1);
-
-	COPY_FMR(ifmr, ofmr);
-	switch (out_type) {
+	ptr += FMR_FORMAT_ID_LEN + FMR_SPEC_VERSION_LEN;
+	avail -= FMR_FORMAT_ID_LEN + FMR_SPEC_VERSION_LEN;
+	switch (std) {
 	case FMR_STD_ANSI:
-		fmr_len = FMR_ANSI_SMALL_HEADER_LENGTH;
-		ver = FMR_ANSI_SPEC_VERSION;
-		break;
-	case FMR_STD_ANSI07:
-		fmr_len = FMR_ANSI07_HEADER_LENGTH;
-		ver = FMR_ANSI07_SPEC_VERSION;
-		break;
+		if (avail < 2)
+			return (-1);
+		*len = ((uint64_t)ptr[0] << 8) | ptr[1];
+		if (*len != 0)
+			return (0);
+		ptr += 2;
+		avail -= 2;
+		/* FALLTHROUGH */
 	case FMR_STD_ISO:
-		fmr_len = FMR_ISO_HEADER_LENGTH;
-		ver = FMR_ISO_SPEC_VERSION;
-		break;
+	case FMR_STD_ANSI07:
+		if (avail < 4)
+			return (-1);
+		*len = ((uint64_t)ptr[0] << 24) | ((uint64_t)ptr[1] << 16) |
+		    ((uint64_t)ptr[2] << 8) | ptr[3];
+		return (0);
+	default:
+		return (-1);
 	}
+}
 
-	/* Fix up the output FMR header for those input types that don't
-	 * have all the needed information.
-	 */
-	
-	if ((out_type == FMR_STD_ANSI) || (out_type == FMR_STD_ISO) ||
-	    (out_type == FMR_STD_ANSI07))
-		if ((in_type == FMR_STD_ISO_NORMAL_CARD) ||
-		    (in_type == FMR_STD_ISO_COMPACT_CARD)) {
-			strncpy(ofmr->format_id, FMR_FORMAT_ID,
-			    FMR_FORMAT_ID_LEN);
-			strncpy(ofmr->spec_version, ver,
-			    FMR_SPEC_VERSION_LEN);
+/******************************************************************************/
+/* Fill a block with the octets carried over from the previous block, if any, */
+/* and as many whole records as fit. The block is grown when it cannot hold   */
+/* even one record.                                                           */
+/******************************************************************************/
+static int
+fill_block(struct pipeline *pl, struct input_block *b,
+    const struct input_block *prev)
+{
+	BIOMDI_FORMAT fmt;
+	BDB bdb;
+	uint64_t reclen;
+	size_t have, n;
+	uint8_t *buf;
+
+	b->first = b->records = 0;
+	b->eof = b->error = FALSE;
+	have = 0;
+	if (prev != NULL) {
+		b->first = prev->first + prev->records;
+		have = prev->trailing;
+		if (have > b->size) {
+			buf = (uint8_t *)realloc(b->buf, prev->size);
+			if (buf == NULL)
+				ALLOC_ERR_OUT("Input block");
+			b->buf = buf;
+			b->size = prev->size;
 		}
-
-	/* Get all of the finger view records */
-	rcount = get_fvmr_count(ifmr);
-	if (rcount > 0) {
-		ifvmrs = (FVMR **) malloc(rcount * sizeof(FVMR *));
-		if (ifvmrs == NULL)
-			ALLOC_ERR_OUT("FVMR Array");
-		if (get_fvmrs(ifmr, ifvmrs) != rcount)
-			ERR_OUT("getting FVMRs from FMR");
-
-		for (r = 0; r < rcount; r++) {
-			if (new_fvmr(out_type, &ofvmr) < 0)
-	                        ALLOC_ERR_RETURN("Output FVMR");
-
-			rc = -1;
-			switch (in_type) {
-			    case FMR_STD_ANSI07:
-				/* The coord and resolution info is stored
-				 * in the FVMR; copy it to the FMR header,
-				 * using the first FVMR as the canonical set.
-				 */
-				ofmr->x_image_size = ifvmrs[0]->x_image_size;
-				ofmr->y_image_size = ifvmrs[0]->y_image_size;
-				ofmr->x_resolution = ifvmrs[0]->x_resolution;
-				ofmr->y_resolution = ifvmrs[0]->y_resolution;
-			    case FMR_STD_ANSI:
-				switch (out_type) {
-				case FMR_STD_ISO:
-				case FMR_STD_ISO_NORMAL_CARD:
-					rc = ansi2iso_fvmr(ifvmrs[r], ofvmr,
-					    &fvmr_len, ifmr->x_resolution,
-					    ifmr->y_resolution);
-					break;
-				case FMR_STD_ISO_COMPACT_CARD:
-					rc = ansi2isocc_fvmr(ifvmrs[r], ofvmr,
-					    &fvmr_len, ifmr->x_resolution,
-					    ifmr->y_resolution);
-					break;
-				default:
-					ERR_OUT("Invalid output type");
-				}
-				break;
-
-			    /* XXX Eventually handle ISO->ISO conversions */
-			    case FMR_STD_ISO:
-				/* For ANSI07, the coord and resolution info
-				 * is copied by iso2ansi_fvmr().
-				 */
-			    case FMR_STD_ISO_NORMAL_CARD:
-				rc = iso2ansi_fvmr(ifvmrs[r], ofvmr, &fvmr_len,
-				    ifmr->x_resolution, ifmr->y_resolution);
+		memcpy(b->buf, prev->buf + prev->length, have);
+	}
+	b->length = 0;
+	for (;;) {
+		if (have == b->size) {
+			if (b->length != 0)
 				break;
-			    case FMR_STD_ISO_COMPACT_CARD:
-				rc = isocc2ansi_fvmr(ifvmrs[r], ofvmr,
-				    &fvmr_len, ifmr->x_resolution,
-				    ifmr->y_resolution);
+			buf = (uint8_t *)realloc(b->buf, b->size * 2);
+			if (buf == NULL)
+				ALLOC_ERR_OUT("Input block");
+			b->buf = buf;
+			b->size *= 2;
+		}
+		n = fread(b->buf + have, 1, b->size - have, pl->fp);
+		if ((n == 0) && ferror(pl->fp))
+			ERR_OUT("Could not read input");
+
+		/* Find the input type from the first record */
+		if ((pl->std == STD_AUTO) && ((n == 0) ||
+		    (have + n >= BIOMDI_SNIFF_LENGTH))) {
+			INIT_BDB(&bdb, b->buf, have + n);
+			if ((sniff_biomdi_record(&bdb, &fmt) != 0) ||
+			    (fmt.modality != BIOMDI_MODALITY_FINGER_MINUTIAE) ||
+			    (fmt.format_std == BIOMDI_STD_UNKNOWN))
+				ERR_OUT("Could not determine the input type");
+			pl->std = fmt.format_std;
+		}
+		have += n;
+		if (n == 0) {
+			b->eof = TRUE;
+			break;
+		}
+		while (input_record_length(pl->std, b->buf + b->length,
+		    have - b->length, &reclen) == 0) {
+			if (reclen < FMR_ANSI07_HEADER_LENGTH)
+				ERR_OUT("Invalid record length %llu",
+				    (unsigned long long)reclen);
+			if (b->length + reclen > have)
 				break;
-			}
-			if (rc != 0)
-				ERR_OUT("Modifying FVMR");
+			b->length += reclen;
+			b->records++;
+		}
+	}
+	if (b->eof && (have != 0) && ((pl->std == FMR_STD_ISO_NORMAL_CARD) ||
+	    (pl->std == FMR_STD_ISO_COMPACT_CARD))) {
+		b->length = have;
+		b->records = 1;
+	}
+	b->trailing = have - b->length;
+	return (0);
 
-			fmr_len += fvmr_len;
-			// XXX Copy the FEDB to the output fmr
-			ofvmr->extended = NULL;
-			add_fvmr_to_fmr(ofvmr, ofmr);
+err_out:
+	return (-1);
+}
 
-			fmr_len += FEDB_HEADER_LENGTH;
+static void *
+reader_thread(void *arg)
+{
+	struct pipeline *pl = (struct pipeline *)arg;
+	struct input_block *b, *prev;
+	uint64_t seq;
+	int ret, stop;
+
+	prev = NULL;
+	for (seq = 0; ; seq++) {
+		b = &pl->blocks[seq % pl->count];
+		pthread_mutex_lock(&pl->lock);
+		while ((b->state != BLOCK_EMPTY) && !pl->stop)
+			pthread_cond_wait(&pl->cond, &pl->lock);
+		stop = pl->stop;
+		pthread_mutex_unlock(&pl->lock);
+		if (stop)
+			break;
+
+		/* The input type is known once the first block is read */
+		ret = fill_block(pl, b, prev);
+		if ((ret == 0) && (seq == 0))
+			ret = init_fmr_transcoder(&pl->fmrt, pl->std, out_type,
+			    iso_xres, iso_yres);
+
+		pthread_mutex_lock(&pl->lock);
+		if (ret != 0)
+			b->error = b->eof = TRUE;
+		if (b->eof) {
+			pl->last = seq;
+			pl->last_known = TRUE;
 		}
+		b->state = BLOCK_FILLED;
+		pthread_cond_broadcast(&pl->cond);
+		pthread_mutex_unlock(&pl->lock);
+		if (b->eof)
+			break;
+		prev = b;
+	}
+	return (NULL);
+}
 
-	} else {
-		if (rcount == 0)
-			ERR_OUT("there are no FVMRs in the input FMR");
-		else
-			ERR_OUT("retrieving FVMRs from input FMR");
+/******************************************************************************/
+/* Convert the records of a block into its output buffer. As when a single    */
+/* record was read, the content of the only record in the input may run past  */
+/* the length given in its header; otherwise, octets following the last       */
+/* record are an error.                                                       */
+/******************************************************************************/
+static int
+convert_block(const FMR_TRANSCODER *fmrt, struct input_block *b)
+{
+	FMR_VIEW fmrv;
+	BDB idb;
+	uint64_t n;
+	int only;
+
+	only = (b->first == 0) && b->eof && (b->records == 1);
+	if (b->eof && (b->trailing != 0) && !only)
+		ERR_OUT("Input ends with a partial record of %lu octets",
+		    (unsigned long)b->trailing);
+
+	REWIND_BDB(&b->odb);
+	INIT_BDB(&idb, b->buf, b->length);
+	for (n = b->first + 1; n <= b->first + b->records; n++) {
+		if (fmr_view_init(&idb, fmrt->in_std, &fmrv) != READ_OK)
+			ERR_OUT("Could not read FMR %llu", (unsigned long long)n);
+		if (only)
+			fmrv.end = b->buf + b->length + b->trailing;
+		if (transcode_fmr(fmrt, &fmrv, &b->odb) != WRITE_OK)
+			ERR_OUT("Could not convert FMR %llu",
+			    (unsigned long long)n);
 	}
+	return (0);
 
-	ofmr->record_length = fmr_len;
-	retval = 0;
 err_out:
-	if (ifvmrs != NULL)
-		free (ifvmrs);
-	return (retval);
+	return (-1);
 }
 
-int
-main(int argc, char *argv[])
+static void *
+convert_thread(void *arg)
 {
-	FMR *ifmr = NULL, *ofmr = NULL;
+	struct pipeline *pl = (struct pipeline *)arg;
+	struct input_block *b;
+
+	pthread_mutex_lock(&pl->lock);
+	for (;;) {
+		while (!pl->stop && !(pl->last_known && (pl->next > pl->last)) &&
+		    (pl->blocks[pl->next % pl->count].state != BLOCK_FILLED))
+			pthread_cond_wait(&pl->cond, &pl->lock);
+		if (pl->stop || (pl->last_known && (pl->next > pl->last)))
+			break;
+		b = &pl->blocks[pl->next % pl->count];
+		b->state = BLOCK_CONVERTING;
+		pl->next++;
+		pthread_mutex_unlock(&pl->lock);
 
-	get_options(argc, argv);
+		if (!b->error && (convert_block(&pl->fmrt, b) != 0))
+			b->error = TRUE;
 
-	if ((in_type == FMR_STD_ISO) ||
-	    (in_type == FMR_STD_ISO_NORMAL_CARD) ||
-	    (in_type == FMR_STD_ISO_COMPACT_CARD))
-		if ((out_type == FMR_STD_ISO) ||
-		    (out_type == FMR_STD_ISO_NORMAL_CARD) ||
-		    (out_type == FMR_STD_ISO_COMPACT_CARD))
-			ERR_OUT("Unsupported conversion");
-
-	// Allocate the input/output FMR records in memory
-	if (new_fmr(in_type, &ifmr) < 0)
-		ALLOC_ERR_OUT("Input FMR");
-	if (new_fmr(out_type, &ofmr) < 0)
-		ALLOC_ERR_OUT("Output FMR");
-
-	// Read the input FMR
-	if (read_fmr(in_fp, ifmr) != READ_OK) {
-		fprintf(stderr, "Could not read FMR from file.\n");
-		goto err_out;
+		pthread_mutex_lock(&pl->lock);
+		b->state = BLOCK_CONVERTED;
+		pthread_cond_broadcast(&pl->cond);
 	}
+	pthread_mutex_unlock(&pl->lock);
+	return (NULL);
+}
 
-	/* ISO card formats have no input resolution, so set it here
-	 * from the input options.
-	 */
-	if ((in_type == FMR_STD_ISO_NORMAL_CARD) ||
-	    (in_type == FMR_STD_ISO_COMPACT_CARD)) {
-		ifmr->x_resolution = iso_xres;
-		ifmr->y_resolution = iso_yres;
+int
+main(int argc, char *argv[])
+{
+	struct pipeline pl;
+	struct input_block *b;
+	struct timeval start, end;
+	pthread_t *tids = NULL;
+	uint64_t seq, records, octets;
+	double secs;
+	int i, started, eof, status;
+
+	memset(&pl, 0, sizeof(struct pipeline));
+	started = 0;
+	status = EXIT_FAILURE;
+	get_options(argc, argv);
+	gettimeofday(&start, NULL);
+
+	pl.fp = in_fp;
+	pl.std = in_type;
+	pl.count = threads * BLOCKS_PER_THREAD;
+	pl.blocks = (struct input_block *)calloc(pl.count,
+	    sizeof(struct input_block));
+	tids = (pthread_t *)malloc((threads + 1) * sizeof(pthread_t));
+	if ((pl.blocks == NULL) || (tids == NULL))
+		ALLOC_ERR_OUT("Block ring");
+	for (i = 0; i < pl.count; i++) {
+		pl.blocks[i].size = INPUT_BLOCK_SIZE;
+		pl.blocks[i].buf = (uint8_t *)malloc(INPUT_BLOCK_SIZE);
+		if (pl.blocks[i].buf == NULL)
+			ALLOC_ERR_OUT("Input block");
+		if (new_growable_bdb(&pl.blocks[i].odb, NULL,
+		    INPUT_BLOCK_SIZE) != WRITE_OK)
+			ALLOC_ERR_OUT("Output buffer");
 	}
-	/* If the input and output file types are the same,
-	 * do a straight copy.
+	pthread_mutex_init(&pl.lock, NULL);
+	pthread_cond_init(&pl.cond, NULL);
+	if (pthread_create(&tids[started], NULL, reader_thread, &pl) != 0)
+		ERR_OUT("Could not start reader thread");
+	for (started = 1; started <= threads; started++)
+		if (pthread_create(&tids[started], NULL, convert_thread,
+		    &pl) != 0)
+			ERR_OUT("Could not start conversion thread");
+
+	/* Convert each FMR directly from its encoding. ISO card formats
+	 * have no input resolution, so the transcoder takes it from the
+	 * input options.
 	 */
-	if (in_type == out_type)
-		copy_without_conversion(ifmr, ofmr, in_type);
-	else
-		copy_with_conversion(ifmr, ofmr, in_type, out_type);
-
-	(void)write_fmr(out_fp, ofmr);
-	free_fmr(ifmr);
-	free_fmr(ofmr);
-
-	close_files();
-
-	exit(EXIT_SUCCESS);
+	records = octets = 0;
+	for (seq = 0, eof = FALSE; !eof; seq++) {
+		b = &pl.blocks[seq % pl.count];
+		pthread_mutex_lock(&pl.lock);
+		while (b->state != BLOCK_CONVERTED)
+			pthread_cond_wait(&pl.cond, &pl.lock);
+		pthread_mutex_unlock(&pl.lock);
+		if (b->error)
+			goto err_out;
+		if (BDB_LENGTH(&b->odb) != 0)
+			if (write_bdb_record(out_fp, &b->odb) != WRITE_OK)
+				ERR_OUT("Could not write output");
+		records += b->records;
+		octets += b->length + b->trailing;
+		eof = b->eof;
+
+		pthread_mutex_lock(&pl.lock);
+		b->state = BLOCK_EMPTY;
+		pthread_cond_broadcast(&pl.cond);
+		pthread_mutex_unlock(&pl.lock);
+	}
+	if (records == 0)
+		ERR_OUT("Input has no records");
+	if (fflush(out_fp) != 0)
+		ERR_OUT("Could not write output");
+	status = EXIT_SUCCESS;
+
+	if (v_opt) {
+		gettimeofday(&end, NULL);
+		secs = (end.tv_sec - start.tv_sec) +
+		    (end.tv_usec - start.tv_usec) / 1000000.0;
+		if (secs <= 0)
+			secs = 1e-6;
+		fprintf(stderr, "%llu records, %.1f MB in %.3f s: "
+		    "%.0f records/s, %.1f MB/s\n", (unsigned long long)records,
+		    octets / 1e6, secs, records / secs, octets / 1e6 / secs);
+	}
 
 err_out:
-	if (ifmr != NULL)
-		free_fmr(ifmr);
-	if (ofmr != NULL)
-		free_fmr(ofmr);
+	/* Stop the threads once they finish the blocks they hold */
+	if (started > 0) {
+		pthread_mutex_lock(&pl.lock);
+		pl.stop = TRUE;
+		pthread_cond_broadcast(&pl.cond);
+		pthread_mutex_unlock(&pl.lock);
+		for (i = 0; i < started; i++)
+			pthread_join(tids[i], NULL);
+	}
+	if (pl.blocks != NULL) {
+		for (i = 0; i < pl.count; i++) {
+			if (pl.blocks[i].buf != NULL)
+				free(pl.blocks[i].buf);
+			if (pl.blocks[i].odb.bdb_start != NULL)
+				free(pl.blocks[i].odb.bdb_start);
+		}
+		free(pl.blocks);
+	}
+	if (tids != NULL)
+		free(tids);
+
 	/* If we created the output file, remove it. */
-	if (out_fp != NULL)
+	if ((status != EXIT_SUCCESS) && (out_file != NULL))
 		(void)unlink(out_file);
 
 	close_files();
-	exit(EXIT_FAILURE);
+	exit(status);
 }
@@ -11,17 +11,23 @@
 /* This program will determine the intersection of two sets of minutiae       */
 /* produce some textual output containing the number of minutiae in each file */
 /* along with the number of minutiae in common.                               */
+/*                                                                            */
+/* In batch mode, every record of a gallery is compared with every record of  */
+/* a probe set. All records are read and indexed once, and the record pairs   */
+/* are compared by a pool of threads, with the results printed in order.     */
 /******************************************************************************/
 
 /* Needed by the GNU C libraries for Posix and other extensions */
-#define _XOPEN_SOURCE	1
+#define _XOPEN_SOURCE	500
 
 #include <sys/queue.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <limits.h>
 #include <math.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdint.h>
 #include <stdlib.h>
@@ -29,16 +35,22 @@
 #include <strings.h>
 #include <unistd.h>
 
+#include <biomdi.h>
 #include <biomdimacro.h>
 #include <fmr.h>
+#include <fmrsort.h>
 
 #ifndef M_PI
 #define M_PI           3.14159265358979323846
 #endif
 
 /* Global option indicators */
+static int a_opt;
+static int l_opt;
 static int v_opt;
+static int m_opt;
 static long r_opt;
+static long t_opt;
 
 /* Global total count of overlapping minutia */
 static int total_overlapping_count = 0;
@@ -46,6 +58,9 @@ static int total_overlapping_count = 0;
 /* Global file pointers */
 static FILE *in_fp[2];	// the FMR (378-2004) input files
 
+/* The gallery and probe files of batch mode */
+static char *set_path[2];
+
 /******************************************************************************/
 /* Print a how-to-use the program message.                                    */
 /******************************************************************************/
@@ -53,8 +68,17 @@ static void
 usage()
 {
 	fprintf(stderr, 
-	    "usage:\n\tfmroverlap -i <file1> -i <file2> -r <num> [-v]\n"
+	    "usage:\n\tfmroverlap -i <file1> -i <file2> -r <num> [-a] [-l] "
+	    "[-v]\n"
+	    "\tfmroverlap -g <gallery> -p <probes> -r <num> [-a] [-l] "
+	    "[-t <num>] [-m]\n"
+	    "\t\t -a: Pair the minutiae by optimal assignment\n"
+	    "\t\t -l: Align the first record to the second before pairing\n"
+	    "\t\t -g: Specifies the gallery manifest or record file\n"
+	    "\t\t -p: Specifies the probe manifest or record file\n"
 	    "\t\t -r: Specifies the radius of interest\n"
+	    "\t\t -t: Specifies the number of threads for batch mode\n"
+	    "\t\t -m: Print batch results as a matrix\n"
 	    "\t\t -v: Be verbose\n");
 }
 
@@ -83,9 +107,10 @@ get_options(int argc, char *argv[])
 	int ch;
 	int i_opt;
 
-	i_opt = v_opt = 0;
+	i_opt = a_opt = l_opt = v_opt = m_opt = 0;
 	r_opt = 0;
-	while ((ch = getopt(argc, argv, "i:r:v")) != -1) {
+	t_opt = 1;
+	while ((ch = getopt(argc, argv, "ag:i:lmp:r:t:v")) != -1) {
 		switch (ch) {
 
 		    case 'i':
@@ -98,6 +123,32 @@ get_options(int argc, char *argv[])
 			i_opt++;
 			break;
 
+		    case 'a':
+			a_opt++;
+			break;
+
+		    case 'g':
+			set_path[0] = optarg;
+			break;
+
+		    case 'l':
+			l_opt++;
+			break;
+
+		    case 'p':
+			set_path[1] = optarg;
+			break;
+
+		    case 'm':
+			m_opt++;
+			break;
+
+		    case 't':
+			t_opt = strtol(optarg, NULL, 10);
+			if ((t_opt < 1) || (t_opt > 1024))
+				ERR_OUT("Thread count must be from 1 to 1024");
+			break;
+
 		    case 'r':
 			r_opt = strtol(optarg, NULL, 10);
 			if (r_opt == 0 && errno == EINVAL)
@@ -116,7 +167,15 @@ get_options(int argc, char *argv[])
 		}
 	}
 
-	if ((i_opt != 2) | (r_opt == 0)) {
+	if (set_path[0] != NULL || set_path[1] != NULL) {
+		if ((set_path[0] == NULL) || (set_path[1] == NULL) ||
+		    (i_opt != 0) || (v_opt != 0) || (r_opt == 0)) {
+			usage();
+			goto err_out;
+		}
+		return;
+	}
+	if ((i_opt != 2) | (r_opt == 0) | (m_opt != 0)) {
 		usage();
 		goto err_out;
 	}
@@ -127,22 +186,46 @@ err_out:
 	exit(EXIT_FAILURE);
 }
 
-static double
-dtheta2(const FMD *a, const FMD *b)
+/* The units of angle in a full circle, for the distance matrix */
+#define ANGLE_UNITS	(360 / FMD_ANSI_ANGLE_UNIT)
+
+/*
+ * The difference of two angles, as the distance matrix has it: the
+ * smaller arc (5 - 355 = 10), in units of the record.
+ */
+static int32_t
+angle_difference(int32_t a, int32_t b)
 {
-   const double d = 2.0*(a->angle - b->angle);	/* 2 converts units to degrees */
-   const double r = d*M_PI/180.0;		/* convert to radians */
-   const double mod360 = 180.0*acos(cos(r))/M_PI; /* avoid wrap around: 5 - 355 = 10 */
-   return mod360*mod360;
+	int32_t d;
+
+	d = (a > b) ? a - b : b - a;
+	if (d >= ANGLE_UNITS)
+		d -= ANGLE_UNITS;
+	return ((d < ANGLE_UNITS - d) ? d : ANGLE_UNITS - d);
 }
 
+/*
+ * The square of an angle difference, in degrees.
+ */
 static double
-distance2D(const FMD *a, const FMD *b)
+dtheta2(int32_t dangle)
 {
-	int dx = (int)(a->x_coord - b->x_coord);
-	int dy = (int)(a->y_coord - b->y_coord);
-	double d = sqrt((double)(dx*dx + dy*dy));
-	return (d);
+   const double d = (double)FMD_ANSI_ANGLE_UNIT * dangle;	/* to degrees */
+   return d*d;
+}
+
+/*
+ * Print one minutia from the minutiae block of an FVMR.
+ */
+static void
+print_fmb_entry(const FVMR *fvmr, const FMB *fmb, int i)
+{
+	FMD fmd;
+
+	memset(&fmd, 0, sizeof(FMD));
+	fmd.format_std = fvmr->format_std;
+	fmb_to_fmd(fmb, i, &fmd);
+	print_fmd(stdout, &fmd);
 }
 
 #ifndef MAX
@@ -179,50 +262,877 @@ distance3D(const FMD *a, const FMD *b)
 }
 #endif
 
+/*
+ * No pair is ever as far apart as this; it is the initial minimum
+ * distance of the original pairing loop.
+ */
+#define NO_PAIR_DISTANCE	100000
+
+/*
+ * The candidate pairs for the minutiae of the first record: entries
+ * start[i] to start[i + 1] - 1 hold the minutiae of the second record
+ * within the radius of interest of minutia i, nearest first, with those
+ * at equal distances in block order, and their distances.
+ */
+struct candidates {
+	int	*start;
+	int	*j;
+	double	*dist;
+};
+
+/*
+ * Return true if a query of the spatial index would examine so much of
+ * the grid that computing the whole distance matrix, and scanning its
+ * rows, is cheaper: when the square of cells around the radius covers
+ * half of the grid.
+ */
+static int
+use_matrix_rows(const MGRID *grid, int radius)
+{
+	uint64_t side;
+
+	side = ((uint64_t)(2 * radius) >> grid->shift) + 2;
+	return (side * side * 2 >= (uint64_t)grid->columns * grid->rows);
+}
+
+/*
+ * The square of the distance between minutia i of the first record and
+ * minutia j of the second, from the distance matrix if there is one.
+ */
+static int64_t
+squared_distance(const FMB *fmb, int i, const MGRID *grid, const MDMAT *mat,
+    int j)
+{
+	int64_t dx, dy;
+
+	if (mat != NULL)
+		return (mat->dist2[i * mat->stride + j]);
+	dx = grid->fmb->x_coord[j] - fmb->x_coord[i];
+	dy = grid->fmb->y_coord[j] - fmb->y_coord[i];
+	return ((dx*dx) + (dy*dy));
+}
+
+/*
+ * Find the minutiae of the second record within 'radius' of minutia i of
+ * the first, in block order, and return their count. They are found by
+ * scanning the row of the distance matrix if there is one, and with the
+ * spatial index otherwise.
+ */
+static int
+find_near(const MGRID *grid, const MDMAT *mat, const FMB *fmb, int i,
+    int radius, int *near)
+{
+	int64_t limit;
+	int k, n, count;
+
+	limit = (int64_t)radius * radius;
+	if (limit >= (int64_t)NO_PAIR_DISTANCE * NO_PAIR_DISTANCE)
+		limit = (int64_t)NO_PAIR_DISTANCE * NO_PAIR_DISTANCE - 1;
+	if (mat != NULL) {
+		for (k = 0, count = 0; k < (int)mat->columns; k++)
+			if (mat->dist2[i * mat->stride + k] <= limit)
+				near[count++] = k;
+		return (count);
+	}
+	n = grid_select_radius(grid, fmb->x_coord[i], fmb->y_coord[i], radius,
+	    near);
+	for (k = 0, count = 0; k < n; k++) {
+		if (squared_distance(fmb, i, grid, NULL, near[k]) <= limit)
+			near[count++] = near[k];
+	}
+	return (count);
+}
+
+/*
+ * Build the candidate pairs, using the spatial index over the second
+ * record or, if it is not NULL, the distance matrix of the two. The
+ * candidates of each minutia are sorted once, by the square of their
+ * distance, which orders them as the distance does.
+ */
+#define DISTANCE_KEY_BITS	34
+static int
+find_candidates(const FMB *fmb0, const MGRID *grid, const MDMAT *mat,
+    int radius, struct candidates *cands)
+{
+	struct minutia_sort_space space;
+	int64_t d2;
+	int *near = NULL;
+	int i, k, n, ncand, mcount, ret = -1;
+
+	memset(cands, 0, sizeof(struct candidates));
+	mcount = grid->count;
+	if (init_minutia_sort_space(&space, mcount) != 0)
+		ALLOC_ERR_RETURN("Candidate sort space");
+	cands->start = (int *)malloc((fmb0->count + 1) * sizeof(int));
+	near = (int *)malloc(mcount * sizeof(int));
+	if ((cands->start == NULL) || (near == NULL))
+		ALLOC_ERR_OUT("Candidate array");
+
+	ncand = 0;
+	for (i = 0; i < (int)fmb0->count; i++) {
+		cands->start[i] = ncand;
+		ncand += find_near(grid, mat, fmb0, i, radius, near);
+	}
+	cands->start[fmb0->count] = ncand;
+	cands->j = (int *)malloc((ncand > 0 ? ncand : 1) * sizeof(int));
+	cands->dist = (double *)malloc((ncand > 0 ? ncand : 1) *
+	    sizeof(double));
+	if ((cands->j == NULL) || (cands->dist == NULL))
+		ALLOC_ERR_OUT("Candidate array");
+
+	for (i = 0; i < (int)fmb0->count; i++) {
+		n = find_near(grid, mat, fmb0, i, radius, near);
+		for (k = 0; k < n; k++)
+			space.keys[k] = squared_distance(fmb0, i, grid, mat,
+			    near[k]);
+		sort_minutia_keys(space.keys, n, DISTANCE_KEY_BITS,
+		    space.order, space.scratch);
+		for (k = 0; k < n; k++) {
+			cands->j[cands->start[i] + k] = near[space.order[k]];
+			d2 = space.keys[space.order[k]];
+			cands->dist[cands->start[i] + k] = sqrt((double)d2);
+		}
+	}
+	ret = 0;
+
+err_out:
+	if (near != NULL)
+		free(near);
+	free_minutia_sort_space(&space);
+	return (ret);
+}
+
+static void
+free_candidates(struct candidates *cands)
+{
+	if (cands->start != NULL)
+		free(cands->start);
+	if (cands->j != NULL)
+		free(cands->j);
+	if (cands->dist != NULL)
+		free(cands->dist);
+}
+
+/*
+ * The rigid transform that aligns the first view to the second: a
+ * rotation about the center of the first view's minutiae, then a
+ * translation. 'votes' is the number of minutia pairs that agree.
+ */
+struct registration {
+	double	rotation;	// units of angle, counterclockwise
+	double	cx;
+	double	cy;
+	double	tx;
+	double	ty;
+	int	votes;
+};
+
+/*
+ * The transforms are voted for in cells of this many units of angle and
+ * pixels, and only rotations up to REGISTER_MAX_ROTATION units are
+ * considered; with ANSI units, the cells are 8 degrees, and the rotation
+ * is at most 46 degrees either way.
+ */
+#define REGISTER_ANGLE_CELL	4
+#define REGISTER_SHIFT_CELL	16
+#define REGISTER_MAX_ROTATION	23
+#define REGISTER_SHIFT_BITS	12
+#define REGISTER_KEY_BITS	(8 + 2 * REGISTER_SHIFT_BITS)
+
+/*
+ * The signed difference from angle a to angle b, in the range
+ * (-ANGLE_UNITS / 2, ANGLE_UNITS / 2].
+ */
+static int
+signed_angle_difference(int a, int b)
+{
+	int d;
+
+	d = (b - a) % ANGLE_UNITS;
+	if (d > ANGLE_UNITS / 2)
+		d -= ANGLE_UNITS;
+	else if (d <= -ANGLE_UNITS / 2)
+		d += ANGLE_UNITS;
+	return (d);
+}
+
+/*
+ * Find the translation that moves minutia i of the first view onto
+ * minutia j of the second after rotating the first view about (cx, cy)
+ * by the angle whose cosine and sine are c and s. Image rows grow
+ * downward, so a counterclockwise rotation is negative in image
+ * coordinates.
+ */
+static void
+pair_translation(const FMB *fmb0, int i, const FMB *fmb1, int j,
+    double c, double s, double cx, double cy, double *tx, double *ty)
+{
+	double x, y;
+
+	x = fmb0->x_coord[i] - cx;
+	y = fmb0->y_coord[i] - cy;
+	*tx = fmb1->x_coord[j] - (cx + c * x + s * y);
+	*ty = fmb1->y_coord[j] - (cy - s * x + c * y);
+}
+
+static uint64_t
+shift_cell(double t)
+{
+	double cell;
+
+	cell = floor(t / REGISTER_SHIFT_CELL) +
+	    (1 << (REGISTER_SHIFT_BITS - 1));
+	if (cell < 0)
+		return (0);
+	if (cell >= (1 << REGISTER_SHIFT_BITS))
+		return ((1 << REGISTER_SHIFT_BITS) - 1);
+	return ((uint64_t)cell);
+}
+
+/*
+ * Sums over pairs of positions, relative to the center of rotation, from
+ * which the least-squares rigid transform between them follows.
+ */
+struct rigid_fit {
+	int	count;
+	double	px, py, qx, qy;
+	double	dot, cross;
+};
+
+static void
+add_fit_pair(struct rigid_fit *fit, double px, double py, double qx,
+    double qy)
+{
+	fit->count++;
+	fit->px += px;
+	fit->py += py;
+	fit->qx += qx;
+	fit->qy += qy;
+	fit->dot += px * qx + py * qy;
+	fit->cross += py * qx - px * qy;
+}
+
+/*
+ * Set the rotation and translation of a registration to those that move
+ * the first positions of the fitted pairs closest to the second.
+ */
+static void
+solve_fit(const struct rigid_fit *fit, struct registration *reg)
+{
+	double dot, cross, px, py, qx, qy, theta, c, s;
+
+	px = fit->px / fit->count;
+	py = fit->py / fit->count;
+	qx = fit->qx / fit->count;
+	qy = fit->qy / fit->count;
+	dot = fit->dot - fit->count * (px * qx + py * qy);
+	cross = fit->cross - fit->count * (py * qx - px * qy);
+	theta = atan2(cross, dot);
+	c = cos(theta);
+	s = sin(theta);
+	reg->rotation = theta * 180.0 / M_PI / FMD_ANSI_ANGLE_UNIT;
+	reg->tx = qx - (c * px + s * py);
+	reg->ty = qy - (-s * px + c * py);
+	reg->votes = fit->count;
+}
+
+/*
+ * Find the rigid transform that best aligns the first view to the
+ * second. Every pair of minutiae whose directions differ by no more than
+ * the largest rotation votes for the transform that maps one onto the
+ * other: the rotation given by their directions, and the translation that
+ * follows. The votes are packed into integer keys by cell, rotation
+ * first, and counted by sorting the keys, so the space needed grows with
+ * the number of votes rather than with the size of the image. The
+ * transform is then refined by a least-squares fit to the positions of
+ * the pairs that agree with the most popular cell. When no pair votes,
+ * the identity is returned.
+ */
+static int
+register_views(const FMB *fmb0, const FVG *geom, const FMB *fmb1,
+    struct registration *reg)
+{
+	struct minutia_sort_space space;
+	int *pairs = NULL, *bydir, *start;
+	struct rigid_fit fit;
+	double cosd[2 * REGISTER_MAX_ROTATION + 1];
+	double sind[2 * REGISTER_MAX_ROTATION + 1];
+	double c, s, tx, ty, sumd, sumx, sumy;
+	uint64_t key, best_key;
+	int a, b, i, j, d, k, n, run, best_run, pass, window, lo, hi;
+	int ret = -1;
+
+	memset(reg, 0, sizeof(struct registration));
+	reg->cx = geom->center_x;
+	reg->cy = geom->center_y;
+	n = fmb0->count * fmb1->count;
+	if (init_minutia_sort_space(&space, n) != 0)
+		ALLOC_ERR_RETURN("Registration votes");
+	pairs = (int *)malloc((n + fmb1->count + ANGLE_UNITS + 1) *
+	    sizeof(int));
+	if (pairs == NULL)
+		ALLOC_ERR_OUT("Registration votes");
+	for (d = -REGISTER_MAX_ROTATION; d <= REGISTER_MAX_ROTATION; d++) {
+		cosd[d + REGISTER_MAX_ROTATION] =
+		    cos(d * FMD_ANSI_ANGLE_UNIT * M_PI / 180.0);
+		sind[d + REGISTER_MAX_ROTATION] =
+		    sin(d * FMD_ANSI_ANGLE_UNIT * M_PI / 180.0);
+	}
+
+	/* Bucket the minutiae of the second view by direction, so that
+	 * each minutia of the first meets only those it may vote with.
+	 */
+	bydir = pairs + n;
+	start = bydir + fmb1->count;
+	memset(start, 0, (ANGLE_UNITS + 1) * sizeof(int));
+	for (j = 0; j < (int)fmb1->count; j++)
+		start[fmb1->angle[j] % ANGLE_UNITS + 1]++;
+	for (a = 0; a < ANGLE_UNITS; a++)
+		start[a + 1] += start[a];
+	for (j = 0; j < (int)fmb1->count; j++)
+		bydir[start[fmb1->angle[j] % ANGLE_UNITS]++] = j;
+	for (a = ANGLE_UNITS; a > 0; a--)
+		start[a] = start[a - 1];
+	start[0] = 0;
+
+	n = 0;
+	for (i = 0; i < (int)fmb0->count; i++) {
+		a = fmb0->angle[i] % ANGLE_UNITS;
+		for (d = -REGISTER_MAX_ROTATION; d <= REGISTER_MAX_ROTATION;
+		    d++) {
+			b = (a + d + ANGLE_UNITS) % ANGLE_UNITS;
+			for (k = start[b]; k < start[b + 1]; k++) {
+				j = bydir[k];
+				pair_translation(fmb0, i, fmb1, j,
+				    cosd[d + REGISTER_MAX_ROTATION],
+				    sind[d + REGISTER_MAX_ROTATION], reg->cx,
+				    reg->cy, &tx, &ty);
+				key = (d + REGISTER_MAX_ROTATION) /
+				    REGISTER_ANGLE_CELL;
+				space.keys[n] = (key <<
+				    (2 * REGISTER_SHIFT_BITS)) |
+				    (shift_cell(tx) << REGISTER_SHIFT_BITS) |
+				    shift_cell(ty);
+				pairs[n++] = i * fmb1->count + j;
+			}
+		}
+	}
+	if (n == 0)
+		goto done;
+
+	/* The longest run of equal keys is the most popular cell; of
+	 * cells with equal votes, that with the smallest key is taken.
+	 */
+	sort_minutia_keys(space.keys, n, REGISTER_KEY_BITS, space.order,
+	    space.scratch);
+	best_key = space.keys[space.order[0]];
+	best_run = 0;
+	for (k = 0; k < n; k += run) {
+		key = space.keys[space.order[k]];
+		for (run = 1; (k + run < n) &&
+		    (space.keys[space.order[k + run]] == key); run++)
+			;
+		if (run > best_run) {
+			best_run = run;
+			best_key = key;
+		}
+	}
+
+	/* Start from the mean transform of the votes in the cell. */
+	sumd = sumx = sumy = 0.0;
+	for (k = 0; k < n; k++) {
+		if (space.keys[k] != best_key)
+			continue;
+		i = pairs[k] / fmb1->count;
+		j = pairs[k] % fmb1->count;
+		d = signed_angle_difference(fmb0->angle[i], fmb1->angle[j]);
+		pair_translation(fmb0, i, fmb1, j,
+		    cosd[d + REGISTER_MAX_ROTATION],
+		    sind[d + REGISTER_MAX_ROTATION], reg->cx, reg->cy,
+		    &tx, &ty);
+		sumd += d;
+		sumx += tx;
+		sumy += ty;
+	}
+	reg->rotation = sumd / best_run;
+	reg->tx = sumx / best_run;
+	reg->ty = sumy / best_run;
+	reg->votes = best_run;
+
+	/* Then fit the positions of the pairs that the transform brings
+	 * within a cell, and within half a cell, of each other; the directions
+	 * of single minutiae are too coarse to give the rotation precisely.
+	 */
+	for (pass = 0; pass < 2; pass++) {
+		window = REGISTER_SHIFT_CELL >> pass;
+		c = cos(reg->rotation * FMD_ANSI_ANGLE_UNIT * M_PI / 180.0);
+		s = sin(reg->rotation * FMD_ANSI_ANGLE_UNIT * M_PI / 180.0);
+		lo = floor((reg->rotation - REGISTER_ANGLE_CELL +
+		    REGISTER_MAX_ROTATION) / REGISTER_ANGLE_CELL);
+		hi = floor((reg->rotation + REGISTER_ANGLE_CELL +
+		    REGISTER_MAX_ROTATION) / REGISTER_ANGLE_CELL);
+		memset(&fit, 0, sizeof(fit));
+		for (k = 0; k < n; k++) {
+			key = space.keys[k] >> (2 * REGISTER_SHIFT_BITS);
+			if (((int)key < lo) || ((int)key > hi))
+				continue;
+			i = pairs[k] / fmb1->count;
+			j = pairs[k] % fmb1->count;
+			d = signed_angle_difference(fmb0->angle[i],
+			    fmb1->angle[j]);
+			if (fabs(d - reg->rotation) > REGISTER_ANGLE_CELL)
+				continue;
+			pair_translation(fmb0, i, fmb1, j, c, s, reg->cx,
+			    reg->cy, &tx, &ty);
+			if ((fabs(tx - reg->tx) > window) ||
+			    (fabs(ty - reg->ty) > window))
+				continue;
+			add_fit_pair(&fit, fmb0->x_coord[i] - reg->cx,
+			    fmb0->y_coord[i] - reg->cy,
+			    fmb1->x_coord[j] - reg->cx,
+			    fmb1->y_coord[j] - reg->cy);
+		}
+		if (fit.count < 2)
+			break;
+		solve_fit(&fit, reg);
+	}
+
+done:
+	ret = 0;
+
+err_out:
+	if (pairs != NULL)
+		free(pairs);
+	free_minutia_sort_space(&space);
+	return (ret);
+}
+
+/*
+ * Make a copy of a minutiae block moved by a registration. The positions
+ * and directions are stored in 'moved', which refers to the source block
+ * for the other fields; the storage is freed with free_moved_fmb().
+ * Positions moved outside the range of the coordinates are clamped to it.
+ */
+static int
+move_fmb(const FMB *fmb, const struct registration *reg, FMB *moved)
+{
+	double c, s, x, y;
+	long v;
+	unsigned int m;
+
+	*moved = *fmb;
+	moved->x_coord = (unsigned short *)malloc(fmb->count *
+	    (2 * sizeof(unsigned short) + sizeof(unsigned char)) + 1);
+	if (moved->x_coord == NULL)
+		ALLOC_ERR_RETURN("Registered minutiae");
+	moved->y_coord = moved->x_coord + fmb->count;
+	moved->angle = (unsigned char *)(moved->y_coord + fmb->count);
+	moved->size = fmb->count;
+
+	c = cos(reg->rotation * FMD_ANSI_ANGLE_UNIT * M_PI / 180.0);
+	s = sin(reg->rotation * FMD_ANSI_ANGLE_UNIT * M_PI / 180.0);
+	for (m = 0; m < fmb->count; m++) {
+		x = fmb->x_coord[m] - reg->cx;
+		y = fmb->y_coord[m] - reg->cy;
+		v = lround(reg->cx + c * x + s * y + reg->tx);
+		moved->x_coord[m] = (v < 0) ? 0 :
+		    (v > FMD_X_COORD_MASK) ? FMD_X_COORD_MASK : v;
+		v = lround(reg->cy - s * x + c * y + reg->ty);
+		moved->y_coord[m] = (v < 0) ? 0 :
+		    (v > FMD_Y_COORD_MASK) ? FMD_Y_COORD_MASK : v;
+		v = lround(fmb->angle[m] + reg->rotation) % ANGLE_UNITS;
+		moved->angle[m] = (v < 0) ? v + ANGLE_UNITS : v;
+	}
+	return (0);
+}
+
+static void
+free_moved_fmb(FMB *moved)
+{
+	if (moved->x_coord != NULL)
+		free(moved->x_coord);
+}
+
+/*
+ * The sums over the minutiae that have been paired.
+ */
+struct pair_sums {
+	int	count;
+	double	distance;
+	double	angle2;		// of the squares of the angle differences
+};
+
+/*
+ * Add the pair of minutia i of the first view and minutia j of the second
+ * to the sums, printing the pair when being verbose.
+ */
+static void
+add_pair(FVMR *fvmr1, const FMB *fmb0, int i, FVMR *fvmr2, const FMB *fmb1,
+    int j, double dist, const MDMAT *mat, struct pair_sums *sums)
+{
+	if (v_opt > 0) {
+		printf("Distance of %.2f calculated "
+		"for this matching pair:\n",
+		    dist);
+		print_fmb_entry(fvmr1, fmb0, i);
+		print_fmb_entry(fvmr2, fmb1, j);
+		printf("-----------------------\n");
+	}
+	sums->count++;
+	sums->distance += dist;
+	sums->angle2 += dtheta2((mat != NULL) ?
+	    mat->dangle[i * mat->stride + j] :
+	    angle_difference(fmb0->angle[i], fmb1->angle[j]));
+}
+
+/*
+ * Solve the assignment problem for the n by n matrix of costs 'cost',
+ * with the Hungarian method, in O(n^3) time: fill 'col_row' so that
+ * column j is assigned row col_row[j], minimizing the total cost. 'work'
+ * must have room for 4 * (n + 1) doubles, and 'iwork' for 2 * (n + 1)
+ * integers.
+ */
+static void
+solve_assignment(const double *cost, int n, int *col_row, double *work,
+    int *iwork)
+{
+	double *u, *v, *minv;
+	unsigned char *used;
+	int *p, *way;
+	int i, j, i0, j0, j1;
+	double cur, delta;
+
+	u = work;
+	v = u + n + 1;
+	minv = v + n + 1;
+	used = (unsigned char *)(minv + n + 1);
+	p = iwork;
+	way = p + n + 1;
+	for (j = 0; j <= n; j++) {
+		u[j] = v[j] = 0.0;
+		p[j] = way[j] = 0;
+	}
+	for (i = 1; i <= n; i++) {
+		p[0] = i;
+		j0 = 0;
+		for (j = 0; j <= n; j++) {
+			minv[j] = HUGE_VAL;
+			used[j] = 0;
+		}
+		do {
+			used[j0] = 1;
+			i0 = p[j0];
+			delta = HUGE_VAL;
+			j1 = 0;
+			for (j = 1; j <= n; j++) {
+				if (used[j])
+					continue;
+				cur = cost[(i0 - 1) * n + (j - 1)] - u[i0] -
+				    v[j];
+				if (cur < minv[j]) {
+					minv[j] = cur;
+					way[j] = j0;
+				}
+				if (minv[j] < delta) {
+					delta = minv[j];
+					j1 = j;
+				}
+			}
+			for (j = 0; j <= n; j++) {
+				if (used[j]) {
+					u[p[j]] += delta;
+					v[j] -= delta;
+				} else {
+					minv[j] -= delta;
+				}
+			}
+			j0 = j1;
+		} while (p[j0] != 0);
+		do {
+			j1 = way[j0];
+			p[j0] = p[j1];
+			j0 = j1;
+		} while (j0 != 0);
+	}
+	for (j = 1; j <= n; j++)
+		col_row[j - 1] = p[j] - 1;
+}
+
+static int
+find_root(int *parent, int x)
+{
+	while (parent[x] != x) {
+		parent[x] = parent[parent[x]];
+		x = parent[x];
+	}
+	return (x);
+}
+
+/*
+ * Pair the minutiae by optimal assignment over the candidate pairs: the
+ * greatest number of pairs, and of those, the least total distance. The
+ * graph of candidate pairs is split into its connected components, and
+ * each is solved on its own, so the cost grows with the cube of the size
+ * of the largest component rather than of the views. Within a component,
+ * every pair that is not a candidate costs more than any set of
+ * candidates together, so the solution has as many candidates as
+ * possible. 'pairk' is filled with the candidate entry of the pair of each
+ * minutia of the first view, or -1 if it is not paired.
+ */
+static int
+assign_pairs(const struct candidates *cands, int m0, int m1, int radius,
+    int *pairk)
+{
+	int *parent = NULL, *label = NULL, *first = NULL, *member = NULL;
+	int *local = NULL, *col_row = NULL, *iwork = NULL;
+	double *cost = NULL, *work = NULL;
+	double big;
+	int c, i, j, k, n, x, nr, nc, ncomp, nodes, maxn, ret = -1;
+
+	/* Without candidates there are no components to solve */
+	if (cands->start[m0] == 0) {
+		for (i = 0; i < m0; i++)
+			pairk[i] = -1;
+		return (0);
+	}
+
+	nodes = m0 + m1;
+	parent = (int *)malloc(nodes * sizeof(int));
+	label = (int *)malloc(nodes * sizeof(int));
+	first = (int *)malloc((nodes + 1) * sizeof(int));
+	member = (int *)malloc(nodes * sizeof(int));
+	local = (int *)malloc(nodes * sizeof(int));
+	if ((parent == NULL) || (label == NULL) || (first == NULL) ||
+	    (member == NULL) || (local == NULL))
+		ALLOC_ERR_OUT("Assignment arrays");
+
+	/* Join the minutiae of each candidate pair; the second view's
+	 * minutiae follow the first's.
+	 */
+	for (x = 0; x < nodes; x++) {
+		parent[x] = x;
+		label[x] = -1;
+	}
+	for (i = 0; i < m0; i++) {
+		pairk[i] = -1;
+		for (k = cands->start[i]; k < cands->start[i + 1]; k++) {
+			x = find_root(parent, i);
+			j = find_root(parent, m0 + cands->j[k]);
+			if (x != j)
+				parent[j] = x;
+			label[i] = label[m0 + cands->j[k]] = 0;
+		}
+	}
+
+	/* Number the components, and list their members together, rows
+	 * first, each in block order.
+	 */
+	ncomp = 0;
+	for (x = 0; x < nodes; x++) {
+		if (label[x] < 0)
+			continue;
+		j = find_root(parent, x);
+		if (j == x)
+			local[x] = ncomp++;
+	}
+	memset(first, 0, (nodes + 1) * sizeof(int));
+	for (x = 0; x < nodes; x++)
+		if (label[x] >= 0) {
+			label[x] = local[find_root(parent, x)];
+			first[label[x] + 1]++;
+		}
+	for (c = 0; c < ncomp; c++)
+		first[c + 1] += first[c];
+	memcpy(local, first, ncomp * sizeof(int));
+	for (x = 0; x < nodes; x++)
+		if (label[x] >= 0)
+			member[local[label[x]]++] = x;
+
+	maxn = 0;
+	for (c = 0; c < ncomp; c++)
+		if (first[c + 1] - first[c] > maxn)
+			maxn = first[c + 1] - first[c];
+	cost = (double *)malloc((size_t)maxn * maxn * sizeof(double));
+	work = (double *)malloc(4 * (maxn + 1) * sizeof(double));
+	col_row = (int *)malloc(maxn * sizeof(int));
+	iwork = (int *)malloc(2 * (maxn + 1) * sizeof(int));
+	if ((cost == NULL) || (work == NULL) || (col_row == NULL) ||
+	    (iwork == NULL))
+		ALLOC_ERR_OUT("Assignment arrays");
+
+	for (c = 0; c < ncomp; c++) {
+		for (nr = 0; (nr < first[c + 1] - first[c]) &&
+		    (member[first[c] + nr] < m0); nr++)
+			local[member[first[c] + nr]] = nr;
+		nc = first[c + 1] - first[c] - nr;
+		for (j = 0; j < nc; j++)
+			local[member[first[c] + nr + j]] = j;
+		n = (nr > nc) ? nr : nc;
+		big = (n + 1) * (radius + 1.0);
+		for (x = 0; x < n * n; x++)
+			cost[x] = big;
+		for (x = 0; x < nr; x++) {
+			i = member[first[c] + x];
+			for (k = cands->start[i]; k < cands->start[i + 1]; k++)
+				cost[x * n + local[m0 + cands->j[k]]] =
+				    cands->dist[k];
+		}
+		solve_assignment(cost, n, col_row, work, iwork);
+		for (j = 0; j < nc; j++) {
+			x = col_row[j];
+			if ((x >= nr) || (cost[x * n + j] >= big))
+				continue;
+			i = member[first[c] + x];
+			for (k = cands->start[i]; k < cands->start[i + 1]; k++)
+				if (local[m0 + cands->j[k]] == j)
+					break;
+			pairk[i] = k;
+		}
+	}
+	ret = 0;
+
+err_out:
+	if (parent != NULL)
+		free(parent);
+	if (label != NULL)
+		free(label);
+	if (first != NULL)
+		free(first);
+	if (member != NULL)
+		free(member);
+	if (local != NULL)
+		free(local);
+	if (cost != NULL)
+		free(cost);
+	if (work != NULL)
+		free(work);
+	if (col_row != NULL)
+		free(col_row);
+	if (iwork != NULL)
+		free(iwork);
+	return (ret);
+}
+
+/*
+ * The statistics of the comparison of two finger view records. When the
+ * views are not compared, because the finger numbers differ or a view has
+ * no minutiae, only the minutiae counts are set.
+ */
+struct overlap_stats {
+	int	compared;
+	int	mcount[2];
+	int	common;
+	double	ratio;
+	double	meandist;
+	double	rmsangle;
+};
+
+static void
+print_overlap_stats(const struct overlap_stats *stats)
+{
+	if (!stats->compared) {
+		fprintf(stdout, "%d %d 0 0 0 0\n", stats->mcount[0],
+		    stats->mcount[1]);
+		return;
+	}
+	fprintf(stdout, "%d %d %d %lf %lf %lf\n", stats->mcount[0],
+	    stats->mcount[1], stats->common, stats->ratio, stats->meandist,
+	    stats->rmsangle);
+}
+
+/*
+ * A record that has been read and indexed: its finger views and, for each
+ * view that has minutiae, the minutiae block, the spatial index of the
+ * minutiae and their geometry. The comparisons use only these pointers,
+ * which are fetched once when the record is indexed, so the views are
+ * not touched by the library accessors while being compared.
+ */
+struct indexed_record {
+	FMR		*fmr;
+	int		fvmrcnt;
+	FVMR		**fvmrs;
+	const FMB	**fmbs;
+	MGRID		**grids;
+	const FVG	**geoms;
+};
+
 /*
  * Compare the minutia records contained in two finger view records.
- * If the finger numbers don't match, this function just returns.
+ * If the finger numbers don't match, only the minutiae counts are set.
  * Otherwise, the distance between the minutia (one from each view)
  * is calculated. If this distance is less than the specified
  * distance (given as the radius of a circle around the minutiae),
- * the minutia pair is counted as overlapping.
+ * the minutia pair is counted as overlapping. Each minutia is in at most
+ * one pair: by default the pairs are made greedily, nearest first, and
+ * with the -a option by optimal assignment. With the -l option, the
+ * minutiae of the first view are first moved by the rigid transform that
+ * best aligns them to the second. View 'v' of each indexed record is
+ * compared, and 'mat' receives the distances between the minutiae of the
+ * views when the radius is large enough that computing all of them is
+ * cheaper than querying the index of the second view. This function only
+ * reads the records, so many comparisons can run at once, each with its
+ * own matrix. Returns 0 on success, -1 on failure.
  */
-static void
-compare_fvmrs(FVMR *fvmr1, FVMR *fvmr2)
+static int
+compare_fvmrs(const struct indexed_record *rec1,
+    const struct indexed_record *rec2, int v, MDMAT *mat,
+    struct overlap_stats *stats)
 {
-	FMD **fmds[2] = {NULL, NULL};
+	FVMR *fvmr1, *fvmr2;
+	const FMB *fmb[2];
+	const MGRID *grid;
+	struct candidates cands;
+	struct pair_sums sums;
+	struct registration reg;
+	const FVG *geom;
+	FMB moved;
 	int mcount[2];
-        int mcount_common = 0;
 	unsigned char *paired[2] = {NULL, NULL};
-	int i, j, r, minj;
-	double **dmat = NULL;
-	double mind, ratio;
-        double meanpaireddistance = 0.0;
-        double meanpairedangle2 = 0.0;  /* mean square diff in angle */
+	int *next = NULL;
+	int i, j, k, r, radius, ret = -1;
+	double nextd, ratio;
 
-	mcount[0] = get_fmd_count(fvmr1);
-	mcount[1] = get_fmd_count(fvmr2);
+	memset(&cands, 0, sizeof(struct candidates));
+	memset(&sums, 0, sizeof(struct pair_sums));
+	memset(&moved, 0, sizeof(FMB));
+	memset(stats, 0, sizeof(struct overlap_stats));
+	fvmr1 = rec1->fvmrs[v];
+	fvmr2 = rec2->fvmrs[v];
+	mcount[0] = stats->mcount[0] = get_fmd_count(fvmr1);
+	mcount[1] = stats->mcount[1] = get_fmd_count(fvmr2);
 
 	if ((fvmr1->finger_number != fvmr2->finger_number) ||
 	    (mcount[0] == 0) || (mcount[1] == 0))
-	{
-		fprintf(stdout, "%d %d 0 0 0 0\n", mcount[0], mcount[1]);
- 		return;
-        }
+ 		return (0);
 
 
-	fmds[0] = (FMD **)malloc(mcount[0] * sizeof(FMD *));
-	if (fmds[0] == NULL)
-		ALLOC_ERR_OUT("FMR Array");
-	if (get_fmds(fvmr1, fmds[0]) != mcount[0])
-		ERR_OUT("getting FMRs from first FVMR");
+	fmb[0] = rec1->fmbs[v];
+	if ((fmb[0] == NULL) || (fmb[0]->count != (unsigned int)mcount[0]))
+		ERR_OUT("getting minutiae block from first FVMR");
 
+	fmb[1] = rec2->fmbs[v];
+	if ((fmb[1] == NULL) || (fmb[1]->count != (unsigned int)mcount[1]))
+		ERR_OUT("getting minutiae block from second FVMR");
+	grid = rec2->grids[v];
+	if ((grid == NULL) || (grid->fmb != fmb[1]))
+		ERR_OUT("indexing minutiae of the second FVMR");
 
-	fmds[1] = (FMD **)malloc(mcount[1] * sizeof(FMD *));
-	if (fmds[1] == NULL)
-		ALLOC_ERR_OUT("FMR Array");
-	if (get_fmds(fvmr2, fmds[1]) != mcount[1])
-		ERR_OUT("getting FMRs from second FVMR");
+	/* Move the first view's minutiae onto the second's */
+	if (l_opt) {
+		geom = rec1->geoms[v];
+		if (geom == NULL)
+			ERR_OUT("getting geometry of first FVMR");
+		if (register_views(fmb[0], geom, fmb[1], &reg) != 0)
+			ERR_OUT("registering the FVMRs");
+		if (move_fmb(fmb[0], &reg, &moved) != 0)
+			ERR_OUT("moving minutiae of first FVMR");
+		fmb[0] = &moved;
+		if (v_opt > 0)
+			printf("Registered by rotating %.1f degrees about "
+			    "(%.0f, %.0f) and moving (%.1f, %.1f), with %d "
+			    "votes.\n", reg.rotation * FMD_ANSI_ANGLE_UNIT,
+			    reg.cx, reg.cy, reg.tx, reg.ty, reg.votes);
+	}
 
 	if (v_opt > 1) {
 		printf("The first FVMR:\n");
@@ -240,99 +1150,546 @@ compare_fvmrs(FVMR *fvmr1, FVMR *fvmr2)
 	memset((void *)paired[0], 0, mcount[0]);
 	memset((void *)paired[1], 0, mcount[1]);
 
-	dmat = (double **)malloc(mcount[0] * sizeof(double *));
-	if (dmat == NULL)
-		ALLOC_ERR_OUT("Distance array");
-	for (i = 0; i < mcount[0]; i++) {
-		dmat[i] = (double *)malloc(mcount[1] * sizeof(double));
-		if (dmat[i] == NULL)
-			ALLOC_ERR_OUT("Distance array");
+	radius = (r_opt < NO_PAIR_DISTANCE) ? (int)r_opt : NO_PAIR_DISTANCE;
+	if (use_matrix_rows(grid, radius)) {
+		if (compute_minutiae_distances(fmb[0], fmb[1], ANGLE_UNITS,
+		    mat) != 0)
+			ERR_OUT("computing minutiae distances");
+	} else {
+		mat = NULL;
 	}
+	if (find_candidates(fmb[0], grid, mat, radius, &cands) != 0)
+		ERR_OUT("finding candidate pairs");
+	next = (int *)malloc(mcount[0] * sizeof(int));
+	if (next == NULL)
+		ALLOC_ERR_OUT("Candidate array");
 
+	if (a_opt) {
+		/* 'next' holds the candidate entry of each pair */
+		if (assign_pairs(&cands, mcount[0], mcount[1], radius,
+		    next) != 0)
+			ERR_OUT("assigning minutiae pairs");
+		for (i = 0; i < mcount[0]; i++)
+			if (next[i] >= 0)
+				add_pair(fvmr1, fmb[0], i, fvmr2, fmb[1],
+				    cands.j[next[i]], cands.dist[next[i]],
+				    mat, &sums);
+		goto summary;
+	}
 	for (i = 0; i < mcount[0]; i++)
-		for (j = 0; j < mcount[1]; j++)
-			dmat[i][j] = distance2D(fmds[0][i], fmds[1][j]);
+		next[i] = cands.start[i];
 
-	for (r = 0; r <= r_opt; r++) {
+	/*
+	 * In each round, every unpaired minutia of the first record is
+	 * paired with its nearest unpaired minutia of the second, if that is
+	 * within the radius of the round. Since paired minutiae stay paired,
+	 * the nearest unpaired candidate is found by moving past those at the
+	 * front of the sorted candidates, and the rounds in which nothing
+	 * can be paired are skipped.
+	 */
+	r = 0;
+	while (r <= r_opt) {
+		nextd = NO_PAIR_DISTANCE;
 		for (i = 0; i < mcount[0]; i++) {
 			if (paired[0][i] == 1)
 				continue;
-			mind = 100000;
-			minj = -1;
-			for (j = 0; j < mcount[1]; j++) {
-				if ((paired[1][j] == 0) &&
-				    (dmat[i][j] < mind)) {
-					mind = dmat[i][j];
-					minj = j;
-				}
-			}
+			while ((next[i] < cands.start[i + 1]) &&
+			    (paired[1][cands.j[next[i]]] == 1))
+				next[i]++;
 		/* There will be times when everything in the second record
-		 * is paired whence minj will still be -1. This might occur
-		 * when there are fewer minutiae in the second template than
-		 * in the first. But if we have found a close candidate, then
-		 * determine if it is close enough and not already paired.
+		 * is paired, or nothing is within the radius of interest.
+		 * But if we have found a close candidate, then determine if
+		 * it is close enough for this round.
 		 */
-			if ((minj > -1) && (mind <= r) &&
-			    (paired[1][minj] == 0)) {
-				if (v_opt > 0) {
-					printf("Distance of %.2f calculated "
-					"for this matching pair:\n",
-					    dmat[i][minj]);
-					print_fmd(stdout, fmds[0][i]);
-					print_fmd(stdout, fmds[1][minj]);
-					printf("-----------------------\n");
-				}
-				paired[0][i] = paired[1][minj] = 1;
-				meanpaireddistance += dmat[i][minj];
-                                meanpairedangle2 += dtheta2(fmds[0][i], fmds[1][minj]);
-				mcount_common++;
+			if (next[i] == cands.start[i + 1])
+				continue;
+			k = next[i];
+			j = cands.j[k];
+			if (cands.dist[k] > r) {
+				if (cands.dist[k] < nextd)
+					nextd = cands.dist[k];
+				continue;
 			}
+			paired[0][i] = paired[1][j] = 1;
+			add_pair(fvmr1, fmb[0], i, fvmr2, fmb[1], j,
+			    cands.dist[k], mat, &sums);
 		}
+		if (nextd >= NO_PAIR_DISTANCE)
+			break;
+		r = (ceil(nextd) > r + 1) ? (int)ceil(nextd) : r + 1;
 	}
+summary:
 	/* Final summary stats are:
 	 * 1. the size of the intersection set divided by the size of the smaller of the
 	 * number of minutiae in the two input templates - this will be on range [0,1].
 	 * 2. the mean displacement of those minutiae that are found to be paired
 	 */
-	ratio = (double)mcount_common / (double)((mcount[0] < mcount[1]) ?
+	ratio = (double)sums.count / (double)((mcount[0] < mcount[1]) ?
 	    mcount[0] : mcount[1]);
 
-        if (mcount_common > 0)
+	stats->compared = TRUE;
+	stats->common = sums.count;
+	stats->ratio = ratio;
+        if (sums.count > 0)
         {
-	   meanpaireddistance /= (double)mcount_common;
-	   meanpairedangle2 = sqrt(meanpairedangle2 / (double)mcount_common); /* rms */
+	   stats->meandist = sums.distance / (double)sums.count;
+	   stats->rmsangle = sqrt(sums.angle2 / (double)sums.count); /* rms */
         }
-	fprintf(stdout, "%d %d %d %lf %lf %lf\n", mcount[0], mcount[1], mcount_common,
-               ratio, meanpaireddistance, meanpairedangle2);
-	total_overlapping_count += mcount_common;
+	ret = 0;
 
 err_out:
-	if (dmat != NULL) {
-		for (i = 0; i < mcount[0]; i++)
-			if (dmat[i] != NULL)
-				free(dmat[i]);
-		free (dmat);
-	}
+	free_moved_fmb(&moved);
+	free_candidates(&cands);
+	if (next != NULL)
+		free(next);
 	if (paired[0] != NULL)
 		free (paired[0]);
 	if (paired[1] != NULL)
 		free (paired[1]);
-	if (fmds[0] != NULL)
-		free(fmds[0]);
-	if (fmds[1] != NULL)
-		free(fmds[1]);
-	return;
+	return (ret);
+}
+
+/*
+ * Get the finger views of a record, and the minutiae block, index and
+ * geometry of each view. This is the only place the library accessors
+ * are called on the views, so once indexed the record is only read and
+ * can be shared by the comparison threads.
+ */
+static int
+index_record(FMR *fmr, struct indexed_record *rec)
+{
+	int i;
+
+	memset(rec, 0, sizeof(struct indexed_record));
+	rec->fmr = fmr;
+	rec->fvmrcnt = get_fvmr_count(fmr);
+	if (rec->fvmrcnt == 0)
+		ERR_OUT("there are no FVMRs in the input FMR");
+	if (rec->fvmrcnt < 0)
+		ERR_OUT("retrieving FVMRs from input FMR");
+	rec->fvmrs = (FVMR **)malloc(rec->fvmrcnt * sizeof(FVMR *));
+	rec->fmbs = (const FMB **)calloc(rec->fvmrcnt, sizeof(FMB *));
+	rec->grids = (MGRID **)calloc(rec->fvmrcnt, sizeof(MGRID *));
+	rec->geoms = (const FVG **)calloc(rec->fvmrcnt, sizeof(FVG *));
+	if ((rec->fvmrs == NULL) || (rec->fmbs == NULL) ||
+	    (rec->grids == NULL) || (rec->geoms == NULL))
+		ALLOC_ERR_OUT("FVMR Array");
+	if (get_fvmrs(fmr, rec->fvmrs) != rec->fvmrcnt)
+		ERR_OUT("getting FVMRs from FMR");
+	for (i = 0; i < rec->fvmrcnt; i++) {
+		if (get_fmd_count(rec->fvmrs[i]) == 0)
+			continue;
+		rec->fmbs[i] = get_fmb(rec->fvmrs[i]);
+		if (rec->fmbs[i] == NULL)
+			continue;
+		if (new_minutiae_grid(rec->fvmrs[i], &rec->grids[i]) != 0)
+			ERR_OUT("indexing minutiae of FVMR");
+		rec->geoms[i] = get_fvmr_geometry(rec->fvmrs[i]);
+	}
+	return (0);
+
+err_out:
+	return (-1);
+}
+
+/*
+ * Free the indexes and views of a record, but not the record itself.
+ */
+static void
+free_indexed_record(struct indexed_record *rec)
+{
+	int i;
+
+	if (rec->grids != NULL) {
+		for (i = 0; i < rec->fvmrcnt; i++)
+			if (rec->grids[i] != NULL)
+				free_minutiae_grid(rec->grids[i]);
+		free(rec->grids);
+	}
+	if (rec->fvmrs != NULL)
+		free(rec->fvmrs);
+	if (rec->fmbs != NULL)
+		free(rec->fmbs);
+	if (rec->geoms != NULL)
+		free(rec->geoms);
+}
+
+/*
+ * A gallery or probe set: the records of a manifest, or of a file of
+ * concatenated records.
+ */
+struct record_set {
+	CORPUS			*corpus;
+	int			count;
+	int			size;
+	struct indexed_record	*records;
+};
+
+static int
+add_record(struct record_set *set, FMR *fmr)
+{
+	struct indexed_record *records;
+	int size;
+
+	if (set->count == set->size) {
+		size = (set->size == 0) ? 64 : set->size * 2;
+		records = (struct indexed_record *)realloc(set->records,
+		    size * sizeof(struct indexed_record));
+		if (records == NULL) {
+			free_fmr(fmr);
+			ALLOC_ERR_RETURN("Record array");
+		}
+		set->records = records;
+		set->size = size;
+	}
+	if (index_record(fmr, &set->records[set->count]) != 0) {
+		free_indexed_record(&set->records[set->count]);
+		free_fmr(fmr);
+		return (-1);
+	}
+	set->count++;
+	return (0);
+}
+
+/*
+ * Read the records of a file of concatenated records.
+ */
+static int
+load_record_file(const char *path, struct record_set *set)
+{
+	FMR *fmr;
+	BDB bdb;
+	uint64_t n;
+
+	if (open_corpus(path, CORPUS_LENGTH_FMR_ANSI, CORPUS_USE_INDEX,
+	    &set->corpus) != 0)
+		ERR_OUT("Could not open %s", path);
+	for (n = 0; n < get_corpus_count(set->corpus); n++) {
+		if (new_fmr(FMR_STD_ANSI, &fmr) < 0)
+			ALLOC_ERR_OUT("Input FMR");
+		if ((get_corpus_record(set->corpus, n, &bdb) != READ_OK) ||
+		    (scan_fmr(&bdb, fmr) != READ_OK)) {
+			free_fmr(fmr);
+			ERR_OUT("Could not read record %llu of %s",
+			    (unsigned long long)n + 1, path);
+		}
+		if (add_record(set, fmr) != 0)
+			ERR_OUT("Could not index record %llu of %s",
+			    (unsigned long long)n + 1, path);
+	}
+	if (get_corpus_trailing(set->corpus) != 0)
+		ERR_OUT("Record %llu of %s is incomplete",
+		    (unsigned long long)n + 1, path);
+	return (0);
+
+err_out:
+	return (-1);
+}
+
+/*
+ * Read the records named in a manifest, one file name per line. Blank
+ * lines are ignored.
+ */
+static int
+load_manifest(FILE *fp, const char *path, struct record_set *set)
+{
+	char line[FILENAME_MAX + 2];
+	FILE *rfp = NULL;
+	FMR *fmr;
+	size_t len;
+	int lineno;
+
+	for (lineno = 1; fgets(line, sizeof(line), fp) != NULL; lineno++) {
+		len = strlen(line);
+		while ((len > 0) && ((line[len - 1] == '\n') ||
+		    (line[len - 1] == '\r')))
+			line[--len] = '\0';
+		if (len == 0)
+			continue;
+		if ((rfp = fopen(line, "rb")) == NULL)
+			ERR_OUT("Could not open %s, line %d of %s", line,
+			    lineno, path);
+		if (new_fmr(FMR_STD_ANSI, &fmr) < 0)
+			ALLOC_ERR_OUT("Input FMR");
+		if (read_fmr(rfp, fmr) != READ_OK) {
+			free_fmr(fmr);
+			ERR_OUT("Could not read FMR from %s", line);
+		}
+		(void)fclose(rfp);
+		rfp = NULL;
+		if (add_record(set, fmr) != 0)
+			ERR_OUT("Could not index FMR from %s", line);
+	}
+	if (ferror(fp))
+		READ_ERR_OUT("Manifest %s", path);
+	return (0);
+
+err_out:
+	if (rfp != NULL)
+		(void)fclose(rfp);
+	return (-1);
+}
+
+/*
+ * Read and index a gallery or probe set. A file that begins with the
+ * format identifier of a record holds concatenated records; any other
+ * file is a manifest.
+ */
+static int
+load_record_set(const char *path, struct record_set *set)
+{
+	FILE *fp;
+	char magic[FMR_FORMAT_ID_LEN];
+	int ret;
+
+	memset(set, 0, sizeof(struct record_set));
+	if ((fp = fopen(path, "rb")) == NULL)
+		ERR_OUT("Could not open %s", path);
+	if ((fread(magic, 1, sizeof(magic), fp) == sizeof(magic)) &&
+	    (memcmp(magic, FMR_FORMAT_ID, FMR_FORMAT_ID_LEN) == 0)) {
+		(void)fclose(fp);
+		ret = load_record_file(path, set);
+	} else {
+		rewind(fp);
+		ret = load_manifest(fp, path, set);
+		(void)fclose(fp);
+	}
+	if ((ret == 0) && (set->count == 0))
+		ERR_OUT("There are no records in %s", path);
+	return (ret);
+
+err_out:
+	return (-1);
+}
+
+static void
+free_record_set(struct record_set *set)
+{
+	int i;
+
+	for (i = 0; i < set->count; i++) {
+		free_indexed_record(&set->records[i]);
+		free_fmr(set->records[i].fmr);
+	}
+	if (set->records != NULL)
+		free(set->records);
+	if (set->corpus != NULL)
+		close_corpus(set->corpus);
+}
+
+/*
+ * The state shared by the threads of a batch comparison. Each record pair
+ * is one item of work, numbered in the order of the output: the gallery
+ * record, then the probe record. The threads take the next item from the
+ * shared counter, so a thread that finishes early takes on more of the
+ * remaining work. The results of the items that are not yet printed are
+ * kept in a window of slots; an item is not taken until its slot is free,
+ * which bounds the memory used when one item is slow. Whichever thread
+ * completes the item at the start of the window prints all of the
+ * completed items that follow, in order.
+ */
+struct batch {
+	struct record_set	*set[2];
+	int			total;
+	int			next;
+	int			printed;
+	int			window;
+	int			views;		// result slots per item
+	unsigned char		*done;
+	int			*status;
+	struct overlap_stats	*stats;
+	int			exit_status;
+	pthread_mutex_t		lock;
+	pthread_cond_t		cond;
+};
+
+#define BATCH_WINDOW_PER_THREAD	64
+
+/*
+ * Compare the views of a record pair, the first view of the gallery
+ * record with the first view of the probe record, and so on. Views
+ * without a counterpart in the other record are not compared.
+ */
+static int
+compare_item(struct batch *batch, int item, MDMAT *mat,
+    struct overlap_stats *stats)
+{
+	struct indexed_record *g, *p;
+	int v, ret;
+
+	g = &batch->set[0]->records[item / batch->set[1]->count];
+	p = &batch->set[1]->records[item % batch->set[1]->count];
+	ret = 0;
+	for (v = 0; (v < g->fvmrcnt) && (v < p->fvmrcnt); v++)
+		if (compare_fvmrs(g, p, v, mat, &stats[v]) != 0)
+			ret = -1;
+	return (ret);
+}
+
+/*
+ * Print the results of an item. In the edge list, each compared pair of
+ * views is a line beginning with the gallery and probe record numbers and
+ * the view number, counting from 1; in the matrix, each gallery record is
+ * a line with the total overlap count of its views for each probe record.
+ */
+static void
+print_item(struct batch *batch, int item, int status,
+    const struct overlap_stats *stats)
+{
+	struct indexed_record *g, *p;
+	int v, views, common, gi, pi;
+
+	gi = item / batch->set[1]->count;
+	pi = item % batch->set[1]->count;
+	g = &batch->set[0]->records[gi];
+	p = &batch->set[1]->records[pi];
+	views = (g->fvmrcnt < p->fvmrcnt) ? g->fvmrcnt : p->fvmrcnt;
+	if (status != 0)
+		batch->exit_status = EXIT_FAILURE;
+	if (!m_opt) {
+		for (v = 0; v < views; v++) {
+			fprintf(stdout, "%d %d %d ", gi + 1, pi + 1, v + 1);
+			print_overlap_stats(&stats[v]);
+		}
+		return;
+	}
+	common = 0;
+	for (v = 0; v < views; v++)
+		common += stats[v].common;
+	fprintf(stdout, "%s%d", (pi == 0) ? "" : " ",
+	    (status != 0) ? -1 : common);
+	if (pi == batch->set[1]->count - 1)
+		fprintf(stdout, "\n");
+}
+
+static void *
+batch_worker(void *arg)
+{
+	struct batch *batch = (struct batch *)arg;
+	struct overlap_stats *stats;
+	MDMAT mat;
+	int item, slot;
+
+	memset(&mat, 0, sizeof(MDMAT));
+	pthread_mutex_lock(&batch->lock);
+	for (;;) {
+		while ((batch->next < batch->total) &&
+		    (batch->next >= batch->printed + batch->window))
+			pthread_cond_wait(&batch->cond, &batch->lock);
+		if (batch->next >= batch->total)
+			break;
+		item = batch->next++;
+		pthread_mutex_unlock(&batch->lock);
+
+		slot = item % batch->window;
+		stats = &batch->stats[slot * batch->views];
+		batch->status[slot] = compare_item(batch, item, &mat, stats);
+
+		pthread_mutex_lock(&batch->lock);
+		batch->done[slot] = 1;
+		while ((batch->printed < batch->total) &&
+		    batch->done[batch->printed % batch->window]) {
+			slot = batch->printed % batch->window;
+			print_item(batch, batch->printed, batch->status[slot],
+			    &batch->stats[slot * batch->views]);
+			batch->done[slot] = 0;
+			batch->printed++;
+		}
+		pthread_cond_broadcast(&batch->cond);
+	}
+	pthread_mutex_unlock(&batch->lock);
+	free_minutiae_distances(&mat);
+	return (NULL);
+}
+
+/*
+ * Compare every gallery record with every probe record, using 'threads'
+ * threads, including the calling thread.
+ */
+static int
+run_batch(struct record_set *gallery, struct record_set *probes,
+    int threads)
+{
+	struct batch batch;
+	pthread_t *tids = NULL;
+	int i, started = 0;
+
+	memset(&batch, 0, sizeof(struct batch));
+	batch.set[0] = gallery;
+	batch.set[1] = probes;
+	batch.exit_status = EXIT_FAILURE;
+	if (gallery->count > INT_MAX / probes->count)
+		ERR_OUT("Too many record pairs");
+	batch.total = gallery->count * probes->count;
+	if (threads > batch.total)
+		threads = batch.total;
+	batch.window = threads * BATCH_WINDOW_PER_THREAD;
+	batch.views = 1;
+	for (i = 0; i < gallery->count; i++)
+		if (gallery->records[i].fvmrcnt > batch.views)
+			batch.views = gallery->records[i].fvmrcnt;
+	batch.done = (unsigned char *)calloc(batch.window,
+	    sizeof(unsigned char));
+	batch.status = (int *)calloc(batch.window, sizeof(int));
+	batch.stats = (struct overlap_stats *)calloc(
+	    batch.window * batch.views, sizeof(struct overlap_stats));
+	tids = (pthread_t *)malloc(threads * sizeof(pthread_t));
+	if ((batch.done == NULL) || (batch.status == NULL) ||
+	    (batch.stats == NULL) || (tids == NULL))
+		ALLOC_ERR_OUT("Batch result array");
+	batch.exit_status = EXIT_SUCCESS;
+	pthread_mutex_init(&batch.lock, NULL);
+	pthread_cond_init(&batch.cond, NULL);
+
+	for (started = 0; started < threads - 1; started++)
+		if (pthread_create(&tids[started], NULL, batch_worker,
+		    &batch) != 0)
+			break;
+	(void)batch_worker(&batch);
+	for (i = 0; i < started; i++)
+		pthread_join(tids[i], NULL);
+
+	pthread_cond_destroy(&batch.cond);
+	pthread_mutex_destroy(&batch.lock);
+
+err_out:
+	if (tids != NULL)
+		free(tids);
+	if (batch.done != NULL)
+		free(batch.done);
+	if (batch.status != NULL)
+		free(batch.status);
+	if (batch.stats != NULL)
+		free(batch.stats);
+	return (batch.exit_status);
 }
 
 int
 main(int argc, char *argv[])
 {
 	FMR *fmrs[2] = {NULL, NULL};
-	FVMR **fvmrs[2] = {NULL, NULL};
-	int i, fvmrcnt[2];
+	struct indexed_record recs[2];
+	struct record_set sets[2];
+	struct overlap_stats stats;
+	MDMAT mat;
+	int i;
 	int exit_status = EXIT_FAILURE;
 
 	get_options(argc, argv);
+	memset(recs, 0, sizeof(recs));
+	memset(&mat, 0, sizeof(MDMAT));
+
+	if (set_path[0] != NULL) {
+		memset(sets, 0, sizeof(sets));
+		for (i = 0; i < 2; i++)
+			if (load_record_set(set_path[i], &sets[i]) != 0)
+				goto batch_out;
+		exit_status = run_batch(&sets[0], &sets[1], (int)t_opt);
+batch_out:
+		free_record_set(&sets[0]);
+		free_record_set(&sets[1]);
+		exit(exit_status);
+	}
 
 	if (new_fmr(FMR_STD_ANSI, &fmrs[0]) < 0)
 		ALLOC_ERR_OUT("Input FMR");
@@ -348,33 +1705,24 @@ main(int argc, char *argv[])
 		goto err_out;
 	}
 
-	for (i = 0; i < 2; i++) {
-		/* Get all of the finger view records for each FMR */
-		fvmrcnt[i] = get_fvmr_count(fmrs[i]);
-		if (fvmrcnt[i] > 0) {
-			fvmrs[i] = (FVMR **)malloc(fvmrcnt[i] * sizeof(FVMR *));
-			if (fvmrs[i] == NULL)
-				ALLOC_ERR_OUT("FVMR Array");
-			if (get_fvmrs(fmrs[i], fvmrs[i]) != fvmrcnt[i])
-				ERR_OUT("getting FVMRs from FMR");
-
-		} else {
-			if (fvmrcnt[i] == 0)
-				ERR_OUT("there are no FVMRs in the input FMR");
-			else
-				ERR_OUT("retrieving FVMRs from input FMR");
-		}
-	}
+	/* Get all of the finger view records for each FMR, and index them */
+	for (i = 0; i < 2; i++)
+		if (index_record(fmrs[i], &recs[i]) != 0)
+			goto err_out;
 
 	/* the files must contain the same number of FVMR's */
-	if (fvmrcnt[0] != fvmrcnt[1])
+	if (recs[0].fvmrcnt != recs[1].fvmrcnt)
 		ERR_OUT("Files do not contain same number of finger view minutia records");
 
 	/* Loop through the FVMRs from the first file, and compare
 	 * to the corresponding FVMR in the second.
 	 */
-	for (i = 0; i < fvmrcnt[0]; i++)
-		compare_fvmrs(fvmrs[0][i], fvmrs[1][i]);
+	for (i = 0; i < recs[0].fvmrcnt; i++) {
+		if (compare_fvmrs(&recs[0], &recs[1], i, &mat, &stats) != 0)
+			continue;
+		print_overlap_stats(&stats);
+		total_overlapping_count += stats.common;
+	}
 
 	close_files();
 
@@ -385,14 +1733,13 @@ main(int argc, char *argv[])
 	exit_status = EXIT_SUCCESS;
 
 err_out:
+	free_minutiae_distances(&mat);
+	free_indexed_record(&recs[0]);
+	free_indexed_record(&recs[1]);
 	if (fmrs[0] != NULL)
 		free_fmr(fmrs[0]);
 	if (fmrs[1] != NULL)
 		free_fmr(fmrs[1]);
-	if (fvmrs[0] != NULL)
-		free(fvmrs[0]);
-	if (fvmrs[1] != NULL)
-		free(fvmrs[1]);
 
 	close_files();
 
@@ -264,20 +264,23 @@ err_out:
 
 /******************************************************************************/
 /* Plot the minutiae from a finger view mintuiae record onto the image        */
-/* passed in as a parameter.                                                  */
+/* passed in as a parameter. Only the minutiae that lie within the image,     */
+/* found with a spatial index, are plotted.                                   */
 /*                                                                            */
 /******************************************************************************/
 int
 plot_minutiae(gdImagePtr img, struct finger_view_minutiae_record *fvmr)
 {
-	int count, i;
+	int count, i, m;
 	int ret = -1;
-	struct finger_minutiae_data **fmds;
+	FMB *fmb;
+	const FVG *geom;
+	MGRID *grid = NULL;
+	int *order = NULL;
 	int *color_map;
 	float fx, fy;
 	int x, y;
 
-	fmds = NULL;
 	count = get_fmd_count(fvmr);
 	if (count == 0)
 		ERR_OUT("FVMR contains no minutiae");
@@ -285,38 +288,43 @@ plot_minutiae(gdImagePtr img, struct finger_view_minutiae_record *fvmr)
 	if (count < 0)
 		ERR_OUT("Retrieving minutiae from FVMR");
 
-	fmds = (struct finger_minutiae_data **) malloc(
-		    count * sizeof(struct finger_minutiae_data **));
-	if (fmds == NULL)
-		ALLOC_ERR_OUT("memory for minutiae data");
-
-	if (get_fmds(fvmr, fmds) != count)
+	fmb = get_fmb(fvmr);
+	if ((fmb == NULL) || (fmb->count != (unsigned int)count))
 		ERR_OUT("getting minutiae data");
 
+	order = (int *)malloc(count * sizeof(int));
+	if (order == NULL)
+		ALLOC_ERR_OUT("memory for minutiae order");
+	if (new_minutiae_grid(fvmr, &grid) != 0)
+		ERR_OUT("indexing minutiae");
+	count = grid_select_rectangle(grid, 0, 0, gdImageSX(img) - 1,
+	    gdImageSY(img) - 1, order);
+
 	color_map = next_color_map();
 	x = y = 0;
 	for (i = 0; i < count; i++) {
+		m = order[i];
 
-		if (fmds[i]->type > MAXTYPES - 1)
+		if (fmb->type[m] > MAXTYPES - 1)
 			ERR_OUT("minutiae type value is invalid");
 
-		// XXX Check that the point is inside the figure
-		gdImageArc(img, fmds[i]->x_coord, fmds[i]->y_coord,
+		gdImageArc(img, fmb->x_coord[m], fmb->y_coord[m],
 			   PLOTDIAM, PLOTDIAM, 0, 360,
-			   color_map[fmds[i]->type]);
+			   color_map[fmb->type[m]]);
 
 		// Plot the tail line segment
-		// XXX Check that the point is inside the figure
-		fx = fmds[i]->x_coord + 
-		    (cos(((fmds[i]->angle * 2) / 180.0) * M_PI) * PLOTLENGTH);
-		fy = fmds[i]->y_coord - 
-		    (sin(((fmds[i]->angle * 2) / 180.0) * M_PI) * PLOTLENGTH);
-		gdImageLine(img, fmds[i]->x_coord, fmds[i]->y_coord,
-			    (int)fx, (int)fy, color_map[fmds[i]->type]);
+		fx = fmb->x_coord[m] + 
+		    (cos(((fmb->angle[m] * 2) / 180.0) * M_PI) * PLOTLENGTH);
+		fy = fmb->y_coord[m] - 
+		    (sin(((fmb->angle[m] * 2) / 180.0) * M_PI) * PLOTLENGTH);
+		gdImageLine(img, fmb->x_coord[m], fmb->y_coord[m],
+			    (int)fx, (int)fy, color_map[fmb->type[m]]);
 
 	}
 	/* Draw a cross at the center of minutiae mass */
-	find_center_of_minutiae_mass(fmds, count, &x, &y);
+	geom = get_fvmr_geometry(fvmr);
+	x = geom->center_x;
+	y = geom->center_y;
 	gdImageLine(img, x, y, x - PLOTLENGTH, y, COMCOLOR);
 	gdImageLine(img, x, y, x + PLOTLENGTH, y, COMCOLOR);
 	gdImageLine(img, x, y, x, y - PLOTLENGTH, COMCOLOR);
@@ -324,8 +332,10 @@ plot_minutiae(gdImagePtr img, struct finger_view_minutiae_record *fvmr)
 
 	ret = 0;
 err_out:
-	if (fmds != NULL)
-		free(fmds);
+	if (grid != NULL)
+		free_minutiae_grid(grid);
+	if (order != NULL)
+		free(order);
 	return (ret);
 }
 
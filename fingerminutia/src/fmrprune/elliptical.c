@@ -50,9 +50,9 @@ compare_by_elliptical(const void *m1, const void *m2)
 	lm1 = (struct minutia_sort_data *)m1;
 	lm2 = (struct minutia_sort_data *)m2;
 	if (lm1->z == lm2->z)
-		if (lm1->fmd->angle < lm2->fmd->angle)
+		if (lm1->angle < lm2->angle)
 			return (-1);
-		else if (lm1->fmd->angle > lm2->fmd->angle)
+		else if (lm1->angle > lm2->angle)
 			return (1);
 		else
 			return (0);
@@ -65,50 +65,53 @@ compare_by_elliptical(const void *m1, const void *m2)
 
 /* 
  * Select by the elliptical method, as described above. Parameter
- * mcount is the total number of minutiae available. Only minutiae
- * that fall within the ellipse are returned.
+ * mcount is set to the number of minutiae that fall within the ellipse,
+ * whose block entries are stored in 'order'. Only the minutiae within
+ * the ellipse, found from the cells of the index that it covers, are
+ * sorted.
  */
 void
-select_fmd_by_elliptical(FMD **fmds, int *mcount, int a, int b)
+select_fmb_by_elliptical(const MGRID *grid, int *order, int *mcount, int x,
+    int y, int a, int b)
 {
+	const FMB *fmb = grid->fmb;
 	int m;
-	int x, y;
 	double fx, fy;
 	struct minutia_sort_data *msds;
 
+	*mcount = 0;
+	if (fmb->count == 0)
+		return;
+
+#ifdef DEBUG
+	printf("Center of mass is (%d, %d)\n", x, y);
+#endif
+	*mcount = grid_select_ellipse(grid, x, y, a, b, order);
 	if (*mcount == 0)
 		return;
 
-	/* Allocate an array to hold the sorting criteria for the FMDs */
+	/* Allocate an array to hold the sorting criteria for the entries */
 	msds = (struct minutia_sort_data *)malloc(*mcount *
 	    sizeof(struct minutia_sort_data));
 	if (msds == NULL)
 		ALLOC_ERR_EXIT("Sorting criteria array");
 
-	find_center_of_minutiae_mass(fmds, *mcount, &x, &y);
-#ifdef DEBUG
-	printf("Center of mass is (%d, %d)\n", x, y);
-#endif
 	for (m = 0; m < *mcount; m++) {
-		fx = (double)(fmds[m]->x_coord - x) / a;
-		fy = (double)(fmds[m]->y_coord - y) / b;
-		msds[m].fmd = fmds[m];
+		fx = (double)(fmb->x_coord[order[m]] - x) / a;
+		fy = (double)(fmb->y_coord[order[m]] - y) / b;
+		msds[m].idx = order[m];
+		msds[m].angle = fmb->angle[order[m]];
 		msds[m].z = (fx*fx) + (fy*fy);
 #ifdef DEBUG
 		printf("Minutiae at (%d, %d) has deltas (%f, %f) and z of %f\n",
-		    fmds[m]->x_coord, fmds[m]->y_coord, fx, fy, msds[m].z);
+		    fmb->x_coord[order[m]], fmb->y_coord[order[m]], fx, fy,
+		    msds[m].z);
 #endif
 	}
 	qsort(msds, *mcount, sizeof(struct minutia_sort_data),
 	    compare_by_elliptical);
 
-	for (m = 0; m < *mcount; m++) {
-		if (msds[m].z < 1.0) {
-			fmds[m] = msds[m].fmd;
-		} else {
-			*mcount = m;
-			break;
-		}
-	}
+	for (m = 0; m < *mcount; m++)
+		order[m] = msds[m].idx;
 	free(msds);
 }
@@ -27,6 +27,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <strings.h>
+#include <time.h>
 #include <unistd.h>
 
 #include <biomdimacro.h>
@@ -45,7 +46,7 @@ usage()
 	    "usage:\n"
 	    "\tfmrprune -i <m1file> -o <outfile> -n <num> -mp\n"
 	    "\tor\n"
-	    "\tfmrprune -i <m1file> -o <outfile> -n <num> -mr\n"
+	    "\tfmrprune -i <m1file> -o <outfile> -n <num> -mr [-s <seed>]\n"
 	    "\tor\n"
 	    "\tfmrprune -i <m1file> -o <outfile> -n <num> -me "
 		"-a <val> -b <val>\n"
@@ -61,6 +62,7 @@ usage()
 	    "\t\t -a:  Semiminor axis length (i.e. width)\n"
 	    "\t\t -b:  Semimajor axis length (i.e. height)\n"
 	    "\t   -mr: Prune using the random method\n"
+	    "\t\t -s: Seed for the random order (default: current time)\n"
 	    "\t   -ml: Prune using the rectangular method\n"
 	    "\t\t -c: Upper-left coordinate for the rectangle\n"
 	    "\t\t -a -b: width and height values for the rectangle\n");
@@ -75,8 +77,8 @@ static int a, b;
 /* Upper left coordinate of the rectangle */
 static int x, y;
 
-/* Keep track of the entire FMR length in a global. */
-static unsigned int fmr_length;
+/* Generator for the random method, seeded once for the whole run */
+static struct minutia_rng rng;
 
 /* Global file pointers */
 static FILE *in_fp = NULL;	// the FMR (378-2004) input file
@@ -133,12 +135,14 @@ get_xy(const char *str)
 static void
 get_options(int argc, char *argv[])
 {
-	int ch, i_opt, o_opt, n_opt, m_opt, a_opt, b_opt, c_opt;
-	char pm, *out_file;
+	int ch, i_opt, o_opt, n_opt, m_opt, a_opt, b_opt, c_opt, s_opt;
+	char pm, *out_file, *end;
+	unsigned long long seed;
 	struct stat sb;
 
-	i_opt = o_opt = n_opt = m_opt = a_opt = b_opt = c_opt = 0;
-	while ((ch = getopt(argc, argv, "i:o:n:m:a:b:c:")) != -1) {
+	i_opt = o_opt = n_opt = m_opt = a_opt = b_opt = c_opt = s_opt = 0;
+	seed = 0;
+	while ((ch = getopt(argc, argv, "i:o:n:m:a:b:c:s:")) != -1) {
 		switch (ch) {
 		    case 'i':
 			if ((in_fp = fopen(optarg, "rb")) == NULL)
@@ -214,6 +218,14 @@ get_options(int argc, char *argv[])
 			c_opt++;
 			break;
 
+		    case 's':
+			errno = 0;
+			seed = strtoull(optarg, &end, 10);
+			if ((*optarg == '\0') || (*end != '\0') || (errno != 0))
+				ERR_OUT("Seed must be numeric");
+			s_opt++;
+			break;
+
 		    default:
 			goto err_usage_out;
 			break;
@@ -226,10 +238,16 @@ get_options(int argc, char *argv[])
 
 	switch(prune_method) {
 	    case PRUNE_METHOD_POLAR:
-	    case PRUNE_METHOD_RANDOM:
 		if (n_opt != 1)
 			goto err_usage_out;
 		break;
+	    case PRUNE_METHOD_RANDOM:
+		if ((n_opt != 1) || (s_opt > 1))
+			goto err_usage_out;
+		if (s_opt == 0)
+			seed = (unsigned long long)time(0);
+		seed_minutia_rng(&rng, seed);
+		break;
 	    case PRUNE_METHOD_ELLIPTICAL:
 		if ((n_opt != 1) || (a_opt != 1) || (b_opt != 1))
 			goto err_usage_out;
@@ -254,15 +272,19 @@ err_out:
 	exit(EXIT_FAILURE);
 }
 
+/*
+ * Compare two minutiae block entry numbers; the block holds the minutiae
+ * in the order of their index within the FVMR.
+ */
 static int
-compare_fmd_by_index(const void *m1, const void *m2)
+compare_fmb_entry(const void *m1, const void *m2)
 {
-	FMD *lm1, *lm2;
-	lm1 = (FMD *)m1;
-	lm2 = (FMD *)m2;
-	if (lm1->index == lm2->index)	/* Should not happen */
+	int lm1, lm2;
+	lm1 = *(const int *)m1;
+	lm2 = *(const int *)m2;
+	if (lm1 == lm2)		/* Should not happen */
 		return (0);
-	else if (lm1->index < lm2->index)
+	else if (lm1 < lm2)
 		return (-1);
 	else
 		return (1);
@@ -275,7 +297,11 @@ compare_fmd_by_index(const void *m1, const void *m2)
 static int
 copy_and_select_fvmr(FVMR *src, FVMR *dst, int mcount)
 {
-	FMD **fmds, *ofmd = NULL;
+	FMB *fmb;
+	FMD *ofmd = NULL;
+	MGRID *grid = NULL;
+	const FVG *geom;
+	int *order;
 	int m, num;
 
 	/* Copy the header information from the source FVMR */
@@ -288,31 +314,47 @@ copy_and_select_fvmr(FVMR *src, FVMR *dst, int mcount)
 	dst->number_of_minutiae = 0;
 
 	dst->extended = NULL;
-	fmr_length += FEDB_HEADER_LENGTH;
 
 	num = get_fmd_count(src);
 	if (num == 0)
 		return (0);
 
-	fmds = (FMD **)malloc(num * sizeof(FMD *));
-	if (fmds == NULL)
-		ALLOC_ERR_RETURN("FMD array");
-	if (get_fmds(src, fmds) != num)
-		ERR_OUT("getting FMDs from FVMR");
+	fmb = get_fmb(src);
+	if ((fmb == NULL) || (fmb->count != (unsigned int)num))
+		ERR_OUT("getting minutiae block from FVMR");
+	order = (int *)malloc(num * sizeof(int));
+	if (order == NULL)
+		ALLOC_ERR_RETURN("minutiae order array");
+	for (m = 0; m < num; m++)
+		order[m] = m;
+
+	/* The center of mass is computed once, and kept with the view */
+	geom = get_fvmr_geometry(src);
+
+	/* The region methods find their minutiae with a spatial index */
+	if ((prune_method == PRUNE_METHOD_ELLIPTICAL) ||
+	    (prune_method == PRUNE_METHOD_RECTANGULAR)) {
+		if (new_minutiae_grid(src, &grid) != 0) {
+			free(order);
+			ERR_OUT("indexing minutiae");
+		}
+	}
 
 	switch (prune_method) {
 	    case PRUNE_METHOD_POLAR:
 		/* If more minutiae are requested than exist, return
-		   what exists. Otherwise, sort the minutiae and return
-		   the selected amount.  */
+		   what exists. Otherwise, select the requested amount
+		   from the front of the sort order.  */
 		if (mcount > num)
 			mcount = num;
 		else
-			sort_fmd_by_polar(fmds, num, 0, 0, TRUE);
+			select_fmb_top_k_polar(fmb, order, mcount,
+			    geom->center_x, geom->center_y, FALSE);
 		break;
 
 	    case PRUNE_METHOD_ELLIPTICAL:
-		select_fmd_by_elliptical(fmds, &num, a, b);
+		select_fmb_by_elliptical(grid, order, &num, geom->center_x,
+		    geom->center_y, a, b);
 		if (num < mcount)	// We may have less minutiae than asked
 			mcount = num;
 		break;
@@ -321,32 +363,31 @@ copy_and_select_fvmr(FVMR *src, FVMR *dst, int mcount)
 		if (mcount > num)
 			mcount = num;
 		else
-			sort_fmd_by_random(fmds, num);
+			select_fmb_top_k_random(fmb, order, mcount, &rng);
 		break;
 
 	    case PRUNE_METHOD_RECTANGULAR:
-		select_fmd_by_rectangular(fmds, &num, x, y, a, b);
+		select_fmb_by_rectangular(grid, order, &num, x, y, a, b);
 		mcount = num;
 		break;
 
 	}
+	if (grid != NULL)
+		free_minutiae_grid(grid);
 
-	qsort(fmds, mcount, sizeof(FMD *), compare_fmd_by_index);
+	qsort(order, mcount, sizeof(int), compare_fmb_entry);
 	for (m = 0; m < mcount; m++) {
 		if (new_fmd(FMR_STD_ANSI, &ofmd, m) < 0)
 			ALLOC_ERR_EXIT("Output FMD");
-		COPY_FMD(fmds[m], ofmd);
-		fmr_length += FMD_DATA_LENGTH;
+		fmb_to_fmd(fmb, order[m], ofmd);
 		add_fmd_to_fvmr(ofmd, dst);
 		dst->number_of_minutiae++;
 	}
 
-	free(fmds);
+	free(order);
 	return (0);
 
 err_out:
-	if (fmds != NULL)
-		free(fmds);
 	return (-1);
 }
 
@@ -373,10 +414,6 @@ main(int argc, char *argv[])
 	if (new_fmr(FMR_STD_ANSI, &ofmr) < 0)
 		ALLOC_ERR_OUT("Output FMR");
 	COPY_FMR(ifmr, ofmr);
-	if (ifmr->record_length_type == FMR_ANSI_SMALL_HEADER_TYPE)
-		fmr_length = FMR_ANSI_SMALL_HEADER_LENGTH;
-	else
-		fmr_length = FMR_ANSI_LARGE_HEADER_LENGTH;
 
 	// Get all of the finger view records
 	rcount = get_fvmr_count(ifmr);
@@ -394,7 +431,6 @@ main(int argc, char *argv[])
 			    selected_minutiae_count) < 0)
 				ERR_OUT("Selecting minutiae");
 			add_fvmr_to_fmr(ofvmr, ofmr);
-			fmr_length += FVMR_HEADER_LENGTH;
 		}
 		free(fvmrs);
 
@@ -406,7 +442,7 @@ main(int argc, char *argv[])
 	}
 
 	free_fmr(ifmr);
-	ofmr->record_length = fmr_length;
+	update_fmr_length(ofmr);
 	(void)write_fmr(out_fp, ofmr);
 	free_fmr(ofmr);
 
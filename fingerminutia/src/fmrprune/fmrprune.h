@@ -15,28 +15,33 @@
 
 /* 
  * Select by the rectangular method, as described above. Parameter
- * mcount is the total number of minutiae available, and is set
- * to the number of selected minutiae on return.
+ * mcount is set to the number of selected minutiae on return.
  *
- * fmds   - Array of FMD pointers to select; will be modified on output.
- * mcount - Number of minutiae to select on input. On output, will be set
- *          to the actual number of minutiae that were selected.
+ * grid   - The spatial index over the minutiae block to select from.
+ * order  - Array of block entry numbers, with room for every entry;
+ *          filled with the selected entries, in block order.
+ * mcount - On output, will be set to the actual number of minutiae
+ *          that were selected.
  * x      - X coordinate of the upper-left point of the rectangle.
  * y      - Y coordinate of the upper-left point of the rectangle.
  * a      - Width of the rectangle.
  * b      - Height of the rectangle.
  */
 void
-select_fmd_by_rectangular(FMD **fmds, int *mcount, int x, int y, int a, int b);
+select_fmb_by_rectangular(const MGRID *grid, int *order, int *mcount, int x,
+    int y, int a, int b);
 
-/* select_fmd_by_elliptical() modifies the input array by storing the minutiae
- * that fall within an ellipse centered on the center of mass of the
- * minutiae.
+/* select_fmb_by_elliptical() fills the order array with the block entries
+ * of the minutiae that fall within an ellipse centered on the center of
+ * mass of the minutiae.
  * Parameters:
- *   fmds   : The array of pointers to the minutia data records.
- *   mcount : The number of minutiae in input; on output, the actual
- *            number of minutiae that fall within the ellipse.
+ *   grid   : The spatial index over the minutiae block to select from.
+ *   order  : Array of block entry numbers, with room for every entry.
+ *   mcount : On output, the actual number of minutiae that fall
+ *            within the ellipse.
+ *   x, y   : The center of mass of the minutiae.
  *   a      : The semi-major axis of the ellipse.
  *   b      : The semi-minor axis of the ellipse.
  */
-void select_fmd_by_elliptical(FMD **fmds, int *mcount, int a, int b);
+void select_fmb_by_elliptical(const MGRID *grid, int *order, int *mcount,
+    int x, int y, int a, int b);
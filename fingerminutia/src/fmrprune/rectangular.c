@@ -21,43 +21,15 @@
 #include <fmr.h>
 
 void
-select_fmd_by_rectangular(FMD **fmds, int *mcount, int x, int y, int a, int b)
+select_fmb_by_rectangular(const MGRID *grid, int *order, int *mcount, int x,
+    int y, int a, int b)
 {
-	int m, lcount;
-	int Lx, Rx, Uy, Ly;
-	FMD **lfmds;
-
-	/* Allocate an array to hold a local copy of the FMD pointers */
-	lfmds = (FMD **)malloc(*mcount * sizeof(FMD *));
-	if (lfmds == NULL)
-		ALLOC_ERR_EXIT("Sorting criteria array");
-	for (m = 0; m < *mcount; m++)
-		lfmds[m] = fmds[m];
-
-	/* Set the left and right-most x, upper and lower-most y */
-	Lx = x;
-	Uy = y;
-	Rx = x + a;
-	Ly = y + b;
-
-	/* Check each minutia point for location inside the box */
-	lcount = 0;
-	for (m = 0; m < *mcount; m++) {
-		if ((lfmds[m]->x_coord >= Lx) &&
-		    (lfmds[m]->x_coord <= Rx) &&
-		    (lfmds[m]->y_coord >= Uy) &&
-		    (lfmds[m]->y_coord <= Ly)) {
-			fmds[lcount] = lfmds[m];
-			lcount++;
-		}
-	}
+	/* Find the minutiae inside the box from the cells that it covers */
+	*mcount = grid_select_rectangle(grid, x, y, a, b, order);
 #ifdef DEBUG
 	printf("Rectangle has coordinates of\n"
 	    "UL(%d, %d), UR(%d, %d), LL(%d, %d), LR(%d, %d)\n"
 	    " with %d minutiae contained within.\n",
-	    Lx, Uy, Rx, Uy, Lx, Ly, Rx, Ly, lcount);
+	    x, y, x + a, y, x, y + b, x + a, y + b, *mcount);
 #endif
-
-	*mcount = lcount;
-	free(lfmds);
 }
@@ -24,6 +24,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <strings.h>
+#include <time.h>
 #include <unistd.h>
 #include <sys/queue.h>
 #include <sys/stat.h>
@@ -38,6 +39,7 @@
 #define SORT_METHOD_XY		3
 #define SORT_METHOD_YX		4
 #define SORT_METHOD_ANGLE	5
+#define SORT_METHOD_SPEC	6
 
 #define SORT_ORDER_ASCENDING	1
 #define SORT_ORDER_DESCENDING	2
@@ -52,21 +54,27 @@ usage()
 	    "usage:\n"
 	    "\tfmrsort -i <m1file> -o <outfile> -mp [-r]\n"
 	    "\tor\n"
-	    "\tfmrsort -i <m1file> -o <outfile> -mr [-r]\n"
+	    "\tfmrsort -i <m1file> -o <outfile> -mr [-s <seed>] [-r]\n"
 	    "\tor\n"
 	    "\tfmrsort -i <m1file> -o <outfile> -mx [-r]\n"
 	    "\tor\n"
 	    "\tfmrsort -i <m1file> -o <outfile> -my [-r]\n"
 	    "\tor\n"
 	    "\tfmrsort -i <m1file> -o <outfile> -ma [-r]\n"
+	    "\tor\n"
+	    "\tfmrsort -i <m1file> -o <outfile> -k <keys> [-r]\n"
 	    "\twhere:\n"
 	    "\t   -i:  Specifies the input file\n"
 	    "\t   -o:  Specifies the output file\n"
 	    "\t   -mp: Sort using the polar method\n"
 	    "\t   -mr: Sort using the random method\n"
+	    "\t\t -s: Seed for the random order (default: current time)\n"
 	    "\t   -mx: Sort using the Cartesian X-Y method\n"
 	    "\t   -my: Sort using the Cartesian Y-X method\n"
 	    "\t   -ma: Sort using the Angle method\n"
+	    "\t   -k:  Sort by a list of keys, e.g. quality:d,polar,angle\n"
+	    "\t\t Keys are polar, x, y, angle, quality, and type, each\n"
+	    "\t\t optionally followed by :a (ascending) or :d (descending)\n"
 	    "\t   -r:  Reverse the sort order to descending\n");
 }
 
@@ -74,8 +82,11 @@ usage()
 static int sort_method;
 static int sort_order = SORT_ORDER_ASCENDING;
 
-/* Keep track of the entire FMR length in a global. */
-static unsigned int fmr_length;
+/* Keys for the sort specification method */
+static struct minutia_sort_spec sort_spec;
+
+/* Generator for the random method, seeded once for the whole run */
+static struct minutia_rng rng;
 
 /* Global file pointers */
 static FILE *in_fp = NULL;	// the FMR input file
@@ -101,12 +112,14 @@ close_files()
 static void
 get_options(int argc, char *argv[])
 {
-	int ch, i_opt, o_opt, m_opt;
-	char pm, *out_file;
+	int ch, i_opt, o_opt, m_opt, s_opt;
+	char pm, *out_file, *end;
+	unsigned long long seed;
 	struct stat sb;
 
-	i_opt = o_opt = m_opt = 0;
-	while ((ch = getopt(argc, argv, "i:o:m:r")) != -1) {
+	i_opt = o_opt = m_opt = s_opt = 0;
+	seed = 0;
+	while ((ch = getopt(argc, argv, "i:o:m:k:rs:")) != -1) {
 		switch (ch) {
 		    case 'i':
 			if ((in_fp = fopen(optarg, "rb")) == NULL)
@@ -152,10 +165,28 @@ get_options(int argc, char *argv[])
 			m_opt++;
 			break;
 
+		    case 'k':
+			if (parse_minutia_sort_spec(optarg, &sort_spec) != 0) {
+				ERRP("Invalid or repeated sort keys '%s'",
+				    optarg);
+				goto err_usage_out;
+			}
+			sort_method = SORT_METHOD_SPEC;
+			m_opt++;
+			break;
+
 		    case 'r':
 			sort_order = SORT_ORDER_DESCENDING;
 			break;
 
+		    case 's':
+			errno = 0;
+			seed = strtoull(optarg, &end, 10);
+			if ((*optarg == '\0') || (*end != '\0') || (errno != 0))
+				ERR_OUT("Seed must be numeric");
+			s_opt++;
+			break;
+
 		    default:
 			goto err_usage_out;
 			break;
@@ -165,6 +196,11 @@ get_options(int argc, char *argv[])
 	/* Check the common required options */
 	if ((i_opt != 1) || (o_opt != 1) || (m_opt != 1))
 		goto err_usage_out;
+	if (s_opt > 1)
+		goto err_usage_out;
+	if (s_opt == 0)
+		seed = (unsigned long long)time(0);
+	seed_minutia_rng(&rng, seed);
 
 	return;
 
@@ -186,52 +222,70 @@ err_out:
 	do {							\
 		if (new_fmd(src->format_std, &ofmd, m) < 0)	\
 			ALLOC_ERR_EXIT("Output FMD");		\
-		COPY_FMD(fmds[m], ofmd);			\
-		fmr_length += FMD_DATA_LENGTH;			\
+		fmb_to_fmd(fmb, order[m], ofmd);		\
 		add_fmd_to_fvmr(ofmd, dst);			\
 	} while (0)
 
 static int
 sort_and_copy_fvmr(FVMR *src, FVMR *dst)
 {
-	FMD **fmds, *ofmd = NULL;
+	FMB *fmb;
+	FMD *ofmd = NULL;
+	const FVG *geom;
+	struct minutia_sort_spec spec;
+	int *order;
 	int m, mcount;
 
 	COPY_FVMR(src, dst);
 
 	/* XXX We don't handle extended data yet. */
 	dst->extended = NULL;
-	fmr_length += FEDB_HEADER_LENGTH;
 
 	mcount = get_fmd_count(src);
 	if (mcount == 0)
 		return (0);
 
-	fmds = (FMD **)malloc(mcount * sizeof(FMD *));
-	if (fmds == NULL)
-		ALLOC_ERR_RETURN("FMD array");
-	if (get_fmds(src, fmds) != mcount)
-		ERR_OUT("getting FMDs from FVMR");
+	fmb = get_fmb(src);
+	if ((fmb == NULL) || (fmb->count != (unsigned int)mcount))
+		ERR_OUT("getting minutiae block from FVMR");
+	order = (int *)malloc(mcount * sizeof(int));
+	if (order == NULL)
+		ALLOC_ERR_RETURN("minutiae order array");
+
+	/* The center of mass is computed once, and kept with the view */
+	geom = get_fvmr_geometry(src);
 
 	switch (sort_method) {
 	    case SORT_METHOD_POLAR:
-		sort_fmd_by_polar(fmds, mcount, 0, 0, TRUE);
+		sort_fmb_by_polar(fmb, order, geom->center_x, geom->center_y,
+		    FALSE);
 		break;
 
 	    case SORT_METHOD_RANDOM:
-		sort_fmd_by_random(fmds, mcount);
+		sort_fmb_by_random_r(fmb, order, &rng);
 		break;
 
 	    case SORT_METHOD_XY:
-		sort_fmd_by_xy(fmds, mcount);
+		sort_fmb_by_xy(fmb, order);
 		break;
 
 	    case SORT_METHOD_YX:
-		sort_fmd_by_yx(fmds, mcount);
+		sort_fmb_by_yx(fmb, order);
 		break;
 
 	    case SORT_METHOD_ANGLE:
-		sort_fmd_by_angle(fmds, mcount);
+		sort_fmb_by_angle(fmb, order);
+		break;
+
+	    case SORT_METHOD_SPEC:
+		spec = sort_spec;
+		spec.centx = geom->center_x;
+		spec.centy = geom->center_y;
+		spec.usecm = FALSE;
+		if (sort_fmb_by_spec(fmb, order, &spec) != 0) {
+			free(order);
+			ERR_OUT("sorting minutiae by keys");
+		}
 		break;
 	}
 
@@ -242,12 +296,10 @@ sort_and_copy_fvmr(FVMR *src, FVMR *dst)
 		for (m = mcount - 1; m >= 0; m--)
 			DUP_FMD;
 
-	free(fmds);
+	free(order);
 	return (0);
 
 err_out:
-	if (fmds != NULL)
-		free(fmds);
 	return (-1);
 }
 
@@ -272,10 +324,6 @@ main(int argc, char *argv[])
 	if (new_fmr(FMR_STD_ANSI, &ofmr) < 0)
 		ALLOC_ERR_OUT("Output FMR");
 	COPY_FMR(ifmr, ofmr);
-	if (ifmr->record_length_type == FMR_ANSI_SMALL_HEADER_TYPE)
-		fmr_length = FMR_ANSI_SMALL_HEADER_LENGTH;
-	else
-		fmr_length = FMR_ANSI_LARGE_HEADER_LENGTH;
 
 	// Get all of the finger view records
 	rcount = get_fvmr_count(ifmr);
@@ -292,7 +340,6 @@ main(int argc, char *argv[])
 			if (sort_and_copy_fvmr(fvmrs[r], ofvmr) < 0)
 				ERR_OUT("Selecting minutiae");
 			add_fvmr_to_fmr(ofvmr, ofmr);
-			fmr_length += FVMR_HEADER_LENGTH;
 		}
 		free(fvmrs);
 
@@ -304,7 +351,7 @@ main(int argc, char *argv[])
 	}
 
 	free_fmr(ifmr);
-	ofmr->record_length = fmr_length;
+	update_fmr_length(ofmr);
 	(void)write_fmr(out_fp, ofmr);
 	free_fmr(ofmr);
 
@@ -32,59 +32,68 @@
 #include <string.h>
 #include <unistd.h>
 
+#include <biomdi.h>
 #include <biomdimacro.h>
 #include <fmr.h>
 
 int main(int argc, char *argv[])
 {
-	char *usage = "usage: fmrv <datafile>\n";
-	FILE *fp;
-	struct stat sb;
+	char *usage = "usage: fmrv [-x] <datafile>\n"
+	    "\t -x Save the record index file <datafile>.idx\n";
+	CORPUS *corpus;
+	ARENA *arena;
+	BDB fmdb;
 	struct finger_minutiae_record *fmr;
-	int ret;
-	unsigned int total_length;
+	uint64_t n;
+	int flags;
+	int ch, status;
 
-	if (argc != 2) {
-		printf("%s", usage);
-		exit (EXIT_FAILURE);
+	flags = CORPUS_USE_INDEX;
+	while ((ch = getopt(argc, argv, "x")) != -1) {
+		switch (ch) {
+		case 'x':
+			flags |= CORPUS_SAVE_INDEX;
+			break;
+		default:
+			printf("%s", usage);
+			exit (EXIT_FAILURE);
+		}
 	}
-
-	if (argv[1] == NULL) {
+	if (argc - optind != 1) {
 		printf("%s", usage);
 		exit (EXIT_FAILURE);
 	}
 
-	fp = fopen(argv[1], "rb");
-	if (fp == NULL)
-		OPEN_ERR_EXIT(argv[optind]);
-
-	if (stat(argv[1], &sb) < 0) {
-		fprintf(stderr, "Could not get stats on input file.\n");
+	if (open_corpus(argv[optind], CORPUS_LENGTH_FMR_ANSI, flags,
+	    &corpus) != 0)
 		exit (EXIT_FAILURE);
-	}
-
-	if (new_fmr(FMR_STD_ANSI, &fmr) < 0)
-		ALLOC_ERR_EXIT("Could not allocate FMR\n");
-
-	total_length = 0;
-	ret = READ_ERROR;
-	while (total_length < sb.st_size) {
-		ret = read_fmr(fp, fmr);
-		if (ret != READ_OK)
-			break;
-		total_length += fmr->record_length;
-
-		// Validate the FMR
-		if (validate_fmr(fmr) != VALIDATE_OK)
-			exit (EXIT_FAILURE);
 
-		free_fmr(fmr);
-
-		if (new_fmr(FMR_STD_ANSI, &fmr) < 0)
+	/* All records are parsed into one arena, reset after each record */
+	if (new_arena(0, &arena) != 0)
+		exit (EXIT_FAILURE);
+	status = EXIT_SUCCESS;
+	for (n = 0; n < get_corpus_count(corpus); n++) {
+		if (new_fmr_arena(FMR_STD_ANSI, arena, &fmr) < 0)
 			ALLOC_ERR_EXIT("Could not allocate FMR\n");
+		if ((get_corpus_record(corpus, n, &fmdb) != READ_OK) ||
+		    (scan_fmr(&fmdb, fmr) != READ_OK) ||
+		    (validate_fmr(fmr) != VALIDATE_OK)) {
+			status = EXIT_FAILURE;
+			break;
+		}
+		reset_arena(arena);
+	}
+	free_arena(arena);
+	if (status != EXIT_SUCCESS) {
+		close_corpus(corpus);
+		exit (EXIT_FAILURE);
 	}
-	if (ret != READ_OK)
+
+	/* An incomplete record at the end of the file is an error */
+	if ((get_corpus_count(corpus) == 0) ||
+	    (get_corpus_trailing(corpus) != 0))
 		exit (EXIT_FAILURE);
+	close_corpus(corpus);
 
 	exit (EXIT_SUCCESS);
 }
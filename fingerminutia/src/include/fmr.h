@@ -54,6 +54,9 @@
 
 #include <string.h>
 
+// Memory arena, defined in biomdi.h
+struct biomdi_arena;
+
 // Stupid
 #ifndef TRUE
 #define TRUE (1)
@@ -196,6 +199,7 @@ struct finger_minutiae_data {
 	TAILQ_ENTRY(finger_minutiae_data)	list;
 	struct finger_view_minutiae_record	*fvmr;	// back pointer to the
 							// parent FVMR
+	struct biomdi_arena			*arena;	// NULL if malloc'd
 };
 typedef struct finger_minutiae_data FMD;
 #define COPY_FMD(src, dst)				\
@@ -214,6 +218,7 @@ struct ridge_count_data {
 	TAILQ_ENTRY(ridge_count_data)	list;
 	struct ridge_count_data_block	*rcdb;		// back pointer to
 							// parent RCDB
+	struct biomdi_arena		*arena;		// NULL if malloc'd
 };
 typedef struct ridge_count_data RCD;
 #define COPY_RCD(src, dst)				\
@@ -226,6 +231,7 @@ struct ridge_count_data_block {
 	unsigned char			method;
 	TAILQ_HEAD(, ridge_count_data)	ridge_counts;
 	struct finger_extended_data	*fed;
+	struct biomdi_arena		*arena;		// NULL if malloc'd
 };
 typedef struct ridge_count_data_block RCDB;
 
@@ -243,6 +249,7 @@ struct core_data {
 #define	cd_endcopy			list
 	TAILQ_ENTRY(core_data)		list;
 	struct core_delta_data_block	*cddb;	
+	struct biomdi_arena		*arena;	// NULL if malloc'd
 };
 typedef struct core_data CD;
 #define COPY_CD(src, dst)				\
@@ -266,6 +273,7 @@ struct delta_data {
 #define	dd_endcopy			list
 	TAILQ_ENTRY(delta_data)		list;
 	struct core_delta_data_block	*cddb;
+	struct biomdi_arena		*arena;	// NULL if malloc'd
 };
 typedef struct delta_data DD;
 #define COPY_DD(src, dst)				\
@@ -285,6 +293,7 @@ struct core_delta_data_block {
 #define	cddb_endcopy			deltas
 	TAILQ_HEAD(, delta_data)	deltas;
 	struct finger_extended_data	*fed;
+	struct biomdi_arena		*arena;		// NULL if malloc'd
 };
 typedef struct core_delta_data_block CDDB;
 #define COPY_CDDB(src, dst)					\
@@ -310,6 +319,7 @@ struct finger_extended_data {
 	TAILQ_ENTRY(finger_extended_data)	list;
 	struct finger_extended_data_block	*fedb;	// back pointer to
 							// parent FEDB
+	struct biomdi_arena			*arena;	// NULL if malloc'd
 };
 typedef struct finger_extended_data FED;
 #define COPY_FED(src, dst)				\
@@ -329,6 +339,8 @@ struct finger_extended_data_block {
 	unsigned int 					partial;
 	TAILQ_HEAD(, finger_extended_data)		extended_data;
 	struct finger_view_minutiae_record		*fvmr;
+	struct biomdi_arena				*arena;	// NULL if
+								// malloc'd
 };
 typedef struct finger_extended_data_block FEDB;
 #define COPY_FEDB(src, dst)					\
@@ -336,9 +348,49 @@ typedef struct finger_extended_data_block FEDB;
             (unsigned) ((uint8_t *)&dst->fedb_endcopy -		\
 		(uint8_t *)&dst->fedb_startcopy))
 
+// Packed copy of the minutiae of a Finger View, one array per field, kept
+// alongside the list of FMD records. Entry i holds the fields of the i'th
+// minutia on the list. The block is filled by add_fmd_to_fvmr(); after an
+// FMD is changed in place, invalidate_fvmr_minutiae() marks the block to be
+// refreshed from the list, which remains the authority.
+struct finger_minutiae_block {
+	unsigned int				count;
+	unsigned int				size;	// allocated entries
+	unsigned int				failed;	// could not grow
+	unsigned short				*x_coord;	// start of
+								// storage
+	unsigned short				*y_coord;
+	unsigned char				*type;
+	unsigned char				*reserved;
+	unsigned char				*angle;
+	unsigned char				*quality;
+};
+typedef struct finger_minutiae_block FMB;
+
+// Geometry of the minutiae of a finger view, computed from the minutiae
+// block. The center is truncated to integers in the same manner as
+// find_center_of_fmb_mass(); the covariance is that of the population.
+struct finger_view_geometry {
+	int					center_x;
+	int					center_y;
+	unsigned short				x_min;	// bounding box
+	unsigned short				y_min;
+	unsigned short				x_max;
+	unsigned short				y_max;
+	double					cov_xx;
+	double					cov_xy;
+	double					cov_yy;
+	double					axis_angle;	// principal
+							// axis, radians
+	double					major_var;	// variance
+	double					minor_var;	// along axes
+};
+typedef struct finger_view_geometry FVG;
+
 // Representation of the Finger View Minutiae Record combined with the 
 // optional Extended Data
 #define FVMR_HEADER_LENGTH	4
+#define FVMR_ANSI07_HEADER_LENGTH	17
 
 // XXX The field names of this struct should be prefixed with fvmr_
 struct finger_view_minutiae_record {
@@ -359,11 +411,17 @@ struct finger_view_minutiae_record {
 	// Flag to indicate a partial FVMR was read
 	unsigned int 				partial;
 	TAILQ_HEAD(, finger_minutiae_data)	minutiae_data;
+	FMB					minutiae_block;
 	struct finger_extended_data_block	*extended;	// optional
 	TAILQ_ENTRY(finger_view_minutiae_record) list;
 	// The remaining fields of this record type are meta-data
 	struct finger_minutiae_record		*fmr;	// back pointer to 
 							// parent record
+	struct biomdi_arena			*arena;	// NULL if malloc'd
+	FVG					geometry;	// cached
+	int					geometry_valid;
+	int					minutiae_dirty;	// block
+							// needs refresh
 };
 typedef struct finger_view_minutiae_record FVMR;
 #define COPY_FVMR(src, dst)					\
@@ -416,6 +474,8 @@ struct finger_minutiae_record {
 	// Keep the next expected minimum view number; this is used during 
 	// record validation.
 	unsigned char				next_min_view[FMR_NUM_FINGER_CODES];
+	// The arena holding this record and all its parts; NULL if malloc'd
+	struct biomdi_arena			*arena;
 };
 typedef struct finger_minutiae_record FMR;
 #define COPY_FMR(src, dst)				\
@@ -423,6 +483,75 @@ typedef struct finger_minutiae_record FMR;
             (unsigned) ((uint8_t *)&dst->fmr_endcopy -	\
 		(uint8_t *)&dst->fmr_startcopy))
 
+/*
+ * Read-only views of a Finger Minutiae Record held in a memory buffer.
+ * A view records only the location of the record, its finger views, and
+ * minutiae within the buffer; the fields themselves are decoded on demand
+ * from the encoded octets. The buffer must remain valid for as long as
+ * the view is used.
+ */
+struct finger_minutiae_record_view {
+	unsigned int				format_std;
+	uint8_t					*start;	// first octet of record
+	uint8_t					*end;	// one past the last octet
+	unsigned int				header_length;
+	unsigned int				record_length;
+	unsigned int				num_views;
+};
+typedef struct finger_minutiae_record_view FMR_VIEW;
+
+struct finger_view_minutiae_record_view {
+	unsigned int				format_std;
+	uint8_t					*start;	// first octet of view
+	uint8_t					*minutiae;
+	uint8_t					*extended;	// NULL if none
+	uint8_t					*end;	// one past the last octet
+	uint8_t					*limit;	// end of the parent record
+	unsigned int				fmd_length;
+	unsigned int				number_of_minutiae;
+	unsigned int				view_index;
+	unsigned int				num_views;
+};
+typedef struct finger_view_minutiae_record_view FVMR_VIEW;
+
+/*
+ * A spatial index over the minutiae block of a finger view. The image is
+ * divided into square cells of equal size, and the block entries of the
+ * minutiae in each cell are stored together, in block order, so a query
+ * examines only the minutiae in the cells that its region overlaps. The
+ * index refers to the block, and must be rebuilt when minutiae are added.
+ */
+struct minutiae_grid {
+	const FMB				*fmb;
+	unsigned int				count;	// minutiae indexed
+	unsigned int				shift;	// log2 of cell size
+	unsigned int				columns;
+	unsigned int				rows;
+	unsigned int				*cell_start;	// by cell,
+								// plus one
+	unsigned int				*entries;	// by cell
+};
+typedef struct minutiae_grid MGRID;
+
+/*
+ * The pairwise distances between the minutiae of two blocks: entry
+ * (i, j) of each matrix, at i * stride + j, is for minutia i of the first
+ * block and minutia j of the second. Every row begins on a 32-octet
+ * boundary. The matrices are in one buffer that is reused, and grown as
+ * needed, from one computation to the next.
+ */
+struct minutiae_distance_matrix {
+	unsigned int				rows;
+	unsigned int				columns;
+	unsigned int				stride;	// entries per row
+	int32_t					*dist2;	// squared distance
+	int32_t					*dangle;	// angle
+							// difference, or NULL
+	void					*mem;	// the buffer
+	size_t					capacity;	// octets
+};
+typedef struct minutiae_distance_matrix MDMAT;
+
 /******************************************************************************/
 /* Define the interface for managing the various pieces of a Finger Minutiae  */
 /* Record.                                                                    */
@@ -445,6 +574,28 @@ typedef struct finger_minutiae_record FMR;
 int
 new_fmr(unsigned int format_std, struct finger_minutiae_record **fmr);
 
+/******************************************************************************/
+/* Allocate and initialize storage for a new Finger Minutiae Record within    */
+/* a memory arena. All the parts of the record that are later created by the  */
+/* read and scan functions are allocated from the same arena. The record      */
+/* is released, along with everything else in the arena, by reset_arena();   */
+/* free_fmr() does nothing for such a record. Passing a NULL arena is the     */
+/* same as calling new_fmr().                                                 */
+/*                                                                            */
+/* Parameters:                                                                */
+/*   format_std The standard for record (ANSI, ISO, etc.)                     */
+/*   arena      The arena from which the record is allocated.                 */
+/*   fmr        Address of the pointer to the FMR that will be allocated.     */
+/*                                                                            */
+/* Returns:                                                                   */
+/*   0      Success                                                           */
+/*  -1      Failure                                                           */
+/*                                                                            */
+/******************************************************************************/
+int
+new_fmr_arena(unsigned int format_std, struct biomdi_arena *arena,
+    struct finger_minutiae_record **fmr);
+
 /******************************************************************************/
 /* Free the storage for a Finger Minutiae Record.                             */
 /* This function does a "deep free", meaning that all storage allocated to    */
@@ -488,6 +639,25 @@ add_fvmr_to_fmr(struct finger_view_minutiae_record *fvmr,
 int
 new_fvmr(unsigned int format_std, struct finger_view_minutiae_record **fvmr);
 
+/******************************************************************************/
+/* Allocate and initialize storage for a single Finger View Record within a   */
+/* memory arena. See new_fmr_arena().                                         */
+/*                                                                            */
+/* Parameters:                                                                */
+/*   format_std The standard for record (ANSI, ISO, etc.)                     */
+/*   arena  The arena from which the record is allocated; may be NULL.        */
+/*   fvmr   Address of the pointer to the FVMR structure that will be         */
+/*          allocated.                                                        */
+/*                                                                            */
+/* Returns:                                                                   */
+/*   0      Success                                                           */
+/*  -1      Failure                                                           */
+/*                                                                            */
+/******************************************************************************/
+int
+new_fvmr_arena(unsigned int format_std, struct biomdi_arena *arena,
+    struct finger_view_minutiae_record **fvmr);
+
 /******************************************************************************/
 /* Free the storage for a single Finger View Record.                          */
 /* This function does a "deep free", meaning that all memory allocated for    */
@@ -545,6 +715,25 @@ int
 new_fmd(unsigned int format_std, struct finger_minutiae_data **fmd,
     unsigned int index);
 
+/******************************************************************************/
+/* Allocate and initialize storage for a single Finger Minutiae Data Record   */
+/* within a memory arena. See new_fmr_arena().                                */
+/*                                                                            */
+/* Parameters:                                                                */
+/*   format_std The standard for record (ANSI, ISO, etc.)                     */
+/*   arena  The arena from which the record is allocated; may be NULL.        */
+/*   fmd    Address of the pointer to the FV structure that will be allocated.*/
+/*   index  Index number of the minutiae (position within the record)         */
+/*                                                                            */
+/* Returns:                                                                   */
+/*   0      Success                                                           */
+/*  -1      Failure                                                           */
+/*                                                                            */
+/******************************************************************************/
+int
+new_fmd_arena(unsigned int format_std, struct biomdi_arena *arena,
+    struct finger_minutiae_data **fmd, unsigned int index);
+
 /******************************************************************************/
 /* Free the storage for a single Finger Minutiae Data Record.                 */
 /*                                                                            */
@@ -568,6 +757,31 @@ free_fmd(struct finger_minutiae_data *fmd);
 void
 find_center_of_minutiae_mass(FMD **fmds, int mcount, int *x, int *y);
 
+/******************************************************************************/
+/* Find the center of mass for the minutiae in a minutiae block.              */
+/*                                                                            */
+/* Parameters:                                                                */
+/*   fmb    Pointer to the minutiae block; must not be empty.                 */
+/*   x      Pointer to the X coordiniate of center, set on return             */
+/*   y      Pointer to the Y coordiniate of center, set on return             */
+/*                                                                            */
+/******************************************************************************/
+void
+find_center_of_fmb_mass(const FMB *fmb, int *x, int *y);
+
+/******************************************************************************/
+/* Compute the geometry of the minutiae in a minutiae block: the center of    */
+/* mass, bounding box, covariance, and principal axes, in one pass over the   */
+/* coordinates.                                                               */
+/*                                                                            */
+/* Parameters:                                                                */
+/*   fmb    Pointer to the minutiae block; must not be empty.                 */
+/*   geom   Pointer to the geometry that is filled.                           */
+/*                                                                            */
+/******************************************************************************/
+void
+find_fmb_geometry(const FMB *fmb, FVG *geom);
+
 /******************************************************************************/
 /* Allocate and initialize storage for a single Finger Extended Data Block.   */
 /* The record will be initialized to 'NULL' values.                           */
@@ -585,6 +799,27 @@ find_center_of_minutiae_mass(FMD **fmds, int mcount, int *x, int *y);
 int
 new_fedb(unsigned int format_std, struct finger_extended_data_block **fedb);
 
+/******************************************************************************/
+/* Allocate and initialize storage for a single Finger Extended Data Block    */
+/* within a memory arena. The Extended Data records, and their Ridge Count    */
+/* and Core/Delta data, that are read into the block are allocated from the   */
+/* same arena. See new_fmr_arena().                                           */
+/*                                                                            */
+/* Parameters:                                                                */
+/*   format_std The standard for record (ANSI, ISO, etc.)                     */
+/*   arena  The arena from which the block is allocated; may be NULL.         */
+/*   fedb   Address of the pointer to the Extended Data block that will       */
+/*          be allocated.                                                     */
+/*                                                                            */
+/* Returns:                                                                   */
+/*   0      Success                                                           */
+/*  -1      Failure                                                           */
+/*                                                                            */
+/******************************************************************************/
+int
+new_fedb_arena(unsigned int format_std, struct biomdi_arena *arena,
+    struct finger_extended_data_block **fedb);
+
 /******************************************************************************/
 /* Free the storage for a single Finger Extended Data Block.                  */
 /* This function does a "deep free", meaning that all memory allocated for    */
@@ -833,6 +1068,7 @@ scan_fmr(BDB *fmdb, struct finger_minutiae_record *fmr);
 /******************************************************************************/
 /* Write a Finger Minutiae Record to a file or memory buffer.                 */
 /* Fields within the FILE and BDB structs are modified by these functions.    */
+/* A buffer from new_growable_bdb() is enlarged as needed when pushing.       */
 /*                                                                            */
 /* Parameters:                                                                */
 /*   fp     The open file pointer.                                            */
@@ -849,6 +1085,51 @@ write_fmr(FILE *fp, struct finger_minutiae_record *fmr);
 int
 push_fmr(BDB *fmdb, struct finger_minutiae_record *fmr);
 
+/******************************************************************************/
+/* Compute the length of a Finger Minutiae Record as it would be written by   */
+/* push_fmr(), from the views and minutiae in the record. The length fields   */
+/* of the record are not used, except to choose the size of the ANSI '04     */
+/* record header, and are not changed.                                        */
+/*                                                                            */
+/* Parameters:                                                                */
+/*   fmr    Pointer to the Finger Minutiae Record.                            */
+/*                                                                            */
+/* Returns:                                                                   */
+/*   The encoded length, in octets.                                           */
+/******************************************************************************/
+uint32_t
+get_fmr_encoded_length(struct finger_minutiae_record *fmr);
+
+/******************************************************************************/
+/* Set the record length, and the length of every extended data block and     */
+/* extended data item, of a Finger Minutiae Record to match its contents.     */
+/* The ANSI '04 record length type is set to the header size that the length  */
+/* requires.                                                                  */
+/*                                                                            */
+/* Parameters:                                                                */
+/*   fmr    Pointer to the Finger Minutiae Record.                            */
+/******************************************************************************/
+void
+update_fmr_length(struct finger_minutiae_record *fmr);
+
+/******************************************************************************/
+/* Update the lengths of a Finger Minutiae Record with update_fmr_length(),   */
+/* then encode the record into a newly allocated buffer of exactly the        */
+/* record length.                                                             */
+/*                                                                            */
+/* Parameters:                                                                */
+/*   fmr    Pointer to the Finger Minutiae Record.                            */
+/*   buf    Set to the address of the buffer, which the caller must free.     */
+/*   length Set to the length of the buffer.                                  */
+/*                                                                            */
+/* Returns:                                                                   */
+/*        WRITE_OK     Success                                                */
+/*        WRITE_ERROR  Failure                                                */
+/******************************************************************************/
+int
+serialize_fmr(struct finger_minutiae_record *fmr, uint8_t **buf,
+    uint32_t *length);
+
 /******************************************************************************/
 /* Print an entire finger Minutiae Record to a file in human-readable form.   */
 /* This function does not validate the record.                                */
@@ -937,6 +1218,19 @@ write_fvmr(FILE *fp, struct finger_view_minutiae_record *fvmr);
 int
 push_fvmr(BDB *fmdb, struct finger_view_minutiae_record *fvmr);
 
+/******************************************************************************/
+/* Compute the length of a Finger View Minutiae Record as it would be written */
+/* by push_fvmr(), including the extended data block.                         */
+/*                                                                            */
+/* Parameters:                                                                */
+/*   fvmr   Pointer to the Finger View Minutiae Record.                       */
+/*                                                                            */
+/* Returns:                                                                   */
+/*   The encoded length, in octets.                                           */
+/******************************************************************************/
+unsigned int
+get_fvmr_encoded_length(struct finger_view_minutiae_record *fvmr);
+
 /******************************************************************************/
 /* Print a FVMR to a file in human-readable form.                             */
 /*                                                                            */
@@ -1124,6 +1418,29 @@ write_fedb(FILE *fp, struct finger_extended_data_block *fed);
 int
 push_fedb(BDB *fmdb, struct finger_extended_data_block *fed);
 
+/******************************************************************************/
+/* Compute the length of an Extended Data Block as it would be written by     */
+/* push_fedb(), including the block length field.                             */
+/*                                                                            */
+/* Parameters:                                                                */
+/*   fedb   Pointer to the Extended Data block; may be NULL.                  */
+/*                                                                            */
+/* Returns:                                                                   */
+/*   The encoded length, in octets.                                           */
+/******************************************************************************/
+unsigned int
+get_fedb_encoded_length(struct finger_extended_data_block *fedb);
+
+/******************************************************************************/
+/* Set the length of each ridge count and core/delta extended data item, and  */
+/* the block length, of an Extended Data Block to match its contents.         */
+/*                                                                            */
+/* Parameters:                                                                */
+/*   fedb   Pointer to the Extended Data block; may be NULL.                  */
+/******************************************************************************/
+void
+update_fedb_length(struct finger_extended_data_block *fedb);
+
 /******************************************************************************/
 /* Print an entire Extended Data Block to a file in human-readable form.      */
 /*                                                                            */
@@ -1560,6 +1877,211 @@ int
 get_fmds(struct finger_view_minutiae_record *fvmr,
          struct finger_minutiae_data *fmds[]);
 
+/******************************************************************************/
+/* Return the packed minutiae block of an FVMR. The block holds the fields of */
+/* the minutiae in the order they appear in the FVMR. The FVMR is not        */
+/* modified unless invalidate_fvmr_minutiae() was called since the block was  */
+/* last refreshed. The block must not be modified by the caller.              */
+/*                                                                            */
+/* Parameters:                                                                */
+/*   fvmr    Pointer to the Finger View Minutiae Record.                      */
+/*                                                                            */
+/* Returns:                                                                   */
+/*   Pointer to the block, NULL if memory for the block could not be          */
+/*   allocated when minutiae were added.                                      */
+/******************************************************************************/
+FMB *
+get_fmb(struct finger_view_minutiae_record *fvmr);
+
+/******************************************************************************/
+/* Return the geometry of the minutiae of an FVMR, as computed by             */
+/* find_fmb_geometry(). The geometry is computed when first requested and     */
+/* kept with the FVMR until minutiae are added or invalidate_fvmr_minutiae()  */
+/* is called.                                                                 */
+/*                                                                            */
+/* Parameters:                                                                */
+/*   fvmr    Pointer to the Finger View Minutiae Record.                      */
+/*                                                                            */
+/* Returns:                                                                   */
+/*   Pointer to the geometry, NULL if the FVMR has no minutiae or its         */
+/*   minutiae block is not available.                                         */
+/******************************************************************************/
+const FVG *
+get_fvmr_geometry(struct finger_view_minutiae_record *fvmr);
+
+void
+invalidate_fvmr_geometry(struct finger_view_minutiae_record *fvmr);
+
+/******************************************************************************/
+/* Mark the minutiae of an FVMR as changed, after an FMD on its list was      */
+/* modified, added or removed other than by add_fmd_to_fvmr(). The minutiae   */
+/* block and geometry are rebuilt from the list when next requested or when   */
+/* the FVMR is written.                                                       */
+/*                                                                            */
+/* Parameters:                                                                */
+/*   fvmr    Pointer to the Finger View Minutiae Record.                      */
+/******************************************************************************/
+void
+invalidate_fvmr_minutiae(struct finger_view_minutiae_record *fvmr);
+
+/******************************************************************************/
+/* Copy the fields of one entry of a minutiae block into an FMD, in the same  */
+/* manner as COPY_FMD(); the format standard and index of the FMD are not     */
+/* changed.                                                                   */
+/*                                                                            */
+/* Parameters:                                                                */
+/*   fmb     Pointer to the minutiae block.                                   */
+/*   i       The entry to copy, starting at 0.                                */
+/*   fmd     Pointer to the Finger Minutiae Data record that is filled.       */
+/******************************************************************************/
+void
+fmb_to_fmd(const FMB *fmb, unsigned int i, struct finger_minutiae_data *fmd);
+
+/******************************************************************************/
+/* Return the length of a single Finger Minutiae Data record as encoded in a  */
+/* record of the given format.                                                */
+/*                                                                            */
+/* Parameters:                                                                */
+/*   format_std  One of the FMR_STD_* values.                                 */
+/*                                                                            */
+/* Returns:                                                                   */
+/*   The record length, in octets.                                            */
+/******************************************************************************/
+unsigned int
+get_fmd_data_length(unsigned int format_std);
+
+/******************************************************************************/
+/* Decode a run of consecutive Finger Minutiae Data records into a minutiae   */
+/* block, producing the same field values as scan_fmd(). The block must have  */
+/* room for the entries; its count is not changed.                            */
+/*                                                                            */
+/* Parameters:                                                                */
+/*   fmb         Pointer to the minutiae block.                               */
+/*   first       The first entry of the block that is filled.                 */
+/*   count       The number of records to decode.                             */
+/*   format_std  The format of the records.                                   */
+/*   buf         Pointer to the first record; the buffer must hold count      */
+/*               times get_fmd_data_length(format_std) octets.                */
+/******************************************************************************/
+void
+decode_fmb(FMB *fmb, unsigned int first, unsigned int count,
+    unsigned int format_std, const uint8_t *buf);
+
+/******************************************************************************/
+/* Encode entries of a minutiae block as a run of consecutive Finger Minutiae */
+/* Data records, producing the same octets as push_fmd().                     */
+/*                                                                            */
+/* Parameters:                                                                */
+/*   fmb         Pointer to the minutiae block.                               */
+/*   first       The first entry of the block that is encoded.                */
+/*   count       The number of entries to encode.                             */
+/*   format_std  The format of the records.                                   */
+/*   buf         Pointer to the output; the buffer must have room for count   */
+/*               times get_fmd_data_length(format_std) octets.                */
+/******************************************************************************/
+void
+encode_fmb(const FMB *fmb, unsigned int first, unsigned int count,
+    unsigned int format_std, uint8_t *buf);
+
+/******************************************************************************/
+/* Build a spatial index over the minutiae of a finger view. The cell size is */
+/* chosen from the image size in the header of the parent record, or of the   */
+/* view itself for ANSI '07, so that each cell holds one or two minutiae on   */
+/* average; minutiae outside the image are placed in the nearest cell.        */
+/* new_fmb_grid() builds the index over a minutiae block, for an image of     */
+/* the given size.                                                            */
+/*                                                                            */
+/* Parameters:                                                                */
+/*   fvmr    Pointer to the Finger View Minutiae Record.                      */
+/*   fmb     Pointer to the minutiae block.                                   */
+/*   x_size  The width and height of the image, in pixels; 0 if unknown.      */
+/*   y_size                                                                   */
+/*   grid    Address of the pointer to the index that will be allocated.      */
+/*                                                                            */
+/* Returns:                                                                   */
+/*   0      Success                                                           */
+/*  -1      Failure                                                           */
+/******************************************************************************/
+int
+new_minutiae_grid(struct finger_view_minutiae_record *fvmr, MGRID **grid);
+
+int
+new_fmb_grid(const FMB *fmb, unsigned int x_size, unsigned int y_size,
+    MGRID **grid);
+
+/******************************************************************************/
+/* Free the storage for a minutiae spatial index.                             */
+/*                                                                            */
+/* Parameters:                                                                */
+/*   grid    Pointer to the index.                                            */
+/******************************************************************************/
+void
+free_minutiae_grid(MGRID *grid);
+
+/******************************************************************************/
+/* Find the minutiae within a region, using a spatial index. Each function    */
+/* fills 'order', which must have room for grid->count entries, with the      */
+/* block entries of the minutiae found, in block order, and returns their     */
+/* count. The regions are:                                                    */
+/*   rectangle   x <= X <= x + a and y <= Y <= y + b.                         */
+/*   ellipse     ((X - x) / a)^2 + ((Y - y) / b)^2 < 1, computed in double    */
+/*               precision; a and b must be positive.                         */
+/*   radius      (X - x)^2 + (Y - y)^2 <= r^2.                                */
+/*                                                                            */
+/* grid_select_nearest() fills 'order' with the k minutiae nearest to (x, y), */
+/* or all of them if there are fewer, in ascending order of distance; those   */
+/* at equal distances are in block order. It returns -1 on failure.           */
+/******************************************************************************/
+int
+grid_select_rectangle(const MGRID *grid, int x, int y, int a, int b,
+    int *order);
+
+int
+grid_select_ellipse(const MGRID *grid, int x, int y, int a, int b,
+    int *order);
+
+int
+grid_select_radius(const MGRID *grid, int x, int y, int r, int *order);
+
+int
+grid_select_nearest(const MGRID *grid, int x, int y, int k, int *order);
+
+/******************************************************************************/
+/* Compute the squared distance between every minutia of one block and every  */
+/* minutia of another and, if angle_units is not 0, the difference of their   */
+/* angles: the smaller of the two arcs between them, in units of the record,  */
+/* where angle_units is the number of units in a full circle (180 for ANSI,   */
+/* 256 for ISO). The angles must be less than angle_units, and the            */
+/* coordinates, as in all formats, must fit in 14 bits. The rows are computed */
+/* eight entries at a time with AVX2 when the processor supports it; the      */
+/* results are the same either way.                                           */
+/*                                                                            */
+/* The matrix must be zeroed before its first use, and its buffer freed with  */
+/* free_minutiae_distances() after its last.                                  */
+/*                                                                            */
+/* Parameters:                                                                */
+/*   a            Pointer to the minutiae block of the rows.                  */
+/*   b            Pointer to the minutiae block of the columns.               */
+/*   angle_units  The units in a full circle, or 0 for no angle matrix.       */
+/*   mat          Pointer to the matrix.                                      */
+/*                                                                            */
+/* Returns:                                                                   */
+/*   0      Success                                                           */
+/*  -1      Failure                                                           */
+/******************************************************************************/
+int
+compute_minutiae_distances(const FMB *a, const FMB *b,
+    unsigned int angle_units, MDMAT *mat);
+
+/******************************************************************************/
+/* Free the buffer of a distance matrix.                                      */
+/*                                                                            */
+/* Parameters:                                                                */
+/*   mat     Pointer to the matrix.                                           */
+/******************************************************************************/
+void
+free_minutiae_distances(MDMAT *mat);
+
 /******************************************************************************/
 /* Return the count of Ridge Count Data records contained in a FVMR.          */
 /*                                                                            */
@@ -1640,4 +2162,130 @@ int
 get_deltas(struct finger_view_minutiae_record *fvmr,
            struct delta_data *deltas[]);
 
+/******************************************************************************/
+/* Define the interface for read-only views of Finger Minutiae Records.       */
+/* These functions never allocate memory; all fields are decoded directly     */
+/* from the record octets held in the buffer.                                 */
+/******************************************************************************/
+
+/******************************************************************************/
+/* Initialize a view of the Finger Minutiae Record starting at the current    */
+/* location of a buffer. Only the record header is examined. On success, the  */
+/* buffer is positioned at the octet following the record, so this function  */
+/* can be called repeatedly to step through concatenated records. For the     */
+/* ISO card formats, the record is taken to be the remainder of the buffer.   */
+/*                                                                            */
+/* Parameters:                                                                */
+/*   fmdb       Pointer to the biometric data block containing the record.    */
+/*   format_std The standard for record (ANSI, ISO, etc.)                     */
+/*   fmrv       Pointer to the view that will be initialized.                 */
+/*                                                                            */
+/* Returns:                                                                   */
+/*        READ_OK     Success                                                 */
+/*        READ_EOF    The buffer does not contain the entire record           */
+/*        READ_ERROR  Failure                                                 */
+/******************************************************************************/
+int
+fmr_view_init(BDB *fmdb, unsigned int format_std,
+    struct finger_minutiae_record_view *fmrv);
+
+/******************************************************************************/
+/* Return the number of finger views, or the record length, from the header  */
+/* of a viewed record.                                                        */
+/*                                                                            */
+/* Parameters:                                                                */
+/*   fmrv   Pointer to the Finger Minutiae Record view.                       */
+/******************************************************************************/
+unsigned int
+fmr_view_num_views(struct finger_minutiae_record_view *fmrv);
+
+unsigned int
+fmr_view_record_length(struct finger_minutiae_record_view *fmrv);
+
+/******************************************************************************/
+/* Decode the header fields of a viewed record into an FMR structure. Only    */
+/* the header fields are filled in; the finger view list is not modified.     */
+/*                                                                            */
+/* Parameters:                                                                */
+/*   fmrv   Pointer to the Finger Minutiae Record view.                       */
+/*   fmr    Pointer to the FMR that receives the header fields.               */
+/******************************************************************************/
+void
+fmr_view_header(struct finger_minutiae_record_view *fmrv,
+    struct finger_minutiae_record *fmr);
+
+/******************************************************************************/
+/* Position a finger view on the first, or next, Finger View Minutiae Record  */
+/* of a viewed record.                                                        */
+/*                                                                            */
+/* Parameters:                                                                */
+/*   fmrv   Pointer to the Finger Minutiae Record view.                       */
+/*   fvmrv  Pointer to the Finger View Minutiae Record view.                  */
+/*                                                                            */
+/* Returns:                                                                   */
+/*        READ_OK     Success                                                 */
+/*        READ_EOF    No more finger views, or the view is truncated          */
+/******************************************************************************/
+int
+fmr_view_first(struct finger_minutiae_record_view *fmrv,
+    struct finger_view_minutiae_record_view *fvmrv);
+
+int
+fvmr_view_next(struct finger_view_minutiae_record_view *fvmrv);
+
+/******************************************************************************/
+/* Decode the header fields of a viewed finger view into an FVMR structure.   */
+/* The minutiae list and extended data of the FVMR are not modified.          */
+/*                                                                            */
+/* Parameters:                                                                */
+/*   fvmrv  Pointer to the Finger View Minutiae Record view.                  */
+/*   fvmr   Pointer to the FVMR that receives the header fields.              */
+/******************************************************************************/
+void
+fvmr_view_header(struct finger_view_minutiae_record_view *fvmrv,
+    struct finger_view_minutiae_record *fvmr);
+
+/******************************************************************************/
+/* Return the number of minutiae in a viewed finger view.                     */
+/*                                                                            */
+/* Parameters:                                                                */
+/*   fvmrv  Pointer to the Finger View Minutiae Record view.                  */
+/******************************************************************************/
+unsigned int
+fvmr_view_num_minutiae(struct finger_view_minutiae_record_view *fvmrv);
+
+/******************************************************************************/
+/* Decode a single minutia of a viewed finger view into a caller-supplied     */
+/* FMD. The list linkage and parent pointer of the FMD are not modified, so   */
+/* the FMD may be a local variable.                                           */
+/*                                                                            */
+/* Parameters:                                                                */
+/*   fvmrv  Pointer to the Finger View Minutiae Record view.                  */
+/*   i      Index of the minutia, starting at 0.                              */
+/*   fmd    Pointer to the FMD that receives the minutia.                     */
+/*                                                                            */
+/* Returns:                                                                   */
+/*        READ_OK     Success                                                 */
+/*        READ_ERROR  Index out of range                                      */
+/******************************************************************************/
+int
+fvmr_view_minutia(struct finger_view_minutiae_record_view *fvmrv,
+    unsigned int i, struct finger_minutiae_data *fmd);
+
+/******************************************************************************/
+/* Initialize a buffer covering the Finger Extended Data Block of a viewed    */
+/* finger view, suitable for passing to scan_fedb().                          */
+/*                                                                            */
+/* Parameters:                                                                */
+/*   fvmrv   Pointer to the Finger View Minutiae Record view.                 */
+/*   fedbdb  Pointer to the BDB that will be initialized.                     */
+/*                                                                            */
+/* Returns:                                                                   */
+/*        READ_OK     Success                                                 */
+/*        READ_EOF    There is no extended data in the view                   */
+/******************************************************************************/
+int
+fvmr_view_extended(struct finger_view_minutiae_record_view *fvmrv,
+    BDB *fedbdb);
+
 #endif /* !_FMR_H */
@@ -66,3 +66,63 @@ int iso2ansi_fvmr(FVMR *ifvmr, FVMR *ofvmr, unsigned int *length,
  */
 int isocc2ansi_fvmr(FVMR *ifvmr, FVMR *ofvmr, unsigned int *length,
     const unsigned short xres, const unsigned short yres);
+
+/*
+ * A transcoder converts Finger Minutiae Records from one format to another
+ * directly between encoded buffers, without building the FMR, FVMR, and FMD
+ * structures. The angle and quality of each minutia are converted by
+ * tables made when the transcoder is initialized, and the coordinates by
+ * integer arithmetic, rounding to the nearest unit. Conversions follow the
+ * functions above, and are also done between the ISO formats and between
+ * the ANSI formats. Extended data is not converted; each output finger
+ * view has an empty extended data block.
+ */
+struct finger_minutiae_record_transcoder {
+	unsigned int	in_std;
+	unsigned int	out_std;
+	unsigned short	x_resolution;	// for ISO card format input
+	unsigned short	y_resolution;
+	uint8_t		angle[256];	// output angle by input angle
+	uint8_t		quality[256];	// output quality by input quality
+};
+typedef struct finger_minutiae_record_transcoder FMR_TRANSCODER;
+
+/*
+ * Initialize a transcoder.
+ * Parameters:
+ *  fmrt    - The transcoder
+ *  in_std  - The format standard of the input records
+ *  out_std - The format standard of the output records
+ *  x_resolution, y_resolution -
+ *            The resolution of the image, in pixels per centimeter, for
+ *            input in an ISO card format; records in the other formats
+ *            carry their own.
+ * Returns:
+ *   0 on success, -1 if a format standard is invalid.
+ */
+int init_fmr_transcoder(FMR_TRANSCODER *fmrt, unsigned int in_std,
+    unsigned int out_std, unsigned short x_resolution,
+    unsigned short y_resolution);
+
+/*
+ * Return the length of the record that transcode_fmr() will produce for
+ * a viewed record.
+ */
+uint32_t get_transcoded_fmr_length(const FMR_TRANSCODER *fmrt,
+    struct finger_minutiae_record_view *fmrv);
+
+/*
+ * Convert a viewed record and push the result into a buffer. A record in
+ * the output format is copied unchanged. As there is no finger view header
+ * in the card formats, the minutiae of every view are written one after
+ * another for card output.
+ * Parameters:
+ *  fmrt   - The transcoder
+ *  fmrv   - View of the record to convert, in the input format
+ *  fmdb   - The buffer, which must have room for the record or be growable
+ * Returns:
+ *  WRITE_OK on success, WRITE_ERROR on failure; on failure the buffer may
+ *  hold part of the record past its original position.
+ */
+int transcode_fmr(const FMR_TRANSCODER *fmrt,
+    struct finger_minutiae_record_view *fmrv, BDB *fmdb);
@@ -13,11 +13,14 @@
  */
 struct minutia_sort_data {
 	FMD	*fmd;
+	int	idx;		// entry in the minutiae block, when sorting
+				// a block instead of FMDs
 	int	distance;	// linear distance between two points
 	double	z;		// floating point distance
-	int	rand;		// a random number associated with the record
 	unsigned short	maj_coord;	// The major coordinate
 	unsigned short	min_coord;	// The minor coordinate
+	unsigned char	angle;
+	unsigned char	quality;
 };
 
 /*
@@ -45,14 +48,38 @@ struct minutia_sort_data {
 void sort_fmd_by_polar(FMD **fmds, int mcount, unsigned short centx,
     unsigned short centy, int usecm);
 
+/*
+ * The state of the pseudo-random number generator used by the random
+ * sorting functions. Each thread, or each job that must be reproducible,
+ * keeps its own state, seeded with seed_minutia_rng(). The same seed
+ * always produces the same sequence of values from next_minutia_rng().
+ */
+struct minutia_rng {
+	uint64_t	s[4];
+};
+
+void seed_minutia_rng(struct minutia_rng *rng, uint64_t seed);
+uint64_t next_minutia_rng(struct minutia_rng *rng);
+
 /* sort_fmd_by_random() modifies the input array by sorting the minutiae
- * randomly.
+ * randomly. The numbers come from a generator that each thread seeds from
+ * the current time on first use, so successive calls give different
+ * orders; use sort_fmd_by_random_r() for a reproducible order.
  * Parameters:
  *   fmds   : The array of pointers to the minutia data records.
  *   mcount : The number of minutiae.
  */
 void sort_fmd_by_random(FMD **fmds, int mcount);
 
+/* sort_fmd_by_random_r() modifies the input array by shuffling the
+ * minutiae, in linear time, using numbers from the given generator.
+ * Parameters:
+ *   fmds   : The array of pointers to the minutia data records.
+ *   mcount : The number of minutiae.
+ *   rng    : The seeded generator state, which is updated.
+ */
+void sort_fmd_by_random_r(FMD **fmds, int mcount, struct minutia_rng *rng);
+
 /* sort_fmd_by_xy() modifies the input array by sorting the minutiae
  * according to Cartesian x-y coordinates: Sort by the X coordinate,
  * and if they are equal, use the Y coordinate.
@@ -88,3 +115,158 @@ void sort_fmd_by_angle(FMD **fmds, int mcount);
  *   mcount : The number of minutiae.
  */
 void sort_fmd_by_quality(FMD **fmds, int mcount);
+
+/*
+ * Declare the sorting functions for minutiae blocks. These functions use
+ * the same criteria as the functions above, but do not modify the block;
+ * instead, the array 'order' is filled with the block entry numbers of the
+ * minutiae in sorted order. The 'order' array must have room for
+ * fmb->count entries.
+ */
+void sort_fmb_by_polar(const FMB *fmb, int *order, unsigned short centx,
+    unsigned short centy, int usecm);
+void sort_fmb_by_random(const FMB *fmb, int *order);
+void sort_fmb_by_random_r(const FMB *fmb, int *order,
+    struct minutia_rng *rng);
+void sort_fmb_by_xy(const FMB *fmb, int *order);
+void sort_fmb_by_yx(const FMB *fmb, int *order);
+void sort_fmb_by_angle(const FMB *fmb, int *order);
+void sort_fmb_by_quality(const FMB *fmb, int *order);
+
+/*
+ * Declare the selection functions. Each gives the first 'k' minutiae of
+ * the order produced by the corresponding sorting function, exactly as
+ * sorting and keeping the first 'k' would, but without ordering the
+ * remaining minutiae; the cost grows with the logarithm of 'k' rather
+ * than of the number of minutiae. When 'k' is not less than the number
+ * of minutiae, all are sorted.
+ *
+ * The select_fmd_* functions move the selected minutiae to the front of
+ * the array, in order; the rest follow in an unspecified order. The
+ * select_fmb_* functions fill the first 'k' entries of the 'order' array,
+ * which must have room for fmb->count entries. The random selections use
+ * the same numbers from the generator as the random sorts, so a seed
+ * selects the first minutiae of the order that it sorts into.
+ */
+void select_fmd_top_k_polar(FMD **fmds, int mcount, int k,
+    unsigned short centx, unsigned short centy, int usecm);
+void select_fmd_top_k_quality(FMD **fmds, int mcount, int k);
+void select_fmd_top_k_random(FMD **fmds, int mcount, int k,
+    struct minutia_rng *rng);
+void select_fmb_top_k_polar(const FMB *fmb, int *order, int k,
+    unsigned short centx, unsigned short centy, int usecm);
+void select_fmb_top_k_quality(const FMB *fmb, int *order, int k);
+void select_fmb_top_k_random(const FMB *fmb, int *order, int k,
+    struct minutia_rng *rng);
+
+/*
+ * The sorting engine used by the functions above. The sort criteria of
+ * each minutia are packed into an integer key, with the primary criterion
+ * in the high bits, and sort_minutia_keys() fills 'order' with the entry
+ * numbers 0 to count - 1, in ascending order of the low 'keybits' bits
+ * of the keys. The sort is stable, so minutiae with equal keys remain in
+ * their original order. 'scratch' must have room for 'count' entries.
+ */
+void sort_minutia_keys(const uint64_t *keys, int count, int keybits,
+    int *order, int *scratch);
+
+/*
+ * Fill the first 'k' entries of 'order' as sort_minutia_keys() would,
+ * using a heap of 'k' keys. The keys are modified. 'order' must have
+ * room for 'count' entries, as must 'scratch'.
+ */
+void select_minutia_keys(uint64_t *keys, int count, int keybits, int k,
+    int *order, int *scratch);
+
+/*
+ * Space for the keys, order, and scratch arrays of the sorting engine.
+ * The arrays are within the structure itself for up to
+ * MINUTIA_SORT_STACK_COUNT minutiae, more than any view can have in the
+ * ANSI and ISO formats, so no memory is allocated when the structure is
+ * on the stack. init_minutia_sort_space() returns -1 if the arrays for a
+ * larger count cannot be allocated. free_minutia_sort_space() may be called
+ * on a space whose initialization failed, or that was already freed.
+ */
+#define MINUTIA_SORT_STACK_COUNT	256
+struct minutia_sort_space {
+	uint64_t	*keys;
+	int		*order;
+	int		*scratch;
+	uint64_t	key_buf[MINUTIA_SORT_STACK_COUNT];
+	int		order_buf[MINUTIA_SORT_STACK_COUNT];
+	int		scratch_buf[MINUTIA_SORT_STACK_COUNT];
+};
+
+int init_minutia_sort_space(struct minutia_sort_space *space, int count);
+void free_minutia_sort_space(struct minutia_sort_space *space);
+
+/*
+ * Sort an array of minutia data records by the keys in 'space', or move
+ * the first 'k' in key order to the front of the array.
+ */
+void sort_fmd_by_keys(FMD **fmds, int mcount, int keybits,
+    struct minutia_sort_space *space);
+void select_fmd_by_keys(FMD **fmds, int mcount, int keybits, int k,
+    struct minutia_sort_space *space);
+
+/*
+ * A sort specification orders minutiae by several criteria at once: the
+ * minutiae are ordered by the first key, those with equal values of the
+ * first key by the second, and so on. Each key may be ascending or
+ * descending. The values of all keys are packed into one integer per
+ * minutia, so the whole specification costs a single sort.
+ *
+ * The polar key is the square of the distance from the center of
+ * minutiae mass, or from (centx, centy) when usecm is false; unlike
+ * sort_fmd_by_polar(), it does not order equal distances by angle, so
+ * "polar,angle" gives that order. The widths of the keys, in bits, are
+ * given by MINUTIA_SORT_KEY_BITS(), and their sum cannot exceed 64.
+ */
+#define MINUTIA_SORT_KEY_POLAR		1
+#define MINUTIA_SORT_KEY_X		2
+#define MINUTIA_SORT_KEY_Y		3
+#define MINUTIA_SORT_KEY_ANGLE		4
+#define MINUTIA_SORT_KEY_QUALITY	5
+#define MINUTIA_SORT_KEY_TYPE		6
+
+#define MINUTIA_SORT_KEY_BITS(key)					\
+	((key) == MINUTIA_SORT_KEY_POLAR ? 32 :				\
+	    ((key) == MINUTIA_SORT_KEY_X || (key) == MINUTIA_SORT_KEY_Y) ? \
+	    16 : 8)
+
+#define MINUTIA_SORT_MAX_KEYS		8
+
+struct minutia_sort_spec {
+	int		count;
+	struct {
+		int	key;		// one of MINUTIA_SORT_KEY_*
+		int	descending;	// true to sort this key downward
+	}		keys[MINUTIA_SORT_MAX_KEYS];
+	unsigned short	centx;		// center for the polar key
+	unsigned short	centy;
+	int		usecm;		// use the center of minutiae mass
+};
+
+/* parse_minutia_sort_spec() fills a sort specification from a string of
+ * comma-separated key names, each optionally followed by ":a" (ascending,
+ * the default) or ":d" (descending); for example, "quality:d,polar,angle".
+ * The key names are "polar", "x", "y", "angle", "quality" and "type", and
+ * each may be abbreviated to its first letter. The polar key uses the
+ * center of minutiae mass.
+ * Returns 0 on success, -1 if the string is not a valid specification,
+ * including when a key is repeated or the keys need more than 64 bits.
+ */
+int parse_minutia_sort_spec(const char *str, struct minutia_sort_spec *spec);
+
+/* sort_fmd_by_spec() modifies the input array by sorting the minutiae in
+ * the order given by the sort specification. sort_fmb_by_spec() fills
+ * 'order', which must have room for fmb->count entries, with the block
+ * entry numbers in that order. Minutiae equal in all keys keep their
+ * original order.
+ * Both return 0 on success, -1 if the specification is not valid or
+ * memory cannot be allocated.
+ */
+int sort_fmd_by_spec(FMD **fmds, int mcount,
+    const struct minutia_sort_spec *spec);
+int sort_fmb_by_spec(const FMB *fmb, int *order,
+    const struct minutia_sort_spec *spec);
@@ -24,27 +24,9 @@
 #include <fmrsort.h>
 
 /*
- * Compare two minutiae records by the minutiae angle.
+ * The key is the angle of the minutia, an octet.
  */
-static int
-compare_by_angle(const void *m1, const void *m2)
-{
-	FMD **lmpp;
-	FMD *lm1, *lm2;
-
-	lmpp = (FMD **)m1;
-	lm1 = (FMD *)*lmpp;
-	lmpp = (FMD **)m2;
-	lm2 = (FMD *)*lmpp;
-
-	if (lm1->angle == lm2->angle)
-		return (0);
-	else
-		if (lm1->angle < lm2->angle)
-			return (-1);
-		else
-			return (1);
-}
+#define ANGLE_KEY_BITS		8
 
 /*
  * Sort a set of finger minutiae data in Angle order.
@@ -53,23 +35,38 @@ void
 sort_fmd_by_angle(FMD **fmds, int mcount)
 {
 	int m;
-	FMD **lfmds;
+	struct minutia_sort_space space;
 
 	if (mcount == 0)
 		return;
 
-	/* Allocate an array to hold the sorting criteria for the FMDs */
-	lfmds = (FMD **)malloc(mcount * sizeof(FMD *));
-	if (lfmds == NULL)
+	if (init_minutia_sort_space(&space, mcount) != 0)
 		ALLOC_ERR_EXIT("Sorting criteria array");
 
 	for (m = 0; m < mcount; m++)
-		lfmds[m] = fmds[m];
-	
-	qsort(lfmds, mcount, sizeof(FMD *), compare_by_angle);
+		space.keys[m] = fmds[m]->angle;
+	sort_fmd_by_keys(fmds, mcount, ANGLE_KEY_BITS, &space);
+
+	free_minutia_sort_space(&space);
+}
+
+void
+sort_fmb_by_angle(const FMB *fmb, int *order)
+{
+	int m, mcount;
+	struct minutia_sort_space space;
+
+	mcount = fmb->count;
+	if (mcount == 0)
+		return;
+
+	if (init_minutia_sort_space(&space, mcount) != 0)
+		ALLOC_ERR_EXIT("Sorting criteria array");
 
 	for (m = 0; m < mcount; m++)
-		fmds[m] = lfmds[m];
+		space.keys[m] = fmb->angle[m];
+	sort_minutia_keys(space.keys, mcount, ANGLE_KEY_BITS, order,
+	    space.scratch);
 
-	free(lfmds);
+	free_minutia_sort_space(&space);
 }
@@ -23,7 +23,7 @@ int
 ansi2iso_fvmr(FVMR *ifvmr, FVMR *ofvmr, unsigned int *length,
     const unsigned short xres, const unsigned short yres)
 {
-	FMD **ifmds = NULL;
+	FMB *ifmb;
 	FMD *ofmd;
 	int m, mcount;
 	double isotheta;
@@ -40,11 +40,9 @@ ansi2iso_fvmr(FVMR *ifvmr, FVMR *ofvmr, unsigned int *length,
 	if (mcount == 0)
 		return (0);
 
-	ifmds = (FMD **)malloc(mcount * sizeof(FMD *));
-	if (ifmds == NULL)
-		ALLOC_ERR_RETURN("FMD array");
-	if (get_fmds(ifvmr, ifmds) != mcount)
-		ERR_OUT("getting FMDs from FVMR");
+	ifmb = get_fmb(ifvmr);
+	if ((ifmb == NULL) || (ifmb->count != (unsigned int)mcount))
+		ERR_OUT("getting minutiae block from FVMR");
 
 	conversion_factor = 1 / FMD_ISO_ANGLE_UNIT;
 	for (m = 0; m < mcount; m++) {
@@ -52,16 +50,17 @@ ansi2iso_fvmr(FVMR *ifvmr, FVMR *ofvmr, unsigned int *length,
 		 * convert from ANSI units to degrees, then from degrees
 		 * to ISO units.
 		 */
-		if (new_fmd(ofvmr->format_std, &ofmd, m) != 0)
+		if (new_fmd_arena(ofvmr->format_std, ofvmr->arena, &ofmd,
+		    m) != 0)
 			ALLOC_ERR_RETURN("Output FMD");
 
-		COPY_FMD(ifmds[m], ofmd);
+		fmb_to_fmd(ifmb, m, ofmd);
 		if (ofvmr->format_std == FMR_STD_ISO_NORMAL_CARD) {
 			/* Convert the minutiae using fixed normal card
 			 * resolution.
 			 */
-			x = (double)ifmds[m]->x_coord;
-			y = (double)ifmds[m]->y_coord;
+			x = (double)ifmb->x_coord[m];
+			y = (double)ifmb->y_coord[m];
 
 			/* millimeters, because INCITS 378 resolution 
 			 * values are in pixels per centimeter */
@@ -78,15 +77,15 @@ ansi2iso_fvmr(FVMR *ifvmr, FVMR *ofvmr, unsigned int *length,
  			ofmd->x_coord = (unsigned short)(0.5 + xunits);
  			ofmd->y_coord = (unsigned short)(0.5 + yunits);
 		}
-		theta = FMD_ANSI_ANGLE_UNIT * (int)ifmds[m]->angle;
+		theta = FMD_ANSI_ANGLE_UNIT * (int)ifmb->angle[m];
 		isotheta = round(conversion_factor * (double)theta);
 		ofmd->angle = (unsigned char)isotheta;
 
 		/* Convert the minutia quality from ANSI07 to ANSI04/ISO05 */
-		ofmd->quality = ifmds[m]->quality;
+		ofmd->quality = ifmb->quality[m];
 		if (ifvmr->format_std == FMR_STD_ANSI07) {
-			if ((ifmds[m]->quality == FMD_FAILED_MINUTIA_QUALITY) ||
-			    (ifmds[m]->quality ==
+			if ((ifmb->quality[m] == FMD_FAILED_MINUTIA_QUALITY) ||
+			    (ifmb->quality[m] ==
 				FMD_NOATTTEMPT_MINUTIA_QUALITY)) {
 				ofmd->quality = FMD_UNKNOWN_MINUTIA_QUALITY;
 			}
@@ -99,12 +98,9 @@ ansi2iso_fvmr(FVMR *ifvmr, FVMR *ofvmr, unsigned int *length,
 			*length += FMD_ISO_NORMAL_DATA_LENGTH;
 	}
 
-	free(ifmds);
 	return (0);
 
 err_out:
-	if (ifmds != NULL)
-		free(ifmds);
 	return (-1);
 }
 
@@ -116,7 +112,7 @@ int
 ansi2isocc_fvmr(FVMR *ifvmr, FVMR *ofvmr, unsigned int *length,
     const unsigned short xres, const unsigned short yres)
 {
-	FMD **ifmds = NULL;
+	FMB *ifmb;
 	FMD *ofmd;
 	int mcount, m;
 	int theta;
@@ -132,31 +128,30 @@ ansi2isocc_fvmr(FVMR *ifvmr, FVMR *ofvmr, unsigned int *length,
 	if (mcount == 0)
 		return (0);
 
-	ifmds = (FMD **)malloc(mcount * sizeof(FMD *));
-	if (ifmds == NULL)
-		ALLOC_ERR_RETURN("FMD array");
-	if (get_fmds(ifvmr, ifmds) != mcount)
-		ERR_OUT("getting FMDs from FVMR");
+	ifmb = get_fmb(ifvmr);
+	if ((ifmb == NULL) || (ifmb->count != (unsigned int)mcount))
+		ERR_OUT("getting minutiae block from FVMR");
 
 	conversion_factor = 1 / FMD_ISOCC_ANGLE_UNIT;
 	for (m = 0; m < mcount; m++) {
-		if (new_fmd(FMR_STD_ISO_COMPACT_CARD, &ofmd, m) != 0)
+		if (new_fmd_arena(FMR_STD_ISO_COMPACT_CARD, ofvmr->arena, &ofmd,
+		    m) != 0)
 			ALLOC_ERR_RETURN("Output FMD");
-		COPY_FMD(ifmds[m], ofmd);
+		fmb_to_fmd(ifmb, m, ofmd);
 
 		/* The ISO minutia record units are different than ANSI,
 		 * so we have to convert from ANSI units to degrees, then
 		 * from degrees to ISO units.
 		 * Also check the edge condition when hitting the max value.
 		 */
-		theta = FMD_ANSI_ANGLE_UNIT * (int)ifmds[m]->angle;
+		theta = FMD_ANSI_ANGLE_UNIT * (int)ifmb->angle[m];
 		isotheta = round(conversion_factor * (double)theta);
 		ofmd->angle = (unsigned char)isotheta;
 		if (isotheta > FMD_MAX_MINUTIA_ISOCC_ANGLE)
 			ofmd->angle = FMD_MAX_MINUTIA_ISOCC_ANGLE;
 
-		x = (double)ifmds[m]->x_coord;
-		y = (double)ifmds[m]->y_coord;
+		x = (double)ifmb->x_coord[m];
+		y = (double)ifmb->y_coord[m];
 
 		/* Convert the minutiae using fixed compact card resolution */
 		/* millimeters, because INCITS 378 resolution 
@@ -176,12 +171,8 @@ ansi2isocc_fvmr(FVMR *ifvmr, FVMR *ofvmr, unsigned int *length,
 		add_fmd_to_fvmr(ofmd, ofvmr);
 		*length += FMD_ISO_COMPACT_DATA_LENGTH;
 	}
-	if (ifmds != NULL)
-		free(ifmds);
 	return (0);
 
 err_out:
-	if (ifmds != NULL)
-		free(ifmds);
 	return (-1);
 }
@@ -0,0 +1,178 @@
+/*
+ * This software was developed at the National Institute of Standards and
+ * Technology (NIST) by employees of the Federal Government in the course
+ * of their official duties. Pursuant to title 17 Section 105 of the
+ * United States Code, this software is not subject to copyright protection
+ * and is in the public domain. NIST assumes no responsibility whatsoever for
+ * its use by other parties, and makes no guarantees, expressed or implied,
+ * about its quality, reliability, or any other characteristic.
+ */
+
+/******************************************************************************/
+/* This file contains the kernel that computes the pairwise distances between */
+/* the minutiae of two blocks. The blocks store each field contiguously, so   */
+/* a row of the matrix is computed from one minutia of the first block and    */
+/* consecutive entries of the second. On x86 processors with AVX2, selected   */
+/* at run time, eight entries are computed at once; defining FMR_NO_SIMD      */
+/* when building leaves only the portable code.                               */
+/*                                                                            */
+/******************************************************************************/
+#include <sys/queue.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <biomdimacro.h>
+#include <fmr.h>
+
+#if !defined(FMR_NO_SIMD) && (defined(__GNUC__) || defined(__clang__)) && \
+    (defined(__x86_64__) || defined(__i386__))
+#define DISTMAT_AVX2
+#include <immintrin.h>
+#endif
+
+/* Rows begin on this boundary, and are padded to a multiple of its entries */
+#define DISTMAT_ALIGN		32
+#define DISTMAT_ROW_ALIGN	(DISTMAT_ALIGN / sizeof(int32_t))
+
+/*
+ * Compute entries 'first' to 'b->count - 1' of the row of minutia i.
+ */
+static void
+fill_entries(const FMB *a, unsigned int i, const FMB *b, unsigned int first,
+    unsigned int angle_units, int32_t *drow, int32_t *arow)
+{
+	int32_t dx, dy, d;
+	unsigned int j;
+
+	for (j = first; j < b->count; j++) {
+		dx = (int32_t)a->x_coord[i] - b->x_coord[j];
+		dy = (int32_t)a->y_coord[i] - b->y_coord[j];
+		drow[j] = (dx * dx) + (dy * dy);
+	}
+	if (arow == NULL)
+		return;
+	for (j = first; j < b->count; j++) {
+		d = (int32_t)a->angle[i] - b->angle[j];
+		if (d < 0)
+			d = -d;
+		if (d >= (int32_t)angle_units)
+			d -= angle_units;
+		arow[j] = (d < (int32_t)angle_units - d) ?
+		    d : (int32_t)angle_units - d;
+	}
+}
+
+static void
+fill_rows(const FMB *a, const FMB *b, unsigned int angle_units, MDMAT *mat)
+{
+	unsigned int i;
+
+	for (i = 0; i < a->count; i++)
+		fill_entries(a, i, b, 0, angle_units,
+		    &mat->dist2[i * mat->stride],
+		    (mat->dangle == NULL) ? NULL :
+		    &mat->dangle[i * mat->stride]);
+}
+
+#ifdef DISTMAT_AVX2
+/*
+ * The same computation as fill_rows(), eight entries at a time; the
+ * entries past the last multiple of eight are left to fill_entries().
+ */
+__attribute__((target("avx2")))
+static void
+fill_rows_avx2(const FMB *a, const FMB *b, unsigned int angle_units,
+    MDMAT *mat)
+{
+	__m256i ax, ay, aa, bx, by, ba, dx, dy, d, units, limit;
+	int32_t *drow, *arow;
+	unsigned int i, j, n;
+
+	n = b->count & ~7U;
+	units = _mm256_set1_epi32((int)angle_units);
+	limit = _mm256_set1_epi32((int)angle_units - 1);
+	for (i = 0; i < a->count; i++) {
+		drow = &mat->dist2[i * mat->stride];
+		arow = (mat->dangle == NULL) ? NULL :
+		    &mat->dangle[i * mat->stride];
+		ax = _mm256_set1_epi32(a->x_coord[i]);
+		ay = _mm256_set1_epi32(a->y_coord[i]);
+		aa = _mm256_set1_epi32(a->angle[i]);
+		for (j = 0; j < n; j += 8) {
+			bx = _mm256_cvtepu16_epi32(_mm_loadu_si128(
+			    (const __m128i *)&b->x_coord[j]));
+			by = _mm256_cvtepu16_epi32(_mm_loadu_si128(
+			    (const __m128i *)&b->y_coord[j]));
+			dx = _mm256_sub_epi32(ax, bx);
+			dy = _mm256_sub_epi32(ay, by);
+			d = _mm256_add_epi32(_mm256_mullo_epi32(dx, dx),
+			    _mm256_mullo_epi32(dy, dy));
+			_mm256_store_si256((__m256i *)&drow[j], d);
+			if (arow == NULL)
+				continue;
+			ba = _mm256_cvtepu8_epi32(_mm_loadl_epi64(
+			    (const __m128i *)&b->angle[j]));
+			d = _mm256_abs_epi32(_mm256_sub_epi32(aa, ba));
+			d = _mm256_sub_epi32(d, _mm256_and_si256(units,
+			    _mm256_cmpgt_epi32(d, limit)));
+			d = _mm256_min_epi32(d, _mm256_sub_epi32(units, d));
+			_mm256_store_si256((__m256i *)&arow[j], d);
+		}
+		fill_entries(a, i, b, n, angle_units, drow, arow);
+	}
+}
+#endif
+
+int
+compute_minutiae_distances(const FMB *a, const FMB *b,
+    unsigned int angle_units, MDMAT *mat)
+{
+	size_t entries, need;
+	uintptr_t base;
+
+	mat->rows = a->count;
+	mat->columns = b->count;
+	mat->stride = (b->count + DISTMAT_ROW_ALIGN - 1) &
+	    ~(DISTMAT_ROW_ALIGN - 1);
+	if ((mat->stride != 0) &&
+	    (mat->rows > SIZE_MAX / 2 / sizeof(int32_t) / mat->stride))
+		ERR_OUT("Distance matrix is too large");
+	entries = (size_t)mat->rows * mat->stride;
+	need = entries * sizeof(int32_t) * ((angle_units != 0) ? 2 : 1) +
+	    DISTMAT_ALIGN - 1;
+	if (need > mat->capacity) {
+		if (mat->mem != NULL)
+			free(mat->mem);
+		mat->capacity = 0;
+		mat->mem = malloc(need);
+		if (mat->mem == NULL)
+			ALLOC_ERR_RETURN("Distance matrix");
+		mat->capacity = need;
+	}
+	base = ((uintptr_t)mat->mem + DISTMAT_ALIGN - 1) &
+	    ~(uintptr_t)(DISTMAT_ALIGN - 1);
+	mat->dist2 = (int32_t *)base;
+	mat->dangle = (angle_units != 0) ? mat->dist2 + entries : NULL;
+
+#ifdef DISTMAT_AVX2
+	if (__builtin_cpu_supports("avx2")) {
+		fill_rows_avx2(a, b, angle_units, mat);
+		return (0);
+	}
+#endif
+	fill_rows(a, b, angle_units, mat);
+	return (0);
+
+err_out:
+	return (-1);
+}
+
+void
+free_minutiae_distances(MDMAT *mat)
+{
+	if (mat->mem != NULL)
+		free(mat->mem);
+	memset(mat, 0, sizeof(MDMAT));
+}
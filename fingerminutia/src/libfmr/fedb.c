@@ -19,6 +19,7 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include <biomdi.h>
 #include <biomdimacro.h>
 #include <fmr.h>
 
@@ -61,6 +62,28 @@ internal_read_dd(FILE *fp, BDB *fmdb, struct delta_data *dd,
 static int
 internal_write_dd(FILE *fp, BDB *fmdb, struct delta_data *dd);
 
+/* Allocate the parts of an extended data block; 'arena' may be NULL */
+static int
+alloc_fed(unsigned int format_std, ARENA *arena,
+    struct finger_extended_data **fed, unsigned short type_id,
+    unsigned short length);
+
+static int
+alloc_rcdb(ARENA *arena, struct ridge_count_data_block **rcdb);
+
+static int
+alloc_rcd(ARENA *arena, struct ridge_count_data **rcd);
+
+static int
+alloc_cddb(unsigned int format_std, ARENA *arena,
+    struct core_delta_data_block **cddb);
+
+static int
+alloc_cd(unsigned int format_std, ARENA *arena, struct core_data **cd);
+
+static int
+alloc_dd(unsigned int format_std, ARENA *arena, struct delta_data **dd);
+
 /******************************************************************************/
 /* Internal routines to convert numeric IDs to strings.                       */
 /******************************************************************************/
@@ -119,10 +142,17 @@ add_cddb_to_fed(struct core_delta_data_block *cddb,
 /******************************************************************************/
 int
 new_fedb(unsigned int format_std, struct finger_extended_data_block **fedb)
+{
+	return (new_fedb_arena(format_std, NULL, fedb));
+}
+
+int
+new_fedb_arena(unsigned int format_std, ARENA *arena,
+    struct finger_extended_data_block **fedb)
 {
 	struct finger_extended_data_block *lfedb;
 
-	lfedb = (struct finger_extended_data_block *)malloc(
+	lfedb = (struct finger_extended_data_block *)arena_alloc(arena,
 			sizeof(struct finger_extended_data_block));
 	if (lfedb == NULL) {
 		perror("Failed to allocate Finger Extended Data block");
@@ -132,6 +162,7 @@ new_fedb(unsigned int format_std, struct finger_extended_data_block **fedb)
 	lfedb->partial = FALSE;
 	lfedb->format_std = format_std;
 	TAILQ_INIT(&lfedb->extended_data);
+	lfedb->arena = arena;
 	*fedb = lfedb;
 	return (0);
 }
@@ -141,6 +172,9 @@ free_fedb(struct finger_extended_data_block *fedb)
 {
 	struct finger_extended_data *fed;
 
+	if (fedb->arena != NULL)
+		return;
+
 	// Loop through the extended data records and free them
 	while (!TAILQ_EMPTY(&fedb->extended_data)) {
 		fed = TAILQ_FIRST(&fedb->extended_data);
@@ -187,7 +221,8 @@ internal_read_fedb(FILE *fp, BDB *fmdb, struct finger_extended_data_block *fedb)
 		if (sval2 > block_length) 
 			ERR_OUT("Extended data length %d is larger than remaining block length of %u", sval2, block_length);
 
-		if (new_fed(fedb->format_std, &fed, sval1, sval2) < 0)
+		if (alloc_fed(fedb->format_std, fedb->arena, &fed, sval1,
+		    sval2) < 0)
 			ERR_OUT("Cannot create new extended data block");
 
 		ret = internal_read_fed(fp, fmdb, fed);
@@ -195,11 +230,14 @@ internal_read_fedb(FILE *fp, BDB *fmdb, struct finger_extended_data_block *fedb)
 			if (fed->partial) {
 				add_fed_to_fedb(fed, fedb);
 				fedb->partial = TRUE;
-			}
+			} else
+				free_fed(fed);
 			return (READ_EOF);
 		}
-		if (ret == READ_ERROR)
+		if (ret == READ_ERROR) {
+			free_fed(fed);
 			ERR_OUT("Could not extended data record");
+		}
 		add_fed_to_fedb(fed, fedb);
 
 		block_length -= fed->length;
@@ -270,6 +308,74 @@ push_fedb(BDB *fmdb, struct finger_extended_data_block *fedb)
 	return (internal_write_fedb(NULL, fmdb, fedb));
 }
 
+/*
+ * Compute the length of the data that follows the header of an extended
+ * data item, as it is written by internal_write_fed().
+ */
+static unsigned int
+fed_data_length(struct finger_extended_data *fed)
+{
+	struct ridge_count_data *rcd;
+	struct core_data *cd;
+	struct delta_data *dd;
+	unsigned int length;
+
+	switch (fed->type_id) {
+
+	case FED_RIDGE_COUNT :
+		length = RIDGE_COUNT_HEADER_LENGTH;
+		TAILQ_FOREACH(rcd, &fed->rcdb->ridge_counts, list)
+			length += RIDGE_COUNT_DATA_LENGTH;
+		return (length);
+
+	case FED_CORE_AND_DELTA :
+		length = CORE_DATA_HEADER_LENGTH;
+		TAILQ_FOREACH(cd, &fed->cddb->cores, list) {
+			length += CORE_DATA_MIN_LENGTH;
+			if (fed->cddb->core_type == CORE_TYPE_ANGULAR)
+				length += CORE_ANGLE_LENGTH;
+		}
+		length += DELTA_DATA_HEADER_LENGTH;
+		TAILQ_FOREACH(dd, &fed->cddb->deltas, list) {
+			length += DELTA_DATA_MIN_LENGTH;
+			if (fed->cddb->delta_type == DELTA_TYPE_ANGULAR)
+				length += 3 * DELTA_ANGLE_LENGTH;
+		}
+		return (length);
+
+	default :
+		return (fed->length - FED_HEADER_LENGTH);
+	}
+}
+
+unsigned int
+get_fedb_encoded_length(struct finger_extended_data_block *fedb)
+{
+	struct finger_extended_data *fed;
+	unsigned int length;
+
+	length = FEDB_HEADER_LENGTH;
+	if (fedb == NULL)
+		return (length);
+	TAILQ_FOREACH(fed, &fedb->extended_data, list)
+		length += FED_HEADER_LENGTH + fed_data_length(fed);
+	return (length);
+}
+
+void
+update_fedb_length(struct finger_extended_data_block *fedb)
+{
+	struct finger_extended_data *fed;
+
+	if (fedb == NULL)
+		return;
+	fedb->block_length = 0;
+	TAILQ_FOREACH(fed, &fedb->extended_data, list) {
+		fed->length = FED_HEADER_LENGTH + fed_data_length(fed);
+		fedb->block_length += fed->length;
+	}
+}
+
 int
 print_fedb(FILE *fp, struct finger_extended_data_block *fedb)
 {
@@ -319,13 +425,21 @@ add_fed_to_fedb(struct finger_extended_data *fed,
 int 
 new_fed(unsigned int format_std, struct finger_extended_data **fed,
 	unsigned short type_id, unsigned short length)
+{
+	return (alloc_fed(format_std, NULL, fed, type_id, length));
+}
+
+static int
+alloc_fed(unsigned int format_std, ARENA *arena,
+    struct finger_extended_data **fed, unsigned short type_id,
+    unsigned short length)
 {
 	struct finger_extended_data *lfed;
 	struct ridge_count_data_block *rcdb;
 	struct core_delta_data_block *cddb;
 	int ret;
 
-	lfed = (struct finger_extended_data*)malloc(
+	lfed = (struct finger_extended_data*)arena_alloc(arena,
 			sizeof(struct finger_extended_data));
 	if (lfed == NULL) {
 		perror("Failed to allocate Finger Extended Data record");
@@ -337,24 +451,26 @@ new_fed(unsigned int format_std, struct finger_extended_data **fed,
 	lfed->type_id = type_id;
 	lfed->length = length;
 	lfed->partial = FALSE;
+	lfed->arena = arena;
 	switch (type_id) {
 
 	case FED_RIDGE_COUNT :
-		ret = new_rcdb(&rcdb);
+		ret = alloc_rcdb(arena, &rcdb);
 		if (ret != 0)
 			ERR_OUT("Could not create new ridge count block");
 		add_rcdb_to_fed(rcdb, lfed);
 		break;
 
 	case FED_CORE_AND_DELTA :
-		ret = new_cddb(format_std, &cddb);
+		ret = alloc_cddb(format_std, arena, &cddb);
 		if (ret != 0)
 			ERR_OUT("Could not create new core/delta block");
 		add_cddb_to_fed(cddb, lfed);
 		break;
 
 	default :
-		lfed->data = (char *)malloc(length - EXTENDED_DATA_HDR_LEN);
+		lfed->data = (char *)arena_alloc(arena,
+		    length - EXTENDED_DATA_HDR_LEN);
 		if (lfed->data == NULL)
 			ERR_OUT("Could not allocate extended data block");
 		memset((void *)lfed->data, 0, sizeof(char));
@@ -364,13 +480,17 @@ new_fed(unsigned int format_std, struct finger_extended_data **fed,
 	*fed = lfed;
 	return (0);
 err_out:
-	free(lfed);
+	if (arena == NULL)
+		free(lfed);
 	return (-1);
 }
 
 void 
 free_fed(struct finger_extended_data *fed)
 {
+	if (fed->arena != NULL)
+		return;
+
 	switch (fed->type_id) {
 
 	case FED_RIDGE_COUNT :
@@ -540,10 +660,16 @@ err_out:
 /******************************************************************************/
 int
 new_rcdb(struct ridge_count_data_block **rcdb)
+{
+	return (alloc_rcdb(NULL, rcdb));
+}
+
+static int
+alloc_rcdb(ARENA *arena, struct ridge_count_data_block **rcdb)
 {
 	struct ridge_count_data_block *lrcdb;
 
-	lrcdb = (struct ridge_count_data_block *)malloc(
+	lrcdb = (struct ridge_count_data_block *)arena_alloc(arena,
 			sizeof(struct ridge_count_data_block));
 	if (lrcdb == NULL) {
 		perror("Failed to allocate Ridge Count Data Block");
@@ -551,6 +677,7 @@ new_rcdb(struct ridge_count_data_block **rcdb)
 	}
 	memset((void *)lrcdb, 0, sizeof(struct ridge_count_data_block));
 	TAILQ_INIT(&lrcdb->ridge_counts);
+	lrcdb->arena = arena;
 
 	*rcdb = lrcdb;
 	return (0);
@@ -561,6 +688,9 @@ free_rcdb(struct ridge_count_data_block *rcdb)
 {
 	struct ridge_count_data *rcd;
 
+	if (rcdb->arena != NULL)
+		return;
+
 	// Free the Ridge Count Data records associated with the RCDB
 	while (!TAILQ_EMPTY(&rcdb->ridge_counts)) {
 		rcd = TAILQ_FIRST(&rcdb->ridge_counts);
@@ -582,16 +712,23 @@ add_rcd_to_rcdb(struct ridge_count_data *rcd,
 
 int
 new_rcd(struct ridge_count_data **rcd)
+{
+	return (alloc_rcd(NULL, rcd));
+}
+
+static int
+alloc_rcd(ARENA *arena, struct ridge_count_data **rcd)
 {
 	struct ridge_count_data *lrcd;
 
-	lrcd = (struct ridge_count_data *)malloc(
+	lrcd = (struct ridge_count_data *)arena_alloc(arena,
 			sizeof(struct ridge_count_data));
 	if (lrcd == NULL) {
 		perror("Failed to allocate Ridge Count Data");
 		return (-1);
 	}
 	memset((void *)lrcd, 0, sizeof(struct ridge_count_data));
+	lrcd->arena = arena;
 
 	*rcd = lrcd;
 	return (0);
@@ -600,7 +737,8 @@ new_rcd(struct ridge_count_data **rcd)
 void
 free_rcd(struct ridge_count_data *rcd)
 {
-	free(rcd);
+	if (rcd->arena == NULL)
+		free(rcd);
 }
 
 static int
@@ -619,7 +757,7 @@ internal_read_rcdb(FILE *fp, BDB *fmdb, struct ridge_count_data_block *rcdb)
 	// from the length of the Extended Data length
 	block_length = rcdb->fed->length - FED_HEADER_LENGTH - 1;
 	while (block_length > 0) {
-		ret = new_rcd(&rcd);
+		ret = alloc_rcd(rcdb->arena, &rcd);
 		if (ret != 0)
 			ERR_OUT("Could not allocate new ridge count data");
 
@@ -627,6 +765,8 @@ internal_read_rcdb(FILE *fp, BDB *fmdb, struct ridge_count_data_block *rcdb)
 			ret = read_rcd(fp, rcd);
 		else
 			ret = scan_rcd(fmdb, rcd);
+		if (ret != READ_OK)
+			free_rcd(rcd);
 		if (ret == READ_EOF)
 			return (READ_EOF);
 		if (ret == READ_ERROR)
@@ -827,10 +967,17 @@ err_out:
 /******************************************************************************/
 int
 new_cddb(unsigned int format_std, struct core_delta_data_block **cddb)
+{
+	return (alloc_cddb(format_std, NULL, cddb));
+}
+
+static int
+alloc_cddb(unsigned int format_std, ARENA *arena,
+    struct core_delta_data_block **cddb)
 {
 	struct core_delta_data_block *lcddb;
 
-	lcddb = (struct core_delta_data_block *)malloc(
+	lcddb = (struct core_delta_data_block *)arena_alloc(arena,
 			sizeof(struct core_delta_data_block));
 	if (lcddb == NULL) {
 		perror("Failed to allocate Core Data Block");
@@ -840,6 +987,7 @@ new_cddb(unsigned int format_std, struct core_delta_data_block **cddb)
 	lcddb->format_std = format_std;
 	TAILQ_INIT(&lcddb->cores);
 	TAILQ_INIT(&lcddb->deltas);
+	lcddb->arena = arena;
 
 	*cddb = lcddb;
 	return (0);
@@ -851,6 +999,9 @@ free_cddb(struct core_delta_data_block *cddb)
 	struct core_data *cd;
 	struct delta_data *dd;
 
+	if (cddb->arena != NULL)
+		return;
+
 	// Free the Core Data records associated with the CDDB
 	while (!TAILQ_EMPTY(&cddb->cores)) {
 		cd = TAILQ_FIRST(&cddb->cores);
@@ -884,16 +1035,23 @@ add_dd_to_cddb(struct delta_data *dd, struct core_delta_data_block *cddb)
 
 int
 new_cd(unsigned int format_std, struct core_data **cd)
+{
+	return (alloc_cd(format_std, NULL, cd));
+}
+
+static int
+alloc_cd(unsigned int format_std, ARENA *arena, struct core_data **cd)
 {
 	struct core_data *lcd;
 
-	lcd = (struct core_data *)malloc(sizeof(struct core_data));
+	lcd = (struct core_data *)arena_alloc(arena, sizeof(struct core_data));
 	if (lcd == NULL) {
 		perror("Failed to allocate Core Data");
 		return (-1);
 	}
 	memset((void *)lcd, 0, sizeof(struct core_data));
 	lcd->format_std = format_std;
+	lcd->arena = arena;
 
 	*cd = lcd;
 	return (0);
@@ -902,21 +1060,29 @@ new_cd(unsigned int format_std, struct core_data **cd)
 void
 free_cd(struct core_data *cd)
 {
-	free(cd);
+	if (cd->arena == NULL)
+		free(cd);
 }
 
 int
 new_dd(unsigned int format_std, struct delta_data **dd)
+{
+	return (alloc_dd(format_std, NULL, dd));
+}
+
+static int
+alloc_dd(unsigned int format_std, ARENA *arena, struct delta_data **dd)
 {
 	struct delta_data *ldd;
 
-	ldd = (struct delta_data *)malloc(sizeof(struct delta_data));
+	ldd = (struct delta_data *)arena_alloc(arena, sizeof(struct delta_data));
 	if (ldd == NULL) {
 		perror("Failed to allocate Delta Data");
 		return (-1);
 	}
 	memset((void *)ldd, 0, sizeof(struct delta_data));
 	ldd->format_std = format_std;
+	ldd->arena = arena;
 
 	*dd = ldd;
 	return (0);
@@ -925,7 +1091,8 @@ new_dd(unsigned int format_std, struct delta_data **dd)
 void
 free_dd(struct delta_data *dd)
 {
-	free(dd);
+	if (dd->arena == NULL)
+		free(dd);
 }
 
 static int
@@ -949,11 +1116,13 @@ internal_read_cddb(FILE *fp, BDB *fmdb, struct core_delta_data_block *cddb)
 
 	// Read each Core Data record
 	for (i = 0; i < cddb->num_cores; i++) {
-		ret = new_cd(cddb->format_std, &cd);
+		ret = alloc_cd(cddb->format_std, cddb->arena, &cd);
 		if (ret != 0)
 			ERR_OUT("Could not allocate core data record");
 
 		ret = internal_read_cd(fp, fmdb, cd, cddb->core_type);
+		if (ret != READ_OK)
+			free_cd(cd);
 		if (ret == READ_EOF)
 			return (READ_EOF);
 		if (ret == READ_ERROR)
@@ -971,11 +1140,13 @@ internal_read_cddb(FILE *fp, BDB *fmdb, struct core_delta_data_block *cddb)
 
 	// Read each Delta Data record
 	for (i = 0; i < cddb->num_deltas; i++) {
-		ret = new_dd(cddb->format_std, &dd);
+		ret = alloc_dd(cddb->format_std, cddb->arena, &dd);
 		if (ret != 0)
 			ERR_OUT("Could not allocate delta data record");
 
 		ret = internal_read_dd(fp, fmdb, dd, cddb->delta_type);
+		if (ret != READ_OK)
+			free_dd(dd);
 		if (ret == READ_EOF)
 			return (READ_EOF);
 		if (ret == READ_ERROR)
@@ -19,6 +19,7 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include <biomdi.h>
 #include <biomdimacro.h>
 #include <fmr.h>
 
@@ -79,9 +80,16 @@ fmd_type_string(FMD *fmd)
 int
 new_fmd(unsigned int format_std, struct finger_minutiae_data **fmd,
     unsigned int index)
+{
+	return (new_fmd_arena(format_std, NULL, fmd, index));
+}
+
+int
+new_fmd_arena(unsigned int format_std, ARENA *arena,
+    struct finger_minutiae_data **fmd, unsigned int index)
 {
 	struct finger_minutiae_data *lfmd;
-	lfmd = (struct finger_minutiae_data *)malloc(
+	lfmd = (struct finger_minutiae_data *)arena_alloc(arena,
 		sizeof(struct finger_minutiae_data));
 	if (lfmd == NULL) {
 		perror("Failed to allocate Finger Minutiae Data record");
@@ -90,6 +98,7 @@ new_fmd(unsigned int format_std, struct finger_minutiae_data **fmd,
 	memset((void *)lfmd, 0, sizeof(struct finger_minutiae_data));
 	lfmd->format_std = format_std;
 	lfmd->index = index;
+	lfmd->arena = arena;
 	*fmd = lfmd;
 	return 0;
 }
@@ -97,7 +106,8 @@ new_fmd(unsigned int format_std, struct finger_minutiae_data **fmd,
 void
 free_fmd(struct finger_minutiae_data *fmd)
 {
-	free(fmd);
+	if (fmd->arena == NULL)
+		free(fmd);
 }
 
 /*
@@ -325,3 +335,240 @@ find_center_of_minutiae_mass(FMD **fmds, int mcount, int *x, int *y)
 	*x = lx / mcount;
 	*y = ly / mcount; 
 }
+
+void
+find_center_of_fmb_mass(const FMB *fmb, int *x, int *y)
+{
+	int lx, ly;
+	unsigned int i;
+
+	lx = ly = 0;
+	for (i = 0; i < fmb->count; i++) {
+		lx += fmb->x_coord[i];
+		ly += fmb->y_coord[i];
+	}
+	*x = lx / (int)fmb->count;
+	*y = ly / (int)fmb->count;
+}
+
+/*
+ * The sums are accumulated over the separate coordinate arrays without
+ * branches, other than for the bounds, so the loop can be vectorized.
+ */
+void
+find_fmb_geometry(const FMB *fmb, FVG *geom)
+{
+	int64_t sx, sy, sxx, syy, sxy;
+	unsigned int i, x, y, xmin, ymin, xmax, ymax;
+	double n, mx, my, half, diff;
+
+	sx = sy = sxx = syy = sxy = 0;
+	xmin = ymin = UINT16_MAX;
+	xmax = ymax = 0;
+	for (i = 0; i < fmb->count; i++) {
+		x = fmb->x_coord[i];
+		y = fmb->y_coord[i];
+		sx += x;
+		sy += y;
+		sxx += (int64_t)x * x;
+		syy += (int64_t)y * y;
+		sxy += (int64_t)x * y;
+		xmin = (x < xmin) ? x : xmin;
+		ymin = (y < ymin) ? y : ymin;
+		xmax = (x > xmax) ? x : xmax;
+		ymax = (y > ymax) ? y : ymax;
+	}
+	geom->center_x = (int)(sx / (int64_t)fmb->count);
+	geom->center_y = (int)(sy / (int64_t)fmb->count);
+	geom->x_min = xmin;
+	geom->y_min = ymin;
+	geom->x_max = xmax;
+	geom->y_max = ymax;
+
+	n = (double)fmb->count;
+	mx = sx / n;
+	my = sy / n;
+	geom->cov_xx = sxx / n - mx * mx;
+	geom->cov_yy = syy / n - my * my;
+	geom->cov_xy = sxy / n - mx * my;
+
+	/* The eigenvalues and major eigenvector of the covariance matrix */
+	half = (geom->cov_xx + geom->cov_yy) / 2.0;
+	diff = sqrt(((geom->cov_xx - geom->cov_yy) / 2.0) *
+	    ((geom->cov_xx - geom->cov_yy) / 2.0) +
+	    geom->cov_xy * geom->cov_xy);
+	geom->major_var = half + diff;
+	geom->minor_var = half - diff;
+	geom->axis_angle = 0.5 * atan2(2.0 * geom->cov_xy,
+	    geom->cov_xx - geom->cov_yy);
+}
+
+void
+fmb_to_fmd(const FMB *fmb, unsigned int i, struct finger_minutiae_data *fmd)
+{
+	fmd->type = fmb->type[i];
+	fmd->x_coord = fmb->x_coord[i];
+	fmd->reserved = fmb->reserved[i];
+	fmd->y_coord = fmb->y_coord[i];
+	fmd->angle = fmb->angle[i];
+	fmd->quality = fmb->quality[i];
+}
+
+/******************************************************************************/
+/* Implementation of the bulk conversion between the record encoding of a run */
+/* of minutiae and a minutiae block. Each field is extracted with a separate  */
+/* pass over the run, so the loops have no branches and a constant stride.   */
+/******************************************************************************/
+unsigned int
+get_fmd_data_length(unsigned int format_std)
+{
+	switch (format_std) {
+		case FMR_STD_ISO_NORMAL_CARD:
+			return (FMD_ISO_NORMAL_DATA_LENGTH);
+		case FMR_STD_ISO_COMPACT_CARD:
+			return (FMD_ISO_COMPACT_DATA_LENGTH);
+		default:
+			return (FMD_DATA_LENGTH);
+	}
+}
+
+/*
+ * Decode the type, X, reserved, Y, and angle fields that are common to
+ * the ANSI, ISO, and ISO normal card minutiae.
+ */
+static void
+decode_ansi_iso_fields(FMB *fmb, unsigned int first, unsigned int count,
+    unsigned int stride, const uint8_t *buf)
+{
+	unsigned short *x, *y;
+	unsigned char *type, *reserved, *angle;
+	unsigned int i;
+
+	x = fmb->x_coord + first;
+	y = fmb->y_coord + first;
+	type = fmb->type + first;
+	reserved = fmb->reserved + first;
+	angle = fmb->angle + first;
+	for (i = 0; i < count; i++)
+		type[i] = (buf[i * stride] & (FMD_MINUTIA_TYPE_MASK >> 8)) >>
+		    (FMD_MINUTIA_TYPE_SHIFT - 8);
+	for (i = 0; i < count; i++)
+		x[i] = ((buf[i * stride] << 8) | buf[i * stride + 1]) &
+		    FMD_X_COORD_MASK;
+	for (i = 0; i < count; i++)
+		reserved[i] = (buf[i * stride + 2] &
+		    (FMD_RESERVED_MASK >> 8)) >> (FMD_RESERVED_SHIFT - 8);
+	for (i = 0; i < count; i++)
+		y[i] = ((buf[i * stride + 2] << 8) | buf[i * stride + 3]) &
+		    FMD_Y_COORD_MASK;
+	for (i = 0; i < count; i++)
+		angle[i] = buf[i * stride + 4];
+}
+
+void
+decode_fmb(FMB *fmb, unsigned int first, unsigned int count,
+    unsigned int format_std, const uint8_t *buf)
+{
+	unsigned char *quality;
+	unsigned int i;
+
+	quality = fmb->quality + first;
+	switch (format_std) {
+	case FMR_STD_ISO_COMPACT_CARD:
+		for (i = 0; i < count; i++)
+			fmb->x_coord[first + i] =
+			    buf[i * FMD_ISO_COMPACT_DATA_LENGTH];
+		for (i = 0; i < count; i++)
+			fmb->y_coord[first + i] =
+			    buf[i * FMD_ISO_COMPACT_DATA_LENGTH + 1];
+		for (i = 0; i < count; i++)
+			fmb->type[first + i] =
+			    (buf[i * FMD_ISO_COMPACT_DATA_LENGTH + 2] &
+			    FMD_ISO_COMPACT_MINUTIA_TYPE_MASK) >>
+			    FMD_ISO_COMPACT_MINUTIA_TYPE_SHIFT;
+		for (i = 0; i < count; i++)
+			fmb->angle[first + i] =
+			    buf[i * FMD_ISO_COMPACT_DATA_LENGTH + 2] &
+			    FMD_ISO_COMPACT_MINUTIA_ANGLE_MASK;
+		memset(fmb->reserved + first, 0, count);
+		memset(quality, ISO_UNKNOWN_FINGER_QUALITY, count);
+		break;
+	case FMR_STD_ISO_NORMAL_CARD:
+		decode_ansi_iso_fields(fmb, first, count,
+		    FMD_ISO_NORMAL_DATA_LENGTH, buf);
+		// There is no quality value in the ISO normal card record
+		memset(quality, 0, count);
+		break;
+	default:
+		decode_ansi_iso_fields(fmb, first, count, FMD_DATA_LENGTH,
+		    buf);
+		for (i = 0; i < count; i++)
+			quality[i] = buf[i * FMD_DATA_LENGTH + 5];
+		break;
+	}
+}
+
+/*
+ * Encode the type/X, Y, and angle fields that are common to the ANSI,
+ * ISO, and ISO normal card minutiae. As with write_ansi_iso_fmd(), the
+ * reserved bits are written as zero.
+ */
+static void
+encode_ansi_iso_fields(const FMB *fmb, unsigned int first,
+    unsigned int count, unsigned int stride, uint8_t *buf)
+{
+	const unsigned short *x, *y;
+	const unsigned char *type, *angle;
+	unsigned int i;
+
+	x = fmb->x_coord + first;
+	y = fmb->y_coord + first;
+	type = fmb->type + first;
+	angle = fmb->angle + first;
+	for (i = 0; i < count; i++)
+		buf[i * stride] = (uint8_t)((type[i] <<
+		    (FMD_MINUTIA_TYPE_SHIFT - 8)) |
+		    ((x[i] & FMD_X_COORD_MASK) >> 8));
+	for (i = 0; i < count; i++)
+		buf[i * stride + 1] = (uint8_t)(x[i] & 0xFF);
+	for (i = 0; i < count; i++)
+		buf[i * stride + 2] = (uint8_t)((y[i] & FMD_Y_COORD_MASK) >> 8);
+	for (i = 0; i < count; i++)
+		buf[i * stride + 3] = (uint8_t)(y[i] & 0xFF);
+	for (i = 0; i < count; i++)
+		buf[i * stride + 4] = angle[i];
+}
+
+void
+encode_fmb(const FMB *fmb, unsigned int first, unsigned int count,
+    unsigned int format_std, uint8_t *buf)
+{
+	unsigned int i;
+
+	switch (format_std) {
+	case FMR_STD_ISO_COMPACT_CARD:
+		for (i = 0; i < count; i++)
+			buf[i * FMD_ISO_COMPACT_DATA_LENGTH] =
+			    (uint8_t)fmb->x_coord[first + i];
+		for (i = 0; i < count; i++)
+			buf[i * FMD_ISO_COMPACT_DATA_LENGTH + 1] =
+			    (uint8_t)fmb->y_coord[first + i];
+		for (i = 0; i < count; i++)
+			buf[i * FMD_ISO_COMPACT_DATA_LENGTH + 2] =
+			    (uint8_t)((fmb->type[first + i] <<
+			    FMD_ISO_COMPACT_MINUTIA_TYPE_SHIFT) |
+			    (fmb->angle[first + i] &
+			    FMD_ISO_COMPACT_MINUTIA_ANGLE_MASK));
+		break;
+	case FMR_STD_ISO_NORMAL_CARD:
+		encode_ansi_iso_fields(fmb, first, count,
+		    FMD_ISO_NORMAL_DATA_LENGTH, buf);
+		break;
+	default:
+		encode_ansi_iso_fields(fmb, first, count, FMD_DATA_LENGTH,
+		    buf);
+		for (i = 0; i < count; i++)
+			buf[i * FMD_DATA_LENGTH + 5] = fmb->quality[first + i];
+		break;
+	}
+}
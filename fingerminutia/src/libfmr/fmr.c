@@ -33,9 +33,16 @@
 /******************************************************************************/
 int
 new_fmr(unsigned int format_std, struct finger_minutiae_record **fmr)
+{
+	return (new_fmr_arena(format_std, NULL, fmr));
+}
+
+int
+new_fmr_arena(unsigned int format_std, ARENA *arena,
+    struct finger_minutiae_record **fmr)
 {
 	struct finger_minutiae_record *lfmr;
-	lfmr = (struct finger_minutiae_record *)malloc(
+	lfmr = (struct finger_minutiae_record *)arena_alloc(arena,
 		sizeof(struct finger_minutiae_record));
 	if (lfmr == NULL) {
 		perror("Failed allocating memory for FMR");
@@ -44,6 +51,7 @@ new_fmr(unsigned int format_std, struct finger_minutiae_record **fmr)
 	memset((void *)lfmr, 0, sizeof(struct finger_minutiae_record));
 	TAILQ_INIT(&lfmr->finger_views);
 	lfmr->format_std = format_std;
+	lfmr->arena = arena;
 	*fmr = lfmr;
 	return 0;
 }
@@ -53,6 +61,10 @@ free_fmr(struct finger_minutiae_record *fmr)
 {
 	struct finger_view_minutiae_record *fvmr;
 
+	// Records in an arena are released by resetting the arena
+	if (fmr->arena != NULL)
+		return;
+
 	// Free the Finger View Minutiae Records contained within the FMR
 	while (!TAILQ_EMPTY(&fmr->finger_views)) {
 		fvmr = TAILQ_FIRST(&fmr->finger_views);
@@ -155,7 +167,7 @@ internal_read_fmr(FILE *fp, BDB *fmdb, struct finger_minutiae_record *fmr)
 
 	// Read the finger views
 	for (i = 1; i <= fmr->num_views; i++) {
-		if (new_fvmr(fmr->format_std, &fvmr) < 0)
+		if (new_fvmr_arena(fmr->format_std, fmr->arena, &fvmr) < 0)
 			ERR_OUT("Could not allocate FVMR %d", i);
 
 		if (fp != NULL)
@@ -174,10 +186,13 @@ internal_read_fmr(FILE *fp, BDB *fmdb, struct finger_minutiae_record *fmr)
 		} else if (ret == READ_EOF) {
 			if (fvmr->partial)
 				add_fvmr_to_fmr(fvmr, fmr);
+			else
+				free_fvmr(fvmr);
 			return READ_EOF;
-		}
-		else
+		} else {
+			free_fvmr(fvmr);
 			ERR_OUT("Could not read entire FVMR %d; Contents:", i);
+		}
 	}
 
 	return READ_OK;
@@ -186,21 +201,78 @@ eof_out:
 	ERRP("EOF encountered in %s", __FUNCTION__);
 	return READ_EOF;
 err_out:
-	if (fvmr != NULL)
+	if ((fvmr != NULL) && biomdi_error_printing())
 		print_fvmr(stderr, fvmr);
 	return READ_ERROR;
 }
 
+/*
+ * Read the record header far enough to find the record length, then
+ * read the entire record into memory and scan it from there. The ISO
+ * card formats have no record length, so they are read field by field.
+ * End of file before the first octet of the record is a clean end of
+ * input, and is not reported; end of file within the header is an error.
+ * A record cut short by the end of the file is returned as read so far,
+ * with READ_EOF.
+ */
 int
 read_fmr(FILE *fp, struct finger_minutiae_record *fmr)
 {
-	return (internal_read_fmr(fp, NULL, fmr));
+	uint8_t hdr[FMR_ANSI_LARGE_HEADER_LENGTH];
+	uint32_t hdrlen;
+	uint64_t reclen;
+	BDB fmdb;
+	int ret;
+
+	if ((fmr->format_std == FMR_STD_ISO_NORMAL_CARD) ||
+	    (fmr->format_std == FMR_STD_ISO_COMPACT_CARD)) {
+		set_biomdi_error_source(fp, NULL);
+		ret = internal_read_fmr(fp, NULL, fmr);
+		set_biomdi_error_source(NULL, NULL);
+		return (ret);
+	}
+
+	/* Format ID, spec version, and the 4-octet record length, or the
+	 * first 4 octets of the ANSI '04 record length fields.
+	 */
+	hdrlen = FMR_FORMAT_ID_LEN + FMR_SPEC_VERSION_LEN + 4;
+	ret = read_bdb_header(fp, hdr, hdrlen);
+	if (ret != READ_OK)
+		return (ret);
+	if (fmr->format_std == FMR_STD_ANSI) {
+		reclen = (hdr[8] << 8) | hdr[9];
+		if (reclen == 0) {
+			ret = read_bdb_header(fp, hdr + hdrlen, 2);
+			if (ret == READ_EOF)
+				ERRP("EOF encountered in record header");
+			if (ret != READ_OK)
+				return (READ_ERROR);
+			hdrlen += 2;
+			reclen = ((uint32_t)hdr[10] << 24) | (hdr[11] << 16) |
+			    (hdr[12] << 8) | hdr[13];
+		}
+	} else {
+		reclen = ((uint32_t)hdr[8] << 24) | (hdr[9] << 16) |
+		    (hdr[10] << 8) | hdr[11];
+	}
+
+	if (read_bdb_record(fp, &fmdb, hdr, hdrlen, reclen) != READ_OK)
+		return (READ_ERROR);
+	set_biomdi_error_source(NULL, &fmdb);
+	ret = internal_read_fmr(NULL, &fmdb, fmr);
+	set_biomdi_error_source(NULL, NULL);
+	return (end_bdb_record(&fmdb, reclen, ret));
 }
 
 int
 scan_fmr(BDB *fmdb, struct finger_minutiae_record *fmr)
 {
-	return (internal_read_fmr(NULL, fmdb, fmr));
+	int ret;
+
+	set_biomdi_error_source(NULL, fmdb);
+	ret = internal_read_fmr(NULL, fmdb, fmr);
+	set_biomdi_error_source(NULL, NULL);
+	return (ret);
 }
 
 static int
@@ -280,10 +352,25 @@ err_out:
 	return WRITE_ERROR;
 }
 
+/*
+ * Write the record by pushing it into a buffer of the encoded length, then
+ * writing the buffer with one write. The minutiae of each view are pushed
+ * from the minutiae block after it is refreshed from the FMD records, so
+ * changes made to an FMD after it was added are written.
+ */
 int
 write_fmr(FILE *fp, struct finger_minutiae_record *fmr)
 {
-	return (internal_write_fmr(fp, NULL, fmr));
+	BDB fmdb;
+	int ret;
+
+	if (new_bdb_record(&fmdb, get_fmr_encoded_length(fmr)) != WRITE_OK)
+		return (WRITE_ERROR);
+	ret = internal_write_fmr(NULL, &fmdb, fmr);
+	if (ret == WRITE_OK)
+		ret = write_bdb_record(fp, &fmdb);
+	free(fmdb.bdb_start);
+	return (ret);
 }
 
 int
@@ -292,6 +379,99 @@ push_fmr(BDB *fmdb, struct finger_minutiae_record *fmr)
 	return (internal_write_fmr(NULL, fmdb, fmr));
 }
 
+/*
+ * Return the length of the record header, which for ANSI '04 records
+ * depends on the record length.
+ */
+static unsigned int
+fmr_header_length(unsigned int format_std, uint32_t record_length)
+{
+	switch (format_std) {
+		case FMR_STD_ANSI:
+			if (record_length > FMR_ANSI_MAX_SHORT_LENGTH)
+				return (FMR_ANSI_LARGE_HEADER_LENGTH);
+			else
+				return (FMR_ANSI_SMALL_HEADER_LENGTH);
+		case FMR_STD_ISO:
+			return (FMR_ISO_HEADER_LENGTH);
+		case FMR_STD_ANSI07:
+			return (FMR_ANSI07_HEADER_LENGTH);
+		default:
+			return (0);
+	}
+}
+
+uint32_t
+get_fmr_encoded_length(struct finger_minutiae_record *fmr)
+{
+	struct finger_view_minutiae_record *fvmr;
+	uint32_t length;
+
+	length = fmr_header_length(fmr->format_std, fmr->record_length);
+	TAILQ_FOREACH(fvmr, &fmr->finger_views, list)
+		length += get_fvmr_encoded_length(fvmr);
+	return (length);
+}
+
+void
+update_fmr_length(struct finger_minutiae_record *fmr)
+{
+	struct finger_view_minutiae_record *fvmr;
+	uint32_t length;
+
+	length = 0;
+	TAILQ_FOREACH(fvmr, &fmr->finger_views, list) {
+		update_fedb_length(fvmr->extended);
+		length += get_fvmr_encoded_length(fvmr);
+	}
+
+	switch (fmr->format_std) {
+		case FMR_STD_ANSI:
+			if (length + FMR_ANSI_SMALL_HEADER_LENGTH >
+			    FMR_ANSI_MAX_SHORT_LENGTH) {
+				fmr->record_length_type =
+				    FMR_ANSI_LARGE_HEADER_TYPE;
+				length += FMR_ANSI_LARGE_HEADER_LENGTH;
+			} else {
+				fmr->record_length_type =
+				    FMR_ANSI_SMALL_HEADER_TYPE;
+				length += FMR_ANSI_SMALL_HEADER_LENGTH;
+			}
+			break;
+		case FMR_STD_ISO:
+			fmr->record_length_type = FMR_ISO_HEADER_TYPE;
+			length += FMR_ISO_HEADER_LENGTH;
+			break;
+		case FMR_STD_ANSI07:
+			fmr->record_length_type = FMR_ANSI07_HEADER_TYPE;
+			length += FMR_ANSI07_HEADER_LENGTH;
+			break;
+	}
+	fmr->record_length = length;
+}
+
+int
+serialize_fmr(struct finger_minutiae_record *fmr, uint8_t **buf,
+    uint32_t *length)
+{
+	BDB fmdb;
+
+	update_fmr_length(fmr);
+	if (new_bdb_record(&fmdb, get_fmr_encoded_length(fmr)) != WRITE_OK)
+		return (WRITE_ERROR);
+	if ((internal_write_fmr(NULL, &fmdb, fmr) != WRITE_OK) ||
+	    (fmdb.bdb_current != fmdb.bdb_end)) {
+		free(fmdb.bdb_start);
+		ERR_OUT("Could not serialize FMR");
+	}
+	*buf = fmdb.bdb_start;
+	*length = fmdb.bdb_size;
+	return (WRITE_OK);
+
+err_out:
+	return (WRITE_ERROR);
+}
+
 int
 print_fmr(FILE *fp, struct finger_minutiae_record *fmr)
 {
@@ -0,0 +1,351 @@
+/*
+ * This software was developed at the National Institute of Standards and
+ * Technology (NIST) by employees of the Federal Government in the course
+ * of their official duties. Pursuant to title 17 Section 105 of the
+ * United States Code, this software is not subject to copyright protection
+ * and is in the public domain. NIST assumes no responsibility  whatsoever for
+ * its use by other parties, and makes no guarantees, expressed or implied,
+ * about its quality, reliability, or any other characteristic.
+ */
+/******************************************************************************/
+/* Implementation of the read-only "view" interface to Finger Minutiae        */
+/* Records. A view refers directly to the octets of a record held in a        */
+/* memory buffer; fields are decoded from the big-endian representation      */
+/* only when asked for, and no memory is allocated.                           */
+/*                                                                            */
+/******************************************************************************/
+#include <sys/queue.h>
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <biomdi.h>
+#include <biomdimacro.h>
+#include <fmr.h>
+
+/*
+ * Decode big-endian values directly from the record octets.
+ */
+#define VIEW_BE16(p)	((uint16_t)(((p)[0] << 8) | (p)[1]))
+#define VIEW_BE32(p)	((uint32_t)(((uint32_t)(p)[0] << 24) |		\
+			    ((uint32_t)(p)[1] << 16) |			\
+			    ((uint32_t)(p)[2] << 8) | (uint32_t)(p)[3]))
+
+/*
+ * Locate the boundaries of the finger view that begins at fvmrv->start,
+ * checking that the view lies entirely within the record.
+ */
+static int
+view_locate_fvmr(struct finger_view_minutiae_record_view *fvmrv)
+{
+	uint8_t *ptr;
+	unsigned int hdrlen;
+	unsigned int block_length;
+
+	/* The card formats have one view with no header; the minutiae
+	 * run to the end of the record.
+	 */
+	if ((fvmrv->format_std == FMR_STD_ISO_NORMAL_CARD) ||
+	    (fvmrv->format_std == FMR_STD_ISO_COMPACT_CARD)) {
+		fvmrv->minutiae = fvmrv->start;
+		fvmrv->number_of_minutiae = (fvmrv->limit - fvmrv->start) /
+		    fvmrv->fmd_length;
+		fvmrv->extended = NULL;
+		fvmrv->end = fvmrv->minutiae +
+		    fvmrv->number_of_minutiae * fvmrv->fmd_length;
+		return (READ_OK);
+	}
+
+	if (fvmrv->format_std == FMR_STD_ANSI07)
+		hdrlen = FVMR_ANSI07_HEADER_LENGTH;
+	else
+		hdrlen = FVMR_HEADER_LENGTH;
+	if (fvmrv->start + hdrlen > fvmrv->limit)
+		goto eof_out;
+	fvmrv->minutiae = fvmrv->start + hdrlen;
+	fvmrv->number_of_minutiae = fvmrv->start[hdrlen - 1];
+
+	ptr = fvmrv->minutiae +
+	    fvmrv->number_of_minutiae * fvmrv->fmd_length;
+	if (ptr + FEDB_HEADER_LENGTH > fvmrv->limit)
+		goto eof_out;
+	block_length = VIEW_BE16(ptr);
+	if (block_length == 0)
+		fvmrv->extended = NULL;
+	else
+		fvmrv->extended = ptr;
+	ptr += FEDB_HEADER_LENGTH + block_length;
+	if (ptr > fvmrv->limit)
+		goto eof_out;
+	fvmrv->end = ptr;
+	return (READ_OK);
+
+eof_out:
+	return (READ_EOF);
+}
+
+int
+fmr_view_init(BDB *fmdb, unsigned int format_std,
+    struct finger_minutiae_record_view *fmrv)
+{
+	uint8_t *ptr;
+	uint32_t record_length;
+	uint16_t sval;
+
+	memset(fmrv, 0, sizeof(struct finger_minutiae_record_view));
+	fmrv->format_std = format_std;
+	ptr = fmdb->bdb_current;
+	fmrv->start = ptr;
+
+	switch (format_std) {
+	case FMR_STD_ISO_NORMAL_CARD:
+	case FMR_STD_ISO_COMPACT_CARD:
+		/* No header; the record is the remainder of the buffer */
+		fmrv->header_length = 0;
+		fmrv->record_length = fmdb->bdb_end - ptr;
+		fmrv->num_views = 1;
+		break;
+
+	case FMR_STD_ANSI:
+		if (ptr + FMR_ANSI_SMALL_HEADER_LENGTH > fmdb->bdb_end)
+			goto eof_out;
+		sval = VIEW_BE16(ptr + FMR_FORMAT_ID_LEN +
+		    FMR_SPEC_VERSION_LEN);
+		if (sval == 0) {
+			if (ptr + FMR_ANSI_LARGE_HEADER_LENGTH > fmdb->bdb_end)
+				goto eof_out;
+			record_length = VIEW_BE32(ptr + FMR_FORMAT_ID_LEN +
+			    FMR_SPEC_VERSION_LEN + 2);
+			fmrv->header_length = FMR_ANSI_LARGE_HEADER_LENGTH;
+		} else {
+			record_length = sval;
+			fmrv->header_length = FMR_ANSI_SMALL_HEADER_LENGTH;
+		}
+		fmrv->record_length = record_length;
+		break;
+
+	case FMR_STD_ISO:
+		if (ptr + FMR_ISO_HEADER_LENGTH > fmdb->bdb_end)
+			goto eof_out;
+		fmrv->header_length = FMR_ISO_HEADER_LENGTH;
+		fmrv->record_length = VIEW_BE32(ptr + FMR_FORMAT_ID_LEN +
+		    FMR_SPEC_VERSION_LEN);
+		break;
+
+	case FMR_STD_ANSI07:
+		if (ptr + FMR_ANSI07_HEADER_LENGTH > fmdb->bdb_end)
+			goto eof_out;
+		fmrv->header_length = FMR_ANSI07_HEADER_LENGTH;
+		fmrv->record_length = VIEW_BE32(ptr + FMR_FORMAT_ID_LEN +
+		    FMR_SPEC_VERSION_LEN);
+		break;
+
+	default:
+		ERR_OUT("Invalid format standard %u", format_std);
+	}
+
+	if (fmrv->header_length != 0) {
+		if (fmrv->record_length < fmrv->header_length)
+			ERR_OUT("Record length %u is less than header length",
+			    fmrv->record_length);
+		/* Number of views is the second to last header octet */
+		fmrv->num_views = ptr[fmrv->header_length - 2];
+	}
+	if (ptr + fmrv->record_length > fmdb->bdb_end)
+		goto eof_out;
+	fmrv->end = ptr + fmrv->record_length;
+
+	/* Leave the buffer positioned at the next record */
+	fmdb->bdb_current = fmrv->end;
+	return (READ_OK);
+
+eof_out:
+	return (READ_EOF);
+err_out:
+	return (READ_ERROR);
+}
+
+unsigned int
+fmr_view_num_views(struct finger_minutiae_record_view *fmrv)
+{
+	return (fmrv->num_views);
+}
+
+unsigned int
+fmr_view_record_length(struct finger_minutiae_record_view *fmrv)
+{
+	return (fmrv->record_length);
+}
+
+void
+fmr_view_header(struct finger_minutiae_record_view *fmrv,
+    struct finger_minutiae_record *fmr)
+{
+	uint8_t *ptr;
+	uint16_t sval;
+
+	fmr->format_std = fmrv->format_std;
+	fmr->record_length = fmrv->record_length;
+	fmr->num_views = fmrv->num_views;
+	if (fmrv->header_length == 0)
+		return;
+
+	ptr = fmrv->start;
+	memcpy(fmr->format_id, ptr, FMR_FORMAT_ID_LEN);
+	ptr += FMR_FORMAT_ID_LEN;
+	memcpy(fmr->spec_version, ptr, FMR_SPEC_VERSION_LEN);
+	ptr += FMR_SPEC_VERSION_LEN;
+	switch (fmrv->format_std) {
+	case FMR_STD_ANSI:
+		if (fmrv->header_length == FMR_ANSI_LARGE_HEADER_LENGTH) {
+			fmr->record_length_type = FMR_ANSI_LARGE_HEADER_TYPE;
+			ptr += 6;
+		} else {
+			fmr->record_length_type = FMR_ANSI_SMALL_HEADER_TYPE;
+			ptr += 2;
+		}
+		break;
+	case FMR_STD_ISO:
+		fmr->record_length_type = FMR_ISO_HEADER_TYPE;
+		ptr += 4;
+		break;
+	case FMR_STD_ANSI07:
+		fmr->record_length_type = FMR_ANSI07_HEADER_TYPE;
+		ptr += 4;
+		break;
+	}
+	if ((fmrv->format_std == FMR_STD_ANSI) ||
+	    (fmrv->format_std == FMR_STD_ANSI07)) {
+		fmr->product_identifier_owner = VIEW_BE16(ptr);
+		fmr->product_identifier_type = VIEW_BE16(ptr + 2);
+		ptr += 4;
+	}
+	sval = VIEW_BE16(ptr);
+	fmr->scanner_id = sval & HDR_SCANNER_ID_MASK;
+	fmr->compliance = (sval & HDR_COMPLIANCE_MASK) >> HDR_COMPLIANCE_SHIFT;
+	ptr += 2;
+	if ((fmrv->format_std == FMR_STD_ANSI) ||
+	    (fmrv->format_std == FMR_STD_ISO)) {
+		fmr->x_image_size = VIEW_BE16(ptr);
+		fmr->y_image_size = VIEW_BE16(ptr + 2);
+		fmr->x_resolution = VIEW_BE16(ptr + 4);
+		fmr->y_resolution = VIEW_BE16(ptr + 6);
+		ptr += 8;
+	}
+	fmr->num_views = ptr[0];
+	fmr->reserved = ptr[1];
+}
+
+int
+fmr_view_first(struct finger_minutiae_record_view *fmrv,
+    struct finger_view_minutiae_record_view *fvmrv)
+{
+	memset(fvmrv, 0, sizeof(struct finger_view_minutiae_record_view));
+	if (fmrv->num_views == 0)
+		return (READ_EOF);
+	fvmrv->format_std = fmrv->format_std;
+	fvmrv->fmd_length = get_fmd_data_length(fmrv->format_std);
+	fvmrv->view_index = 0;
+	fvmrv->num_views = fmrv->num_views;
+	fvmrv->start = fmrv->start + fmrv->header_length;
+	fvmrv->limit = fmrv->end;
+	return (view_locate_fvmr(fvmrv));
+}
+
+int
+fvmr_view_next(struct finger_view_minutiae_record_view *fvmrv)
+{
+	if (fvmrv->view_index + 1 >= fvmrv->num_views)
+		return (READ_EOF);
+	fvmrv->view_index++;
+	fvmrv->start = fvmrv->end;
+	return (view_locate_fvmr(fvmrv));
+}
+
+void
+fvmr_view_header(struct finger_view_minutiae_record_view *fvmrv,
+    struct finger_view_minutiae_record *fvmr)
+{
+	uint8_t *ptr;
+
+	fvmr->format_std = fvmrv->format_std;
+	fvmr->number_of_minutiae = fvmrv->number_of_minutiae;
+	if ((fvmrv->format_std == FMR_STD_ISO_NORMAL_CARD) ||
+	    (fvmrv->format_std == FMR_STD_ISO_COMPACT_CARD))
+		return;
+
+	ptr = fvmrv->start;
+	fvmr->finger_number = ptr[0];
+	if (fvmrv->format_std == FMR_STD_ANSI07) {
+		fvmr->view_number = ptr[1];
+		fvmr->impression_type = ptr[2];
+		fvmr->finger_quality = ptr[3];
+		fvmr->algorithm_id = VIEW_BE32(ptr + 4);
+		fvmr->x_image_size = VIEW_BE16(ptr + 8);
+		fvmr->y_image_size = VIEW_BE16(ptr + 10);
+		fvmr->x_resolution = VIEW_BE16(ptr + 12);
+		fvmr->y_resolution = VIEW_BE16(ptr + 14);
+	} else {
+		fvmr->view_number = (ptr[1] & FVMR_VIEW_NUMBER_MASK) >>
+		    FVMR_VIEW_NUMBER_SHIFT;
+		fvmr->impression_type = ptr[1] & FVMR_IMPRESSION_MASK;
+		fvmr->finger_quality = ptr[2];
+	}
+}
+
+unsigned int
+fvmr_view_num_minutiae(struct finger_view_minutiae_record_view *fvmrv)
+{
+	return (fvmrv->number_of_minutiae);
+}
+
+int
+fvmr_view_minutia(struct finger_view_minutiae_record_view *fvmrv,
+    unsigned int i, struct finger_minutiae_data *fmd)
+{
+	uint8_t *ptr;
+	uint16_t sval;
+
+	if (i >= fvmrv->number_of_minutiae)
+		return (READ_ERROR);
+	ptr = fvmrv->minutiae + i * fvmrv->fmd_length;
+	fmd->format_std = fvmrv->format_std;
+	fmd->index = i + 1;
+	if (fvmrv->format_std == FMR_STD_ISO_COMPACT_CARD) {
+		fmd->x_coord = ptr[0];
+		fmd->y_coord = ptr[1];
+		fmd->type = (ptr[2] & FMD_ISO_COMPACT_MINUTIA_TYPE_MASK) >>
+		    FMD_ISO_COMPACT_MINUTIA_TYPE_SHIFT;
+		fmd->angle = ptr[2] & FMD_ISO_COMPACT_MINUTIA_ANGLE_MASK;
+		fmd->reserved = 0;
+		fmd->quality = ISO_UNKNOWN_FINGER_QUALITY;
+		return (READ_OK);
+	}
+	sval = VIEW_BE16(ptr);
+	fmd->type = (sval & FMD_MINUTIA_TYPE_MASK) >> FMD_MINUTIA_TYPE_SHIFT;
+	fmd->x_coord = sval & FMD_X_COORD_MASK;
+	sval = VIEW_BE16(ptr + 2);
+	fmd->reserved = (sval & FMD_RESERVED_MASK) >> FMD_RESERVED_SHIFT;
+	fmd->y_coord = sval & FMD_Y_COORD_MASK;
+	fmd->angle = ptr[4];
+	if (fvmrv->format_std == FMR_STD_ISO_NORMAL_CARD)
+		fmd->quality = 0;
+	else
+		fmd->quality = ptr[5];
+	return (READ_OK);
+}
+
+int
+fvmr_view_extended(struct finger_view_minutiae_record_view *fvmrv,
+    BDB *fedbdb)
+{
+	unsigned int len;
+
+	if (fvmrv->extended == NULL)
+		return (READ_EOF);
+	len = fvmrv->end - fvmrv->extended;
+	INIT_BDB(fedbdb, fvmrv->extended, len);
+	return (READ_OK);
+}
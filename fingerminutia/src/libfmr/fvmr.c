@@ -30,10 +30,17 @@
 /******************************************************************************/
 int
 new_fvmr(unsigned int format_std, struct finger_view_minutiae_record **fvmr)
+{
+	return (new_fvmr_arena(format_std, NULL, fvmr));
+}
+
+int
+new_fvmr_arena(unsigned int format_std, ARENA *arena,
+    struct finger_view_minutiae_record **fvmr)
 {
 	struct finger_view_minutiae_record *lfvmr;
 
-	lfvmr = (struct finger_view_minutiae_record *)malloc(
+	lfvmr = (struct finger_view_minutiae_record *)arena_alloc(arena,
 			sizeof(struct finger_view_minutiae_record));
 	if (lfvmr == NULL) {
 		perror("Failed to allocate Finger View Minutiae Record");
@@ -44,15 +51,65 @@ new_fvmr(unsigned int format_std, struct finger_view_minutiae_record **fvmr)
 	lfvmr->extended = NULL;
 	lfvmr->partial = FALSE;
 	TAILQ_INIT(&lfvmr->minutiae_data);
+	lfvmr->arena = arena;
 	*fvmr = lfvmr;
 	return 0;
 }
 
+/*
+ * Grow the minutiae block to hold 'size' entries. All the arrays share
+ * one allocation, starting with the X coordinates.
+ */
+#define FMB_ENTRY_LENGTH	(2 * sizeof(unsigned short) + 4)
+static int
+grow_fmb(struct finger_view_minutiae_record *fvmr, unsigned int size)
+{
+	FMB *fmb;
+	uint8_t *ptr;
+	unsigned short *old_x;
+
+	fmb = &fvmr->minutiae_block;
+	if (size <= fmb->size)
+		return (0);
+	ptr = (uint8_t *)arena_alloc(fvmr->arena, size * FMB_ENTRY_LENGTH);
+	if (ptr == NULL) {
+		fmb->failed = TRUE;
+		ALLOC_ERR_RETURN("minutiae block");
+	}
+	old_x = fmb->x_coord;
+	if (fmb->count != 0) {
+		memcpy(ptr, fmb->x_coord, fmb->count * sizeof(unsigned short));
+		memcpy(ptr + size * sizeof(unsigned short), fmb->y_coord,
+		    fmb->count * sizeof(unsigned short));
+		memcpy(ptr + size * 2 * sizeof(unsigned short), fmb->type,
+		    fmb->count);
+		memcpy(ptr + size * (2 * sizeof(unsigned short) + 1),
+		    fmb->reserved, fmb->count);
+		memcpy(ptr + size * (2 * sizeof(unsigned short) + 2),
+		    fmb->angle, fmb->count);
+		memcpy(ptr + size * (2 * sizeof(unsigned short) + 3),
+		    fmb->quality, fmb->count);
+	}
+	fmb->x_coord = (unsigned short *)ptr;
+	fmb->y_coord = (unsigned short *)(ptr + size * sizeof(unsigned short));
+	fmb->type = ptr + size * 2 * sizeof(unsigned short);
+	fmb->reserved = ptr + size * (2 * sizeof(unsigned short) + 1);
+	fmb->angle = ptr + size * (2 * sizeof(unsigned short) + 2);
+	fmb->quality = ptr + size * (2 * sizeof(unsigned short) + 3);
+	fmb->size = size;
+	if ((old_x != NULL) && (fvmr->arena == NULL))
+		free(old_x);
+	return (0);
+}
+
 void
 free_fvmr(struct finger_view_minutiae_record *fvmr)
 {
 	struct finger_minutiae_data *fmd;
 
+	if (fvmr->arena != NULL)
+		return;
+
 	// Free the Finger Minutiae Records contained within the FVMR
 	while (!TAILQ_EMPTY(&fvmr->minutiae_data)) {
 		fmd = TAILQ_FIRST(&fvmr->minutiae_data);
@@ -62,6 +119,8 @@ free_fvmr(struct finger_view_minutiae_record *fvmr)
 	if (fvmr->extended != NULL) {
 		free_fedb(fvmr->extended);
 	}
+	if (fvmr->minutiae_block.x_coord != NULL)
+		free(fvmr->minutiae_block.x_coord);
 
 	// Free the FVMR itself
 	free(fvmr);
@@ -71,6 +130,48 @@ free_fvmr(struct finger_view_minutiae_record *fvmr)
 /* Implement the interface for reading and writing Finger View Minutiae       */
 /* records.                                                                   */
 /******************************************************************************/
+/*
+ * Scan all the minutiae of a view from a buffer by decoding them into the
+ * minutiae block in one pass, then filling the FMD records from the block.
+ * Returns READ_EOF, leaving the buffer untouched, when the buffer does not
+ * hold all the minutiae or the block could not be sized, so the caller can
+ * fall back to scanning each FMD record.
+ */
+static int
+scan_fmb(BDB *fmdb, struct finger_view_minutiae_record *fvmr)
+{
+	struct finger_minutiae_data *fmd;
+	FMB *fmb;
+	unsigned int i, len;
+
+	fmb = &fvmr->minutiae_block;
+	len = fvmr->number_of_minutiae *
+	    get_fmd_data_length(fvmr->format_std);
+	if ((fmb->count != 0) || (fmb->size < fvmr->number_of_minutiae) ||
+	    ((uint32_t)(fmdb->bdb_end - fmdb->bdb_current) < len))
+		return (READ_EOF);
+	decode_fmb(fmb, 0, fvmr->number_of_minutiae, fvmr->format_std,
+	    fmdb->bdb_current);
+	fmdb->bdb_current += len;
+	fmb->count = fvmr->number_of_minutiae;
+	fvmr->geometry_valid = FALSE;
+
+	for (i = 0; i < fvmr->number_of_minutiae; i++) {
+		if (new_fmd_arena(fvmr->format_std, fvmr->arena, &fmd,
+		    i+1) < 0)
+			ERR_OUT("Could not allocate FMD %d", i);
+		fmb_to_fmd(fmb, i, fmd);
+		fmd->fvmr = fvmr;
+		TAILQ_INSERT_TAIL(&fvmr->minutiae_data, fmd, list);
+	}
+	return (READ_OK);
+
+err_out:
+	// The list is shorter than the block
+	fvmr->minutiae_dirty = TRUE;
+	return (READ_ERROR);
+}
+
 static int
 internal_read_fvmr(FILE *fp, BDB *fmdb,
     struct finger_view_minutiae_record *fvmr)
@@ -91,7 +192,8 @@ internal_read_fvmr(FILE *fp, BDB *fmdb,
 		ret = READ_OK;
 		i = 1;
 		while (ret == READ_OK) {
-			if (new_fmd(fvmr->format_std, &fmd, i) < 0)
+			if (new_fmd_arena(fvmr->format_std, fvmr->arena,
+			    &fmd, i) < 0)
 				ERR_OUT("Could not allocate FMD %d", i);
 
 			if (fp != NULL)
@@ -102,7 +204,10 @@ internal_read_fvmr(FILE *fp, BDB *fmdb,
 				add_fmd_to_fvmr(fmd, fvmr);
 				i++;
 				fvmr->number_of_minutiae++;
-			} else if (ret == READ_EOF)
+				continue;
+			}
+			free_fmd(fmd);
+			if (ret == READ_EOF)
 				return READ_OK;
 			else 
 				ERR_OUT("Could not read FMD %d", i);
@@ -140,33 +245,49 @@ internal_read_fvmr(FILE *fp, BDB *fmdb,
 	CGET(&cval, fp, fmdb);
 	fvmr->number_of_minutiae = cval;
 
-	// Finger minutiae data
+	// Finger minutiae data; size the minutiae block for all of them
+	(void)grow_fmb(fvmr, fvmr->number_of_minutiae);
+	if (fp != NULL)
+		ret = READ_EOF;
+	else
+		ret = scan_fmb(fmdb, fvmr);
+	if (ret == READ_OK)
+		goto fedb_in;
+	if (ret == READ_ERROR)
+		goto err_out;
 	for (i = 0; i < fvmr->number_of_minutiae; i++) {
-		if (new_fmd(fvmr->format_std, &fmd, i+1) < 0)
+		if (new_fmd_arena(fvmr->format_std, fvmr->arena, &fmd,
+		    i+1) < 0)
 			ERR_OUT("Could not allocate FMD %d", i);
 
 		if (fp != NULL)
 			ret = read_fmd(fp, fmd);
 		else
 			ret = scan_fmd(fmdb, fmd);
-		if (ret == READ_OK)
+		if (ret == READ_OK) {
 			add_fmd_to_fvmr(fmd, fvmr);
-		else if (ret == READ_EOF)
+			continue;
+		}
+		free_fmd(fmd);
+		if (ret == READ_EOF)
 			goto eof_out;
 		else 
 			ERR_OUT("Could not read FMD %d", i);
 	}
 
+fedb_in:
 	// Read the extended data block, if it exists
-	if (new_fedb(fvmr->format_std, &fedb) < 0)
+	if (new_fedb_arena(fvmr->format_std, fvmr->arena, &fedb) < 0)
 		ERR_OUT("Could not allocate extended data block");
 
 	if (fp != NULL)
 		ret = read_fedb(fp, fedb);
 	else
 		ret = scan_fedb(fmdb, fedb);
-	if (ret == READ_ERROR)
+	if (ret == READ_ERROR) {
+		free_fedb(fedb);
 		ERR_OUT("Could not read extended data block");
+	}
 
 	// EOF is OK as we may have read a partial block
 	if (fedb->partial)
@@ -197,11 +318,95 @@ scan_fvmr(BDB *fmdb, struct finger_view_minutiae_record *fvmr)
 	return (internal_read_fvmr(NULL, fmdb, fvmr));
 }
 
+/*
+ * Refresh the minutiae block from the list of FMD records, which remains the
+ * authority on the minutiae of the view. The block is only rebuilt when the
+ * minutiae were marked as changed by invalidate_fvmr_minutiae(); otherwise
+ * the view is left untouched. Returns non-zero when the block could not be
+ * grown to hold all the minutiae.
+ */
+static int
+sync_fmb(struct finger_view_minutiae_record *fvmr)
+{
+	struct finger_minutiae_data *fmd;
+	FMB *fmb;
+	unsigned int count, n;
+
+	fmb = &fvmr->minutiae_block;
+	if (fmb->failed)
+		return (-1);
+	if (!fvmr->minutiae_dirty)
+		return (0);
+	count = 0;
+	TAILQ_FOREACH(fmd, &fvmr->minutiae_data, list)
+		count++;
+	if (grow_fmb(fvmr, count) != 0)
+		return (-1);
+	if (count != fmb->count)
+		fvmr->geometry_valid = FALSE;
+	n = 0;
+	TAILQ_FOREACH(fmd, &fvmr->minutiae_data, list) {
+		if ((fmb->x_coord[n] != fmd->x_coord) ||
+		    (fmb->y_coord[n] != fmd->y_coord) ||
+		    (fmb->type[n] != fmd->type) ||
+		    (fmb->reserved[n] != fmd->reserved) ||
+		    (fmb->angle[n] != fmd->angle) ||
+		    (fmb->quality[n] != fmd->quality)) {
+			fmb->x_coord[n] = fmd->x_coord;
+			fmb->y_coord[n] = fmd->y_coord;
+			fmb->type[n] = fmd->type;
+			fmb->reserved[n] = fmd->reserved;
+			fmb->angle[n] = fmd->angle;
+			fmb->quality[n] = fmd->quality;
+			fvmr->geometry_valid = FALSE;
+		}
+		n++;
+	}
+	fmb->count = count;
+	fvmr->minutiae_dirty = FALSE;
+	return (0);
+}
+
+/*
+ * Write the minutiae of a view. When pushing to a buffer, the minutiae
+ * block is encoded in one pass instead of pushing each FMD record.
+ */
+static int
+write_minutiae(FILE *fp, BDB *fmdb, struct finger_view_minutiae_record *fvmr)
+{
+	struct finger_minutiae_data *fmd;
+	FMB *fmb;
+	unsigned int len;
+	int ret;
+
+	fmb = &fvmr->minutiae_block;
+	if ((fp == NULL) && (sync_fmb(fvmr) == 0)) {
+		len = fmb->count * get_fmd_data_length(fvmr->format_std);
+		if (((uint32_t)(fmdb->bdb_end - fmdb->bdb_current) < len) &&
+		    (!(fmdb->bdb_flags & BDB_GROWABLE) ||
+		    (grow_bdb(fmdb, len) != 0)))
+			return WRITE_ERROR;
+		encode_fmb(fmb, 0, fmb->count, fvmr->format_std,
+		    fmdb->bdb_current);
+		fmdb->bdb_current += len;
+		return WRITE_OK;
+	}
+
+	TAILQ_FOREACH(fmd, &fvmr->minutiae_data, list) {
+		if (fp != NULL)
+			ret = write_fmd(fp, fmd);
+		else
+			ret = push_fmd(fmdb, fmd);
+		if (ret != WRITE_OK)
+			return WRITE_ERROR;
+	}
+	return WRITE_OK;
+}
+
 static int
 internal_write_fvmr(FILE *fp, BDB *fmdb,
     struct finger_view_minutiae_record *fvmr)
 {
-	struct finger_minutiae_data *fmd;
 	unsigned char cval;
 	int ret;
 
@@ -210,14 +415,8 @@ internal_write_fvmr(FILE *fp, BDB *fmdb,
 	 */
 	if ((fvmr->format_std == FMR_STD_ISO_NORMAL_CARD) ||
 	    (fvmr->format_std == FMR_STD_ISO_COMPACT_CARD)) {
-		TAILQ_FOREACH(fmd, &fvmr->minutiae_data, list) {
-			if (fp != NULL)
-				ret = write_fmd(fp, fmd);
-			else
-				ret = push_fmd(fmdb, fmd);
-			if (ret != WRITE_OK)
-				ERR_OUT("Could not write minutiae data");
-		}
+		if (write_minutiae(fp, fmdb, fvmr) != WRITE_OK)
+			ERR_OUT("Could not write minutiae data");
 		return WRITE_OK;
 	}
 	CPUT(fvmr->finger_number, fp, fmdb);
@@ -240,14 +439,8 @@ internal_write_fvmr(FILE *fp, BDB *fmdb,
 	CPUT(fvmr->number_of_minutiae, fp, fmdb);
 
 	// Write each Finger Minutiae Data record
-	TAILQ_FOREACH(fmd, &fvmr->minutiae_data, list) {
-		if (fp != NULL)
-			ret = write_fmd(fp, fmd);
-		else
-			ret = push_fmd(fmdb, fmd);
-		if (ret != WRITE_OK)
-			ERR_OUT("Could not write minutiae data");
-	}
+	if (write_minutiae(fp, fmdb, fvmr) != WRITE_OK)
+		ERR_OUT("Could not write minutiae data");
 
 	// Write the extended data
 	if (fp != NULL)
@@ -275,6 +468,29 @@ push_fvmr(BDB *fmdb, struct finger_view_minutiae_record *fvmr)
 	return (internal_write_fvmr(NULL, fmdb, fvmr));
 }
 
+unsigned int
+get_fvmr_encoded_length(struct finger_view_minutiae_record *fvmr)
+{
+	struct finger_minutiae_data *fmd;
+	unsigned int length, fmdlen;
+
+	fmdlen = get_fmd_data_length(fvmr->format_std);
+	length = 0;
+	TAILQ_FOREACH(fmd, &fvmr->minutiae_data, list)
+		length += fmdlen;
+
+	/* ISO normal and compact card formats have only the minutiae */
+	if ((fvmr->format_std == FMR_STD_ISO_NORMAL_CARD) ||
+	    (fvmr->format_std == FMR_STD_ISO_COMPACT_CARD))
+		return (length);
+
+	if (fvmr->format_std == FMR_STD_ANSI07)
+		length += FVMR_ANSI07_HEADER_LENGTH;
+	else
+		length += FVMR_HEADER_LENGTH;
+	return (length + get_fedb_encoded_length(fvmr->extended));
+}
+
 int
 print_fvmr(FILE *fp, struct finger_view_minutiae_record *fvmr)
 {
@@ -365,8 +581,27 @@ void
 add_fmd_to_fvmr(struct finger_minutiae_data *fmd,
                 struct finger_view_minutiae_record *fvmr)
 {
+	FMB *fmb;
+	unsigned int n;
+
 	fmd->fvmr = fvmr;
 	TAILQ_INSERT_TAIL(&fvmr->minutiae_data, fmd, list);
+
+	// Append the minutia to the block, doubling the block when full
+	fmb = &fvmr->minutiae_block;
+	if (fmb->failed)
+		return;
+	if (fmb->count == fmb->size)
+		if (grow_fmb(fvmr, (fmb->size == 0) ? 16 : fmb->size * 2) != 0)
+			return;
+	fvmr->geometry_valid = FALSE;
+	n = fmb->count++;
+	fmb->x_coord[n] = fmd->x_coord;
+	fmb->y_coord[n] = fmd->y_coord;
+	fmb->type[n] = fmd->type;
+	fmb->reserved[n] = fmd->reserved;
+	fmb->angle[n] = fmd->angle;
+	fmb->quality[n] = fmd->quality;
 }
 
 void
@@ -401,6 +636,39 @@ get_fmds(struct finger_view_minutiae_record *fvmr,
 	return count;
 }
 
+FMB *
+get_fmb(struct finger_view_minutiae_record *fvmr)
+{
+	if (sync_fmb(fvmr) != 0)
+		return (NULL);
+	return (&fvmr->minutiae_block);
+}
+
+const FVG *
+get_fvmr_geometry(struct finger_view_minutiae_record *fvmr)
+{
+	if ((sync_fmb(fvmr) != 0) || (fvmr->minutiae_block.count == 0))
+		return (NULL);
+	if (!fvmr->geometry_valid) {
+		find_fmb_geometry(&fvmr->minutiae_block, &fvmr->geometry);
+		fvmr->geometry_valid = TRUE;
+	}
+	return (&fvmr->geometry);
+}
+
+void
+invalidate_fvmr_geometry(struct finger_view_minutiae_record *fvmr)
+{
+	fvmr->geometry_valid = FALSE;
+}
+
+void
+invalidate_fvmr_minutiae(struct finger_view_minutiae_record *fvmr)
+{
+	fvmr->minutiae_dirty = TRUE;
+	fvmr->geometry_valid = FALSE;
+}
+
 int
 get_rcd_count(struct finger_view_minutiae_record *fvmr)
 {
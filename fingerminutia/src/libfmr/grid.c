@@ -0,0 +1,448 @@
+/*
+ * This software was developed at the National Institute of Standards and
+ * Technology (NIST) by employees of the Federal Government in the course
+ * of their official duties. Pursuant to title 17 Section 105 of the
+ * United States Code, this software is not subject to copyright protection
+ * and is in the public domain. NIST assumes no responsibility whatsoever for
+ * its use by other parties, and makes no guarantees, expressed or implied,
+ * about its quality, reliability, or any other characteristic.
+ */
+
+/******************************************************************************/
+/* This file contains the functions for the spatial index over the minutiae   */
+/* of a finger view. The image is divided into a uniform grid of square cells */
+/* whose size is a power of two, so the cell of a coordinate is found with a  */
+/* shift. The block entries are bucketed by cell with a counting sort, and    */
+/* each query visits only the cells that overlap its region.                  */
+/*                                                                            */
+/******************************************************************************/
+#include <sys/queue.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <biomdimacro.h>
+#include <fmr.h>
+
+/*
+ * The cell size is the smallest power of two, within these limits, that
+ * gives no more cells than half the number of minutiae.
+ */
+#define GRID_MIN_SHIFT		3
+#define GRID_MAX_SHIFT		14
+#define GRID_CELL_TARGET	2
+
+/* For the nearest search, the entry number is packed below the distance */
+#define NEAREST_INDEX_BITS	24
+#define NEAREST_INDEX_MASK	((1 << NEAREST_INDEX_BITS) - 1)
+
+static unsigned int
+cell_count(unsigned int width, unsigned int height, unsigned int shift)
+{
+	return ((((width - 1) >> shift) + 1) * (((height - 1) >> shift) + 1));
+}
+
+int
+new_fmb_grid(const FMB *fmb, unsigned int x_size, unsigned int y_size,
+    MGRID **grid)
+{
+	MGRID *lgrid;
+	unsigned int m, c, col, row, cells, width, height, shift;
+
+	/* The grid covers the image and every minutia */
+	width = x_size;
+	height = y_size;
+	for (m = 0; m < fmb->count; m++) {
+		if (fmb->x_coord[m] >= width)
+			width = fmb->x_coord[m] + 1;
+		if (fmb->y_coord[m] >= height)
+			height = fmb->y_coord[m] + 1;
+	}
+	if (width == 0)
+		width = 1;
+	if (height == 0)
+		height = 1;
+
+	shift = GRID_MIN_SHIFT;
+	while ((shift < GRID_MAX_SHIFT) &&
+	    (cell_count(width, height, shift) * GRID_CELL_TARGET > fmb->count))
+		shift++;
+
+	lgrid = (MGRID *)malloc(sizeof(MGRID));
+	if (lgrid == NULL)
+		ALLOC_ERR_RETURN("Minutiae grid");
+	lgrid->fmb = fmb;
+	lgrid->count = fmb->count;
+	lgrid->shift = shift;
+	lgrid->columns = ((width - 1) >> shift) + 1;
+	lgrid->rows = ((height - 1) >> shift) + 1;
+	cells = lgrid->columns * lgrid->rows;
+	lgrid->cell_start = (unsigned int *)calloc(cells + 1,
+	    sizeof(unsigned int));
+	lgrid->entries = (unsigned int *)malloc(
+	    (fmb->count > 0 ? fmb->count : 1) * sizeof(unsigned int));
+	if ((lgrid->cell_start == NULL) || (lgrid->entries == NULL)) {
+		free_minutiae_grid(lgrid);
+		ALLOC_ERR_RETURN("Minutiae grid cells");
+	}
+
+	/* Bucket the entries by cell, keeping block order within each cell */
+	for (m = 0; m < fmb->count; m++) {
+		col = fmb->x_coord[m] >> shift;
+		row = fmb->y_coord[m] >> shift;
+		lgrid->cell_start[row * lgrid->columns + col + 1]++;
+	}
+	for (c = 1; c <= cells; c++)
+		lgrid->cell_start[c] += lgrid->cell_start[c - 1];
+	for (m = 0; m < fmb->count; m++) {
+		c = (fmb->y_coord[m] >> shift) * lgrid->columns +
+		    (fmb->x_coord[m] >> shift);
+		lgrid->entries[lgrid->cell_start[c]++] = m;
+	}
+	for (c = cells; c > 0; c--)
+		lgrid->cell_start[c] = lgrid->cell_start[c - 1];
+	lgrid->cell_start[0] = 0;
+
+	*grid = lgrid;
+	return (0);
+}
+
+int
+new_minutiae_grid(struct finger_view_minutiae_record *fvmr, MGRID **grid)
+{
+	FMB *fmb;
+	unsigned int x_size, y_size;
+
+	fmb = get_fmb(fvmr);
+	if (fmb == NULL)
+		ERR_OUT("Minutiae block is not available");
+	x_size = y_size = 0;
+	if (fvmr->format_std == FMR_STD_ANSI07) {
+		x_size = fvmr->x_image_size;
+		y_size = fvmr->y_image_size;
+	} else if (fvmr->fmr != NULL) {
+		x_size = fvmr->fmr->x_image_size;
+		y_size = fvmr->fmr->y_image_size;
+	}
+	return (new_fmb_grid(fmb, x_size, y_size, grid));
+
+err_out:
+	return (-1);
+}
+
+void
+free_minutiae_grid(MGRID *grid)
+{
+	if (grid->cell_start != NULL)
+		free(grid->cell_start);
+	if (grid->entries != NULL)
+		free(grid->entries);
+	free(grid);
+}
+
+/*
+ * Find the range of cells overlapping the pixels from (x0, y0) to (x1, y1),
+ * inclusive. Returns 0 if no cell overlaps.
+ */
+static int
+cell_range(const MGRID *grid, int x0, int y0, int x1, int y1,
+    unsigned int *c0, unsigned int *r0, unsigned int *c1, unsigned int *r1)
+{
+	if ((x1 < 0) || (y1 < 0) || (x0 > x1) || (y0 > y1))
+		return (0);
+	*c0 = (x0 < 0) ? 0 : (unsigned int)x0 >> grid->shift;
+	*r0 = (y0 < 0) ? 0 : (unsigned int)y0 >> grid->shift;
+	*c1 = (unsigned int)x1 >> grid->shift;
+	*r1 = (unsigned int)y1 >> grid->shift;
+	if (*c0 >= grid->columns || *r0 >= grid->rows)
+		return (0);
+	if (*c1 >= grid->columns)
+		*c1 = grid->columns - 1;
+	if (*r1 >= grid->rows)
+		*r1 = grid->rows - 1;
+	return (1);
+}
+
+static int
+compare_entry(const void *e1, const void *e2)
+{
+	int le1, le2;
+
+	le1 = *(const int *)e1;
+	le2 = *(const int *)e2;
+	return ((le1 > le2) - (le1 < le2));
+}
+
+/*
+ * The entries of the cells are each in block order, so the result needs
+ * sorting only when it came from more than one cell.
+ */
+#define FINISH_SELECTION(order, count, cells_hit)			\
+	do {								\
+		if ((cells_hit) > 1)					\
+			qsort((order), (count), sizeof(int),		\
+			    compare_entry);				\
+	} while (0)
+
+int
+grid_select_rectangle(const MGRID *grid, int x, int y, int a, int b,
+    int *order)
+{
+	const FMB *fmb = grid->fmb;
+	unsigned int c0, r0, c1, r1, col, row, i;
+	int m, count, hit, cells_hit;
+
+	count = cells_hit = 0;
+	if (!cell_range(grid, x, y, x + a, y + b, &c0, &r0, &c1, &r1))
+		return (0);
+	for (row = r0; row <= r1; row++) {
+		for (col = c0; col <= c1; col++) {
+			hit = 0;
+			for (i = grid->cell_start[row * grid->columns + col];
+			    i < grid->cell_start[row * grid->columns + col + 1];
+			    i++) {
+				m = grid->entries[i];
+				if ((fmb->x_coord[m] >= x) &&
+				    (fmb->x_coord[m] <= x + a) &&
+				    (fmb->y_coord[m] >= y) &&
+				    (fmb->y_coord[m] <= y + b)) {
+					order[count++] = m;
+					hit = 1;
+				}
+			}
+			cells_hit += hit;
+		}
+	}
+	FINISH_SELECTION(order, count, cells_hit);
+	return (count);
+}
+
+int
+grid_select_ellipse(const MGRID *grid, int x, int y, int a, int b,
+    int *order)
+{
+	const FMB *fmb = grid->fmb;
+	unsigned int c0, r0, c1, r1, col, row, i;
+	int m, count, hit, cells_hit;
+	double fx, fy;
+
+	count = cells_hit = 0;
+	if ((a <= 0) || (b <= 0))
+		return (0);
+	if (!cell_range(grid, x - a, y - b, x + a, y + b, &c0, &r0, &c1, &r1))
+		return (0);
+	for (row = r0; row <= r1; row++) {
+		for (col = c0; col <= c1; col++) {
+			hit = 0;
+			for (i = grid->cell_start[row * grid->columns + col];
+			    i < grid->cell_start[row * grid->columns + col + 1];
+			    i++) {
+				m = grid->entries[i];
+				fx = (double)(fmb->x_coord[m] - x) / a;
+				fy = (double)(fmb->y_coord[m] - y) / b;
+				if ((fx*fx) + (fy*fy) < 1.0) {
+					order[count++] = m;
+					hit = 1;
+				}
+			}
+			cells_hit += hit;
+		}
+	}
+	FINISH_SELECTION(order, count, cells_hit);
+	return (count);
+}
+
+int
+grid_select_radius(const MGRID *grid, int x, int y, int r, int *order)
+{
+	const FMB *fmb = grid->fmb;
+	unsigned int c0, r0, c1, r1, col, row, i;
+	int m, count, hit, cells_hit;
+	int64_t dx, dy, r2;
+
+	count = cells_hit = 0;
+	if (r < 0)
+		return (0);
+	r2 = (int64_t)r * r;
+	if (!cell_range(grid, x - r, y - r, x + r, y + r, &c0, &r0, &c1, &r1))
+		return (0);
+	for (row = r0; row <= r1; row++) {
+		for (col = c0; col <= c1; col++) {
+			hit = 0;
+			for (i = grid->cell_start[row * grid->columns + col];
+			    i < grid->cell_start[row * grid->columns + col + 1];
+			    i++) {
+				m = grid->entries[i];
+				dx = fmb->x_coord[m] - x;
+				dy = fmb->y_coord[m] - y;
+				if ((dx*dx) + (dy*dy) <= r2) {
+					order[count++] = m;
+					hit = 1;
+				}
+			}
+			cells_hit += hit;
+		}
+	}
+	FINISH_SELECTION(order, count, cells_hit);
+	return (count);
+}
+
+/*
+ * Move the value at 'i' down the max-heap of 'n' values until neither
+ * child is larger.
+ */
+static void
+sift_down(uint64_t *heap, int i, int n)
+{
+	uint64_t val;
+	int child;
+
+	val = heap[i];
+	for (;;) {
+		child = 2 * i + 1;
+		if (child >= n)
+			break;
+		if ((child + 1 < n) && (heap[child + 1] > heap[child]))
+			child++;
+		if (heap[child] <= val)
+			break;
+		heap[i] = heap[child];
+		i = child;
+	}
+	heap[i] = val;
+}
+
+/*
+ * Move the value at 'i' up the max-heap until its parent is not smaller.
+ */
+static void
+sift_up(uint64_t *heap, int i)
+{
+	uint64_t val;
+	int parent;
+
+	val = heap[i];
+	while (i > 0) {
+		parent = (i - 1) / 2;
+		if (heap[parent] >= val)
+			break;
+		heap[i] = heap[parent];
+		i = parent;
+	}
+	heap[i] = val;
+}
+
+static int
+min_int(int a, int b)
+{
+	return ((a < b) ? a : b);
+}
+
+static int64_t
+min_int64(int64_t a, int64_t b)
+{
+	return ((a < b) ? a : b);
+}
+
+/*
+ * Add the minutiae of one cell to the max-heap of the 'k' nearest found
+ * so far, which holds 'size' values.
+ */
+static void
+add_cell_to_heap(const MGRID *grid, unsigned int cell, int x, int y,
+    uint64_t *heap, int *size, int k)
+{
+	const FMB *fmb = grid->fmb;
+	uint64_t val;
+	int64_t dx, dy;
+	unsigned int i, m;
+
+	for (i = grid->cell_start[cell]; i < grid->cell_start[cell + 1]; i++) {
+		m = grid->entries[i];
+		dx = fmb->x_coord[m] - x;
+		dy = fmb->y_coord[m] - y;
+		val = ((uint64_t)((dx*dx) + (dy*dy)) << NEAREST_INDEX_BITS) | m;
+		if (*size < k) {
+			heap[(*size)++] = val;
+			sift_up(heap, *size - 1);
+		} else if (val < heap[0]) {
+			heap[0] = val;
+			sift_down(heap, 0, k);
+		}
+	}
+}
+
+int
+grid_select_nearest(const MGRID *grid, int x, int y, int k, int *order)
+{
+	uint64_t *heap, val;
+	int64_t bound, cell;
+	int col, row, ccol, crow, ring, step, size, n;
+
+	if (k > (int)grid->count)
+		k = grid->count;
+	if (k <= 0)
+		return (0);
+	if (grid->count > NEAREST_INDEX_MASK + 1)
+		ERR_OUT("Too many minutiae for the nearest search");
+	heap = (uint64_t *)malloc(k * sizeof(uint64_t));
+	if (heap == NULL)
+		ALLOC_ERR_RETURN("Nearest minutiae heap");
+
+	/* Start from the cell nearest the point, and visit rings of cells */
+	cell = (int64_t)1 << grid->shift;
+	ccol = (x < 0) ? 0 : min_int(x >> grid->shift, grid->columns - 1);
+	crow = (y < 0) ? 0 : min_int(y >> grid->shift, grid->rows - 1);
+	size = 0;
+	for (ring = 0; ; ring++) {
+		for (row = crow - ring; row <= crow + ring; row++) {
+			if ((row < 0) || (row >= (int)grid->rows))
+				continue;
+			/* Within the ring, only its first and last columns */
+			step = ((row == crow - ring) || (row == crow + ring)) ?
+			    1 : 2 * ring;
+			for (col = ccol - ring; col <= ccol + ring; col += step)
+				if ((col >= 0) && (col < (int)grid->columns))
+					add_cell_to_heap(grid,
+					    row * grid->columns + col, x, y,
+					    heap, &size, k);
+		}
+
+		/* Stop when every cell has been visited */
+		if ((ccol - ring <= 0) && (crow - ring <= 0) &&
+		    (ccol + ring >= (int)grid->columns - 1) &&
+		    (crow + ring >= (int)grid->rows - 1))
+			break;
+
+		/*
+		 * Or when no minutia outside the visited cells can be as
+		 * near as the farthest of those found.
+		 */
+		if (size == k) {
+			bound = min_int64(
+			    min_int64(x - (int64_t)(ccol - ring) * cell + 1,
+			    (int64_t)(ccol + ring + 1) * cell - x),
+			    min_int64(y - (int64_t)(crow - ring) * cell + 1,
+			    (int64_t)(crow + ring + 1) * cell - y));
+			if ((bound > 0) && ((uint64_t)(bound * bound) >
+			    (heap[0] >> NEAREST_INDEX_BITS)))
+				break;
+		}
+	}
+
+	/* Sort the heap into ascending order */
+	for (n = k - 1; n > 0; n--) {
+		val = heap[0];
+		heap[0] = heap[n];
+		heap[n] = val;
+		sift_down(heap, 0, n);
+	}
+	for (n = 0; n < k; n++)
+		order[n] = (int)(heap[n] & NEAREST_INDEX_MASK);
+	free(heap);
+	return (k);
+
+err_out:
+	return (-1);
+}
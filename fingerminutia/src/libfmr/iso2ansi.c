@@ -28,7 +28,7 @@ int
 iso2ansi_fvmr(FVMR *ifvmr, FVMR *ofvmr, unsigned int *length,
     const unsigned short xres, const unsigned short yres)
 {
-	FMD **ifmds = NULL;
+	FMB *ifmb;
 	FMD *ofmd;
 	int m, mcount;
 	double theta;
@@ -53,27 +53,26 @@ iso2ansi_fvmr(FVMR *ifvmr, FVMR *ofvmr, unsigned int *length,
 	if (mcount == 0)
 		return (0);
 
-	ifmds = (FMD **)malloc(mcount * sizeof(FMD *));
-	if (ifmds == NULL)
-		ALLOC_ERR_RETURN("FMD array");
-	if (get_fmds(ifvmr, ifmds) != mcount)
-		ERR_OUT("getting FMDs from FVMR");
+	ifmb = get_fmb(ifvmr);
+	if ((ifmb == NULL) || (ifmb->count != (unsigned int)mcount))
+		ERR_OUT("getting minutiae block from FVMR");
 
 	/* The ISO minutia record uses all possible values for the
 	 * angle, so convert from units to actual theta values.
 	 */
 	conversion_factor = FMD_ISO_ANGLE_UNIT;
 	for (m = 0; m < mcount; m++) {
-		if (new_fmd(ofvmr->format_std, &ofmd, m) != 0)
+		if (new_fmd_arena(ofvmr->format_std, ofvmr->arena, &ofmd,
+		    m) != 0)
 			ALLOC_ERR_RETURN("Output FMD");
 
-		COPY_FMD(ifmds[m], ofmd);
+		fmb_to_fmd(ifmb, m, ofmd);
 		if (ifvmr->format_std == FMR_STD_ISO_NORMAL_CARD) {
 			/* Convert the minutiae using fixed normal card
 			 * resolution; ISO NC is 0.01 p/mm, so convert
 			 * to 1 p/mm */
-			xunits = (double)ifmds[m]->x_coord * 0.01;
-			yunits = (double)ifmds[m]->y_coord * 0.01;
+			xunits = (double)ifmb->x_coord[m] * 0.01;
+			yunits = (double)ifmb->y_coord[m] * 0.01;
 
 			/* Convert from p/mm to p/cm */
 			xcm = (xunits * xres) / 10.0;
@@ -82,7 +81,7 @@ iso2ansi_fvmr(FVMR *ifvmr, FVMR *ofvmr, unsigned int *length,
 			ofmd->x_coord = (unsigned short)(0.5 + xcm);
 			ofmd->y_coord = (unsigned short)(0.5 + ycm);
 		}
-		theta = round(conversion_factor * (double)(ifmds[m]->angle));
+		theta = round(conversion_factor * (double)(ifmb->angle[m]));
 		ofmd->angle = (unsigned char)(round(theta / FMD_ANSI_ANGLE_UNIT));
 		/* Check the edge condition where theta rounds greater than
 		 * max angle value */
@@ -90,9 +89,9 @@ iso2ansi_fvmr(FVMR *ifvmr, FVMR *ofvmr, unsigned int *length,
 			ofmd->angle = FMD_MAX_MINUTIA_ANGLE;
 
 		/* Convert quality from ANSI04/ISO05 to ANSI07. */
-		ofmd->quality = ifmds[m]->quality;
+		ofmd->quality = ifmb->quality[m];
 		if (ofvmr->format_std == FMR_STD_ANSI07) {
-			if (ifmds[m]->quality == FMD_UNKNOWN_MINUTIA_QUALITY) {
+			if (ifmb->quality[m] == FMD_UNKNOWN_MINUTIA_QUALITY) {
 				ofmd->quality = FMD_NOATTTEMPT_MINUTIA_QUALITY;
 			}
 		}
@@ -100,12 +99,9 @@ iso2ansi_fvmr(FVMR *ifvmr, FVMR *ofvmr, unsigned int *length,
 		*length += FMD_DATA_LENGTH;
 	}
 
-	free(ifmds);
 	return (0);
 
 err_out:
-	if (ifmds != NULL)
-		free(ifmds);
 	return (-1);
 }
 
@@ -117,7 +113,7 @@ isocc2ansi_fvmr(FVMR *ifvmr, FVMR *ofvmr, unsigned int *length,
     const unsigned short xres, const unsigned short yres)
 {
 
-	FMD **ifmds = NULL;
+	FMB *ifmb;
 	FMD *ofmd;
 	int m, mcount;
 	double theta;
@@ -131,25 +127,24 @@ isocc2ansi_fvmr(FVMR *ifvmr, FVMR *ofvmr, unsigned int *length,
 	if (mcount == 0)
 		return (0);
 
-	ifmds = (FMD **)malloc(mcount * sizeof(FMD *));
-	if (ifmds == NULL)
-		ALLOC_ERR_RETURN("FMD array");
-	if (get_fmds(ifvmr, ifmds) != mcount)
-		ERR_OUT("getting FMDs from FVMR");
+	ifmb = get_fmb(ifvmr);
+	if ((ifmb == NULL) || (ifmb->count != (unsigned int)mcount))
+		ERR_OUT("getting minutiae block from FVMR");
 
 	conversion_factor = FMD_ISOCC_ANGLE_UNIT;
 	for (m = 0; m < mcount; m++) {
-		if (new_fmd(ofvmr->format_std, &ofmd, m) != 0)
+		if (new_fmd_arena(ofvmr->format_std, ofvmr->arena, &ofmd,
+		    m) != 0)
 			ALLOC_ERR_RETURN("Output FMD");
-		COPY_FMD(ifmds[m], ofmd);
-		theta = conversion_factor * (double)(ifmds[m]->angle);
+		fmb_to_fmd(ifmb, m, ofmd);
+		theta = conversion_factor * (double)(ifmb->angle[m]);
 		theta = round(theta + 0.5);
 		ofmd->angle = (unsigned char)(round(theta / FMD_ANSI_ANGLE_UNIT));
 		ofmd->quality = FMD_UNKNOWN_MINUTIA_QUALITY;
 
 		/* ISO CC is 0.1 p/mm, so convert to 1 p/mm */
-		xunits = (double)ifmds[m]->x_coord * 0.1;
-		yunits = (double)ifmds[m]->y_coord * 0.1;
+		xunits = (double)ifmb->x_coord[m] * 0.1;
+		yunits = (double)ifmb->y_coord[m] * 0.1;
 
 		/* Convert from p/mm to p/cm */
 		xcm = (xunits * xres) / 10.0;
@@ -162,7 +157,6 @@ isocc2ansi_fvmr(FVMR *ifvmr, FVMR *ofvmr, unsigned int *length,
 		*length += FMD_DATA_LENGTH;
 	}
 
-	free(ifmds);
 	return (0);
 
 err_out:
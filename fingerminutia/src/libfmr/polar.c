@@ -30,44 +30,20 @@
  * (Note that we actually compare the square of the distance)
  * In the case where the distances are equal, the minutia with the smallest
  * angle is lower in the sort order.
+ *
+ * The key holds the distance, biased so that the order of the signed
+ * values is kept, above the angle.
  */
-static int
-compare_by_polar(const void *m1, const void *m2)
-{
-	struct minutia_sort_data *lm1, *lm2;
-
-	lm1 = (struct minutia_sort_data *)m1;
-	lm2 = (struct minutia_sort_data *)m2;
-	if (lm1->distance == lm2->distance)
-		if (lm1->fmd->angle < lm2->fmd->angle)
-			return (-1);
-		else if (lm1->fmd->angle > lm2->fmd->angle)
-			return (1);
-		else
-			return (0);
-	else
-		if (lm1->distance < lm2->distance)
-			return (-1);
-		else
-			return (1);
-}
+#define POLAR_KEY(distance, angle)					\
+	(((uint64_t)((uint32_t)(distance) ^ 0x80000000) << 8) | (angle))
+#define POLAR_KEY_BITS		40
 
-void
-sort_fmd_by_polar(FMD **fmds, int mcount, unsigned short centx,
-    unsigned short centy, int usecm)
+static void
+polar_fmd_keys(FMD **fmds, int mcount, unsigned short centx,
+    unsigned short centy, int usecm, uint64_t *keys)
 {
 	int m;
 	int x, y, x_delta, y_delta;
-	struct minutia_sort_data *msds;
-
-	if (mcount == 0)
-		return;
-
-	/* Allocate an array to hold the sorting criteria for the FMDs */
-	msds = (struct minutia_sort_data *)malloc(mcount *
-	    sizeof(struct minutia_sort_data));
-	if (msds == NULL)
-		ALLOC_ERR_EXIT("Sorting criteria array");
 
 	if (usecm) {
 		find_center_of_minutiae_mass(fmds, mcount, &x, &y);
@@ -78,14 +54,94 @@ sort_fmd_by_polar(FMD **fmds, int mcount, unsigned short centx,
 	for (m = 0; m < mcount; m++) {
 		x_delta = fmds[m]->x_coord - x;
 		y_delta = fmds[m]->y_coord - y;
-		msds[m].distance = (x_delta*x_delta) + (y_delta*y_delta);
-		msds[m].fmd = fmds[m];
+		keys[m] = POLAR_KEY((x_delta*x_delta) + (y_delta*y_delta),
+		    fmds[m]->angle);
 	}
-	qsort(msds, mcount, sizeof(struct minutia_sort_data),
-	    compare_by_polar);
+}
+
+static void
+polar_fmb_keys(const FMB *fmb, unsigned short centx, unsigned short centy,
+    int usecm, uint64_t *keys)
+{
+	int m;
+	int x, y, x_delta, y_delta;
+
+	if (usecm) {
+		find_center_of_fmb_mass(fmb, &x, &y);
+	} else {
+		x = centx;
+		y = centy;
+	}
+	for (m = 0; m < (int)fmb->count; m++) {
+		x_delta = fmb->x_coord[m] - x;
+		y_delta = fmb->y_coord[m] - y;
+		keys[m] = POLAR_KEY((x_delta*x_delta) + (y_delta*y_delta),
+		    fmb->angle[m]);
+	}
+}
+
+void
+sort_fmd_by_polar(FMD **fmds, int mcount, unsigned short centx,
+    unsigned short centy, int usecm)
+{
+	struct minutia_sort_space space;
+
+	if (mcount == 0)
+		return;
+
+	if (init_minutia_sort_space(&space, mcount) != 0)
+		ALLOC_ERR_EXIT("Sorting criteria array");
+	polar_fmd_keys(fmds, mcount, centx, centy, usecm, space.keys);
+	sort_fmd_by_keys(fmds, mcount, POLAR_KEY_BITS, &space);
+	free_minutia_sort_space(&space);
+}
 
-	for (m = 0; m < mcount; m++)
-		fmds[m] = msds[m].fmd;
+void
+select_fmd_top_k_polar(FMD **fmds, int mcount, int k, unsigned short centx,
+    unsigned short centy, int usecm)
+{
+	struct minutia_sort_space space;
 
-	free(msds);
+	if (mcount == 0)
+		return;
+
+	if (init_minutia_sort_space(&space, mcount) != 0)
+		ALLOC_ERR_EXIT("Sorting criteria array");
+	polar_fmd_keys(fmds, mcount, centx, centy, usecm, space.keys);
+	select_fmd_by_keys(fmds, mcount, POLAR_KEY_BITS, k, &space);
+	free_minutia_sort_space(&space);
+}
+
+void
+sort_fmb_by_polar(const FMB *fmb, int *order, unsigned short centx,
+    unsigned short centy, int usecm)
+{
+	struct minutia_sort_space space;
+
+	if (fmb->count == 0)
+		return;
+
+	if (init_minutia_sort_space(&space, fmb->count) != 0)
+		ALLOC_ERR_EXIT("Sorting criteria array");
+	polar_fmb_keys(fmb, centx, centy, usecm, space.keys);
+	sort_minutia_keys(space.keys, fmb->count, POLAR_KEY_BITS, order,
+	    space.scratch);
+	free_minutia_sort_space(&space);
+}
+
+void
+select_fmb_top_k_polar(const FMB *fmb, int *order, int k,
+    unsigned short centx, unsigned short centy, int usecm)
+{
+	struct minutia_sort_space space;
+
+	if (fmb->count == 0)
+		return;
+
+	if (init_minutia_sort_space(&space, fmb->count) != 0)
+		ALLOC_ERR_EXIT("Sorting criteria array");
+	polar_fmb_keys(fmb, centx, centy, usecm, space.keys);
+	select_minutia_keys(space.keys, fmb->count, POLAR_KEY_BITS, k, order,
+	    space.scratch);
+	free_minutia_sort_space(&space);
 }
@@ -24,49 +24,86 @@
 #include <fmrsort.h>
 
 /*
- * Compare two minutiae records by the minutiae quality.
+ * The key is the quality of the minutia, an octet.
  */
-static int
-compare_by_quality(const void *m1, const void *m2)
+#define QUALITY_KEY_BITS		8
+
+void
+sort_fmd_by_quality(FMD **fmds, int mcount)
 {
-	FMD **lmpp;
-	FMD *lm1, *lm2;
-
-	lmpp = (FMD **)m1;
-	lm1 = (FMD *)*lmpp;
-	lmpp = (FMD **)m2;
-	lm2 = (FMD *)*lmpp;
-
-	if (lm1->quality == lm2->quality)
-		return (0);
-	else
-		if (lm1->quality < lm2->quality)
-			return (-1);
-		else
-			return (1);
+	int m;
+	struct minutia_sort_space space;
+
+	if (mcount == 0)
+		return;
+
+	if (init_minutia_sort_space(&space, mcount) != 0)
+		ALLOC_ERR_EXIT("Sorting criteria array");
+
+	for (m = 0; m < mcount; m++)
+		space.keys[m] = fmds[m]->quality;
+	sort_fmd_by_keys(fmds, mcount, QUALITY_KEY_BITS, &space);
+
+	free_minutia_sort_space(&space);
 }
 
 void
-sort_fmd_by_quality(FMD **fmds, int mcount)
+sort_fmb_by_quality(const FMB *fmb, int *order)
+{
+	int m, mcount;
+	struct minutia_sort_space space;
+
+	mcount = fmb->count;
+	if (mcount == 0)
+		return;
+
+	if (init_minutia_sort_space(&space, mcount) != 0)
+		ALLOC_ERR_EXIT("Sorting criteria array");
+
+	for (m = 0; m < mcount; m++)
+		space.keys[m] = fmb->quality[m];
+	sort_minutia_keys(space.keys, mcount, QUALITY_KEY_BITS, order,
+	    space.scratch);
+
+	free_minutia_sort_space(&space);
+}
+
+void
+select_fmd_top_k_quality(FMD **fmds, int mcount, int k)
 {
 	int m;
-	FMD **lfmds;
+	struct minutia_sort_space space;
 
 	if (mcount == 0)
 		return;
 
-	/* Allocate an array to hold the sorting criteria for the FMDs */
-	lfmds = (FMD **)malloc(mcount * sizeof(FMD *));
-	if (lfmds == NULL)
+	if (init_minutia_sort_space(&space, mcount) != 0)
 		ALLOC_ERR_EXIT("Sorting criteria array");
 
 	for (m = 0; m < mcount; m++)
-		lfmds[m] = fmds[m];
-	
-	qsort(lfmds, mcount, sizeof(FMD *), compare_by_quality);
+		space.keys[m] = fmds[m]->quality;
+	select_fmd_by_keys(fmds, mcount, QUALITY_KEY_BITS, k, &space);
+
+	free_minutia_sort_space(&space);
+}
+
+void
+select_fmb_top_k_quality(const FMB *fmb, int *order, int k)
+{
+	int m, mcount;
+	struct minutia_sort_space space;
+
+	mcount = fmb->count;
+	if (mcount == 0)
+		return;
+
+	if (init_minutia_sort_space(&space, mcount) != 0)
+		ALLOC_ERR_EXIT("Sorting criteria array");
 
 	for (m = 0; m < mcount; m++)
-		fmds[m] = lfmds[m];
+		space.keys[m] = fmb->quality[m];
+	select_minutia_keys(space.keys, mcount, QUALITY_KEY_BITS, k, order,
+	    space.scratch);
 
-	free(lfmds);
+	free_minutia_sort_space(&space);
 }
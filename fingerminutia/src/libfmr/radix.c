@@ -0,0 +1,231 @@
+/*
+ * This software was developed at the National Institute of Standards and
+ * Technology (NIST) by employees of the Federal Government in the course
+ * of their official duties. Pursuant to title 17 Section 105 of the
+ * United States Code, this software is not subject to copyright protection
+ * and is in the public domain. NIST assumes no responsibility whatsoever for
+ * its use by other parties, and makes no guarantees, expressed or implied,
+ * about its quality, reliability, or any other characteristic.
+ */
+
+/******************************************************************************/
+/* This file contains the sorting engine used by the minutiae sorting         */
+/* methods. The sort criteria of each minutia are packed into one integer     */
+/* key, and the minutiae are ordered with a stable LSD radix sort of the      */
+/* keys, one octet at a time. When only the first few minutiae of the order  */
+/* are wanted, they are selected with a bounded heap instead.                 */
+/*                                                                            */
+/******************************************************************************/
+#include <sys/queue.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <biomdimacro.h>
+#include <fmr.h>
+#include <fmrsort.h>
+
+#define RADIX_BITS	8
+#define RADIX_SIZE	(1 << RADIX_BITS)
+#define RADIX_MASK	(RADIX_SIZE - 1)
+#define RADIX_PASSES	(64 / RADIX_BITS)
+
+void
+sort_minutia_keys(const uint64_t *keys, int count, int keybits, int *order,
+    int *scratch)
+{
+	int counts[RADIX_PASSES][RADIX_SIZE];
+	int *src, *dst, *tmp;
+	int m, d, p, passes, shift, sum, c;
+
+	for (m = 0; m < count; m++)
+		order[m] = m;
+	if (count < 2)
+		return;
+
+	/* Count the digits for all passes with one scan of the keys */
+	passes = (keybits + RADIX_BITS - 1) / RADIX_BITS;
+	memset(counts, 0, passes * sizeof(counts[0]));
+	for (m = 0; m < count; m++)
+		for (p = 0; p < passes; p++)
+			counts[p][(keys[m] >> (p * RADIX_BITS)) & RADIX_MASK]++;
+
+	src = order;
+	dst = scratch;
+	for (p = 0; p < passes; p++) {
+		shift = p * RADIX_BITS;
+
+		/* Skip the pass when every key has the same digit */
+		if (counts[p][(keys[src[0]] >> shift) & RADIX_MASK] == count)
+			continue;
+
+		sum = 0;
+		for (d = 0; d < RADIX_SIZE; d++) {
+			c = counts[p][d];
+			counts[p][d] = sum;
+			sum += c;
+		}
+		for (m = 0; m < count; m++)
+			dst[counts[p][(keys[src[m]] >> shift) & RADIX_MASK]++] =
+			    src[m];
+		tmp = src;
+		src = dst;
+		dst = tmp;
+	}
+	if (src != order)
+		memcpy(order, src, count * sizeof(int));
+}
+
+/*
+ * For selection, the entry number is packed below the key, so that every
+ * value is distinct and equal keys are ordered by entry number, as in the
+ * stable sort.
+ */
+#define SELECT_INDEX_BITS	24
+#define SELECT_INDEX_MASK	((1 << SELECT_INDEX_BITS) - 1)
+
+/*
+ * Move the value at 'i' down the max-heap of 'n' values until neither
+ * child is larger.
+ */
+static void
+sift_down(uint64_t *heap, int i, int n)
+{
+	uint64_t val;
+	int child;
+
+	val = heap[i];
+	for (;;) {
+		child = 2 * i + 1;
+		if (child >= n)
+			break;
+		if ((child + 1 < n) && (heap[child + 1] > heap[child]))
+			child++;
+		if (heap[child] <= val)
+			break;
+		heap[i] = heap[child];
+		i = child;
+	}
+	heap[i] = val;
+}
+
+void
+select_minutia_keys(uint64_t *keys, int count, int keybits, int k,
+    int *order, int *scratch)
+{
+	uint64_t val;
+	int m;
+
+	if (k > count)
+		k = count;
+	if ((k == count) || (keybits + SELECT_INDEX_BITS > 64) ||
+	    (count > SELECT_INDEX_MASK + 1)) {
+		sort_minutia_keys(keys, count, keybits, order, scratch);
+		return;
+	}
+	if (k <= 0)
+		return;
+
+	for (m = 0; m < count; m++)
+		keys[m] = ((keys[m] & (((uint64_t)1 << keybits) - 1)) <<
+		    SELECT_INDEX_BITS) | m;
+
+	/* Keep the k smallest values in a max-heap at the front */
+	for (m = k / 2 - 1; m >= 0; m--)
+		sift_down(keys, m, k);
+	for (m = k; m < count; m++) {
+		if (keys[m] < keys[0]) {
+			keys[0] = keys[m];
+			sift_down(keys, 0, k);
+		}
+	}
+
+	/* Sort the heap into ascending order */
+	for (m = k - 1; m > 0; m--) {
+		val = keys[0];
+		keys[0] = keys[m];
+		keys[m] = val;
+		sift_down(keys, 0, m);
+	}
+	for (m = 0; m < k; m++)
+		order[m] = (int)(keys[m] & SELECT_INDEX_MASK);
+}
+
+int
+init_minutia_sort_space(struct minutia_sort_space *space, int count)
+{
+	if (count <= MINUTIA_SORT_STACK_COUNT) {
+		space->keys = space->key_buf;
+		space->order = space->order_buf;
+		space->scratch = space->scratch_buf;
+		return (0);
+	}
+	space->keys = (uint64_t *)malloc(count * sizeof(uint64_t));
+	space->order = (int *)malloc(count * sizeof(int));
+	space->scratch = (int *)malloc(count * sizeof(int));
+	if ((space->keys == NULL) || (space->order == NULL) ||
+	    (space->scratch == NULL)) {
+		free_minutia_sort_space(space);
+		return (-1);
+	}
+	return (0);
+}
+
+void
+free_minutia_sort_space(struct minutia_sort_space *space)
+{
+	if (space->keys != space->key_buf) {
+		free(space->keys);
+		free(space->order);
+		free(space->scratch);
+	}
+	/* Leave the space safe to free again */
+	space->keys = space->key_buf;
+	space->order = space->order_buf;
+	space->scratch = space->scratch_buf;
+}
+
+void
+sort_fmd_by_keys(FMD **fmds, int mcount, int keybits,
+    struct minutia_sort_space *space)
+{
+	FMD **sorted;
+	int m;
+
+	sort_minutia_keys(space->keys, mcount, keybits, space->order,
+	    space->scratch);
+
+	/* The keys are no longer needed, so their space holds the pointers */
+	sorted = (FMD **)space->keys;
+	for (m = 0; m < mcount; m++)
+		sorted[m] = fmds[space->order[m]];
+	memcpy(fmds, sorted, mcount * sizeof(FMD *));
+}
+
+void
+select_fmd_by_keys(FMD **fmds, int mcount, int keybits, int k,
+    struct minutia_sort_space *space)
+{
+	FMD **sorted;
+	int *selected;
+	int m, n;
+
+	if (k > mcount)
+		k = mcount;
+	select_minutia_keys(space->keys, mcount, keybits, k, space->order,
+	    space->scratch);
+
+	/* The selected minutiae come first, then the rest in input order */
+	selected = space->scratch;
+	memset(selected, 0, mcount * sizeof(int));
+	sorted = (FMD **)space->keys;
+	for (n = 0; n < k; n++) {
+		sorted[n] = fmds[space->order[n]];
+		selected[space->order[n]] = 1;
+	}
+	for (m = 0; m < mcount; m++)
+		if (!selected[m])
+			sorted[n++] = fmds[m];
+	memcpy(fmds, sorted, mcount * sizeof(FMD *));
+}
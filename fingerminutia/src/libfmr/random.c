@@ -14,7 +14,6 @@
 /*                                                                            */
 /******************************************************************************/
 #include <sys/queue.h>
-#include <math.h>
 #include <stdio.h>
 #include <stdint.h>
 #include <stdlib.h>
@@ -25,50 +24,141 @@
 #include <fmrsort.h>
 
 /*
- * Sort a set of finger minutiae data in a random order.
+ * The xoshiro256** generator, seeded with splitmix64 as recommended by its
+ * authors, D. Blackman and S. Vigna.
  */
-static int
-compare_by_random(const void *m1, const void *m2)
+static uint64_t
+splitmix64(uint64_t *x)
 {
-	struct minutia_sort_data *lm1, *lm2;
+	uint64_t z;
 
-	lm1 = (struct minutia_sort_data *)m1;
-	lm2 = (struct minutia_sort_data *)m2;
-
-	if (lm1->rand == lm2->rand)
-		return (0);
-	if (lm1->rand < lm2->rand)
-		return (-1);
-	else
-		return (1);
+	z = (*x += 0x9E3779B97F4A7C15ULL);
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+	return (z ^ (z >> 31));
 }
 
+#define ROTL64(x, k)	(((x) << (k)) | ((x) >> (64 - (k))))
+
+/*
+ * The generator used by the random sorts that are not given one. It is
+ * seeded on first use in each thread and then left to run, so every call
+ * gets a different order; the address of the state differs between the
+ * threads, and is mixed into the seed so they do not share a sequence.
+ */
+static BIOMDI_THREAD_LOCAL struct minutia_rng default_rng;
+static BIOMDI_THREAD_LOCAL int default_rng_seeded = 0;
+
 void
-sort_fmd_by_random(FMD **fmds, int mcount)
+seed_minutia_rng(struct minutia_rng *rng, uint64_t seed)
 {
-	int m;
-	struct minutia_sort_data *msds;
+	int i;
 
-	if (mcount == 0)
-		return;
+	for (i = 0; i < 4; i++)
+		rng->s[i] = splitmix64(&seed);
+}
 
-	srand(time(0));
+uint64_t
+next_minutia_rng(struct minutia_rng *rng)
+{
+	uint64_t *s = rng->s;
+	uint64_t result, t;
 
-	/* Allocate an array to hold the sorting criteria for the FMDs */
-	msds = (struct minutia_sort_data *)malloc(mcount *
-	    sizeof(struct minutia_sort_data));
-	if (msds == NULL)
-		ALLOC_ERR_EXIT("Sorting criteria array");
+	result = ROTL64(s[1] * 5, 7) * 9;
+	t = s[1] << 17;
+	s[2] ^= s[0];
+	s[3] ^= s[1];
+	s[1] ^= s[2];
+	s[0] ^= s[3];
+	s[2] ^= t;
+	s[3] = ROTL64(s[3], 45);
+	return (result);
+}
 
-	for (m = 0; m < mcount; m++) {
-		msds[m].fmd = fmds[m];
-		msds[m].rand = rand();
+static struct minutia_rng *
+get_default_rng(void)
+{
+	if (!default_rng_seeded) {
+		seed_minutia_rng(&default_rng, (uint64_t)time(0) ^
+		    (uint64_t)(uintptr_t)&default_rng);
+		default_rng_seeded = 1;
 	}
-	qsort(msds, mcount, sizeof(struct minutia_sort_data),
-	    compare_by_random);
+	return (&default_rng);
+}
 
+/*
+ * Return a uniformly distributed value in [0, bound), rejecting the few
+ * values at the top of the range that would bias the result.
+ */
+static uint64_t
+bounded_minutia_rng(struct minutia_rng *rng, uint64_t bound)
+{
+	uint64_t r, threshold;
+
+	threshold = -bound % bound;
+	do {
+		r = next_minutia_rng(rng);
+	} while (r < threshold);
+	return (r % bound);
+}
+
+/*
+ * Shuffle the minutiae with the Fisher-Yates algorithm, which fills the
+ * array from the front; selecting the first k minutiae stops after k
+ * steps, so gives the same minutiae as a complete shuffle.
+ */
+void
+select_fmd_top_k_random(FMD **fmds, int mcount, int k,
+    struct minutia_rng *rng)
+{
+	FMD *fmd;
+	int m, j;
+
+	for (m = 0; (m < k) && (m < mcount - 1); m++) {
+		j = m + (int)bounded_minutia_rng(rng, (uint64_t)(mcount - m));
+		fmd = fmds[m];
+		fmds[m] = fmds[j];
+		fmds[j] = fmd;
+	}
+}
+
+void
+sort_fmd_by_random_r(FMD **fmds, int mcount, struct minutia_rng *rng)
+{
+	select_fmd_top_k_random(fmds, mcount, mcount, rng);
+}
+
+void
+sort_fmd_by_random(FMD **fmds, int mcount)
+{
+	sort_fmd_by_random_r(fmds, mcount, get_default_rng());
+}
+
+void
+select_fmb_top_k_random(const FMB *fmb, int *order, int k,
+    struct minutia_rng *rng)
+{
+	int m, j, idx, mcount;
+
+	mcount = fmb->count;
 	for (m = 0; m < mcount; m++)
-		fmds[m] = msds[m].fmd;
+		order[m] = m;
+	for (m = 0; (m < k) && (m < mcount - 1); m++) {
+		j = m + (int)bounded_minutia_rng(rng, (uint64_t)(mcount - m));
+		idx = order[m];
+		order[m] = order[j];
+		order[j] = idx;
+	}
+}
 
-	free(msds);
+void
+sort_fmb_by_random_r(const FMB *fmb, int *order, struct minutia_rng *rng)
+{
+	select_fmb_top_k_random(fmb, order, fmb->count, rng);
+}
+
+void
+sort_fmb_by_random(const FMB *fmb, int *order)
+{
+	sort_fmb_by_random_r(fmb, order, get_default_rng());
 }
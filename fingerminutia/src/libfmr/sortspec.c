@@ -0,0 +1,238 @@
+/*
+ * This software was developed at the National Institute of Standards and
+ * Technology (NIST) by employees of the Federal Government in the course
+ * of their official duties. Pursuant to title 17 Section 105 of the
+ * United States Code, this software is not subject to copyright protection
+ * and is in the public domain. NIST assumes no responsibility whatsoever for
+ * its use by other parties, and makes no guarantees, expressed or implied,
+ * about its quality, reliability, or any other characteristic.
+ */
+
+/******************************************************************************/
+/* This file contains the functions that sort minutiae by a specification of  */
+/* several keys. The values of all keys are packed into a single integer key  */
+/* for each minutia, with the first key in the high bits, and the minutiae    */
+/* are ordered with one pass of the sorting engine.                           */
+/*                                                                            */
+/******************************************************************************/
+#include <sys/queue.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <biomdimacro.h>
+#include <fmr.h>
+#include <fmrsort.h>
+
+static const struct {
+	const char	*name;
+	int		key;
+} key_names[] = {
+	{ "polar", MINUTIA_SORT_KEY_POLAR },
+	{ "x", MINUTIA_SORT_KEY_X },
+	{ "y", MINUTIA_SORT_KEY_Y },
+	{ "angle", MINUTIA_SORT_KEY_ANGLE },
+	{ "quality", MINUTIA_SORT_KEY_QUALITY },
+	{ "type", MINUTIA_SORT_KEY_TYPE }
+};
+#define KEY_NAME_COUNT	(sizeof(key_names) / sizeof(key_names[0]))
+
+/*
+ * Return the total width of the keys in the specification, or -1 if the
+ * specification is not valid.
+ */
+static int
+spec_bits(const struct minutia_sort_spec *spec)
+{
+	int i, bits;
+
+	if ((spec->count < 1) || (spec->count > MINUTIA_SORT_MAX_KEYS))
+		return (-1);
+	bits = 0;
+	for (i = 0; i < spec->count; i++) {
+		if ((spec->keys[i].key < MINUTIA_SORT_KEY_POLAR) ||
+		    (spec->keys[i].key > MINUTIA_SORT_KEY_TYPE))
+			return (-1);
+		bits += MINUTIA_SORT_KEY_BITS(spec->keys[i].key);
+	}
+	if (bits > 64)
+		return (-1);
+	return (bits);
+}
+
+int
+parse_minutia_sort_spec(const char *str, struct minutia_sort_spec *spec)
+{
+	const char *p, *end, *colon;
+	size_t len, nlen;
+	int i, n;
+
+	memset(spec, 0, sizeof(struct minutia_sort_spec));
+	spec->usecm = TRUE;
+	p = str;
+	for (;;) {
+		end = strchr(p, ',');
+		len = (end == NULL) ? strlen(p) : (size_t)(end - p);
+		colon = memchr(p, ':', len);
+		nlen = (colon == NULL) ? len : (size_t)(colon - p);
+		if ((nlen == 0) || (spec->count == MINUTIA_SORT_MAX_KEYS))
+			return (-1);
+
+		/* Match the whole key name, or its first letter */
+		n = spec->count;
+		for (i = 0; i < KEY_NAME_COUNT; i++)
+			if (((nlen == 1) && (*p == key_names[i].name[0])) ||
+			    ((nlen == strlen(key_names[i].name)) &&
+			    (strncmp(p, key_names[i].name, nlen) == 0)))
+				break;
+		if (i == KEY_NAME_COUNT)
+			return (-1);
+		spec->keys[n].key = key_names[i].key;
+
+		/* A repeated key could never break a tie */
+		for (i = 0; i < n; i++)
+			if (spec->keys[i].key == spec->keys[n].key)
+				return (-1);
+
+		if (colon != NULL) {
+			if (len - nlen != 2)
+				return (-1);
+			if (colon[1] == 'd')
+				spec->keys[n].descending = TRUE;
+			else if (colon[1] != 'a')
+				return (-1);
+		}
+		spec->count++;
+		if (end == NULL)
+			break;
+		p = end + 1;
+	}
+	return ((spec_bits(spec) < 0) ? -1 : 0);
+}
+
+/*
+ * Pack the values of one minutia into its key, the first key of the
+ * specification in the high bits. A descending key is stored inverted.
+ */
+static uint64_t
+pack_spec_key(const struct minutia_sort_spec *spec, int x, int y,
+    int cx, int cy, unsigned char angle, unsigned char quality,
+    unsigned char type)
+{
+	uint64_t packed, val;
+	int i, bits, x_delta, y_delta;
+
+	packed = 0;
+	for (i = 0; i < spec->count; i++) {
+		switch (spec->keys[i].key) {
+		    case MINUTIA_SORT_KEY_POLAR:
+			x_delta = x - cx;
+			y_delta = y - cy;
+			val = (uint64_t)((int64_t)x_delta*x_delta) +
+			    (uint64_t)((int64_t)y_delta*y_delta);
+			if (val > UINT32_MAX)
+				val = UINT32_MAX;
+			break;
+		    case MINUTIA_SORT_KEY_X:
+			val = (uint16_t)x;
+			break;
+		    case MINUTIA_SORT_KEY_Y:
+			val = (uint16_t)y;
+			break;
+		    case MINUTIA_SORT_KEY_ANGLE:
+			val = angle;
+			break;
+		    case MINUTIA_SORT_KEY_QUALITY:
+			val = quality;
+			break;
+		    default:
+			val = type;
+			break;
+		}
+		bits = MINUTIA_SORT_KEY_BITS(spec->keys[i].key);
+		if (spec->keys[i].descending)
+			val ^= ((uint64_t)1 << bits) - 1;
+		packed = (packed << bits) | val;
+	}
+	return (packed);
+}
+
+/*
+ * Return true if the specification has a polar key, and so needs the
+ * center point.
+ */
+static int
+spec_has_polar(const struct minutia_sort_spec *spec)
+{
+	int i;
+
+	for (i = 0; i < spec->count; i++)
+		if (spec->keys[i].key == MINUTIA_SORT_KEY_POLAR)
+			return (TRUE);
+	return (FALSE);
+}
+
+int
+sort_fmd_by_spec(FMD **fmds, int mcount, const struct minutia_sort_spec *spec)
+{
+	struct minutia_sort_space space;
+	int m, bits, cx, cy;
+
+	bits = spec_bits(spec);
+	if (bits < 0)
+		ERR_OUT("Invalid minutiae sort specification");
+	if (mcount == 0)
+		return (0);
+
+	cx = spec->centx;
+	cy = spec->centy;
+	if (spec_has_polar(spec) && spec->usecm)
+		find_center_of_minutiae_mass(fmds, mcount, &cx, &cy);
+
+	if (init_minutia_sort_space(&space, mcount) != 0)
+		ALLOC_ERR_RETURN("Sorting criteria array");
+	for (m = 0; m < mcount; m++)
+		space.keys[m] = pack_spec_key(spec, fmds[m]->x_coord,
+		    fmds[m]->y_coord, cx, cy, fmds[m]->angle,
+		    fmds[m]->quality, fmds[m]->type);
+	sort_fmd_by_keys(fmds, mcount, bits, &space);
+	free_minutia_sort_space(&space);
+	return (0);
+
+err_out:
+	return (-1);
+}
+
+int
+sort_fmb_by_spec(const FMB *fmb, int *order,
+    const struct minutia_sort_spec *spec)
+{
+	struct minutia_sort_space space;
+	int m, bits, cx, cy;
+
+	bits = spec_bits(spec);
+	if (bits < 0)
+		ERR_OUT("Invalid minutiae sort specification");
+	if (fmb->count == 0)
+		return (0);
+
+	cx = spec->centx;
+	cy = spec->centy;
+	if (spec_has_polar(spec) && spec->usecm)
+		find_center_of_fmb_mass(fmb, &cx, &cy);
+
+	if (init_minutia_sort_space(&space, fmb->count) != 0)
+		ALLOC_ERR_RETURN("Sorting criteria array");
+	for (m = 0; m < (int)fmb->count; m++)
+		space.keys[m] = pack_spec_key(spec, fmb->x_coord[m],
+		    fmb->y_coord[m], cx, cy, fmb->angle[m], fmb->quality[m],
+		    fmb->type[m]);
+	sort_minutia_keys(space.keys, fmb->count, bits, order,
+	    space.scratch);
+	free_minutia_sort_space(&space);
+	return (0);
+
+err_out:
+	return (-1);
+}
@@ -0,0 +1,514 @@
+/*
+ * This software was developed at the National Institute of Standards and
+ * Technology (NIST) by employees of the Federal Government in the course
+ * of their official duties. Pursuant to title 17 Section 105 of the
+ * United States Code, this software is not subject to copyright protection
+ * and is in the public domain. NIST assumes no responsibility  whatsoever for
+ * its use by other parties, and makes no guarantees, expressed or implied,
+ * about its quality, reliability, or any other characteristic.
+ */
+/******************************************************************************/
+/* Implementation of the conversion of a Finger Minutiae Record from one      */
+/* format to another directly between encoded buffers. The record is read     */
+/* through a view, and the converted record is pushed into the output buffer  */
+/* as it is decoded; no FMR, FVMR, or FMD structures are built. The angle and */
+/* quality of each minutia are converted by tables made once for the pair of  */
+/* formats, and the coordinates by integer arithmetic.                        */
+/*                                                                            */
+/******************************************************************************/
+#include <sys/queue.h>
+
+#include <math.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <biomdi.h>
+#include <biomdimacro.h>
+#include <fmr.h>
+#include <fmr2fmr.h>
+
+#define IS_CARD(std)	(((std) == FMR_STD_ISO_NORMAL_CARD) ||	\
+			    ((std) == FMR_STD_ISO_COMPACT_CARD))
+
+/*
+ * Micrometers per coordinate unit of the card formats; the other formats
+ * count pixels, whose size is given by the resolution in pixels per
+ * centimeter.
+ */
+#define ISONC_COORD_UM		10
+#define ISOCC_COORD_UM		100
+#define UM_PER_CM		10000
+
+/*
+ * Convert an angle to whole degrees, and back, the same way as the
+ * record conversion functions, ansi2iso_fvmr() and the others.
+ */
+static int
+angle_to_degrees(unsigned int angle, unsigned int format_std)
+{
+	switch (format_std) {
+	case FMR_STD_ANSI:
+	case FMR_STD_ANSI07:
+		return (FMD_ANSI_ANGLE_UNIT * angle);
+	case FMR_STD_ISO_COMPACT_CARD:
+		return ((int)round(FMD_ISOCC_ANGLE_UNIT * angle + 0.5));
+	default:
+		return ((int)round(FMD_ISO_ANGLE_UNIT * angle));
+	}
+}
+
+static int
+degrees_to_angle(int degrees, unsigned int format_std)
+{
+	int angle;
+
+	switch (format_std) {
+	case FMR_STD_ANSI:
+	case FMR_STD_ANSI07:
+		angle = (int)round((double)degrees / FMD_ANSI_ANGLE_UNIT);
+		if (angle > FMD_MAX_MINUTIA_ANGLE)
+			angle = FMD_MAX_MINUTIA_ANGLE;
+		break;
+	case FMR_STD_ISO_COMPACT_CARD:
+		angle = (int)round(degrees / FMD_ISOCC_ANGLE_UNIT);
+		if (angle > FMD_MAX_MINUTIA_ISOCC_ANGLE)
+			angle = FMD_MAX_MINUTIA_ISOCC_ANGLE;
+		break;
+	default:
+		angle = (int)round(degrees / FMD_ISO_ANGLE_UNIT);
+		if (angle > FMD_MAX_MINUTIA_ISONC_ANGLE)
+			angle = FMD_MAX_MINUTIA_ISONC_ANGLE;
+		break;
+	}
+	return (angle);
+}
+
+static int
+angle_units_equal(unsigned int std1, unsigned int std2)
+{
+	if (std1 == std2)
+		return (TRUE);
+	if (((std1 == FMR_STD_ANSI) || (std1 == FMR_STD_ANSI07)) &&
+	    ((std2 == FMR_STD_ANSI) || (std2 == FMR_STD_ANSI07)))
+		return (TRUE);
+	if (((std1 == FMR_STD_ISO) || (std1 == FMR_STD_ISO_NORMAL_CARD)) &&
+	    ((std2 == FMR_STD_ISO) || (std2 == FMR_STD_ISO_NORMAL_CARD)))
+		return (TRUE);
+	return (FALSE);
+}
+
+int
+init_fmr_transcoder(FMR_TRANSCODER *fmrt, unsigned int in_std,
+    unsigned int out_std, unsigned short x_resolution,
+    unsigned short y_resolution)
+{
+	unsigned int i;
+
+	if ((in_std < FMR_STD_ANSI) || (in_std > FMR_STD_ANSI07))
+		ERR_OUT("Invalid input format standard %u", in_std);
+	if ((out_std < FMR_STD_ANSI) || (out_std > FMR_STD_ANSI07))
+		ERR_OUT("Invalid output format standard %u", out_std);
+	fmrt->in_std = in_std;
+	fmrt->out_std = out_std;
+	fmrt->x_resolution = x_resolution;
+	fmrt->y_resolution = y_resolution;
+
+	for (i = 0; i < 256; i++) {
+		if (angle_units_equal(in_std, out_std))
+			fmrt->angle[i] = i;
+		else
+			fmrt->angle[i] = degrees_to_angle(
+			    angle_to_degrees(i, in_std), out_std);
+	}
+
+	/* ANSI '07 reserves two quality values for minutiae that were not
+	 * rated, where the other formats use 0.
+	 */
+	for (i = 0; i < 256; i++)
+		fmrt->quality[i] = i;
+	if ((in_std == FMR_STD_ANSI07) && (out_std != FMR_STD_ANSI07)) {
+		fmrt->quality[FMD_NOATTTEMPT_MINUTIA_QUALITY] =
+		    FMD_UNKNOWN_MINUTIA_QUALITY;
+		fmrt->quality[FMD_FAILED_MINUTIA_QUALITY] =
+		    FMD_UNKNOWN_MINUTIA_QUALITY;
+	}
+	if ((in_std != FMR_STD_ANSI07) && (out_std == FMR_STD_ANSI07))
+		fmrt->quality[FMD_UNKNOWN_MINUTIA_QUALITY] =
+		    FMD_NOATTTEMPT_MINUTIA_QUALITY;
+	return (0);
+
+err_out:
+	return (-1);
+}
+
+/*
+ * The ratio of the output to the input coordinate unit along one axis,
+ * and the largest output coordinate.
+ */
+struct coord_scale {
+	uint64_t	num;
+	uint64_t	den;
+	unsigned int	max;
+};
+
+/*
+ * Find the length of a coordinate unit as a fraction of a micrometer.
+ */
+static int
+coord_unit(unsigned int format_std, unsigned short resolution,
+    uint64_t *num, uint64_t *den)
+{
+	switch (format_std) {
+	case FMR_STD_ISO_NORMAL_CARD:
+		*num = ISONC_COORD_UM;
+		*den = 1;
+		break;
+	case FMR_STD_ISO_COMPACT_CARD:
+		*num = ISOCC_COORD_UM;
+		*den = 1;
+		break;
+	default:
+		if (resolution == 0)
+			ERR_OUT("Resolution is needed to convert coordinates");
+		*num = UM_PER_CM;
+		*den = resolution;
+		break;
+	}
+	return (0);
+
+err_out:
+	return (-1);
+}
+
+static int
+init_coord_scale(struct coord_scale *scale, unsigned int in_std,
+    unsigned int out_std, unsigned short resolution)
+{
+	uint64_t in_num, in_den, out_num, out_den;
+
+	if (out_std == FMR_STD_ISO_COMPACT_CARD)
+		scale->max = UINT8_MAX;
+	else
+		scale->max = FMD_X_COORD_MASK;
+
+	/* Coordinates in pixels keep the resolution of the input */
+	if (!IS_CARD(in_std) && !IS_CARD(out_std)) {
+		scale->num = scale->den = 1;
+		return (0);
+	}
+	if (coord_unit(in_std, resolution, &in_num, &in_den) != 0)
+		return (-1);
+	if (coord_unit(out_std, resolution, &out_num, &out_den) != 0)
+		return (-1);
+	scale->num = in_num * out_den;
+	scale->den = in_den * out_num;
+	return (0);
+}
+
+/*
+ * Scale a coordinate, rounding halves up, and limit it to the range of
+ * the output.
+ */
+static inline unsigned int
+scale_coord(const struct coord_scale *scale, unsigned int c)
+{
+	uint64_t v;
+
+	if (scale->num == scale->den)
+		v = c;
+	else
+		v = (2 * c * scale->num + scale->den) / (2 * scale->den);
+	return ((v > scale->max) ? scale->max : (unsigned int)v);
+}
+
+/*
+ * Convert a run of minutiae from the input encoding to the output
+ * encoding.
+ */
+static void
+transcode_minutiae(const FMR_TRANSCODER *fmrt, const struct coord_scale *xs,
+    const struct coord_scale *ys, const uint8_t *in, unsigned int count,
+    uint8_t *out)
+{
+	unsigned int i, inlen, outlen, type, x, y, angle, quality;
+
+	inlen = get_fmd_data_length(fmrt->in_std);
+	outlen = get_fmd_data_length(fmrt->out_std);
+	for (i = 0; i < count; i++, in += inlen, out += outlen) {
+		if (fmrt->in_std == FMR_STD_ISO_COMPACT_CARD) {
+			x = in[0];
+			y = in[1];
+			type = (in[2] & FMD_ISO_COMPACT_MINUTIA_TYPE_MASK) >>
+			    FMD_ISO_COMPACT_MINUTIA_TYPE_SHIFT;
+			angle = in[2] & FMD_ISO_COMPACT_MINUTIA_ANGLE_MASK;
+			quality = ISO_UNKNOWN_FINGER_QUALITY;
+		} else {
+			type = in[0] >> (FMD_MINUTIA_TYPE_SHIFT - 8);
+			x = ((in[0] << 8) | in[1]) & FMD_X_COORD_MASK;
+			y = ((in[2] << 8) | in[3]) & FMD_Y_COORD_MASK;
+			angle = in[4];
+			if (fmrt->in_std == FMR_STD_ISO_NORMAL_CARD)
+				quality = 0;
+			else
+				quality = in[5];
+		}
+		x = scale_coord(xs, x);
+		y = scale_coord(ys, y);
+		angle = fmrt->angle[angle];
+		if (fmrt->out_std == FMR_STD_ISO_COMPACT_CARD) {
+			out[0] = x;
+			out[1] = y;
+			out[2] = (type << FMD_ISO_COMPACT_MINUTIA_TYPE_SHIFT) |
+			    (angle & FMD_ISO_COMPACT_MINUTIA_ANGLE_MASK);
+			continue;
+		}
+		out[0] = (type << (FMD_MINUTIA_TYPE_SHIFT - 8)) | (x >> 8);
+		out[1] = x & 0xFF;
+		out[2] = y >> 8;
+		out[3] = y & 0xFF;
+		out[4] = angle;
+		if (fmrt->out_std != FMR_STD_ISO_NORMAL_CARD)
+			out[5] = fmrt->quality[quality];
+	}
+}
+
+/*
+ * Return the length of a converted finger view with 'count' minutiae.
+ */
+static uint32_t
+transcoded_fvmr_length(unsigned int out_std, unsigned int count)
+{
+	uint32_t length;
+
+	length = count * get_fmd_data_length(out_std);
+	if (IS_CARD(out_std))
+		return (length);
+	if (out_std == FMR_STD_ANSI07)
+		length += FVMR_ANSI07_HEADER_LENGTH;
+	else
+		length += FVMR_HEADER_LENGTH;
+	return (length + FEDB_HEADER_LENGTH);
+}
+
+/*
+ * The record header fields that are carried over to the output, taken
+ * from the record header or, for ANSI '07 input, from the first finger
+ * view, and, for card input, from the transcoder.
+ */
+static void
+get_source_header(const FMR_TRANSCODER *fmrt,
+    struct finger_minutiae_record_view *fmrv, FMR *hdr)
+{
+	struct finger_view_minutiae_record_view fvmrv;
+	FVMR fvmr;
+
+	memset(hdr, 0, sizeof(FMR));
+	fmr_view_header(fmrv, hdr);
+	if (IS_CARD(fmrt->in_std)) {
+		hdr->x_resolution = fmrt->x_resolution;
+		hdr->y_resolution = fmrt->y_resolution;
+	} else if ((fmrt->in_std == FMR_STD_ANSI07) &&
+	    (fmr_view_first(fmrv, &fvmrv) == READ_OK)) {
+		memset(&fvmr, 0, sizeof(FVMR));
+		fvmr_view_header(&fvmrv, &fvmr);
+		hdr->x_image_size = fvmr.x_image_size;
+		hdr->y_image_size = fvmr.y_image_size;
+		hdr->x_resolution = fvmr.x_resolution;
+		hdr->y_resolution = fvmr.y_resolution;
+	}
+}
+
+static int
+push_fmr_header(unsigned int out_std, const FMR *hdr, uint32_t length,
+    BDB *fmdb)
+{
+	OPUSH(FMR_FORMAT_ID, FMR_FORMAT_ID_LEN, fmdb);
+	if (out_std == FMR_STD_ANSI07)
+		OPUSH(FMR_ANSI07_SPEC_VERSION, FMR_SPEC_VERSION_LEN, fmdb);
+	else if (out_std == FMR_STD_ISO)
+		OPUSH(FMR_ISO_SPEC_VERSION, FMR_SPEC_VERSION_LEN, fmdb);
+	else
+		OPUSH(FMR_ANSI_SPEC_VERSION, FMR_SPEC_VERSION_LEN, fmdb);
+	if (out_std != FMR_STD_ANSI) {
+		LPUSH(length, fmdb);
+	} else if (length > FMR_ANSI_MAX_SHORT_LENGTH) {
+		SPUSH(0, fmdb);
+		LPUSH(length, fmdb);
+	} else {
+		SPUSH(length, fmdb);
+	}
+	if (out_std != FMR_STD_ISO) {
+		SPUSH(hdr->product_identifier_owner, fmdb);
+		SPUSH(hdr->product_identifier_type, fmdb);
+	}
+	SPUSH((hdr->compliance << HDR_COMPLIANCE_SHIFT) | hdr->scanner_id,
+	    fmdb);
+	if (out_std != FMR_STD_ANSI07) {
+		SPUSH(hdr->x_image_size, fmdb);
+		SPUSH(hdr->y_image_size, fmdb);
+		SPUSH(hdr->x_resolution, fmdb);
+		SPUSH(hdr->y_resolution, fmdb);
+	}
+	CPUSH(hdr->num_views, fmdb);
+	CPUSH(0, fmdb);
+	return (WRITE_OK);
+
+err_out:
+	return (WRITE_ERROR);
+}
+
+/*
+ * Push the header of a converted finger view. Image size and resolution,
+ * needed in the header of an ANSI '07 view, come from the view itself or
+ * from the record header.
+ */
+static int
+push_fvmr_header(unsigned int out_std, const FVMR *fvmr, const FMR *hdr,
+    unsigned int count, BDB *fmdb)
+{
+	CPUSH(fvmr->finger_number, fmdb);
+	if (out_std == FMR_STD_ANSI07) {
+		CPUSH(fvmr->view_number, fmdb);
+		CPUSH(fvmr->impression_type, fmdb);
+		CPUSH(fvmr->finger_quality, fmdb);
+		LPUSH(fvmr->algorithm_id, fmdb);
+		if (fvmr->format_std == FMR_STD_ANSI07) {
+			SPUSH(fvmr->x_image_size, fmdb);
+			SPUSH(fvmr->y_image_size, fmdb);
+			SPUSH(fvmr->x_resolution, fmdb);
+			SPUSH(fvmr->y_resolution, fmdb);
+		} else {
+			SPUSH(hdr->x_image_size, fmdb);
+			SPUSH(hdr->y_image_size, fmdb);
+			SPUSH(hdr->x_resolution, fmdb);
+			SPUSH(hdr->y_resolution, fmdb);
+		}
+	} else {
+		CPUSH(((fvmr->view_number << FVMR_VIEW_NUMBER_SHIFT) &
+		    FVMR_VIEW_NUMBER_MASK) |
+		    (fvmr->impression_type & FVMR_IMPRESSION_MASK), fmdb);
+		CPUSH(fvmr->finger_quality, fmdb);
+	}
+	CPUSH(count, fmdb);
+	return (WRITE_OK);
+
+err_out:
+	return (WRITE_ERROR);
+}
+
+uint32_t
+get_transcoded_fmr_length(const FMR_TRANSCODER *fmrt,
+    struct finger_minutiae_record_view *fmrv)
+{
+	struct finger_view_minutiae_record_view fvmrv;
+	uint32_t length;
+	int ret;
+
+	if (fmrt->in_std == fmrt->out_std)
+		return (fmrv->end - fmrv->start);
+	length = 0;
+	for (ret = fmr_view_first(fmrv, &fvmrv); ret == READ_OK;
+	    ret = fvmr_view_next(&fvmrv))
+		length += transcoded_fvmr_length(fmrt->out_std,
+		    fvmrv.number_of_minutiae);
+	switch (fmrt->out_std) {
+	case FMR_STD_ANSI:
+		if (length + FMR_ANSI_SMALL_HEADER_LENGTH >
+		    FMR_ANSI_MAX_SHORT_LENGTH)
+			length += FMR_ANSI_LARGE_HEADER_LENGTH;
+		else
+			length += FMR_ANSI_SMALL_HEADER_LENGTH;
+		break;
+	case FMR_STD_ISO:
+		length += FMR_ISO_HEADER_LENGTH;
+		break;
+	case FMR_STD_ANSI07:
+		length += FMR_ANSI07_HEADER_LENGTH;
+		break;
+	}
+	return (length);
+}
+
+int
+transcode_fmr(const FMR_TRANSCODER *fmrt,
+    struct finger_minutiae_record_view *fmrv, BDB *fmdb)
+{
+	struct finger_view_minutiae_record_view fvmrv;
+	struct coord_scale xs, ys;
+	FMR hdr;
+	FVMR fvmr;
+	uint32_t length, vlen;
+	unsigned int views, count;
+	int ret;
+
+	if (fmrv->format_std != fmrt->in_std)
+		ERR_OUT("Record is not in the input format of the transcoder");
+
+	/* Make room for the whole record, so that the minutiae can be
+	 * converted in place.
+	 */
+	length = get_transcoded_fmr_length(fmrt, fmrv);
+	if ((fmdb->bdb_current + length > fmdb->bdb_end) &&
+	    (!(fmdb->bdb_flags & BDB_GROWABLE) ||
+	    (grow_bdb(fmdb, length) != 0)))
+		ERR_OUT("Output buffer is too small for record");
+
+	if (fmrt->in_std == fmrt->out_std) {
+		OPUSH(fmrv->start, length, fmdb);
+		return (WRITE_OK);
+	}
+
+	get_source_header(fmrt, fmrv, &hdr);
+	if (!IS_CARD(fmrt->out_std))
+		if (push_fmr_header(fmrt->out_std, &hdr, length, fmdb) !=
+		    WRITE_OK)
+			ERR_OUT("Could not write record header");
+
+	views = 0;
+	for (ret = fmr_view_first(fmrv, &fvmrv); ret == READ_OK;
+	    ret = fvmr_view_next(&fvmrv)) {
+		memset(&fvmr, 0, sizeof(FVMR));
+		fvmr_view_header(&fvmrv, &fvmr);
+		count = fvmrv.number_of_minutiae;
+		if (fmrt->in_std == FMR_STD_ANSI07) {
+			if ((init_coord_scale(&xs, fmrt->in_std,
+			    fmrt->out_std, fvmr.x_resolution) != 0) ||
+			    (init_coord_scale(&ys, fmrt->in_std,
+			    fmrt->out_std, fvmr.y_resolution) != 0))
+				goto err_out;
+		} else {
+			if ((init_coord_scale(&xs, fmrt->in_std,
+			    fmrt->out_std, hdr.x_resolution) != 0) ||
+			    (init_coord_scale(&ys, fmrt->in_std,
+			    fmrt->out_std, hdr.y_resolution) != 0))
+				goto err_out;
+		}
+		if (!IS_CARD(fmrt->out_std)) {
+			if (count > FMR_MAX_NUM_MINUTIAE)
+				ERR_OUT("Finger view has %u minutiae", count);
+			if (push_fvmr_header(fmrt->out_std, &fvmr, &hdr,
+			    count, fmdb) != WRITE_OK)
+				ERR_OUT("Could not write finger view header");
+		}
+		vlen = count * get_fmd_data_length(fmrt->out_std);
+		transcode_minutiae(fmrt, &xs, &ys, fvmrv.minutiae, count,
+		    fmdb->bdb_current);
+		fmdb->bdb_current += vlen;
+
+		/* Extended data is not converted; an empty block is
+		 * written instead.
+		 */
+		if (!IS_CARD(fmrt->out_std))
+			SPUSH(0, fmdb);
+		views++;
+	}
+	if (views != hdr.num_views)
+		ERR_OUT("Record has %u of %u finger views", views,
+		    hdr.num_views);
+	return (WRITE_OK);
+
+err_out:
+	return (WRITE_ERROR);
+}
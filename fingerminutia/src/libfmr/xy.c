@@ -24,30 +24,11 @@
 #include <fmrsort.h>
 
 /*
- * Compare two minutiae records by the major and minor coordinates. These
+ * The key holds the major coordinate above the minor coordinate. These
  * values are set to X-Y or Y-X based on sorting criteria.
  */
-static int
-compare_by_coords(const void *m1, const void *m2)
-{
-	struct minutia_sort_data *lm1, *lm2;
-
-	lm1 = (struct minutia_sort_data *)m1;
-	lm2 = (struct minutia_sort_data *)m2;
-
-	if (lm1->maj_coord == lm2->maj_coord)
-		if (lm1->min_coord < lm2->min_coord)
-			return (-1);
-		else if (lm1->min_coord > lm2->min_coord)
-			return (1);
-		else
-			return (0);
-	else
-		if (lm1->maj_coord < lm2->maj_coord)
-			return (-1);
-		else
-			return (1);
-}
+#define COORD_KEY(maj, min)	(((uint64_t)(maj) << 16) | (min))
+#define COORD_KEY_BITS		32
 
 /*
  * Sort a set of finger minutiae data in Cartesian X-Y order.
@@ -56,30 +37,19 @@ void
 sort_fmd_by_xy(FMD **fmds, int mcount)
 {
 	int m;
-	struct minutia_sort_data *msds;
+	struct minutia_sort_space space;
 
 	if (mcount == 0)
 		return;
 
-	/* Allocate an array to hold the sorting criteria for the FMDs */
-	msds = (struct minutia_sort_data *)malloc(mcount *
-	    sizeof(struct minutia_sort_data));
-	if (msds == NULL)
+	if (init_minutia_sort_space(&space, mcount) != 0)
 		ALLOC_ERR_EXIT("Sorting criteria array");
 
-	for (m = 0; m < mcount; m++) {
-		msds[m].fmd = fmds[m];
-		msds[m].maj_coord = fmds[m]->x_coord;
-		msds[m].min_coord = fmds[m]->y_coord;
-	}
-	
-	qsort(msds, mcount, sizeof(struct minutia_sort_data),
-	    compare_by_coords);
-
 	for (m = 0; m < mcount; m++)
-		fmds[m] = msds[m].fmd;
+		space.keys[m] = COORD_KEY(fmds[m]->x_coord, fmds[m]->y_coord);
+	sort_fmd_by_keys(fmds, mcount, COORD_KEY_BITS, &space);
 
-	free(msds);
+	free_minutia_sort_space(&space);
 }
 
 /*
@@ -89,28 +59,55 @@ void
 sort_fmd_by_yx(FMD **fmds, int mcount)
 {
 	int m;
-	struct minutia_sort_data *msds;
+	struct minutia_sort_space space;
 
 	if (mcount == 0)
 		return;
 
-	/* Allocate an array to hold the sorting criteria for the FMDs */
-	msds = (struct minutia_sort_data *)malloc(mcount *
-	    sizeof(struct minutia_sort_data));
-	if (msds == NULL)
+	if (init_minutia_sort_space(&space, mcount) != 0)
 		ALLOC_ERR_EXIT("Sorting criteria array");
 
-	for (m = 0; m < mcount; m++) {
-		msds[m].fmd = fmds[m];
-		msds[m].maj_coord = fmds[m]->y_coord;
-		msds[m].min_coord = fmds[m]->x_coord;
-	}
-	
-	qsort(msds, mcount, sizeof(struct minutia_sort_data),
-	    compare_by_coords);
+	for (m = 0; m < mcount; m++)
+		space.keys[m] = COORD_KEY(fmds[m]->y_coord, fmds[m]->x_coord);
+	sort_fmd_by_keys(fmds, mcount, COORD_KEY_BITS, &space);
+
+	free_minutia_sort_space(&space);
+}
+
+/*
+ * Sort the entries of a minutiae block using the major and minor
+ * coordinate arrays given.
+ */
+static void
+sort_fmb_by_coords(const FMB *fmb, int *order, const unsigned short *maj,
+    const unsigned short *min)
+{
+	int m, mcount;
+	struct minutia_sort_space space;
+
+	mcount = fmb->count;
+	if (mcount == 0)
+		return;
+
+	if (init_minutia_sort_space(&space, mcount) != 0)
+		ALLOC_ERR_EXIT("Sorting criteria array");
 
 	for (m = 0; m < mcount; m++)
-		fmds[m] = msds[m].fmd;
+		space.keys[m] = COORD_KEY(maj[m], min[m]);
+	sort_minutia_keys(space.keys, mcount, COORD_KEY_BITS, order,
+	    space.scratch);
 
-	free(msds);
+	free_minutia_sort_space(&space);
+}
+
+void
+sort_fmb_by_xy(const FMB *fmb, int *order)
+{
+	sort_fmb_by_coords(fmb, order, fmb->x_coord, fmb->y_coord);
+}
+
+void
+sort_fmb_by_yx(const FMB *fmb, int *order)
+{
+	sort_fmb_by_coords(fmb, order, fmb->y_coord, fmb->x_coord);
 }
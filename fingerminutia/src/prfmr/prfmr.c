@@ -27,9 +27,12 @@
 #include <string.h>
 #include <unistd.h>
 
+#include <biomdi.h>
 #include <biomdimacro.h>
 #include <fmr.h>
 
+#define STD_AUTO	0	// Input type found from the record header
+
 static int in_type;	// Standard type of the input file
 
 
@@ -50,6 +53,8 @@ stdstr_to_type(char *stdstr)
 		return (FMR_STD_ISO_COMPACT_CARD);
 	if (strcmp(stdstr, "ANSI07") == 0)
 		return (FMR_STD_ANSI07);
+	if (strcmp(stdstr, "auto") == 0)
+		return (STD_AUTO);
 	return (-1);
 }
 
@@ -59,7 +64,8 @@ usage()
 	fprintf(stderr, "usage: prfmr [-v] [-ti <type] <datafile>\n"
 		"\t -v Validate the record\n"
 		"\t -k Format output for consumption by mkfmr\n"
-		"\t -ti <type> is one of ISO | ISONC | ISOCC | ANSI | ANSI07\n");
+		"\t -ti <type> is one of ISO | ISONC | ISOCC | ANSI | ANSI07 "
+		"| auto\n");
 	exit (EXIT_FAILURE);
 }
 
@@ -68,6 +74,10 @@ int main(int argc, char *argv[])
 	FILE *fp;
 	struct stat sb;
 	struct finger_minutiae_record *fmr;
+	uint8_t hdr[BIOMDI_SNIFF_LENGTH];
+	size_t hdrlen;
+	BIOMDI_FORMAT fmt;
+	BDB bdb;
 	int v_opt = 0, k_opt = 0, ti_opt = 0;
 	int ch;
 	int ret;
@@ -123,6 +133,21 @@ int main(int argc, char *argv[])
 		exit (EXIT_FAILURE);
 	}
 
+	/* Find the input type from the header of the first record */
+	if (in_type == STD_AUTO) {
+		hdrlen = fread(hdr, 1, BIOMDI_SNIFF_LENGTH, fp);
+		rewind(fp);
+		INIT_BDB(&bdb, hdr, hdrlen);
+		if ((sniff_biomdi_record(&bdb, &fmt) != 0) ||
+		    (fmt.modality != BIOMDI_MODALITY_FINGER_MINUTIAE) ||
+		    (fmt.format_std == BIOMDI_STD_UNKNOWN)) {
+			fprintf(stderr,
+			    "Could not determine the input type.\n");
+			exit (EXIT_FAILURE);
+		}
+		in_type = fmt.format_std;
+	}
+
 	if (new_fmr(in_type, &fmr) < 0) {
 		fprintf(stderr, "could not allocate FMR\n");
 		exit (EXIT_FAILURE);
@@ -21,8 +21,10 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include <biomdi.h>
 #include <biomdimacro.h>
 #include <fmr.h>
+#include <fmr2fmr.h>
 
 // Test program to exercise some of the FMR library functions.
 
@@ -52,16 +54,39 @@ print_fmr_stats(FMR *fmr) {
 		printf("FVMR %d has %d ridge data records.\n", 
 			i, get_rcd_count(fvmrs[i]));
 	}
+	free(fvmrs);
 }
 
+#define LATTICE_COUNT	256
+
 int main(int argc, char *argv[])
 {
 	FILE *infp;
 	FILE *outfp;
 	FMR *fmr;
-	uint8_t *buf;
+	FMR *afmr;
+	ARENA *arena;
+	uint8_t *buf, *obuf, *fbuf;
+	uint32_t buflen;
 	BDB *fmdb;
+	BDB gdb, tdb[2];
+	BIOMDI_ERRCTX errctx;
+	BIOMDI_FORMAT bfmt;
 	struct stat sb;
+	FMR_VIEW fmrv, afmrv;
+	FVMR_VIEW fvmrv, tfvmrv;
+	FMR_TRANSCODER fmrt;
+	FMD fmd, *fmdp;
+	FVMR *fvmr, **fvmrs;
+	FMB *fmb, *afmb, lfmb;
+	MGRID *grid;
+	MDMAT dmat;
+	unsigned short lx[LATTICE_COUNT], ly[LATTICE_COUNT];
+	unsigned char lz[LATTICE_COUNT];
+	const FVG *geom;
+	int *order;
+	unsigned int m, j;
+	int i, n, x, y, d, count, ret;
 
 	if (argc != 2) {
 		printf("usage: %s <infile> (must be ANSI FMR)\n", argv[0]);
@@ -91,21 +116,16 @@ int main(int argc, char *argv[])
 	 */
 	printf("\nTesting the push functions...\n");
 
-	buf = (uint8_t *)malloc(fmr->record_length);
-	if (buf == NULL) {
-		fprintf(stderr, "could not allocate buffer\n");
-		exit (EXIT_FAILURE);
-	}
 	fmdb = (BDB *)malloc(sizeof(BDB));
 	if (fmdb == NULL) {
 		fprintf(stderr, "could not allocate BDB\n");
 		exit (EXIT_FAILURE);
 	}
-	INIT_BDB(fmdb, buf, fmr->record_length);
-	if (push_fmr(fmdb, fmr) != WRITE_OK) {
+	if (serialize_fmr(fmr, &buf, &buflen) != WRITE_OK) {
 		fprintf(stderr, "could not push FMR\n");
 		exit (EXIT_FAILURE);
 	}
+	INIT_BDB(fmdb, buf, buflen);
 
         outfp = tmpfile();
         if (outfp == NULL) {
@@ -119,6 +139,29 @@ int main(int argc, char *argv[])
 		    strerror(errno));
 		exit (EXIT_FAILURE);
 	}
+
+	/* Push the same record twice into a growable buffer that starts
+	 * out too small, reusing the buffer for the second record.
+	 */
+	if (new_growable_bdb(&gdb, NULL, 16) != WRITE_OK) {
+		fprintf(stderr, "could not allocate growable BDB\n");
+		exit (EXIT_FAILURE);
+	}
+	for (i = 0; i < 2; i++) {
+		REWIND_BDB(&gdb);
+		if (push_fmr(&gdb, fmr) != WRITE_OK) {
+			fprintf(stderr, "could not push FMR to growable BDB\n");
+			exit (EXIT_FAILURE);
+		}
+		if ((BDB_LENGTH(&gdb) != buflen) ||
+		    (memcmp(gdb.bdb_start, buf, buflen) != 0)) {
+			fprintf(stderr, "growable BDB does not match\n");
+			exit (EXIT_FAILURE);
+		}
+	}
+	printf("Growable BDB of %u octets matches.\n", gdb.bdb_size);
+	free(gdb.bdb_start);
+
 	free_fmr(fmr);
 	new_fmr(FMR_STD_ANSI, &fmr);
 	rewind(outfp);
@@ -157,6 +200,384 @@ int main(int argc, char *argv[])
 	}
 	print_fmr_stats(fmr);
 
+	/* Test the view functions by walking the same buffer without
+	 * building the record tree.
+	 */
+	printf("\nTesting the view functions...\n");
+	REWIND_BDB(fmdb);
+	if (fmr_view_init(fmdb, FMR_STD_ANSI, &fmrv) != READ_OK) {
+		fprintf(stderr, "could not view FMR\n");
+		exit (EXIT_FAILURE);
+	}
+	printf("FVMR count is %u\n", fmr_view_num_views(&fmrv));
+	i = 0;
+	ret = fmr_view_first(&fmrv, &fvmrv);
+	while (ret == READ_OK) {
+		printf("FVMR %d has %u minutiae.\n", i,
+		    fvmr_view_num_minutiae(&fvmrv));
+		for (m = 0; m < fvmr_view_num_minutiae(&fvmrv); m++) {
+			if (fvmr_view_minutia(&fvmrv, m, &fmd) != READ_OK) {
+				fprintf(stderr, "could not view minutia\n");
+				exit (EXIT_FAILURE);
+			}
+		}
+		ret = fvmr_view_next(&fvmrv);
+		i++;
+	}
+	if (i != get_fvmr_count(fmr)) {
+		fprintf(stderr, "view FVMR count does not match\n");
+		exit (EXIT_FAILURE);
+	}
+
+	/* Test the arena functions by scanning the same buffer several
+	 * times into one arena, resetting the arena between records.
+	 */
+	printf("\nTesting the arena functions...\n");
+	if (new_arena(0, &arena) != 0) {
+		fprintf(stderr, "could not allocate arena\n");
+		exit (EXIT_FAILURE);
+	}
+	for (i = 0; i < 3; i++) {
+		REWIND_BDB(fmdb);
+		if (new_fmr_arena(FMR_STD_ANSI, arena, &afmr) < 0) {
+			fprintf(stderr, "could not allocate arena FMR\n");
+			exit (EXIT_FAILURE);
+		}
+		if (scan_fmr(fmdb, afmr) != READ_OK) {
+			fprintf(stderr, "could not scan arena FMR\n");
+			exit (EXIT_FAILURE);
+		}
+		if (get_fvmr_count(afmr) != get_fvmr_count(fmr)) {
+			fprintf(stderr, "arena FVMR count does not match\n");
+			exit (EXIT_FAILURE);
+		}
+		free_fmr(afmr);		/* does nothing */
+		reset_arena(arena);
+	}
+	printf("Arena holds %u octets\n", (unsigned)arena->total);
+	free_arena(arena);
+
+	/* Test the block functions by serializing the scanned FMR, whose
+	 * minutiae are encoded from the minutiae blocks, and comparing
+	 * the result to the input buffer.
+	 */
+	printf("\nTesting the block functions...\n");
+	if (serialize_fmr(fmr, &obuf, &buflen) != WRITE_OK) {
+		fprintf(stderr, "could not push scanned FMR\n");
+		exit (EXIT_FAILURE);
+	}
+	if ((buflen != sb.st_size) || (memcmp(obuf, buf, buflen) != 0)) {
+		fprintf(stderr, "pushed FMR does not match input\n");
+		exit (EXIT_FAILURE);
+	}
+	printf("Pushed FMR matches input\n");
+	free(obuf);
+
+	/* A minutia changed in place after it was read, and marked as
+	 * changed, must be in the minutiae block and must be written when
+	 * the FMR is pushed or written to a file; the record must match
+	 * again once the change is undone.
+	 */
+	fvmr = TAILQ_FIRST(&fmr->finger_views);
+	if ((fvmr != NULL) && !TAILQ_EMPTY(&fvmr->minutiae_data)) {
+		fmdp = TAILQ_FIRST(&fvmr->minutiae_data);
+		fmdp->angle ^= 1;
+		invalidate_fvmr_minutiae(fvmr);
+		if ((get_fmb(fvmr) == NULL) ||
+		    (get_fmb(fvmr)->angle[0] != fmdp->angle)) {
+			fprintf(stderr, "changed minutia not in block\n");
+			exit (EXIT_FAILURE);
+		}
+		if ((serialize_fmr(fmr, &obuf, &buflen) != WRITE_OK) ||
+		    (memcmp(obuf, buf, buflen) == 0)) {
+			fprintf(stderr, "changed minutia was not pushed\n");
+			exit (EXIT_FAILURE);
+		}
+		outfp = tmpfile();
+		fbuf = (uint8_t *)malloc(buflen);
+		if ((outfp == NULL) || (fbuf == NULL) ||
+		    (write_fmr(outfp, fmr) != WRITE_OK)) {
+			fprintf(stderr, "could not write changed FMR\n");
+			exit (EXIT_FAILURE);
+		}
+		rewind(outfp);
+		if ((fread(fbuf, 1, buflen, outfp) != buflen) ||
+		    (memcmp(fbuf, obuf, buflen) != 0)) {
+			fprintf(stderr, "changed minutia was not written\n");
+			exit (EXIT_FAILURE);
+		}
+		fclose(outfp);
+		free(fbuf);
+		free(obuf);
+		fmdp->angle ^= 1;
+		invalidate_fvmr_minutiae(fvmr);
+		if ((serialize_fmr(fmr, &obuf, &buflen) != WRITE_OK) ||
+		    (memcmp(obuf, buf, buflen) != 0)) {
+			fprintf(stderr, "restored minutia was not pushed\n");
+			exit (EXIT_FAILURE);
+		}
+		free(obuf);
+		printf("Changed minutia is pushed and written\n");
+	}
+
+	/* Test the spatial index by comparing the minutiae that it finds
+	 * near the center of each view with those found by checking every
+	 * minutia.
+	 */
+	printf("\nTesting the spatial index and geometry...\n");
+	count = get_fvmr_count(fmr);
+	fvmrs = (FVMR **)malloc(count * sizeof(FVMR *));
+	if ((fvmrs == NULL) || (get_fvmrs(fmr, fvmrs) != count)) {
+		fprintf(stderr, "could not get FVMRs\n");
+		exit (EXIT_FAILURE);
+	}
+	for (i = 0; i < count; i++) {
+		fmb = get_fmb(fvmrs[i]);
+		if ((fmb->count == 0) ||
+		    (new_minutiae_grid(fvmrs[i], &grid) != 0))
+			continue;
+		order = (int *)malloc(fmb->count * sizeof(int));
+		find_center_of_fmb_mass(fmb, &x, &y);
+		n = grid_select_radius(grid, x, y, 50, order);
+		for (m = 0, ret = 0; m < fmb->count; m++) {
+			if ((fmb->x_coord[m] - x) * (fmb->x_coord[m] - x) +
+			    (fmb->y_coord[m] - y) * (fmb->y_coord[m] - y) >
+			    50 * 50)
+				continue;
+			if ((ret >= n) || (order[ret] != (int)m))
+				break;
+			ret++;
+		}
+		if ((m != fmb->count) || (ret != n) ||
+		    (grid_select_nearest(grid, fmb->x_coord[0],
+		    fmb->y_coord[0], 1, order) != 1) ||
+		    (fmb->x_coord[order[0]] != fmb->x_coord[0]) ||
+		    (fmb->y_coord[order[0]] != fmb->y_coord[0])) {
+			fprintf(stderr, "spatial index of FVMR %d is wrong\n",
+			    i);
+			exit (EXIT_FAILURE);
+		}
+		printf("FVMR %d has %d minutiae within 50 pixels of "
+		    "(%d, %d).\n", i, n, x, y);
+
+		/* The cached geometry has the same center */
+		geom = get_fvmr_geometry(fvmrs[i]);
+		if ((geom == NULL) || (geom->center_x != x) ||
+		    (geom->center_y != y) ||
+		    (get_fvmr_geometry(fvmrs[i]) != geom)) {
+			fprintf(stderr, "geometry of FVMR %d is wrong\n", i);
+			exit (EXIT_FAILURE);
+		}
+		printf("FVMR %d minutiae lie within (%u, %u) - (%u, %u), "
+		    "principal axis at %.2f radians.\n", i, geom->x_min,
+		    geom->y_min, geom->x_max, geom->y_max,
+		    geom->axis_angle);
+		free(order);
+		free_minutiae_grid(grid);
+	}
+
+	/* Search from the corner of a lattice of minutiae, 32 pixels apart,
+	 * so that the rings of cells reach beyond the edge of the grid
+	 * before the nearest minutiae are known.
+	 */
+	memset(&lfmb, 0, sizeof(FMB));
+	lfmb.count = lfmb.size = LATTICE_COUNT;
+	lfmb.x_coord = lx;
+	lfmb.y_coord = ly;
+	lfmb.type = lfmb.reserved = lfmb.angle = lfmb.quality = lz;
+	memset(lz, 0, sizeof(lz));
+	for (m = 0; m < LATTICE_COUNT; m++) {
+		lx[m] = (m % 16) * 32;
+		ly[m] = (m / 16) * 32;
+	}
+	if (new_fmb_grid(&lfmb, 512, 512, &grid) != 0) {
+		fprintf(stderr, "could not index lattice\n");
+		exit (EXIT_FAILURE);
+	}
+	order = (int *)malloc(LATTICE_COUNT * sizeof(int));
+	for (n = 1; n <= 16; n++) {
+		if (grid_select_nearest(grid, 0, 0, n, order) != n) {
+			fprintf(stderr, "nearest search of lattice failed\n");
+			exit (EXIT_FAILURE);
+		}
+		for (j = 1; j < (unsigned int)n; j++)
+			if (lx[order[j - 1]] * lx[order[j - 1]] +
+			    ly[order[j - 1]] * ly[order[j - 1]] >
+			    lx[order[j]] * lx[order[j]] +
+			    ly[order[j]] * ly[order[j]]) {
+				fprintf(stderr, "nearest search of lattice "
+				    "is out of order\n");
+				exit (EXIT_FAILURE);
+			}
+	}
+	/* The 16th nearest is at (0, 128) or (128, 0) */
+	if (lx[order[15]] * lx[order[15]] + ly[order[15]] * ly[order[15]] !=
+	    128 * 128) {
+		fprintf(stderr, "nearest search of lattice is wrong\n");
+		exit (EXIT_FAILURE);
+	}
+	free(order);
+	free_minutiae_grid(grid);
+	printf("Nearest search of lattice is correct.\n");
+
+	/* Test the distance matrix of each pair of views against the
+	 * distances computed one pair of minutiae at a time.
+	 */
+	printf("\nTesting the distance matrix...\n");
+	memset(&dmat, 0, sizeof(MDMAT));
+	for (i = 0; i < count * count; i++) {
+		fmb = get_fmb(fvmrs[i / count]);
+		afmb = get_fmb(fvmrs[i % count]);
+		if (compute_minutiae_distances(fmb, afmb, 180, &dmat) != 0) {
+			fprintf(stderr, "could not compute distances\n");
+			exit (EXIT_FAILURE);
+		}
+		for (m = 0, ret = 0; m < fmb->count; m++) {
+			for (j = 0; j < afmb->count; j++) {
+				x = fmb->x_coord[m] - afmb->x_coord[j];
+				y = fmb->y_coord[m] - afmb->y_coord[j];
+				d = abs(fmb->angle[m] - afmb->angle[j]);
+				if (d > 90)
+					d = 180 - d;
+				if ((dmat.dist2[m * dmat.stride + j] !=
+				    x * x + y * y) ||
+				    (dmat.dangle[m * dmat.stride + j] != d))
+					ret++;
+			}
+		}
+		if ((ret != 0) || (dmat.rows != fmb->count) ||
+		    (dmat.columns != afmb->count) ||
+		    ((uintptr_t)dmat.dist2 % 32 != 0)) {
+			fprintf(stderr, "distances of FVMRs %d and %d are "
+			    "wrong\n", i / count, i % count);
+			exit (EXIT_FAILURE);
+		}
+		printf("FVMRs %d and %d: %u by %u distances match.\n",
+		    i / count, i % count, dmat.rows, dmat.columns);
+	}
+	free_minutiae_distances(&dmat);
+	free(fvmrs);
+
+	/* Test the error context by recording, instead of printing, the
+	 * errors from validating a damaged record and scanning a truncated
+	 * one.
+	 */
+	printf("\nTesting the error context...\n");
+	init_biomdi_errctx(&errctx, 0);
+	set_biomdi_errctx(&errctx);
+	fmr->format_id[0]++;
+	if ((validate_fmr(fmr) == VALIDATE_OK) || (errctx.count == 0) ||
+	    (errctx.errors[0].code != BIOMDI_ERR_INVALID)) {
+		fprintf(stderr, "validation error not recorded\n");
+		exit (EXIT_FAILURE);
+	}
+	fmr->format_id[0]--;
+	print_biomdi_errors(stdout, &errctx);
+	clear_biomdi_errctx(&errctx);
+	INIT_BDB(fmdb, buf, sb.st_size / 2);
+	new_fmr(FMR_STD_ANSI, &afmr);
+	if ((scan_fmr(fmdb, afmr) == READ_OK) || (errctx.count == 0) ||
+	    (errctx.errors[errctx.count - 1].offset < 0)) {
+		fprintf(stderr, "scan error not recorded\n");
+		exit (EXIT_FAILURE);
+	}
+	free_fmr(afmr);
+	print_biomdi_errors(stdout, &errctx);
+
+	/* A record truncated at any point must fail to scan and leave
+	 * nothing behind once freed, or once its arena is reset.
+	 */
+	if (new_arena(0, &arena) != 0) {
+		fprintf(stderr, "could not allocate arena\n");
+		exit (EXIT_FAILURE);
+	}
+	for (i = 0; i < sb.st_size; i++) {
+		INIT_BDB(fmdb, buf, i);
+		new_fmr(FMR_STD_ANSI, &afmr);
+		if (scan_fmr(fmdb, afmr) == READ_OK) {
+			fprintf(stderr, "truncated FMR was scanned\n");
+			exit (EXIT_FAILURE);
+		}
+		free_fmr(afmr);
+		INIT_BDB(fmdb, buf, i);
+		if ((new_fmr_arena(FMR_STD_ANSI, arena, &afmr) < 0) ||
+		    (scan_fmr(fmdb, afmr) == READ_OK)) {
+			fprintf(stderr, "truncated arena FMR was scanned\n");
+			exit (EXIT_FAILURE);
+		}
+		reset_arena(arena);
+		clear_biomdi_errctx(&errctx);
+	}
+	free_arena(arena);
+	set_biomdi_errctx(NULL);
+
+	/* Test the format sniffer on the input record */
+	printf("\nTesting the format sniffer...\n");
+	INIT_BDB(fmdb, buf, sb.st_size);
+	if ((sniff_biomdi_record(fmdb, &bfmt) != 0) ||
+	    (bfmt.modality != BIOMDI_MODALITY_FINGER_MINUTIAE) ||
+	    (bfmt.format_std != FMR_STD_ANSI) ||
+	    (bfmt.record_length != fmr->record_length)) {
+		fprintf(stderr, "format of input FMR not found\n");
+		exit (EXIT_FAILURE);
+	}
+	printf("Input FMR is ANSI, version %u, %u octets\n", bfmt.version,
+	    (unsigned)bfmt.record_length);
+
+	/* Test the transcoder by converting the input to ANSI '07 and
+	 * back, and comparing the minutiae of each view with the input.
+	 */
+	printf("\nTesting the transcoder...\n");
+	INIT_BDB(fmdb, buf, sb.st_size);
+	if (fmr_view_init(fmdb, FMR_STD_ANSI, &fmrv) != READ_OK) {
+		fprintf(stderr, "could not view input FMR\n");
+		exit (EXIT_FAILURE);
+	}
+	for (i = 0; i < 2; i++) {
+		if ((init_fmr_transcoder(&fmrt, (i == 0) ? FMR_STD_ANSI :
+		    FMR_STD_ANSI07, (i == 0) ? FMR_STD_ANSI07 : FMR_STD_ANSI,
+		    0, 0) != 0) ||
+		    (new_growable_bdb(&tdb[i], NULL, 0) != WRITE_OK) ||
+		    (transcode_fmr(&fmrt, &fmrv, &tdb[i]) != WRITE_OK)) {
+			fprintf(stderr, "could not transcode FMR\n");
+			exit (EXIT_FAILURE);
+		}
+		printf("Transcoded FMR is %u octets\n",
+		    (unsigned)BDB_LENGTH(&tdb[i]));
+		INIT_BDB(&gdb, tdb[i].bdb_start, BDB_LENGTH(&tdb[i]));
+		if (fmr_view_init(&gdb, (i == 0) ? FMR_STD_ANSI07 :
+		    FMR_STD_ANSI, &fmrv) != READ_OK) {
+			fprintf(stderr, "could not view transcoded FMR\n");
+			exit (EXIT_FAILURE);
+		}
+	}
+	INIT_BDB(fmdb, buf, sb.st_size);
+	if ((fmr_view_init(fmdb, FMR_STD_ANSI, &afmrv) != READ_OK) ||
+	    (fmr_view_first(&afmrv, &fvmrv) != READ_OK) ||
+	    (fmr_view_first(&fmrv, &tfvmrv) != READ_OK)) {
+		fprintf(stderr, "could not view finger views\n");
+		exit (EXIT_FAILURE);
+	}
+	count = 0;
+	do {
+		if ((fvmrv.number_of_minutiae != tfvmrv.number_of_minutiae) ||
+		    (memcmp(fvmrv.minutiae, tfvmrv.minutiae,
+		    fvmrv.number_of_minutiae * FMD_DATA_LENGTH) != 0)) {
+			fprintf(stderr, "transcoded minutiae do not match\n");
+			exit (EXIT_FAILURE);
+		}
+		count++;
+		ret = fvmr_view_next(&fvmrv);
+		n = fvmr_view_next(&tfvmrv);
+	} while ((ret == READ_OK) && (n == READ_OK));
+	if ((ret != n) || (count != get_fvmr_count(fmr))) {
+		fprintf(stderr, "transcoded FMR has %d views\n", count);
+		exit (EXIT_FAILURE);
+	}
+	printf("Minutiae of %d views match after round trip\n", count);
+	free(tdb[0].bdb_start);
+	free(tdb[1].bdb_start);
+
 	free(buf);
 	free(fmdb);
 	free_fmr(fmr);
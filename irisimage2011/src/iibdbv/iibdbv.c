@@ -13,6 +13,10 @@
 /* ISO/IEC 19794-6:2005 standard. The record can be optionally validated.     */
 /* The file may contain more than one image biometric data block.             */
 /******************************************************************************/
+
+/* Needed by the GNU C libraries for Posix and other extensions */
+#define _XOPEN_SOURCE	1
+
 #include <sys/queue.h>
 #include <sys/stat.h>
 #include <sys/types.h>
@@ -60,48 +64,46 @@ err_out:
 
 int main(int argc, char *argv[])
 {
-	char *usage = "usage: iibdbv <datafile>\n";
-	FILE *fp;
-	struct stat sb;
+	char *usage = "usage: iibdbv [-x] <datafile>\n"
+	    "\t -x Save the record index file <datafile>.idx";
+	CORPUS *corpus;
+	BDB bdb;
 	IIBDB *iibdb;
-	int ret;
-	unsigned int total_length;
-	unsigned int count;
+	uint64_t n;
+	int flags;
+	int ch;
 	int status;
 
-	if (argc != 2) {
+	flags = CORPUS_USE_INDEX;
+	while ((ch = getopt(argc, argv, "x")) != -1) {
+		switch (ch) {
+		case 'x':
+			flags |= CORPUS_SAVE_INDEX;
+			break;
+		default:
+			printf("%s\n", usage);
+			exit (EXIT_FAILURE);
+		}
+	}
+	if (argc - optind != 1) {
 		printf("%s\n", usage);
 		exit (EXIT_FAILURE);
 	}
 				
-	fp = fopen(argv[1], "rb");
-	if (fp == NULL)
-		ERR_EXIT("Open of %s failed: %s\n", argv[1],
-		    strerror(errno));
-
-	if (new_iibdb(&iibdb) < 0)
-		ALLOC_ERR_EXIT("Iris Image Biometric Data Block");
+	if (open_corpus(argv[optind], CORPUS_LENGTH_32, flags, &corpus) != 0)
+		ERR_EXIT("Could not open %s", argv[optind]);
 
-	if (stat(argv[1], &sb) < 0)
-		ERR_EXIT("Could not get stats on input file");
-
-	total_length = 0;
-	count = 0;
 	status = EXIT_SUCCESS;
-	while (total_length < sb.st_size) {
-		ret = read_iibdb(fp, iibdb);
-		if (ret != READ_OK) {
+	for (n = 0; n < get_corpus_count(corpus); n++) {
+		if (new_iibdb(&iibdb) < 0)
+			ALLOC_ERR_EXIT("Iris Image Biometric Data Block");
+		if ((get_corpus_record(corpus, n, &bdb) != READ_OK) ||
+		    (scan_iibdb(&bdb, iibdb) != READ_OK)) {
+			free_iibdb(iibdb);
 			status = EXIT_FAILURE;
 			break;
 		}
-		count++;
-		printf("Iris Image Data Record %u ", count);
-		if (iibdb->general_header.record_length == 0) {
-			printf("Record length for record %u is 0.\n", count);
-			status = EXIT_FAILURE;
-		} else {
-			total_length += iibdb->general_header.record_length;
-		}
+		printf("Iris Image Data Record %llu ", (unsigned long long)n + 1);
 
 		if (validate_iibdb(iibdb) != VALIDATE_OK) {
 			printf("is NOT valid.\n");
@@ -113,8 +115,12 @@ int main(int argc, char *argv[])
 			
 		}
 		free_iibdb(iibdb);
-		if (new_iibdb(&iibdb) < 0)
-			ALLOC_ERR_EXIT("Iris Image Biometric Data Block");
 	}
+	if (get_corpus_trailing(corpus) != 0) {
+		printf("Record %llu is incomplete or has an invalid length.\n",
+		    (unsigned long long)get_corpus_count(corpus) + 1);
+		status = EXIT_FAILURE;
+	}
+	close_corpus(corpus);
 	exit (status);
 }
@@ -49,7 +49,7 @@
 #define IID_FORMAT_ID_LEN			4
 #define IID_ISO_FORMAT_VERSION			"020"
 #define IID_FORMAT_VERSION_LEN			4
-#define IID_RECORD_HEADER_LENGTH		15
+#define IID_RECORD_HEADER_LENGTH		16
 #define IID_MIN_IRISES				1
 #define IID_MAX_IRISES				65535
 #define IID_MIN_EYES				0
@@ -139,6 +139,7 @@ typedef struct iris_general_header IGH;
 #define IID_COORDINATE_SMALLEST_XY		1
 #define IID_COORDINATE_LARGEST_XY		65535
 
+#define IID_QUALITY_BLOCK_LENGTH		5
 struct iris_quality_block {
 	uint8_t	 score;
 	uint16_t algorithm_vendor_id;
@@ -146,6 +147,8 @@ struct iris_quality_block {
 };
 typedef struct iris_quality_block IIDQB;
 
+/* Length of the representation header without the quality blocks */
+#define IID_REPRESENTATION_HEADER_LENGTH	52
 struct iris_representation_header {
 #define irh_startcopy			representation_length
 	uint32_t			representation_length;
@@ -206,6 +209,7 @@ void free_iibdb(IIBDB *iibdb);
 /* read_iibdb() reads the general header, then the iris representation        */
 /* headers and associated image data.                                         */
 /* The FILE and BDB structs are modified by these functions.                  */
+/* A buffer from new_growable_bdb() is enlarged as needed when pushing.       */
 /*                                                                            */
 /* Parameters:                                                                */
 /*   fp     The open file pointer.                                            */
@@ -243,6 +247,46 @@ int push_irh(BDB *bdb, IRH *irh);
 int write_iibdb(FILE *fp, IIBDB *iibdb);
 int push_iibdb(BDB *bdb, IIBDB *iibdb);
 
+/******************************************************************************/
+/* Functions to compute the length of Iris Image records as they would be     */
+/* pushed, from the sub-records and image data; the length fields of the      */
+/* records are not used or changed.                                           */
+/*                                                                            */
+/* Parameters:                                                                */
+/*   irh    Pointer to the input iris representation header structure.        */
+/*   iibdb  Pointer to the input iris image biometric datablock structure.    */
+/*                                                                            */
+/* Return:                                                                    */
+/*        The encoded length, in octets.                                      */
+/******************************************************************************/
+uint32_t get_irh_encoded_length(IRH *irh);
+uint32_t get_iibdb_encoded_length(IIBDB *iibdb);
+
+/******************************************************************************/
+/* Set the record length, and the length of each representation, of an Iris   */
+/* Image record to match its contents.                                        */
+/*                                                                            */
+/* Parameters:                                                                */
+/*   iibdb  Pointer to the iris image biometric datablock structure.          */
+/******************************************************************************/
+void update_iibdb_length(IIBDB *iibdb);
+
+/******************************************************************************/
+/* Update the lengths of an Iris Image record with update_iibdb_length(),     */
+/* then encode the record into a newly allocated buffer of exactly the        */
+/* record length.                                                             */
+/*                                                                            */
+/* Parameters:                                                                */
+/*   iibdb  Pointer to the iris image biometric datablock structure.          */
+/*   buf    Set to the address of the buffer, which the caller must free.     */
+/*   length Set to the length of the buffer.                                  */
+/*                                                                            */
+/* Return:                                                                    */
+/*        WRITE_OK    Success                                                 */
+/*        WRITE_ERROR Failure                                                 */
+/******************************************************************************/
+int serialize_iibdb(IIBDB *iibdb, uint8_t **buf, uint32_t *length);
+
 /******************************************************************************/
 /* Functions to print Iris Image records to a file in human-readable form.    */
 /*                                                                            */
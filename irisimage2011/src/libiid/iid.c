@@ -310,16 +310,43 @@ err_out:
 	return (READ_ERROR);
 }
 
+/*
+ * Read the general header far enough to find the record length, then
+ * read the entire record into memory and scan it from there. End of file
+ * before the first octet of the record is not reported; a record cut
+ * short by the end of the file is returned as read so far, with READ_EOF.
+ */
 int
 read_iibdb(FILE *fp, IIBDB *iibdb)
 {
-	return (internal_read_iibdb(fp, NULL, iibdb));
+	uint8_t hdr[IID_FORMAT_ID_LEN + IID_FORMAT_VERSION_LEN + 4];
+	uint64_t reclen;
+	BDB bdb;
+	int ret;
+
+	ret = read_bdb_header(fp, hdr, sizeof(hdr));
+	if (ret != READ_OK)
+		return (ret);
+	reclen = ((uint32_t)hdr[8] << 24) | (hdr[9] << 16) | (hdr[10] << 8) |
+	    hdr[11];
+
+	if (read_bdb_record(fp, &bdb, hdr, sizeof(hdr), reclen) != READ_OK)
+		return (READ_ERROR);
+	set_biomdi_error_source(NULL, &bdb);
+	ret = internal_read_iibdb(NULL, &bdb, iibdb);
+	set_biomdi_error_source(NULL, NULL);
+	return (end_bdb_record(&bdb, reclen, ret));
 }
 
 int
 scan_iibdb(BDB *bdb, IIBDB *iibdb)
 {
-	return (internal_read_iibdb(NULL, bdb, iibdb));
+	int ret;
+
+	set_biomdi_error_source(NULL, bdb);
+	ret = internal_read_iibdb(NULL, bdb, iibdb);
+	set_biomdi_error_source(NULL, NULL);
+	return (ret);
 }
 
 static int
@@ -417,10 +444,23 @@ err_out:
 	return (WRITE_ERROR);
 }
 
+/*
+ * Write the record by pushing it into a buffer of the encoded length, then
+ * writing the buffer with one write.
+ */
 int
 write_iibdb(FILE *fp, IIBDB *iibdb)
 {
-	return (internal_write_iibdb(fp, NULL, iibdb));
+	BDB bdb;
+	int ret;
+
+	if (new_bdb_record(&bdb, get_iibdb_encoded_length(iibdb)) != WRITE_OK)
+		return (WRITE_ERROR);
+	ret = internal_write_iibdb(NULL, &bdb, iibdb);
+	if (ret == WRITE_OK)
+		ret = write_bdb_record(fp, &bdb);
+	free(bdb.bdb_start);
+	return (ret);
 }
 
 int
@@ -429,6 +469,62 @@ push_iibdb(BDB *bdb, IIBDB *iibdb)
 	return (internal_write_iibdb(NULL, bdb, iibdb));
 }
 
+uint32_t
+get_irh_encoded_length(IRH *irh)
+{
+	uint32_t length;
+
+	length = IID_REPRESENTATION_HEADER_LENGTH +
+	    irh->num_quality_blocks * IID_QUALITY_BLOCK_LENGTH;
+	if (irh->image_data != NULL)
+		length += irh->image_length;
+	return (length);
+}
+
+uint32_t
+get_iibdb_encoded_length(IIBDB *iibdb)
+{
+	IRH *irh;
+	uint32_t length;
+
+	length = IID_RECORD_HEADER_LENGTH;
+	TAILQ_FOREACH(irh, &iibdb->image_headers, list)
+		length += get_irh_encoded_length(irh);
+	return (length);
+}
+
+void
+update_iibdb_length(IIBDB *iibdb)
+{
+	IRH *irh;
+
+	TAILQ_FOREACH(irh, &iibdb->image_headers, list)
+		irh->representation_length = get_irh_encoded_length(irh);
+	iibdb->general_header.record_length = get_iibdb_encoded_length(iibdb);
+}
+
+int
+serialize_iibdb(IIBDB *iibdb, uint8_t **buf, uint32_t *length)
+{
+	BDB bdb;
+
+	update_iibdb_length(iibdb);
+	if (new_bdb_record(&bdb, iibdb->general_header.record_length) !=
+	    WRITE_OK)
+		return (WRITE_ERROR);
+	if ((internal_write_iibdb(NULL, &bdb, iibdb) != WRITE_OK) ||
+	    (bdb.bdb_current != bdb.bdb_end)) {
+		free(bdb.bdb_start);
+		ERR_OUT("Could not serialize Iris Image Biometric Data Block");
+	}
+	*buf = bdb.bdb_start;
+	*length = bdb.bdb_size;
+	return (WRITE_OK);
+
+err_out:
+	return (WRITE_ERROR);
+}
+
 int
 print_irh(FILE *fp, IRH *irh)
 {